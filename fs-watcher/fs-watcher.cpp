@@ -61,7 +61,7 @@ FsWatcher::FsWatcher(boost::asio::io_service& io,
 
 FsWatcher::~FsWatcher()
 {
-  sqlite3_close(m_db);
+  DbHelper::closeDatabase(m_db);
 }
 
 void
@@ -248,13 +248,10 @@ FsWatcher::initFileStateDb()
     fs::path(m_dirPath.toStdString()) / ".chronoshare" / "fs_watcher";
   fs::create_directories(dbFolder);
 
-  int res = sqlite3_open((dbFolder / "filestate.db").string().c_str(), &m_db);
-  if (res != SQLITE_OK) {
-    BOOST_THROW_EXCEPTION(Error("Cannot open database: " + (dbFolder / "filestate.db").string()));
-  }
+  m_db = DbHelper::openDatabase(dbFolder / "filestate.db");
 
   char* errmsg = 0;
-  res = sqlite3_exec(m_db, INIT_DATABASE.c_str(), NULL, NULL, &errmsg);
+  int res = sqlite3_exec(m_db, INIT_DATABASE.c_str(), NULL, NULL, &errmsg);
   if (res != SQLITE_OK && errmsg != 0) {
     // _LOG_TRACE("Init \"error\": " << errmsg);
     std::cout << "FS-Watcher DB error: " << errmsg << std::endl;
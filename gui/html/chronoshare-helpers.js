@@ -17,8 +17,8 @@ function number_format( number, decimals, dec_point, thousands_sep ) {
     return s + (j ? i.substr(0, j) + t : "") + i.substr(j).replace(/(\d{3})(?=\d)/g, "$1" + t) + (c ? d + Math.abs(n - i).toFixed(c).slice(2) : "");
 }
 
-function SegNumToFileSize (segNum) {
-    filesize = segNum * 1024;
+function SegNumToFileSize (segNum, segSize) {
+    filesize = segNum * (segSize || 1024);
 
     if (filesize >= 1073741824) {
 	filesize = number_format(filesize / 1073741824, 2, '.', '') + ' Gb';
@@ -105,17 +105,18 @@ displayContent = function (newcontent, more, baseUrl) {
 
                 $("#get-more").unbind ('click').click (function () {
                     url = baseUrl;
-                    url += "&offset="+more;
+                    url += "&offset="+encodeURIComponent (encodeURIComponent (more));
 
                     document.location = url;
                 });
             }
-            if (PARAMS.offset > 0) {
+            if (PARAMS.offset !== undefined && PARAMS.offset != 0) {
                 $("#get-less").show ();
 
+                // cursors only lead forward, go back to the first page
                 $("#get-less").unbind ('click').click (function () {
                     url = baseUrl;
-                    if (PARAMS.offset > 5) {
+                    if (!isNaN (PARAMS.offset) && PARAMS.offset > 5) {
                         url += "&offset="+(PARAMS.offset - 5);
                     }
 
@@ -58,7 +58,8 @@ $.Class ("ChronoShare", { },
      },
 
      info_files: function(folder) {
-         request = new Name ().add (this.files)./*add (folder_in_question).*/addSegment (PARAMS.offset?PARAMS.offset:0);
+         request = new Name ().add (this.files)/*.add (folder_in_question)*/;
+         add_offset (request);
          face.expressInterest(request, info_files_onData, on_Timeout); 
          console.log("Express OK: " + request.to_uri());
      },
@@ -72,7 +73,7 @@ $.Class ("ChronoShare", { },
          if (fileOrFolder) {
              request.add (fileOrFolder);
          }
-         request.addSegment (PARAMS.offset?PARAMS.offset:0);
+         add_offset (request);
 
          face.expressInterest(request, info_actions_onData, on_Timeout); 
          console.log("Express OK: " + request.to_uri());
@@ -133,6 +134,17 @@ function file_onData(interest, upcallInfo) {
   }
 };
 
+// "offset" is either a page number or a cursor returned in "more" field of the previous page
+function add_offset(request) {
+  if (PARAMS.offset && isNaN (PARAMS.offset)) {
+    request.add (PARAMS.offset);
+  }
+  else {
+    request.addSegment (PARAMS.offset?PARAMS.offset:0);
+  }
+  return request;
+};
+
 function info_actions_onData(interest, upcallInfo) {
 
   convertedData = upcallInfo.getContent().buf().toString('binary'); //DataUtils.toString (upcallInfo.contentObject.content);
@@ -157,7 +169,7 @@ function info_actions_onData(interest, upcallInfo) {
   console.log(info_actions_collection);
 
 	if (data[moreName] !== undefined) {
-		nextSegment = interest.getName().getPrefix(-1).addSegment(data[moreName]);
+		nextSegment = interest.getName().getPrefix(-1).add(data[moreName]);
     info_actions_counter++;
 
     if (info_actions_counter < 5) {
@@ -202,7 +214,7 @@ function info_files_onData(interest, upcallInfo) {
   console.log(info_files_collection);
 
 	if (data[moreName] !== undefined) {
-		nextSegment = interest.getName().getPrefix(-1).addSegment(data[moreName]);
+		nextSegment = interest.getName().getPrefix(-1).add(data[moreName]);
     info_files_counter++;
 
     if (info_files_counter < 5) {
@@ -337,7 +349,7 @@ $.Class ("HistoryDisplay", {}, {
 			.text (action.filename)
 			.prepend ($("<img />", { "src": imgFullPath(fileExtension(action.filename)) })));
 	    row.append ($("<td />", { "class": "version" }).text (action.version));
-	    row.append ($("<td />", { "class": "size" }).text (action.update?SegNumToFileSize (action.update.segNum):""));
+	    row.append ($("<td />", { "class": "size" }).text (action.update?SegNumToFileSize (action.update.segNum, action.update.segSize):""));
 	    row.append ($("<td />", { "class": "timestamp" }).text (new Date (action.timestamp+"+00:00"))); // conversion from UTC timezone (we store action time in UTC)
 	    row.append ($("<td />", { "class": "modified-by border-right" })
 	        	.append ($("<userName />").text (action.id.userName))
@@ -475,7 +487,7 @@ $.Class ("FilesDisplay", {}, {
 			.text (file.filename)
 			.prepend ($("<img />", { "src": imgFullPath(fileExtension(file.filename)) })));
 	    row.append ($("<td />", { "class": "version" }).text (file.version));
-	    row.append ($("<td />", { "class": "size" }).text (SegNumToFileSize (file.segNum)));
+	    row.append ($("<td />", { "class": "size" }).text (SegNumToFileSize (file.segNum, file.segSize)));
 	    row.append ($("<td />", { "class": "modified" }).text (new Date (file.timestamp+"+00:00"))); // convert from UTC
 	    row.append ($("<td />", { "class": "modified-by border-right"})
 			.append ($("<userName />").text (file.owner.userName))
@@ -29,6 +29,8 @@ namespace chronoshare {
 
 INIT_LOGGER("ActionLog")
 
+const size_t ActionLog::MAX_LATEST_ACTIONS = 100000;
+
 const std::string INIT_DATABASE = "\
 CREATE TABLE ActionLog(                                                \n\
     device_name BLOB NOT NULL,                                          \n\
@@ -47,6 +49,8 @@ CREATE TABLE ActionLog(                                                \n\
     file_ctime  TIMESTAMP,                                              \n\
     file_chmod  INTEGER,                                                \n\
     file_seg_num INTEGER, /* NULL if action is \"delete\" */            \n\
+    file_seg_size INTEGER, /* NULL if \"delete\" or unknown(1024) */    \n\
+    file_is_chunked INTEGER, /* 1 if published with a chunk list */     \n\
                                                                         \n\
     parent_device_name BLOB,                                            \n\
     parent_seq_no      INTEGER,                                         \n\
@@ -61,8 +65,11 @@ CREATE INDEX ActionLog_filename_version ON ActionLog(filename,version);
 CREATE INDEX ActionLog_parent ON ActionLog(parent_device_name, parent_seq_no);   \n\
 CREATE INDEX ActionLog_action_name ON ActionLog(action_name);          \n\
 CREATE INDEX ActionLog_filename_version_hash ON ActionLog(filename,version,file_hash); \n\
-                                                                        \n\
-CREATE TRIGGER ActionLogInsert_trigger                                  \n\
+";
+
+// applies actions to FileState when ActionLog is opened with useInsertTrigger
+const std::string INSERT_TRIGGER = "\
+CREATE TRIGGER IF NOT EXISTS ActionLogInsert_trigger                    \n\
     AFTER INSERT ON ActionLog                                           \n\
     FOR EACH ROW                                                        \n\
     WHEN(SELECT device_name                                            \n\
@@ -78,10 +85,42 @@ CREATE TRIGGER ActionLogInsert_trigger                                  \n\
         SELECT apply_action(NEW.device_name, NEW.seq_no,               \
                              NEW.action,NEW.filename,NEW.version,NEW.file_hash,     \
                              strftime('%s', NEW.file_atime),strftime('%s', NEW.file_mtime),strftime('%s', NEW.file_ctime), \
-                             NEW.file_chmod, NEW.file_seg_num); /* function that applies action and adds record the FileState */  \n \
+                             NEW.file_chmod, NEW.file_seg_num, NEW.file_seg_size); /* function that applies action and adds record the FileState */  \n \
     END;                                                                \n\
 ";
 
+// indexes added after the initial schema, created for existing databases as well
+const std::string INIT_INDEXES = "\
+CREATE INDEX IF NOT EXISTS ActionLog_action_timestamp                                  \n\
+    ON ActionLog(action_timestamp, device_name, seq_no);                              \n\
+CREATE INDEX IF NOT EXISTS ActionLog_filename_action_timestamp                         \n\
+    ON ActionLog(filename, action_timestamp, device_name, seq_no);                    \n\
+CREATE INDEX IF NOT EXISTS ActionLog_file_hash ON ActionLog(file_hash);                \n\
+";
+
+const std::string SELECT_ACTIONS = "\
+SELECT device_name,seq_no,action,filename,directory,version,strftime('%s', action_timestamp), \
+       file_hash,strftime('%s', file_mtime),file_chmod,file_seg_num,                           \
+       parent_device_name,parent_seq_no,file_seg_size                                          \
+    FROM ActionLog                                                                             \
+";
+
+const std::string INSERT_UPDATE_ACTION = "\
+INSERT INTO ActionLog                                                                       \
+    (device_name, seq_no, action, filename, version, action_timestamp,                     \
+     file_hash, file_atime, file_mtime, file_ctime, file_chmod, file_seg_num,              \
+     parent_device_name, parent_seq_no,                                                    \
+     action_name, action_content_object, file_seg_size, file_is_chunked)                   \
+    VALUES(?, ?, ?, ?, ?, datetime(?, 'unixepoch'),                                        \
+           ?, datetime(?, 'unixepoch'), datetime(?, 'unixepoch'), datetime(?, 'unixepoch'), \
+           ?, ?,                                                                           \
+           ?, ?,                                                                           \
+           ?, ?, ?, ?);                                                                    \
+";
+
+const std::string UPDATE_ACTION_DIRECTORY =
+  "UPDATE ActionLog SET directory=directory_name(filename) WHERE device_name=? AND seq_no=?";
+
 // static void xTrace(void*, const char* q)
 // {
 //   _LOG_TRACE("SQLITE: " << q);
@@ -90,7 +129,7 @@ CREATE TRIGGER ActionLogInsert_trigger                                  \n\
 ActionLog::ActionLog(Face& face, const boost::filesystem::path& path,
                      SyncLogPtr syncLog, const std::string& sharedFolder,
                      const std::string& appName, OnFileAddedOrChangedCallback onFileAddedOrChanged,
-                     OnFileRemovedCallback onFileRemoved)
+                     OnFileRemovedCallback onFileRemoved, bool useInsertTrigger)
   : DbHelper(path / ".chronoshare", "action-log.db")
   , m_syncLog(syncLog)
   // , m_face(face)
@@ -98,6 +137,8 @@ ActionLog::ActionLog(Face& face, const boost::filesystem::path& path,
   , m_appName(appName)
   , m_onFileAddedOrChanged(onFileAddedOrChanged)
   , m_onFileRemoved(onFileRemoved)
+  , m_signingService(SigningService::getInstance())
+  , m_useInsertTrigger(useInsertTrigger)
 {
   sqlite3_exec(m_db, "PRAGMA foreign_keys = OFF", NULL, NULL, NULL);
   _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, sqlite3_errmsg(m_db));
@@ -105,6 +146,21 @@ ActionLog::ActionLog(Face& face, const boost::filesystem::path& path,
   sqlite3_exec(m_db, INIT_DATABASE.c_str(), NULL, NULL, NULL);
   _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, sqlite3_errmsg(m_db));
 
+  // databases created before segment size was recorded, fails if the column exists
+  sqlite3_exec(m_db, "ALTER TABLE ActionLog ADD COLUMN file_seg_size INTEGER;", NULL, NULL, NULL);
+  // and before content-defined chunking, fails if the column exists
+  sqlite3_exec(m_db, "ALTER TABLE ActionLog ADD COLUMN file_is_chunked INTEGER;", NULL, NULL, NULL);
+
+  sqlite3_exec(m_db, INIT_INDEXES.c_str(), NULL, NULL, NULL);
+  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, sqlite3_errmsg(m_db));
+
+  // databases created by earlier versions always have the trigger, possibly an older one
+  sqlite3_exec(m_db, "DROP TRIGGER IF EXISTS ActionLogInsert_trigger;", NULL, NULL, NULL);
+  if (m_useInsertTrigger) {
+    sqlite3_exec(m_db, INSERT_TRIGGER.c_str(), NULL, NULL, NULL);
+  }
+  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, sqlite3_errmsg(m_db));
+
   int res =
     sqlite3_create_function(m_db, "apply_action", -1, SQLITE_ANY, reinterpret_cast<void*>(this),
                             ActionLog::apply_action_xFun, 0, 0);
@@ -113,174 +169,299 @@ ActionLog::ActionLog(Face& face, const boost::filesystem::path& path,
   }
 
   m_fileState = make_shared<FileState>(path);
+
+  // SyncLog may not have saved the last local seq_no before an unclean shutdown
+  Block localName = m_syncLog->GetLocalName().wireEncode();
+  Statement stmt(*this, "SELECT MAX(seq_no) FROM ActionLog WHERE device_name=?");
+  sqlite3_bind_blob(stmt, 1, localName.wire(), localName.size(), SQLITE_STATIC);
+  if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+    m_syncLog->UpdateLocalSeqNo(sqlite3_column_int64(stmt, 0));
+  }
 }
 
 std::tuple<sqlite3_int64 /*version*/, BufferPtr /*device name*/, sqlite3_int64 /*seq_no*/>
-ActionLog::GetLatestActionForFile(const std::string& filename)
+ActionLog::GetLatestActionForFile(const LatestAction& latest)
 {
-  // check if something already exists
-  sqlite3_stmt* stmt;
-  int res = sqlite3_prepare_v2(m_db, "SELECT version,device_name,seq_no,action "
-                                     "FROM ActionLog "
-                                     "WHERE filename=? ORDER BY version DESC LIMIT 1",
-                               -1, &stmt, 0);
+  BufferPtr parent_device_name;
+  sqlite3_int64 parent_seq_no = -1;
 
-  if (res != SQLITE_OK) {
-    BOOST_THROW_EXCEPTION(Error("Some error with GetExistingRecord"));
+  if (latest.version >= 0 &&
+      latest.action == 0) // prevent "linking" if the file was previously deleted
+  {
+    parent_device_name = std::make_shared<Buffer>(latest.deviceName);
+    parent_seq_no = latest.seqNo;
   }
 
-  sqlite3_int64 version = -1;
-  BufferPtr parent_device_name;
-  sqlite3_int64 parent_seq_no = -1;
+  return std::make_tuple(latest.version, parent_device_name, parent_seq_no);
+}
 
+ActionLog::LatestAction
+ActionLog::LookupLatestAction(const std::string& filename)
+{
+  auto pending = m_pendingLatestActions.find(filename);
+  if (pending != m_pendingLatestActions.end()) {
+    return pending->second;
+  }
+
+  auto latest = m_latestActions.find(filename);
+  if (latest != m_latestActions.end()) {
+    return latest->second;
+  }
+
+  Statement stmt(*this, "SELECT version,device_name,seq_no,action "
+                        "FROM ActionLog "
+                        "WHERE filename=? ORDER BY version DESC, device_name DESC LIMIT 1");
   sqlite3_bind_text(stmt, 1, filename.c_str(), filename.size(), SQLITE_STATIC);
+
+  LatestAction action{-1, Buffer(), -1, 0};
   if (sqlite3_step(stmt) == SQLITE_ROW) {
-    version = sqlite3_column_int64(stmt, 0);
+    action = LatestAction{sqlite3_column_int64(stmt, 0),
+                          Buffer(sqlite3_column_blob(stmt, 1), sqlite3_column_bytes(stmt, 1)),
+                          sqlite3_column_int64(stmt, 2), sqlite3_column_int(stmt, 3)};
+  }
 
-    if (sqlite3_column_int(stmt, 3) == 0) // prevent "linking" if the file was previously deleted
-    {
-      parent_device_name =
-        std::make_shared<Buffer>(sqlite3_column_blob(stmt, 1), sqlite3_column_bytes(stmt, 1));
-      parent_seq_no = sqlite3_column_int64(stmt, 2);
-    }
+  // actions are looked up before they are inserted, and a file with actions inserted by the
+  // current transaction is in m_pendingLatestActions, so the row found here is committed
+  if (m_latestActions.size() >= MAX_LATEST_ACTIONS) {
+    m_latestActions.clear();
+  }
+  m_latestActions[filename] = action;
+  return action;
+}
+
+void
+ActionLog::ApplyAction(const Buffer& deviceName, sqlite3_int64 seqNo, const ActionItem& action,
+                       LatestAction& latest)
+{
+  // the action with the highest (version, device_name) defines the file state
+  if (latest.version > static_cast<sqlite3_int64>(action.version()) ||
+      (latest.version == static_cast<sqlite3_int64>(action.version()) &&
+       std::lexicographical_compare(deviceName.begin(), deviceName.end(),
+                                    latest.deviceName.begin(), latest.deviceName.end()))) {
+    return;
   }
 
-  sqlite3_finalize(stmt);
-  return std::make_tuple(version, parent_device_name, parent_seq_no);
+  latest = LatestAction{static_cast<sqlite3_int64>(action.version()), deviceName, seqNo,
+                        action.action()};
+  m_pendingLatestActions[action.filename()] = latest;
+
+  if (m_useInsertTrigger) {
+    return;
+  }
+
+  if (action.action() == ActionItem::UPDATE) {
+    _LOG_DEBUG("Update " << action.filename() << " " << action.mtime());
+
+    m_fileState->UpdateFile(action.filename(), action.version(),
+                            Buffer(action.file_hash().c_str(), action.file_hash().size()),
+                            deviceName, seqNo, 0, action.mtime(), 0, action.mode(),
+                            action.seg_num(), action.has_seg_size() ? action.seg_size() : 0);
+  }
+  else if (action.action() == ActionItem::DELETE) {
+    m_fileState->DeleteFile(action.filename());
+
+    m_onFileRemoved(action.filename());
+  }
+}
+
+void
+ActionLog::EndTransaction()
+{
+  int res = sqlite3_exec(m_db, "END TRANSACTION;", 0, 0, 0);
+  if (res != SQLITE_OK) {
+    _LOG_ERROR("Cannot commit ActionLog transaction: " << sqlite3_errmsg(m_db));
+    sqlite3_exec(m_db, "ROLLBACK TRANSACTION;", 0, 0, 0);
+  }
+  PublishLatestActions(res == SQLITE_OK);
+}
+
+void
+ActionLog::PublishLatestActions(bool isCommitted)
+{
+  if (isCommitted) {
+    if (m_latestActions.size() + m_pendingLatestActions.size() > MAX_LATEST_ACTIONS) {
+      m_latestActions.clear();
+    }
+    for (auto& pending : m_pendingLatestActions) {
+      m_latestActions[pending.first] = std::move(pending.second);
+    }
+  }
+  m_pendingLatestActions.clear();
 }
 
 // local add action. remote action is extracted from content object
 ActionItemPtr
 ActionLog::AddLocalActionUpdate(const std::string& filename, const Buffer& hash, time_t wtime,
-                                int mode, int seg_num)
+                                int mode, int seg_num, int seg_size)
 {
+  LocalUpdate update{filename, make_shared<Buffer>(hash), wtime, mode, seg_num, seg_size,
+                     nullptr, 0};
+  return AddLocalActionUpdates(std::vector<LocalUpdate>{update}).front();
+}
+
+std::vector<ActionItemPtr>
+ActionLog::AddLocalActionUpdates(const std::vector<LocalUpdate>& updates)
+{
+  std::vector<ActionItemPtr> items;
+  if (updates.empty()) {
+    return items;
+  }
+
+  _LOG_DEBUG("Adding " << updates.size() << " local UPDATE actions");
+
   sqlite3_exec(m_db, "BEGIN TRANSACTION;", 0, 0, 0);
 
   Block device_name = m_syncLog->GetLocalName().wireEncode();
+  BufferPtr local_device_name = make_shared<Buffer>(device_name.wire(), device_name.size());
 
-  sqlite3_int64 seq_no = m_syncLog->GetNextLocalSeqNo();
-  sqlite3_int64 version;
-  BufferPtr parent_device_name;
-  sqlite3_int64 parent_seq_no = -1;
-
+  sqlite3_int64 first_seq_no = m_syncLog->GetNextLocalSeqNos(updates.size());
   sqlite3_int64 action_time = std::time(0);
 
-  tie(version, parent_device_name, parent_seq_no) = GetLatestActionForFile(filename);
-  version++;
+  // index of the last update of a file earlier in this batch, its row is not in the log yet
+  std::map<std::string, size_t> batchUpdates;
+  // latest action of each file, looked up before any of the batch is inserted
+  std::map<std::string, LatestAction> latestActions;
 
-  sqlite3_stmt* stmt;
-  int res = sqlite3_prepare_v2(
-    m_db,
-    "INSERT INTO ActionLog "
-    "(device_name, seq_no, action, filename, version, action_timestamp, "
-    "file_hash, file_atime, file_mtime, file_ctime, file_chmod, file_seg_num, "
-    "parent_device_name, parent_seq_no, "
-    "action_name, action_content_object) "
-    "VALUES(?, ?, ?, ?, ?, datetime(?, 'unixepoch'),"
-    "        ?, datetime(?, 'unixepoch'), datetime(?, 'unixepoch'), datetime(?, 'unixepoch'), ?,?, "
-    "        ?, ?, "
-    "        ?, ?);",
-    -1, &stmt, 0);
+  std::vector<shared_ptr<Data>> actions;
+  items.reserve(updates.size());
+  actions.reserve(updates.size());
 
-  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, sqlite3_errmsg(m_db));
+  for (size_t i = 0; i < updates.size(); i++) {
+    const LocalUpdate& update = updates[i];
+    sqlite3_int64 seq_no = first_seq_no + i;
 
-  if (res != SQLITE_OK) {
-    BOOST_THROW_EXCEPTION(Error(sqlite3_errmsg(m_db)));
-  }
+    sqlite3_int64 version;
+    BufferPtr parent_device_name;
+    sqlite3_int64 parent_seq_no = -1;
 
-  sqlite3_bind_blob(stmt, 1, device_name.wire(), device_name.size(), SQLITE_STATIC);
-  sqlite3_bind_int64(stmt, 2, seq_no);
-  sqlite3_bind_int(stmt, 3, 0);
-  sqlite3_bind_text(stmt, 4, filename.c_str(), filename.size(), SQLITE_STATIC);
-  sqlite3_bind_int64(stmt, 5, version);
-  sqlite3_bind_int64(stmt, 6, action_time);
+    auto previous = batchUpdates.find(update.filename);
+    if (previous != batchUpdates.end()) {
+      version = items[previous->second]->version();
+      parent_device_name = local_device_name;
+      parent_seq_no = first_seq_no + previous->second;
+    }
+    else {
+      const LatestAction& latest = latestActions[update.filename] =
+        LookupLatestAction(update.filename);
+      tie(version, parent_device_name, parent_seq_no) = GetLatestActionForFile(latest);
+    }
+    version++;
+    batchUpdates[update.filename] = i;
+
+    ActionItemPtr item = make_shared<ActionItem>();
+    item->set_action(ActionItem::UPDATE);
+    item->set_filename(update.filename);
+    item->set_version(version);
+    item->set_timestamp(action_time);
+    item->set_file_hash(update.hash->buf(), update.hash->size());
+    // item->set_atime(atime);
+    item->set_mtime(update.wtime);
+    // item->set_ctime(ctime);
+    item->set_mode(update.mode);
+    item->set_seg_num(update.seg_num);
+    if (update.seg_size > 0) {
+      item->set_seg_size(update.seg_size);
+    }
+    if (update.chunk_list_hash) {
+      item->set_chunk_list_hash(update.chunk_list_hash->buf(), update.chunk_list_hash->size());
+      item->set_chunk_list_seg_num(update.chunk_list_seg_num);
+    }
 
-  sqlite3_bind_blob(stmt, 7, hash.buf(), hash.size(), SQLITE_STATIC);
+    if (parent_device_name && parent_seq_no > 0) {
+      item->set_parent_device_name(parent_device_name->buf(), parent_device_name->size());
+      item->set_parent_seq_no(parent_seq_no);
+    }
 
-  // sqlite3_bind_int64(stmt, 8, atime); // NULL
-  sqlite3_bind_int64(stmt, 9, wtime);
-  // sqlite3_bind_int64(stmt, 10, ctime); // NULL
-  sqlite3_bind_int(stmt, 11, mode);
-  sqlite3_bind_int(stmt, 12, seg_num);
+    // assign name to the action, serialize action, and create content object
 
-  if (parent_device_name && parent_seq_no > 0) {
-    sqlite3_bind_blob(stmt, 13, parent_device_name->buf(), parent_device_name->size(),
-                      SQLITE_STATIC);
-    sqlite3_bind_int64(stmt, 14, parent_seq_no);
-  }
+    std::string item_msg;
+    item->SerializeToString(&item_msg);
 
-  ActionItemPtr item = make_shared<ActionItem>();
-  item->set_action(ActionItem::UPDATE);
-  item->set_filename(filename);
-  item->set_version(version);
-  item->set_timestamp(action_time);
-  item->set_file_hash(hash.buf(), hash.size());
-  // item->set_atime(atime);
-  item->set_mtime(wtime);
-  // item->set_ctime(ctime);
-  item->set_mode(mode);
-  item->set_seg_num(seg_num);
+    // action name: /<device_name>/<appname>/action/<shared-folder>/<action-seq>
+
+    Name actionName = Name("/");
+    actionName.append(m_syncLog->GetLocalName()).append(m_appName).append("action");
+    actionName.append(m_sharedFolderName).appendNumber(seq_no);
+    _LOG_DEBUG("ActionName: " << actionName);
 
-  if (parent_device_name && parent_seq_no > 0) {
-    // cout << Name(*parent_device_name) << endl;
+    shared_ptr<Data> actionData = make_shared<Data>();
+    actionData->setName(actionName);
+    actionData->setFreshnessPeriod(time::seconds(60));
+    actionData->setContent(reinterpret_cast<const uint8_t*>(item_msg.c_str()), item_msg.size());
 
-    item->set_parent_device_name(parent_device_name->buf(), parent_device_name->size());
-    item->set_parent_seq_no(parent_seq_no);
+    items.push_back(item);
+    actions.push_back(actionData);
   }
 
-  // assign name to the action, serialize action, and create content object
+  m_signingService->sign(actions, SigningService::PRIORITY_INTERACTIVE);
 
-  std::string item_msg;
-  item->SerializeToString(&item_msg);
-  _LOG_DEBUG("Update Serialize Result " << item_msg);
+  m_fileState->BeginUpdates();
 
+  for (size_t i = 0; i < updates.size(); i++) {
+    const LocalUpdate& update = updates[i];
+    const ActionItem& item = *items[i];
+    sqlite3_int64 seq_no = first_seq_no + i;
 
-  // action name: /<device_name>/<appname>/action/<shared-folder>/<action-seq>
+    Statement stmt(*this, INSERT_UPDATE_ACTION);
 
-  Name actionName = Name("/");
-  actionName.append(m_syncLog->GetLocalName()).append(m_appName).append("action");
-  actionName.append(m_sharedFolderName).appendNumber(seq_no);
-  _LOG_DEBUG("ActionName: " << actionName);
+    sqlite3_bind_blob(stmt, 1, device_name.wire(), device_name.size(), SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, seq_no);
+    sqlite3_bind_int(stmt, 3, 0);
+    sqlite3_bind_text(stmt, 4, update.filename.c_str(), update.filename.size(), SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 5, item.version());
+    sqlite3_bind_int64(stmt, 6, action_time);
 
-  shared_ptr<Data> actionData = make_shared<Data>();
-  actionData->setName(actionName);
-  actionData->setFreshnessPeriod(time::seconds(60));
-  actionData->setContent(reinterpret_cast<const uint8_t*>(item_msg.c_str()), item_msg.size());
-  m_keyChain.sign(*actionData);
+    sqlite3_bind_blob(stmt, 7, update.hash->buf(), update.hash->size(), SQLITE_STATIC);
 
-  // _LOG_DEBUG(" >>>>>>> " << Name(namePtr->buf() << " " << namePtr->length());
+    // sqlite3_bind_int64(stmt, 8, atime); // NULL
+    sqlite3_bind_int64(stmt, 9, update.wtime);
+    // sqlite3_bind_int64(stmt, 10, ctime); // NULL
+    sqlite3_bind_int(stmt, 11, update.mode);
+    sqlite3_bind_int(stmt, 12, update.seg_num);
+    if (update.seg_size > 0) {
+      sqlite3_bind_int(stmt, 17, update.seg_size);
+    }
+    if (update.chunk_list_hash) {
+      sqlite3_bind_int(stmt, 18, 1);
+    }
 
-  sqlite3_bind_blob(stmt, 15, actionName.wireEncode().wire(), actionName.wireEncode().size(),
-                    SQLITE_STATIC);
-  sqlite3_bind_blob(stmt, 16, actionData->wireEncode().wire(), actionData->wireEncode().size(),
-                    SQLITE_STATIC);
+    if (item.has_parent_device_name()) {
+      sqlite3_bind_blob(stmt, 13, item.parent_device_name().c_str(),
+                        item.parent_device_name().size(), SQLITE_STATIC);
+      sqlite3_bind_int64(stmt, 14, item.parent_seq_no());
+    }
 
-  sqlite3_step(stmt);
+    const Name& actionName = actions[i]->getName();
+    sqlite3_bind_blob(stmt, 15, actionName.wireEncode().wire(), actionName.wireEncode().size(),
+                      SQLITE_STATIC);
+    sqlite3_bind_blob(stmt, 16, actions[i]->wireEncode().wire(), actions[i]->wireEncode().size(),
+                      SQLITE_STATIC);
 
-  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE, sqlite3_errmsg(m_db));
+    if (sqlite3_step(stmt) == SQLITE_DONE) {
+      ApplyAction(*local_device_name, seq_no, item, latestActions[update.filename]);
+    }
 
-  sqlite3_finalize(stmt);
+    _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE, sqlite3_errmsg(m_db));
 
-  // I had a problem including directory_name assignment as part of the initial insert.
-  sqlite3_prepare_v2(
-    m_db,
-    "UPDATE ActionLog SET directory=directory_name(filename) WHERE device_name=? AND seq_no=?", -1,
-    &stmt, 0);
-  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, sqlite3_errmsg(m_db));
+    // I had a problem including directory_name assignment as part of the initial insert.
+    Statement dirStmt(*this, UPDATE_ACTION_DIRECTORY);
 
-  sqlite3_bind_blob(stmt, 1, device_name.wire(), device_name.size(), SQLITE_STATIC);
-  sqlite3_bind_int64(stmt, 2, seq_no);
-  sqlite3_step(stmt);
-  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE, sqlite3_errmsg(m_db));
+    sqlite3_bind_blob(dirStmt, 1, device_name.wire(), device_name.size(), SQLITE_STATIC);
+    sqlite3_bind_int64(dirStmt, 2, seq_no);
+    sqlite3_step(dirStmt);
+    _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE, sqlite3_errmsg(m_db));
+  }
 
-  sqlite3_finalize(stmt);
+  EndTransaction();
 
-  sqlite3_exec(m_db, "END TRANSACTION;", 0, 0, 0);
+  // set complete for local files
+  for (const LocalUpdate& update : updates) {
+    m_fileState->SetFileComplete(update.filename);
+  }
 
-  // set complete for local file
-  m_fileState->SetFileComplete(filename);
+  m_fileState->CommitUpdates();
 
-  return item;
+  return items;
 }
 
 // void
@@ -304,38 +485,30 @@ ActionLog::AddLocalActionDelete(const std::string& filename)
 
   sqlite3_int64 action_time = std::time(0);
 
-  tie(version, parent_device_name, parent_seq_no) = GetLatestActionForFile(filename);
+  // must be looked up before the action is in the log
+  LatestAction latest = LookupLatestAction(filename);
+  tie(version, parent_device_name, parent_seq_no) = GetLatestActionForFile(latest);
   if (!parent_device_name) // no records exist or file was already deleted
   {
     _LOG_DEBUG("Nothing to delete... [" << filename << "]");
 
     // just in case, remove data from FileState
-    sqlite3_stmt* stmt;
-    sqlite3_prepare_v2(m_db, "DELETE FROM FileState WHERE filename = ? ", -1, &stmt, 0);
-    sqlite3_bind_text(stmt, 1, filename.c_str(), filename.size(), SQLITE_STATIC); // file
+    m_fileState->DeleteFile(filename);
 
-    sqlite3_step(stmt);
-
-    _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE, sqlite3_errmsg(m_db));
-
-    sqlite3_finalize(stmt);
-
-    sqlite3_exec(m_db, "END TRANSACTION;", 0, 0, 0);
+    EndTransaction();
     return ActionItemPtr();
   }
   version++;
 
   sqlite3_int64 seq_no = m_syncLog->GetNextLocalSeqNo();
 
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(m_db, "INSERT INTO ActionLog "
-                           "(device_name, seq_no, action, filename, version, action_timestamp, "
-                           "parent_device_name, parent_seq_no, "
-                           "action_name, action_content_object) "
-                           "VALUES(?, ?, ?, ?, ?, datetime(?, 'unixepoch'),"
-                           "        ?, ?,"
-                           "        ?, ?)",
-                     -1, &stmt, 0);
+  Statement stmt(*this, "INSERT INTO ActionLog "
+                        "(device_name, seq_no, action, filename, version, action_timestamp, "
+                        "parent_device_name, parent_seq_no, "
+                        "action_name, action_content_object) "
+                        "VALUES(?, ?, ?, ?, ?, datetime(?, 'unixepoch'),"
+                        "        ?, ?,"
+                        "        ?, ?)");
 
   sqlite3_bind_blob(stmt, 1, device_name.wire(), device_name.size(), SQLITE_STATIC);
   sqlite3_bind_int64(stmt, 2, seq_no);
@@ -369,14 +542,16 @@ ActionLog::AddLocalActionDelete(const std::string& filename)
   actionData->setName(actionName);
   actionData->setFreshnessPeriod(time::seconds(60));
   actionData->setContent(reinterpret_cast<const uint8_t*>(msg.c_str()), msg.size());
-  m_keyChain.sign(*actionData);
+  m_signingService->sign(*actionData, SigningService::PRIORITY_INTERACTIVE);
 
   sqlite3_bind_blob(stmt, 9, actionName.wireEncode().wire(), actionName.wireEncode().size(),
                     SQLITE_STATIC);
   sqlite3_bind_blob(stmt, 10, actionData->wireEncode().wire(), actionData->wireEncode().size(),
                     SQLITE_STATIC);
 
-  sqlite3_step(stmt);
+  if (sqlite3_step(stmt) == SQLITE_DONE) {
+    ApplyAction(Buffer(device_name.wire(), device_name.size()), seq_no, *item, latest);
+  }
 
   _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE, sqlite3_errmsg(m_db));
 
@@ -384,23 +559,15 @@ ActionLog::AddLocalActionDelete(const std::string& filename)
 
   // assign name to the action, serialize action, and create content object
 
-  sqlite3_finalize(stmt);
-
   // I had a problem including directory_name assignment as part of the initial insert.
-  sqlite3_prepare_v2(
-    m_db,
-    "UPDATE ActionLog SET directory=directory_name(filename) WHERE device_name=? AND seq_no=?", -1,
-    &stmt, 0);
-  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, sqlite3_errmsg(m_db));
+  Statement dirStmt(*this, UPDATE_ACTION_DIRECTORY);
 
-  sqlite3_bind_blob(stmt, 1, device_name.wire(), device_name.size(), SQLITE_STATIC);
-  sqlite3_bind_int64(stmt, 2, seq_no);
-  sqlite3_step(stmt);
+  sqlite3_bind_blob(dirStmt, 1, device_name.wire(), device_name.size(), SQLITE_STATIC);
+  sqlite3_bind_int64(dirStmt, 2, seq_no);
+  sqlite3_step(dirStmt);
   _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE, sqlite3_errmsg(m_db));
 
-  sqlite3_finalize(stmt);
-
-  sqlite3_exec(m_db, "END TRANSACTION;", 0, 0, 0);
+  EndTransaction();
 
   return item;
 }
@@ -409,10 +576,8 @@ shared_ptr<Data>
 ActionLog::LookupActionData(const Name& deviceName, sqlite3_int64 seqno)
 {
   _LOG_TRACE("Looking Action for deviceName [" << deviceName << "] and seqno:" << seqno);
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(m_db,
-                     "SELECT action_content_object FROM ActionLog WHERE device_name=? AND seq_no=?",
-                     -1, &stmt, 0);
+  Statement stmt(*this,
+                 "SELECT action_content_object FROM ActionLog WHERE device_name=? AND seq_no=?");
 
   sqlite3_bind_blob(stmt, 1, deviceName.wireEncode().wire(), deviceName.wireEncode().size(),
                     SQLITE_STATIC); // ndn version
@@ -431,7 +596,6 @@ ActionLog::LookupActionData(const Name& deviceName, sqlite3_int64 seqno)
   }
   // _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK && sqlite3_errcode(m_db) != SQLITE_ROW,
   // sqlite3_errmsg(m_db));
-  sqlite3_finalize(stmt);
 
   return retval;
 }
@@ -451,9 +615,7 @@ ActionLog::LookupAction(const Name& deviceName, sqlite3_int64 seqno)
 shared_ptr<Data>
 ActionLog::LookupActionData(const Name& actionName)
 {
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(m_db, "SELECT action_content_object FROM ActionLog WHERE action_name=?", -1,
-                     &stmt, 0);
+  Statement stmt(*this, "SELECT action_content_object FROM ActionLog WHERE action_name=?");
 
   _LOG_DEBUG(actionName);
 
@@ -474,7 +636,6 @@ ActionLog::LookupActionData(const Name& actionName)
   }
   // _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK && sqlite3_errcode(m_db) != SQLITE_ROW,
   // sqlite3_errmsg(m_db));
-  sqlite3_finalize(stmt);
 
   return retval;
 }
@@ -496,17 +657,14 @@ FileItemPtr
 ActionLog::LookupAction(const std::string& filename, sqlite3_int64 version,
                         const Buffer& filehash)
 {
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(
-    m_db,
-    "SELECT device_name, seq_no, strftime('%s', file_mtime), file_chmod, file_seg_num, file_hash "
-    " FROM ActionLog "
-    " WHERE action = 0 AND "
-    "       filename=? AND "
-    "       version=? AND "
-    "       is_prefix(?, file_hash)=1",
-    -1, &stmt, 0);
-  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, sqlite3_errmsg(m_db));
+  Statement stmt(*this,
+                 "SELECT device_name, seq_no, strftime('%s', file_mtime), file_chmod, file_seg_num, file_hash, "
+                 "       file_seg_size "
+                 " FROM ActionLog "
+                 " WHERE action = 0 AND "
+                 "       filename=? AND "
+                 "       version=? AND "
+                 "       is_prefix(?, file_hash)=1");
 
   sqlite3_bind_text(stmt, 1, filename.c_str(), filename.size(), SQLITE_STATIC);
   sqlite3_bind_int64(stmt, 2, version);
@@ -524,6 +682,9 @@ ActionLog::LookupAction(const std::string& filename, sqlite3_int64 version,
     fileItem->set_seg_num(sqlite3_column_int64(stmt, 4));
 
     fileItem->set_file_hash(sqlite3_column_blob(stmt, 5), sqlite3_column_bytes(stmt, 5));
+    if (sqlite3_column_type(stmt, 6) != SQLITE_NULL) {
+      fileItem->set_seg_size(sqlite3_column_int(stmt, 6));
+    }
   }
 
   _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE || sqlite3_errcode(m_db) != SQLITE_ROW
@@ -551,20 +712,10 @@ ActionLog::AddRemoteAction(const Name& deviceName, sqlite3_int64 seqno,
 
   _LOG_DEBUG("AddRemoteAction: [" << action->action() <<"], from ["<< deviceName.toUri() << "] seqno: " << seqno);
 
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(
-    m_db,
-    "INSERT INTO ActionLog "
-    "(device_name, seq_no, action, filename, version, action_timestamp, "
-    "file_hash, file_atime, file_mtime, file_ctime, file_chmod, file_seg_num, "
-    "parent_device_name, parent_seq_no, "
-    "action_name, action_content_object) "
-    "VALUES(?, ?, ?, ?, ?, datetime(?, 'unixepoch'),"
-    "        ?, datetime(?, 'unixepoch'), datetime(?, 'unixepoch'), datetime(?, 'unixepoch'), ?,?, "
-    "        ?, ?, "
-    "        ?, ?);",
-    -1, &stmt, 0);
-  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, sqlite3_errmsg(m_db));
+  // must be looked up before the action is in the log
+  LatestAction latest = LookupLatestAction(action->filename());
+
+  Statement stmt(*this, INSERT_UPDATE_ACTION);
 
   sqlite3_bind_blob(stmt, 1, deviceName.wireEncode().wire(), deviceName.wireEncode().size(),
                     SQLITE_STATIC);
@@ -585,6 +736,12 @@ ActionLog::AddRemoteAction(const Name& deviceName, sqlite3_int64 seqno,
 
     sqlite3_bind_int(stmt, 11, action->mode());
     sqlite3_bind_int(stmt, 12, action->seg_num());
+    if (action->has_seg_size()) {
+      sqlite3_bind_int(stmt, 17, action->seg_size());
+    }
+    if (action->has_chunk_list_hash()) {
+      sqlite3_bind_int(stmt, 18, 1);
+    }
   }
 
   if (action->has_parent_device_name()) {
@@ -600,28 +757,27 @@ ActionLog::AddRemoteAction(const Name& deviceName, sqlite3_int64 seqno,
                     SQLITE_STATIC);
   sqlite3_bind_blob(stmt, 16, actionData->wireEncode().wire(), actionData->wireEncode().size(),
                     SQLITE_STATIC);
-  sqlite3_step(stmt);
-
-  // if action needs to be applied to file state, the trigger will take care of it
+  // a duplicate of an already known action is rejected by the primary key and not applied again
+  if (sqlite3_step(stmt) == SQLITE_DONE) {
+    ApplyAction(Buffer(deviceName.wireEncode().wire(), deviceName.wireEncode().size()), seqno,
+                *action, latest);
+  }
 
   _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE, sqlite3_errmsg(m_db));
 
-  sqlite3_finalize(stmt);
-
   // I had a problem including directory_name assignment as part of the initial insert.
-  sqlite3_prepare_v2(
-    m_db,
-    "UPDATE ActionLog SET directory=directory_name(filename) WHERE device_name=? AND seq_no=?", -1,
-    &stmt, 0);
-  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, sqlite3_errmsg(m_db));
+  Statement dirStmt(*this, UPDATE_ACTION_DIRECTORY);
 
-  sqlite3_bind_blob(stmt, 1, deviceName.wireEncode().wire(), deviceName.wireEncode().size(),
+  sqlite3_bind_blob(dirStmt, 1, deviceName.wireEncode().wire(), deviceName.wireEncode().size(),
                     SQLITE_STATIC);
-  sqlite3_bind_int64(stmt, 2, seqno);
-  sqlite3_step(stmt);
+  sqlite3_bind_int64(dirStmt, 2, seqno);
+  sqlite3_step(dirStmt);
   _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE, sqlite3_errmsg(m_db));
 
-  sqlite3_finalize(stmt);
+  // outside of a transaction the insert is already committed
+  if (sqlite3_get_autocommit(m_db)) {
+    PublishLatestActions(true);
+  }
 
   return action;
 }
@@ -664,8 +820,7 @@ ActionLog::AddRemoteAction(shared_ptr<Data> actionData)
 sqlite3_int64
 ActionLog::LogSize()
 {
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(m_db, "SELECT count(*) FROM ActionLog", -1, &stmt, 0);
+  Statement stmt(*this, "SELECT count(*) FROM ActionLog");
 
   sqlite3_int64 retval = -1;
   if (sqlite3_step(stmt) == SQLITE_ROW) {
@@ -684,44 +839,50 @@ ActionLog::LookupActionsInFolderRecursively(const function<void(const Name& name
   if (limit >= 0)
     limit += 1; // to check if there is more data
 
-  sqlite3_stmt* stmt;
   if (folder != "") {
-    /// @todo Do something to improve efficiency of this query. Right now it is basically scanning
-    /// the whole database
-
-    sqlite3_prepare_v2(m_db, "SELECT "
-                             "device_name,seq_no,action,filename,directory,version,strftime('%s', "
-                             "action_timestamp), "
-                             "       file_hash,strftime('%s', file_mtime),file_chmod,file_seg_num, "
-                             "       parent_device_name,parent_seq_no "
-                             "   FROM ActionLog "
-                             "   WHERE is_dir_prefix(?, directory)=1 "
-                             "   ORDER BY action_timestamp DESC "
-                             "   LIMIT ? OFFSET ?",
-                       -1, &stmt, 0); // there is a small ambiguity with is_prefix matching, but
-                                      // should be ok for now
-    _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, sqlite3_errmsg(m_db));
-
-    sqlite3_bind_text(stmt, 1, folder.c_str(), folder.size(), SQLITE_STATIC);
-    _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, sqlite3_errmsg(m_db));
-
-    sqlite3_bind_int(stmt, 2, limit);
-    sqlite3_bind_int(stmt, 3, offset);
+    // files under the folder are exactly those with filename in ["folder/", "folder0"), as '0'
+    // follows '/'; the range is scanned using ActionLog_filename_version index
+    std::string from = folder + "/";
+    std::string to = folder + "0";
+
+    Statement stmt(*this, "SELECT "
+                          "device_name,seq_no,action,filename,directory,version,strftime('%s', "
+                          "action_timestamp), "
+                          "       file_hash,strftime('%s', file_mtime),file_chmod,file_seg_num, "
+                          "       parent_device_name,parent_seq_no,file_seg_size "
+                          "   FROM ActionLog "
+                          "   WHERE filename >= ? AND filename < ? "
+                          "   ORDER BY action_timestamp DESC, device_name DESC, seq_no DESC "
+                          "   LIMIT ? OFFSET ?");
+
+    sqlite3_bind_text(stmt, 1, from.c_str(), from.size(), SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, to.c_str(), to.size(), SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 3, limit);
+    sqlite3_bind_int(stmt, 4, offset);
+
+    return VisitActions(stmt, visitor, limit);
   }
   else {
-    sqlite3_prepare_v2(m_db, "SELECT "
-                             "device_name,seq_no,action,filename,directory,version,strftime('%s', "
-                             "action_timestamp), "
-                             "       file_hash,strftime('%s', file_mtime),file_chmod,file_seg_num, "
-                             "       parent_device_name,parent_seq_no "
-                             "   FROM ActionLog "
-                             "   ORDER BY action_timestamp DESC "
-                             "   LIMIT ? OFFSET ?",
-                       -1, &stmt, 0);
+    Statement stmt(*this, "SELECT "
+                          "device_name,seq_no,action,filename,directory,version,strftime('%s', "
+                          "action_timestamp), "
+                          "       file_hash,strftime('%s', file_mtime),file_chmod,file_seg_num, "
+                          "       parent_device_name,parent_seq_no,file_seg_size "
+                          "   FROM ActionLog "
+                          "   ORDER BY action_timestamp DESC, device_name DESC, seq_no DESC "
+                          "   LIMIT ? OFFSET ?");
     sqlite3_bind_int(stmt, 1, limit);
     sqlite3_bind_int(stmt, 2, offset);
+
+    return VisitActions(stmt, visitor, limit);
   }
+}
 
+bool
+ActionLog::VisitActions(sqlite3_stmt* stmt,
+                        const function<void(const Name& name, sqlite3_int64 seq_no, const ActionItem&)>& visitor,
+                        int limit)
+{
   _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, sqlite3_errmsg(m_db));
 
   while (sqlite3_step(stmt) == SQLITE_ROW) {
@@ -749,6 +910,9 @@ ActionLog::LookupActionsInFolderRecursively(const function<void(const Name& name
       action.set_mtime(sqlite3_column_int(stmt, 8));
       action.set_mode(sqlite3_column_int(stmt, 9));
       action.set_seg_num(sqlite3_column_int64(stmt, 10));
+      if (sqlite3_column_type(stmt, 13) != SQLITE_NULL) {
+        action.set_seg_size(sqlite3_column_int(stmt, 13));
+      }
     }
     if (sqlite3_column_bytes(stmt, 11) > 0) {
       action.set_parent_device_name(sqlite3_column_blob(stmt, 11), sqlite3_column_bytes(stmt, 11));
@@ -761,14 +925,9 @@ ActionLog::LookupActionsInFolderRecursively(const function<void(const Name& name
 
   _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE, sqlite3_errmsg(m_db));
 
-  sqlite3_finalize(stmt);
-
   return (limit == 1); // more data is available
 }
 
-/**
- * @todo Figure out the way to minimize code duplication
- */
 bool
 ActionLog::LookupActionsForFile(const function<void(const Name& name, sqlite3_int64 seq_no, const ActionItem&)>& visitor,
                                 const std::string& file, int offset /*=0*/, int limit /*=-1*/)
@@ -780,86 +939,137 @@ ActionLog::LookupActionsForFile(const function<void(const Name& name, sqlite3_in
   if (limit >= 0)
     limit += 1; // to check if there is more data
 
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(
-    m_db,
-    "SELECT device_name,seq_no,action,filename,directory,version,strftime('%s', action_timestamp), "
-    "       file_hash,strftime('%s', file_mtime),file_chmod,file_seg_num, "
-    "       parent_device_name,parent_seq_no "
-    "   FROM ActionLog "
-    "   WHERE filename=? "
-    "   ORDER BY action_timestamp DESC "
-    "   LIMIT ? OFFSET ?",
-    -1, &stmt, 0); // there is a small ambiguity with is_prefix matching, but should be ok for now
-  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, sqlite3_errmsg(m_db));
+  Statement stmt(*this,
+                 "SELECT device_name,seq_no,action,filename,directory,version,strftime('%s', action_timestamp), "
+                 "       file_hash,strftime('%s', file_mtime),file_chmod,file_seg_num, "
+                 "       parent_device_name,parent_seq_no,file_seg_size "
+                 "   FROM ActionLog "
+                 "   WHERE filename=? "
+                 "   ORDER BY action_timestamp DESC, device_name DESC, seq_no DESC "
+                 "   LIMIT ? OFFSET ?");
 
   sqlite3_bind_text(stmt, 1, file.c_str(), file.size(), SQLITE_STATIC);
-  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, sqlite3_errmsg(m_db));
-
   sqlite3_bind_int(stmt, 2, limit);
   sqlite3_bind_int(stmt, 3, offset);
 
-  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, sqlite3_errmsg(m_db));
+  return VisitActions(stmt, visitor, limit);
+}
 
-  while (sqlite3_step(stmt) == SQLITE_ROW) {
-    if (limit == 1)
-      break;
+bool
+ActionLog::LookupActionsInFolderRecursively(const function<void(const Name& name, sqlite3_int64 seq_no, const ActionItem&)>& visitor,
+                                            const std::string& folder, const ActionKey& after,
+                                            int limit)
+{
+  _LOG_DEBUG("LookupActionsInFolderRecursively: [" << folder << "] after " << after.deviceName
+                                                   << "/" << after.seqNo);
 
-    ActionItem action;
+  if (limit >= 0)
+    limit += 1; // to check if there is more data
 
-    Name
-    device_name(Block(reinterpret_cast<const uint8_t*>(sqlite3_column_blob(stmt, 0)),
-                           sqlite3_column_bytes(stmt, 0)));
+  const Block& device_name = after.deviceName.wireEncode();
 
-    sqlite3_int64 seq_no = sqlite3_column_int64(stmt, 1);
-    action.set_action(static_cast<ActionItem_ActionType>(sqlite3_column_int(stmt, 2)));
-    action.set_filename(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3)),
-                        sqlite3_column_bytes(stmt, 3));
-    std::string
-    directory(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4)),
-              sqlite3_column_bytes(stmt, 4));
-    action.set_version(sqlite3_column_int64(stmt, 5));
-    action.set_timestamp(sqlite3_column_int64(stmt, 6));
+  if (folder != "") {
+    std::string from = folder + "/";
+    std::string to = folder + "0";
+
+    Statement stmt(*this, SELECT_ACTIONS +
+                          "   WHERE filename >= ? AND filename < ? AND "
+                          "         (action_timestamp, device_name, seq_no) < "
+                          "         (datetime(?, 'unixepoch'), ?, ?) "
+                          "   ORDER BY action_timestamp DESC, device_name DESC, seq_no DESC "
+                          "   LIMIT ?");
+
+    sqlite3_bind_text(stmt, 1, from.c_str(), from.size(), SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, to.c_str(), to.size(), SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 3, after.timestamp);
+    sqlite3_bind_blob(stmt, 4, device_name.wire(), device_name.size(), SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 5, after.seqNo);
+    sqlite3_bind_int(stmt, 6, limit);
+
+    return VisitActions(stmt, visitor, limit);
+  }
+  else {
+    Statement stmt(*this, SELECT_ACTIONS +
+                          "   WHERE (action_timestamp, device_name, seq_no) < "
+                          "         (datetime(?, 'unixepoch'), ?, ?) "
+                          "   ORDER BY action_timestamp DESC, device_name DESC, seq_no DESC "
+                          "   LIMIT ?");
+
+    sqlite3_bind_int64(stmt, 1, after.timestamp);
+    sqlite3_bind_blob(stmt, 2, device_name.wire(), device_name.size(), SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 3, after.seqNo);
+    sqlite3_bind_int(stmt, 4, limit);
+
+    return VisitActions(stmt, visitor, limit);
+  }
+}
 
-    if (action.action() == 0) {
-      action.set_file_hash(sqlite3_column_blob(stmt, 7), sqlite3_column_bytes(stmt, 7));
-      action.set_mtime(sqlite3_column_int(stmt, 8));
-      action.set_mode(sqlite3_column_int(stmt, 9));
-      action.set_seg_num(sqlite3_column_int64(stmt, 10));
-    }
-    if (sqlite3_column_bytes(stmt, 11) > 0) {
-      action.set_parent_device_name(sqlite3_column_blob(stmt, 11), sqlite3_column_bytes(stmt, 11));
-      action.set_parent_seq_no(sqlite3_column_int64(stmt, 12));
-    }
+bool
+ActionLog::LookupActionsForFile(const function<void(const Name& name, sqlite3_int64 seq_no, const ActionItem&)>& visitor,
+                                const std::string& file, const ActionKey& after, int limit)
+{
+  _LOG_DEBUG("LookupActionsForFile: [" << file << "] after " << after.deviceName << "/"
+                                       << after.seqNo);
+  if (file.empty())
+    return false;
 
-    visitor(device_name, seq_no, action);
-    limit--;
-  }
+  if (limit >= 0)
+    limit += 1; // to check if there is more data
 
-  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE, sqlite3_errmsg(m_db));
+  const Block& device_name = after.deviceName.wireEncode();
 
-  sqlite3_finalize(stmt);
+  Statement stmt(*this, SELECT_ACTIONS +
+                        "   WHERE filename=? AND "
+                        "         (action_timestamp, device_name, seq_no) < "
+                        "         (datetime(?, 'unixepoch'), ?, ?) "
+                        "   ORDER BY action_timestamp DESC, device_name DESC, seq_no DESC "
+                        "   LIMIT ?");
 
-  return (limit == 1); // more data is available
+  sqlite3_bind_text(stmt, 1, file.c_str(), file.size(), SQLITE_STATIC);
+  sqlite3_bind_int64(stmt, 2, after.timestamp);
+  sqlite3_bind_blob(stmt, 3, device_name.wire(), device_name.size(), SQLITE_STATIC);
+  sqlite3_bind_int64(stmt, 4, after.seqNo);
+  sqlite3_bind_int(stmt, 5, limit);
+
+  return VisitActions(stmt, visitor, limit);
+}
+
+std::vector<Name>
+ActionLog::LookupFileSources(const ActionItem& action)
+{
+  // segments are numbered differently with content-defined chunking
+  Statement stmt(*this, "SELECT DISTINCT device_name "
+                        "   FROM ActionLog "
+                        "   WHERE file_hash = ? AND action = 0 AND IFNULL(file_seg_size, 1024) = ? "
+                        "         AND IFNULL(file_is_chunked, 0) = ? "
+                        "   ORDER BY device_name");
+  sqlite3_bind_blob(stmt, 1, action.file_hash().c_str(), action.file_hash().size(), SQLITE_STATIC);
+  sqlite3_bind_int(stmt, 2, action.seg_size());
+  sqlite3_bind_int(stmt, 3, action.has_chunk_list_hash() ? 1 : 0);
+
+  std::vector<Name> sources;
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    sources.push_back(Name(Block(reinterpret_cast<const uint8_t*>(sqlite3_column_blob(stmt, 0)),
+                                 sqlite3_column_bytes(stmt, 0))));
+  }
+  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE,
+                  "LookupFileSources: " << sqlite3_errmsg(m_db));
+
+  return sources;
 }
 
 void
 ActionLog::LookupRecentFileActions(const function<void(const std::string&, int, int)>& visitor, int limit)
 {
-  sqlite3_stmt* stmt;
-
-  sqlite3_prepare_v2(
-    m_db, "SELECT AL.filename, AL.action"
-          "   FROM ActionLog AL"
-          "   JOIN "
-          "(SELECT filename, MAX(action_timestamp) AS action_timestamp "
-          "       FROM ActionLog "
-          "       GROUP BY filename ) AS GAL"
-          "   ON AL.filename = GAL.filename AND AL.action_timestamp = GAL.action_timestamp "
-          "   ORDER BY AL.action_timestamp DESC "
-          "   LIMIT ?;",
-    -1, &stmt, 0);
-  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, sqlite3_errmsg(m_db));
+  Statement stmt(*this, "SELECT AL.filename, AL.action"
+                        "   FROM ActionLog AL"
+                        "   JOIN "
+                        "(SELECT filename, MAX(action_timestamp) AS action_timestamp "
+                        "       FROM ActionLog "
+                        "       GROUP BY filename ) AS GAL"
+                        "   ON AL.filename = GAL.filename AND AL.action_timestamp = GAL.action_timestamp "
+                        "   ORDER BY AL.action_timestamp DESC "
+                        "   LIMIT ?;");
   sqlite3_bind_int(stmt, 1, limit);
   int index = 0;
   while (sqlite3_step(stmt) == SQLITE_ROW) {
@@ -872,8 +1082,6 @@ ActionLog::LookupRecentFileActions(const function<void(const std::string&, int,
   }
 
   _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE, sqlite3_errmsg(m_db));
-
-  sqlite3_finalize(stmt);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////
@@ -885,8 +1093,9 @@ ActionLog::apply_action_xFun(sqlite3_context* context, int argc, sqlite3_value**
 {
   ActionLog* the = reinterpret_cast<ActionLog*>(sqlite3_user_data(context));
 
-  if (argc != 11) {
-    sqlite3_result_error(context, "``apply_action'' expects 10 arguments", -1);
+  // triggers created by earlier versions do not pass the segment size
+  if (argc != 11 && argc != 12) {
+    sqlite3_result_error(context, "``apply_action'' expects 11 or 12 arguments", -1);
     return;
   }
 
@@ -909,12 +1118,13 @@ ActionLog::apply_action_xFun(sqlite3_context* context, int argc, sqlite3_value**
     time_t ctime = static_cast<time_t>(sqlite3_value_int64(argv[8]));
     int mode = sqlite3_value_int(argv[9]);
     int seg_num = sqlite3_value_int(argv[10]);
+    int seg_size = argc > 11 ? sqlite3_value_int(argv[11]) : 0; // 0 if NULL
 
     _LOG_DEBUG("Update " << filename << " " << atime << " " << mtime << " " << ctime << " "
                          << toHex(hash));
 
     the->m_fileState->UpdateFile(filename, version, hash, device_name, seq_no, atime, mtime, ctime,
-                                 mode, seg_num);
+                                 mode, seg_num, seg_size);
 
     // no callback here
   }
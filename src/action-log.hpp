@@ -24,12 +24,15 @@
 #include "core/chronoshare-common.hpp"
 #include "db-helper.hpp"
 #include "file-state.hpp"
+#include "signing-service.hpp"
 #include "sync-log.hpp"
 #include "action-item.pb.h"
 #include "file-item.pb.h"
 
 #include <ndn-cxx/face.hpp>
-#include <ndn-cxx/security/key-chain.hpp>
+
+#include <unordered_map>
+#include <vector>
 
 namespace ndn {
 namespace chronoshare {
@@ -58,10 +61,33 @@ public:
 
   typedef boost::function<void(std::string /*filename*/)> OnFileRemovedCallback;
 
+  /**
+   * @brief Parameters of a local file update, see AddLocalActionUpdate()
+   */
+  struct LocalUpdate
+  {
+    std::string filename;
+    ConstBufferPtr hash;
+    time_t wtime;
+    int mode;
+    int seg_num;
+    int seg_size; ///< size of the segments the file is published with, 0 to not record it
+    ConstBufferPtr chunk_list_hash; ///< nullptr unless published with content-defined chunking
+    int chunk_list_seg_num;
+  };
+
+  /// number of files whose latest action is kept in memory for conflict resolution
+  static const size_t MAX_LATEST_ACTIONS;
+
 public:
+  /**
+   * @param useInsertTrigger  apply actions to FileState from an SQLite trigger on ActionLog
+   *                          instead of deciding in ActionLog itself (slower, kept as a fallback)
+   */
   ActionLog(Face& face, const boost::filesystem::path& path,
             SyncLogPtr syncLog, const std::string& sharedFolder, const std::string& appName,
-            OnFileAddedOrChangedCallback onFileAddedOrChanged, OnFileRemovedCallback onFileRemoved);
+            OnFileAddedOrChangedCallback onFileAddedOrChanged, OnFileRemovedCallback onFileRemoved,
+            bool useInsertTrigger = false);
 
   virtual ~ActionLog()
   {
@@ -72,7 +98,16 @@ public:
   //////////////////////////
   ActionItemPtr
   AddLocalActionUpdate(const std::string& filename, const Buffer& hash, time_t wtime, int mode,
-                       int seg_num);
+                       int seg_num, int seg_size = 0);
+
+  /**
+   * @brief Add update actions for a batch of local files
+   *
+   * Actions get consecutive seq_no, are signed in parallel, and are added to the log in one
+   * transaction.  The caller needs to notify SyncCore only once for the whole batch.
+   */
+  std::vector<ActionItemPtr>
+  AddLocalActionUpdates(const std::vector<LocalUpdate>& updates);
 
   // void
   // AddActionMove(const std::string &oldFile, const std::string &newFile);
@@ -128,6 +163,38 @@ public:
   LookupActionsForFile(const function<void(const Name& name, sqlite3_int64 seq_no, const ActionItem&)>& visitor,
                        const std::string& file, int offset = 0, int limit = -1);
 
+  /**
+   * @brief Position in a listing of actions, which are ordered by decreasing
+   *        (timestamp, device_name, seq_no)
+   */
+  struct ActionKey
+  {
+    time_t timestamp;
+    Name deviceName;
+    sqlite3_int64 seqNo;
+  };
+
+  /**
+   * @brief Lookup up to [limit] actions that follow [after] in the listing of [folder] and call
+   *        visitor(device_name,seqno,action) for each action
+   *
+   * Unlike offset-based lookup, the cost does not grow with the position in the listing.
+   */
+  bool
+  LookupActionsInFolderRecursively(const function<void(const Name& name, sqlite3_int64 seq_no, const ActionItem&)>& visitor,
+                                   const std::string& folder, const ActionKey& after, int limit);
+
+  bool
+  LookupActionsForFile(const function<void(const Name& name, sqlite3_int64 seq_no, const ActionItem&)>& visitor,
+                       const std::string& file, const ActionKey& after, int limit);
+
+  /**
+   * @brief Lookup devices that published the file of update @p action with the same segments,
+   *        each of them can serve the segments of the file
+   */
+  std::vector<Name>
+  LookupFileSources(const ActionItem& action);
+
   void
   LookupRecentFileActions(const function<void(const std::string&, int, int)>& visitor,
                           int limit = 5);
@@ -142,8 +209,65 @@ public:
   LogSize();
 
 private:
-  std::tuple<sqlite3_int64 /*version*/, BufferPtr /*device name*/, sqlite3_int64 /*seq_no*/>
-  GetLatestActionForFile(const std::string& filename);
+  /**
+   * @brief The action currently applied to FileState for a file, i.e., the one with the highest
+   *        (version, device_name)
+   */
+  struct LatestAction
+  {
+    sqlite3_int64 version; // -1 if there are no actions for the file
+    Buffer deviceName;
+    sqlite3_int64 seqNo;
+    int action;
+  };
+
+  /**
+   * @brief Get the latest action for a file, applied by the current transaction, cached, or
+   *        looked up in the log
+   */
+  LatestAction
+  LookupLatestAction(const std::string& filename);
+
+  /**
+   * @brief Get version of @p latest, and its device name and seq_no to link a new action to
+   */
+  static std::tuple<sqlite3_int64 /*version*/, BufferPtr /*device name*/, sqlite3_int64 /*seq_no*/>
+  GetLatestActionForFile(const LatestAction& latest);
+
+  /**
+   * @brief Apply a just inserted action to FileState if it wins over @p latest
+   *
+   * @p latest must be looked up before the action is inserted, it is updated if the action
+   * wins.  The new latest action is kept aside until the transaction that inserted it is
+   * committed.
+   *
+   * Does the same as ActionLogInsert_trigger, which is used instead if m_useInsertTrigger is set.
+   */
+  void
+  ApplyAction(const Buffer& deviceName, sqlite3_int64 seqNo, const ActionItem& action,
+              LatestAction& latest);
+
+  /**
+   * @brief Commit the current transaction, or roll it back if the commit fails
+   */
+  void
+  EndTransaction();
+
+  /**
+   * @brief Move the latest actions applied by a committed transaction into the cache, or drop
+   *        them if it was rolled back
+   */
+  void
+  PublishLatestActions(bool isCommitted);
+
+  /**
+   * @brief Step through rows of an ActionLog SELECT and call visitor for up to (limit - 1) of them
+   * @return true if more rows are available
+   */
+  bool
+  VisitActions(sqlite3_stmt* stmt,
+               const function<void(const Name& name, sqlite3_int64 seq_no, const ActionItem&)>& visitor,
+               int limit);
 
   static void
   apply_action_xFun(sqlite3_context* context, int argc, sqlite3_value** argv);
@@ -158,7 +282,14 @@ private:
 
   OnFileAddedOrChangedCallback m_onFileAddedOrChanged;
   OnFileRemovedCallback m_onFileRemoved;
-  KeyChain m_keyChain;
+  SigningServicePtr m_signingService;
+
+  bool m_useInsertTrigger;
+  // filename -> latest committed action, filled on first access to the file and cleared once
+  // it grows beyond MAX_LATEST_ACTIONS
+  std::unordered_map<std::string, LatestAction> m_latestActions;
+  // filename -> latest action applied by the current transaction
+  std::unordered_map<std::string, LatestAction> m_pendingLatestActions;
 };
 
 namespace Error {
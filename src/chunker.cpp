@@ -0,0 +1,101 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+
+#include "chunker.hpp"
+
+#include <algorithm>
+
+namespace ndn {
+namespace chronoshare {
+
+// Gear table with random values.  It is generated from a fixed seed (splitmix64), since all
+// devices must find the same boundaries.
+struct GearTable
+{
+  GearTable()
+  {
+    uint64_t state = 0x6368726f6e6f7368; // "chronosh"
+    for (uint64_t& value : values) {
+      uint64_t z = (state += 0x9e3779b97f4a7c15);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+      value = z ^ (z >> 31);
+    }
+  }
+
+  uint64_t values[256];
+};
+
+static const GearTable GEAR;
+
+// mask of the @p nBits highest bits; the gear hash mixes the preceding 64 bytes into them
+static uint64_t
+makeMask(int nBits)
+{
+  return nBits <= 0 ? 0 : ~uint64_t(0) << (64 - nBits);
+}
+
+Chunker::Chunker(size_t maxSize)
+  : m_maxSize(maxSize)
+  , m_hash(0)
+  , m_length(0)
+{
+  int avgBits = 0;
+  while ((size_t(2) << avgBits) <= maxSize / 2) {
+    avgBits++;
+  }
+  m_avgSize = size_t(1) << avgBits;
+  m_minSize = m_avgSize / 2;
+
+  // normalized chunking, level 2
+  m_maskSmall = makeMask(avgBits + 2);
+  m_maskLarge = makeMask(avgBits - 2);
+}
+
+bool
+Chunker::findBoundary(const uint8_t* buf, size_t size, size_t& nConsumed)
+{
+  nConsumed = 0;
+
+  // boundaries are never placed within the minimum size, no need to hash these bytes
+  if (m_length < m_minSize) {
+    size_t nSkipped = std::min(size, m_minSize - m_length);
+    nConsumed += nSkipped;
+    m_length += nSkipped;
+  }
+
+  while (nConsumed < size) {
+    m_hash = (m_hash << 1) + GEAR.values[buf[nConsumed]];
+    nConsumed++;
+    m_length++;
+
+    uint64_t mask = m_length < m_avgSize ? m_maskSmall : m_maskLarge;
+    if ((m_hash & mask) == 0 || m_length >= m_maxSize) {
+      m_hash = 0;
+      m_length = 0;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+} // chronoshare
+} // ndn
@@ -0,0 +1,94 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+
+#ifndef CHRONOSHARE_SRC_CHUNKER_HPP
+#define CHRONOSHARE_SRC_CHUNKER_HPP
+
+#include "core/chronoshare-common.hpp"
+
+namespace ndn {
+namespace chronoshare {
+
+/**
+ * @brief Finds content-defined chunk boundaries in a stream (FastCDC)
+ *
+ * A boundary is placed where the gear hash of the preceding 64 bytes matches a mask, so an edit
+ * in a file moves only the boundaries next to it, and the chunks elsewhere keep their content.
+ * A stricter mask is used before the average chunk size and a looser one after it, which keeps
+ * chunk sizes close to the average.  Chunks are never shorter than the minimum size (except the
+ * last one) or longer than the maximum size.
+ *
+ * Boundaries depend only on the content and the sizes, every device finds the same ones.
+ */
+class Chunker
+{
+public:
+  /**
+   * @brief Chunker with chunks of at most @p maxSize bytes
+   *
+   * The average size is the largest power of two up to half of @p maxSize, the minimum size is
+   * half of the average.
+   */
+  explicit
+  Chunker(size_t maxSize);
+
+  size_t
+  getMinSize() const
+  {
+    return m_minSize;
+  }
+
+  size_t
+  getAvgSize() const
+  {
+    return m_avgSize;
+  }
+
+  size_t
+  getMaxSize() const
+  {
+    return m_maxSize;
+  }
+
+  /**
+   * @brief Feed next bytes of the stream to the chunker
+   *
+   * @param[out] nConsumed number of bytes of @p buf that belong to the current chunk
+   * @return true if the current chunk ends after @p nConsumed bytes, in which case the next call
+   *         starts a new chunk
+   */
+  bool
+  findBoundary(const uint8_t* buf, size_t size, size_t& nConsumed);
+
+private:
+  size_t m_minSize;
+  size_t m_avgSize;
+  size_t m_maxSize;
+  uint64_t m_maskSmall; // before the average size
+  uint64_t m_maskLarge; // after the average size
+
+  uint64_t m_hash;
+  size_t m_length; // of the current chunk so far
+};
+
+} // chronoshare
+} // ndn
+
+#endif // CHRONOSHARE_SRC_CHUNKER_HPP
@@ -0,0 +1,150 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+
+#include "congestion-control.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace ndn {
+namespace chronoshare {
+
+const Milliseconds RttEstimator::INITIAL_RTO = std::chrono::seconds(1);
+const Milliseconds RttEstimator::MIN_RTO = std::chrono::milliseconds(200);
+const Milliseconds RttEstimator::MAX_RTO = std::chrono::seconds(8);
+
+// RFC 6298
+static const double RTT_ALPHA = 0.125;
+static const double RTT_BETA = 0.25;
+static const int RTT_K = 4;
+
+RttEstimator::RttEstimator()
+  : m_hasSamples(false)
+  , m_srtt(0)
+  , m_rttVar(0)
+  , m_rto(INITIAL_RTO)
+{
+}
+
+void
+RttEstimator::addMeasurement(Milliseconds rtt)
+{
+  if (!m_hasSamples) {
+    m_srtt = rtt;
+    m_rttVar = rtt / 2;
+    m_hasSamples = true;
+  }
+  else {
+    m_rttVar = (1 - RTT_BETA) * m_rttVar + RTT_BETA * Milliseconds(std::abs((m_srtt - rtt).count()));
+    m_srtt = (1 - RTT_ALPHA) * m_srtt + RTT_ALPHA * rtt;
+  }
+
+  m_rto = std::min(std::max(m_srtt + RTT_K * m_rttVar, MIN_RTO), MAX_RTO);
+}
+
+void
+RttEstimator::backoff()
+{
+  m_rto = std::min(m_rto * 2, MAX_RTO);
+}
+
+const double CongestionWindow::INITIAL_WINDOW = 6;
+const double CongestionWindow::MIN_WINDOW = 2;
+const double CongestionWindow::MAX_WINDOW = 1024;
+
+// RFC 8312
+static const double CUBIC_C = 0.4;
+static const double CUBIC_BETA = 0.7;
+
+CongestionWindow::CongestionWindow(Algorithm algorithm)
+  : m_algorithm(algorithm)
+  , m_window(INITIAL_WINDOW)
+  , m_threshold(std::numeric_limits<double>::max())
+  , m_maxWindow(INITIAL_WINDOW)
+  , m_k(0)
+{
+}
+
+void
+CongestionWindow::increase(TimePoint now)
+{
+  if (m_algorithm == ALGORITHM_FIXED) {
+    return;
+  }
+
+  if (m_window < m_threshold) {
+    m_window += 1;
+  }
+  else if (m_algorithm == ALGORITHM_AIMD) {
+    m_window += 1 / m_window;
+  }
+  else {
+    double t = std::chrono::duration<double>(now - m_lastLoss).count();
+    double target = CUBIC_C * std::pow(t - m_k, 3) + m_maxWindow;
+    if (target > m_window) {
+      m_window += (target - m_window) / m_window;
+    }
+    else {
+      m_window += 0.01 / m_window; // probe slowly around the window of the last loss
+    }
+  }
+
+  m_window = std::min(m_window, MAX_WINDOW);
+}
+
+void
+CongestionWindow::decrease(TimePoint now)
+{
+  switch (m_algorithm) {
+  case ALGORITHM_FIXED:
+    return;
+
+  case ALGORITHM_AIMD:
+    m_window = std::max(m_window / 2, MIN_WINDOW);
+    break;
+
+  case ALGORITHM_CUBIC:
+    m_maxWindow = m_window;
+    m_k = std::cbrt(m_maxWindow * (1 - CUBIC_BETA) / CUBIC_C);
+    m_lastLoss = now;
+    m_window = std::max(m_window * CUBIC_BETA, MIN_WINDOW);
+    break;
+  }
+
+  m_threshold = m_window;
+}
+
+std::ostream&
+operator<<(std::ostream& os, CongestionWindow::Algorithm algorithm)
+{
+  switch (algorithm) {
+  case CongestionWindow::ALGORITHM_FIXED:
+    return os << "fixed";
+  case CongestionWindow::ALGORITHM_AIMD:
+    return os << "AIMD";
+  case CongestionWindow::ALGORITHM_CUBIC:
+    return os << "CUBIC";
+  }
+  return os;
+}
+
+} // chronoshare
+} // ndn
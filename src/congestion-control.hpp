@@ -0,0 +1,163 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+
+#ifndef CHRONOSHARE_SRC_CONGESTION_CONTROL_HPP
+#define CHRONOSHARE_SRC_CONGESTION_CONTROL_HPP
+
+#include "core/chronoshare-common.hpp"
+
+#include <chrono>
+
+namespace ndn {
+namespace chronoshare {
+
+typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+/**
+ * @brief Estimates round-trip time and retransmission timeout as specified in RFC 6298
+ */
+class RttEstimator
+{
+public:
+  static const Milliseconds INITIAL_RTO;
+  static const Milliseconds MIN_RTO;
+  static const Milliseconds MAX_RTO;
+
+public:
+  RttEstimator();
+
+  /**
+   * @brief Take a sample, which should not come from a retransmitted Interest
+   */
+  void
+  addMeasurement(Milliseconds rtt);
+
+  /**
+   * @brief Double the retransmission timeout after a timeout
+   */
+  void
+  backoff();
+
+  bool
+  hasSamples() const
+  {
+    return m_hasSamples;
+  }
+
+  Milliseconds
+  getSmoothedRtt() const
+  {
+    return m_srtt;
+  }
+
+  Milliseconds
+  getRttVariation() const
+  {
+    return m_rttVar;
+  }
+
+  Milliseconds
+  getRto() const
+  {
+    return m_rto;
+  }
+
+private:
+  bool m_hasSamples;
+  Milliseconds m_srtt;
+  Milliseconds m_rttVar;
+  Milliseconds m_rto;
+};
+
+/**
+ * @brief Window of Interests in flight, in segments
+ *
+ * Both AIMD and CUBIC grow the window by one segment per received segment in slow start, until
+ * the first loss.  Afterwards AIMD grows it by one segment per window and halves it on a loss,
+ * while CUBIC grows it along the cubic function of RFC 8312 since the last loss and reduces it
+ * to 70% on a loss.
+ */
+class CongestionWindow
+{
+public:
+  enum Algorithm {
+    ALGORITHM_FIXED, ///< window of INITIAL_WINDOW segments that is never adjusted
+    ALGORITHM_AIMD,
+    ALGORITHM_CUBIC
+  };
+
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+  static const double INITIAL_WINDOW;
+  static const double MIN_WINDOW;
+  static const double MAX_WINDOW;
+
+public:
+  explicit
+  CongestionWindow(Algorithm algorithm = ALGORITHM_AIMD);
+
+  /**
+   * @brief Grow the window after a segment is received at @p now
+   */
+  void
+  increase(TimePoint now = std::chrono::steady_clock::now());
+
+  /**
+   * @brief Shrink the window after a loss at @p now, should be called once per window of losses
+   */
+  void
+  decrease(TimePoint now = std::chrono::steady_clock::now());
+
+  Algorithm
+  getAlgorithm() const
+  {
+    return m_algorithm;
+  }
+
+  double
+  getWindow() const
+  {
+    return m_window;
+  }
+
+  double
+  getThreshold() const
+  {
+    return m_threshold;
+  }
+
+private:
+  Algorithm m_algorithm;
+  double m_window;
+  double m_threshold; // slow start threshold
+
+  // CUBIC
+  double m_maxWindow; // window before the last loss
+  double m_k;         // seconds from the last loss until the window is back at m_maxWindow
+  TimePoint m_lastLoss;
+};
+
+std::ostream&
+operator<<(std::ostream& os, CongestionWindow::Algorithm algorithm);
+
+} // chronoshare
+} // ndn
+
+#endif // CHRONOSHARE_SRC_CONGESTION_CONTROL_HPP
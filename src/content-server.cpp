@@ -31,20 +31,24 @@ namespace ndn {
 namespace chronoshare {
 
 static const int DB_CACHE_LIFETIME = 60;
+static const int64_t READ_AHEAD_SEGMENTS = 8;
 
 ContentServer::ContentServer(Face& face, ActionLogPtr actionLog,
                              const boost::filesystem::path& rootDir, const Name& userName,
                              const std::string& sharedFolderName, const std::string& appName,
-                             int freshness)
+                             int freshness, size_t packetCacheCapacity)
   : m_face(face)
   , m_actionLog(actionLog)
   , m_dbFolder(rootDir / ".chronoshare")
   , m_freshness(freshness)
+  , m_objectStore(ObjectStore::open(m_dbFolder))
   , m_scheduler(face.getIoService())
   , m_flushStateDbCacheEvent(m_scheduler)
+  , m_packetCache(make_shared<PacketCache>(packetCacheCapacity))
   , m_userName(userName)
   , m_sharedFolderName(sharedFolderName)
   , m_appName(appName)
+  , m_signingService(SigningService::getInstance())
 {
   //  m_listeningThread = boost::thread(bind(&ContentServer::listen, this));
 
@@ -168,55 +172,153 @@ ContentServer::serve_File_Execute(const Name& forwardingHint, const Name& name,
                                          << ", file_hash: " << toHex(hash)
                                          << " segment: " << segment);
 
-  std::string hashStr = toHex(hash);
-
-  ObjectDbPtr db;
+  Name dataName = forwardingHint.size() == 0 ? name : interest;
+  bool hasForwardingHint = forwardingHint.size() > 0;
 
-  ScopedLock(m_dbCacheMutex);
-  {
-    DbCache::iterator it = m_dbCache.find(hash);
-    if (it != m_dbCache.end()) {
-      db = it->second;
+  shared_ptr<const Data> cached = m_packetCache->find(dataName);
+  if (cached != nullptr) {
+    _LOG_DEBUG("Serving cached segment " << dataName);
+    m_face.put(*cached);
+  }
+  else {
+    // duplicate Interests, and Interests for segments being read ahead, wait for the packet
+    // that is being signed
+    Face& face = m_face;
+    if (m_packetCache->markPending(dataName, [&face] (const shared_ptr<const Data>& data) {
+          face.put(*data);
+        })) {
+      serveSegment(deviceName, hash, segment, dataName, hasForwardingHint);
     }
     else {
-      if (ObjectDb::DoesExist(m_dbFolder, deviceName,
-                              hashStr)) // this is kind of overkill, as it counts available segments
-      {
-        db = make_shared<ObjectDb>(m_dbFolder, hashStr);
-        m_dbCache.insert(make_pair(hash, db));
-      }
-      else {
-        _LOG_ERROR("ObjectDd doesn't exist for device: " << deviceName << ", file_hash: "
-                                                         << toHex(hash));
-      }
+      _LOG_DEBUG("Segment " << dataName << " is being signed already");
     }
   }
 
-  if (db) {
-    BufferPtr co = db->fetchSegment(deviceName, segment);
-    if (co) {
+  readAhead(deviceName, hash, segment, dataName.getPrefix(-1), hasForwardingHint);
+}
 
-      shared_ptr<Data> data = make_shared<Data>();
-      data->setContent(co->buf(), co->size());
-      if (forwardingHint.size() == 0) {
-        _LOG_DEBUG(deviceName << "forwardingHint.size = 0 Name: " << name);
-        data->setName(name);
-      }
-      else {
-        if (m_freshness > 0) {
-          data->setFreshnessPeriod(time::seconds(m_freshness));
-        }
-        data->setName(interest);
-      }
-      m_keyChain.sign(*data);
-      m_face.put(*data);
-      _LOG_DEBUG("Send File Data Done!");
-    }
-    else {
+void
+ContentServer::serveSegment(const Name& deviceName, const Buffer& hash, int64_t segment,
+                            const Name& dataName, bool hasForwardingHint)
+{
+  ObjectDbPtr db = lookupObjectDb(deviceName, hash);
+  shared_ptr<Data> stored = db ? db->fetchSegmentData(deviceName, segment) : nullptr;
+  if (!stored) {
+    if (db) {
       _LOG_ERROR("ObjectDd exists, but no segment "
                  << segment << " for device: " << deviceName
                  << ", file_hash: " << toHex(hash));
     }
+    m_packetCache->cancelPending(dataName);
+    return;
+  }
+
+  bool isSigned = false;
+  shared_ptr<Data> data = makeSegmentData(stored, dataName, hasForwardingHint, isSigned);
+  if (isSigned) {
+    _LOG_DEBUG("Serving stored segment " << dataName);
+    m_face.put(*data);
+    m_packetCache->insert(data);
+  }
+  else {
+    Face& face = m_face;
+    PacketCachePtr cache = m_packetCache;
+    m_signingService->sign(data, SigningService::PRIORITY_SEGMENT, m_face.getIoService(),
+                           [&face, cache] (const shared_ptr<Data>& signedData) {
+                             face.put(*signedData);
+                             cache->insert(signedData);
+                           });
+  }
+  _LOG_DEBUG("Send File Data Done!");
+}
+
+ObjectDbPtr
+ContentServer::lookupObjectDb(const Name& deviceName, const Buffer& hash)
+{
+  ScopedLock lock(m_dbCacheMutex);
+
+  DbCache::iterator it = m_dbCache.find(hash);
+  if (it != m_dbCache.end()) {
+    return it->second;
+  }
+
+  std::string hashStr = toHex(hash);
+  if (!ObjectDb::DoesExist(m_dbFolder, deviceName,
+                           hashStr)) { // this is kind of overkill, as it counts available segments
+    _LOG_ERROR("ObjectDd doesn't exist for device: " << deviceName << ", file_hash: " << hashStr);
+    return ObjectDbPtr();
+  }
+
+  ObjectDbPtr db = make_shared<ObjectDb>(m_dbFolder, hashStr);
+  m_dbCache.insert(make_pair(hash, db));
+  return db;
+}
+
+shared_ptr<Data>
+ContentServer::makeSegmentData(const shared_ptr<Data>& stored, const Name& dataName,
+                               bool hasForwardingHint, bool& isSigned)
+{
+  isSigned = stored->getName() == dataName;
+  if (isSigned) {
+    return stored;
+  }
+
+  shared_ptr<Data> data = make_shared<Data>();
+  data->setContent(stored->getContent());
+  if (hasForwardingHint && m_freshness > 0) {
+    data->setFreshnessPeriod(time::seconds(m_freshness));
+  }
+  data->setName(dataName);
+  return data;
+}
+
+void
+ContentServer::readAhead(const Name& deviceName, const Buffer& hash, int64_t segment,
+                         const Name& prefix, bool hasForwardingHint)
+{
+  PacketCachePtr cache = m_packetCache;
+
+  // segments that are neither cached nor being signed already
+  std::map<int64_t, Name> missing;
+  for (int64_t next = segment + 1; next <= segment + READ_AHEAD_SEGMENTS; next++) {
+    Name dataName = Name(prefix).appendNumber(next);
+    if (cache->markPending(dataName)) {
+      missing[next] = dataName;
+    }
+  }
+  if (missing.empty()) {
+    return;
+  }
+
+  // usually only the last one is missing, as the rest were read ahead for earlier requests
+  ObjectStore::SegmentReader reader(*m_objectStore, hash, deviceName, missing.begin()->first);
+  auto entry = missing.begin();
+  const uint8_t* content = nullptr;
+  size_t size = 0;
+  while (entry != missing.end() && reader.next(content, size)) {
+    if (reader.getNSegments() - 1 < entry->first) {
+      continue;
+    }
+
+    _LOG_TRACE("Reading ahead " << entry->second);
+    bool isSigned = false;
+    shared_ptr<Data> data = makeSegmentData(make_shared<Data>(reader.getPacket()), entry->second,
+                                            hasForwardingHint, isSigned);
+    if (isSigned) {
+      cache->insert(data);
+    }
+    else {
+      m_signingService->sign(data, SigningService::PRIORITY_BULK, m_face.getIoService(),
+                             [cache] (const shared_ptr<Data>& signedData) {
+                               cache->insert(signedData);
+                             });
+    }
+    ++entry;
+  }
+
+  // past the last segment
+  for (; entry != missing.end(); ++entry) {
+    cache->cancelPending(entry->second);
   }
 }
 
@@ -236,7 +338,7 @@ ContentServer::serve_Action_Execute(const Name& forwardingHint, const Name& name
   shared_ptr<Data> data = m_actionLog->LookupActionData(deviceName, seqno);
   if (data) {
     if (forwardingHint.size() == 0) {
-      m_keyChain.sign(*data);
+      // the action is stored signed under its name
       m_face.put(*data);
     }
     else {
@@ -244,8 +346,7 @@ ContentServer::serve_Action_Execute(const Name& forwardingHint, const Name& name
       if (m_freshness > 0) {
         data->setFreshnessPeriod(time::seconds(m_freshness));
       }
-      m_keyChain.sign(*data);
-      m_face.put(*data);
+      m_signingService->signAndPut(m_face, data, SigningService::PRIORITY_INTERACTIVE);
     }
   }
   else {
@@ -256,18 +357,25 @@ ContentServer::serve_Action_Execute(const Name& forwardingHint, const Name& name
 void
 ContentServer::flushStaleDbCache()
 {
-  ScopedLock(m_dbCacheMutex);
-  DbCache::iterator it = m_dbCache.begin();
-  while (it != m_dbCache.end()) {
-    ObjectDbPtr db = it->second;
-    if (db->secondsSinceLastUse() >= DB_CACHE_LIFETIME) {
-      m_dbCache.erase(it++);
-    }
-    else {
-      ++it;
+  {
+    ScopedLock lock(m_dbCacheMutex);
+    DbCache::iterator it = m_dbCache.begin();
+    while (it != m_dbCache.end()) {
+      ObjectDbPtr db = it->second;
+      if (db->secondsSinceLastUse() >= DB_CACHE_LIFETIME) {
+        m_dbCache.erase(it++);
+      }
+      else {
+        ++it;
+      }
     }
   }
 
+  PacketCache::Stats stats = m_packetCache->getStats();
+  _LOG_DEBUG("Packet cache: " << stats.nPackets << " packets, " << stats.nBytes << " bytes, "
+             << stats.nHits << " hits, " << stats.nMisses << " misses (hit rate "
+             << stats.getHitRate() << "), " << stats.nEvictions << " evictions");
+
   m_flushStateDbCacheEvent = m_scheduler.scheduleEvent(time::seconds(DB_CACHE_LIFETIME),
                                                        bind(&ContentServer::flushStaleDbCache, this));
 }
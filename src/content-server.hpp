@@ -25,9 +25,10 @@
 
 #include "object-db.hpp"
 #include "action-log.hpp"
+#include "packet-cache.hpp"
+#include "signing-service.hpp"
 
 #include <ndn-cxx/face.hpp>
-#include <ndn-cxx/security/key-chain.hpp>
 #include <ndn-cxx/util/scheduler.hpp>
 #include <ndn-cxx/util/scheduler-scoped-event-id.hpp>
 
@@ -45,7 +46,8 @@ public:
   ContentServer(Face& face, ActionLogPtr actionLog,
                 const boost::filesystem::path& rootDir, const Name& userName,
                 const std::string& sharedFolderName, const std::string& appName,
-                int freshness = -1);
+                int freshness = -1,
+                size_t packetCacheCapacity = PacketCache::DEFAULT_CAPACITY);
   ~ContentServer();
 
   // the assumption is, when the interest comes in, interest is informs of
@@ -57,6 +59,12 @@ public:
   void
   deregisterPrefix(const Name& prefix);
 
+  PacketCache::Stats
+  getPacketCacheStats() const
+  {
+    return m_packetCache->getStats();
+  }
+
 private:
   void
   filterAndServe(const InterestFilter& forwardingHint, const Interest& interest);
@@ -79,6 +87,42 @@ private:
   serve_File_Execute(const Name& forwardingHint, const Name& name,
                      const Name& interest);
 
+  ObjectDbPtr
+  lookupObjectDb(const Name& deviceName, const Buffer& hash);
+
+  /**
+   * @brief Read @p segment of the file and put it as @p dataName, signing it if necessary
+   *
+   * @p dataName must be marked pending in the packet cache, the packet is inserted there.
+   */
+  void
+  serveSegment(const Name& deviceName, const Buffer& hash, int64_t segment, const Name& dataName,
+               bool hasForwardingHint);
+
+  /**
+   * @brief Get Data named @p dataName with the content of the @p stored segment packet
+   *
+   * The stored packet is returned as is if it is named @p dataName, otherwise a new unsigned
+   * packet with its content is made, e.g., for the forwarding hint name.
+   *
+   * @param[out] isSigned  whether the returned packet is the signed stored one
+   */
+  shared_ptr<Data>
+  makeSegmentData(const shared_ptr<Data>& stored, const Name& dataName, bool hasForwardingHint,
+                  bool& isSigned);
+
+  /**
+   * @brief Sign segments following @p segment into the packet cache, as they are likely to be
+   *        requested next
+   *
+   * The segments are read from the object store with one SegmentReader.
+   *
+   * @param prefix  served name of the file without the segment component
+   */
+  void
+  readAhead(const Name& deviceName, const Buffer& hash, int64_t segment, const Name& prefix,
+            bool hasForwardingHint);
+
   void
   flushStaleDbCache();
 
@@ -96,17 +140,19 @@ private:
   Mutex m_mutex;
   boost::filesystem::path m_dbFolder;
   int m_freshness;
+  ObjectStorePtr m_objectStore; // keeps the store of m_dbFolder open
 
   Scheduler m_scheduler;
   util::scheduler::ScopedEventId m_flushStateDbCacheEvent;
   typedef std::map<Buffer, ObjectDbPtr> DbCache;
   DbCache m_dbCache;
   Mutex m_dbCacheMutex;
+  PacketCachePtr m_packetCache; // shared with pending signing callbacks
 
   Name m_userName;
   std::string m_sharedFolderName;
   std::string m_appName;
-  KeyChain m_keyChain;
+  SigningServicePtr m_signingService;
   boost::thread m_listeningThread;
 };
 
@@ -22,6 +22,10 @@
 #include "core/logging.hpp"
 
 #include <ndn-cxx/util/digest.hpp>
+#include <ndn-cxx/util/scheduler.hpp>
+#include <ndn-cxx/util/scheduler-scoped-event-id.hpp>
+
+#include <set>
 
 namespace ndn {
 namespace chronoshare {
@@ -36,16 +40,186 @@ const std::string INIT_DATABASE = "\
     PRAGMA foreign_keys = ON;      \
 ";
 
-DbHelper::DbHelper(const fs::path& path, const std::string& dbname)
+DbHelper::Profile
+DbHelper::Profile::durable()
 {
-  fs::create_directories(path);
+  return Profile{false, 2, 0, -2000, time::seconds(0)};
+}
+
+DbHelper::Profile
+DbHelper::Profile::fast()
+{
+  return Profile{true, 1, 64 * 1024 * 1024, -8 * 1024, time::seconds(30)};
+}
+
+namespace {
+
+#ifdef DISABLE_SQLITE3_FS_LOCKING
+DbHelper::Profile g_defaultProfile = DbHelper::Profile::durable();
+#else
+DbHelper::Profile g_defaultProfile = DbHelper::Profile::fast();
+#endif // DISABLE_SQLITE3_FS_LOCKING
+
+/**
+ * @brief Periodically runs passive checkpoints of the registered WAL databases
+ *
+ * Passive checkpoints never wait for readers or writers, so they are safe to run from the
+ * io_service thread while other threads use the same connections.
+ */
+class BackgroundCheckpointer : noncopyable
+{
+public:
+  void
+  add(sqlite3* db)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_dbs.insert(db);
+  }
+
+  void
+  remove(sqlite3* db)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_dbs.erase(db);
+  }
+
+  void
+  start(boost::asio::io_service& ioService, const time::seconds& interval)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_nUsers++ > 0 || interval <= time::seconds(0)) {
+      return;
+    }
+
+    m_interval = interval;
+    m_scheduler.reset(new Scheduler(ioService));
+    m_event.reset(new util::scheduler::ScopedEventId(*m_scheduler));
+    *m_event = m_scheduler->scheduleEvent(m_interval, bind(&BackgroundCheckpointer::run, this));
+  }
+
+  void
+  stop()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_nUsers == 0 || --m_nUsers > 0) {
+      return;
+    }
+
+    m_event.reset();
+    m_scheduler.reset();
+  }
+
+private:
+  void
+  run()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (sqlite3* db : m_dbs) {
+      int nLogFrames = 0;
+      int nCheckpointed = 0;
+      int res = sqlite3_wal_checkpoint_v2(db, nullptr, SQLITE_CHECKPOINT_PASSIVE,
+                                          &nLogFrames, &nCheckpointed);
+      _LOG_DEBUG_COND(res != SQLITE_OK && res != SQLITE_BUSY,
+                      "Checkpoint failed: " << sqlite3_errmsg(db));
+      _LOG_DEBUG_COND(res == SQLITE_OK && nLogFrames > 0,
+                      "Checkpointed " << nCheckpointed << " of " << nLogFrames << " WAL frames");
+    }
+
+    if (m_scheduler != nullptr) {
+      *m_event = m_scheduler->scheduleEvent(m_interval, bind(&BackgroundCheckpointer::run, this));
+    }
+  }
+
+private:
+  std::mutex m_mutex;
+  std::set<sqlite3*> m_dbs;
+  int m_nUsers = 0;
+  time::seconds m_interval;
+  unique_ptr<Scheduler> m_scheduler;
+  unique_ptr<util::scheduler::ScopedEventId> m_event;
+};
+
+BackgroundCheckpointer&
+getBackgroundCheckpointer()
+{
+  static BackgroundCheckpointer checkpointer;
+  return checkpointer;
+}
+
+void
+applyPragma(sqlite3* db, const std::string& pragma)
+{
+  int res = sqlite3_exec(db, ("PRAGMA " + pragma + ";").c_str(), NULL, NULL, NULL);
+  _LOG_DEBUG_COND(res != SQLITE_OK, "PRAGMA " << pragma << " failed: " << sqlite3_errmsg(db));
+}
+
+} // namespace
+
+void
+DbHelper::setDefaultProfile(const Profile& profile)
+{
+  g_defaultProfile = profile;
+}
+
+const DbHelper::Profile&
+DbHelper::getDefaultProfile()
+{
+  return g_defaultProfile;
+}
 
-  int res = sqlite3_open((path / dbname).c_str(), &m_db);
+sqlite3*
+DbHelper::openDatabase(const fs::path& path)
+{
+  sqlite3* db = nullptr;
+  int res = sqlite3_open(path.c_str(), &db);
   if (res != SQLITE_OK) {
-    BOOST_THROW_EXCEPTION(Error("Cannot open/create database: [" + (path / dbname).string() + "]"));
+    sqlite3_close(db);
+    BOOST_THROW_EXCEPTION(Error("Cannot open/create database: [" + path.string() + "]"));
+  }
+
+  const Profile& profile = g_defaultProfile;
+
+  // switching the journal mode is a no-op if the database file already uses it, and fails
+  // (harmlessly) while another connection has the file open
+  applyPragma(db, std::string("journal_mode = ") + (profile.useWal ? "WAL" : "DELETE"));
+  applyPragma(db, "synchronous = " + std::to_string(profile.synchronous));
+  applyPragma(db, "mmap_size = " + std::to_string(profile.mmapSize));
+  applyPragma(db, "cache_size = " + std::to_string(profile.cacheSize));
+
+  if (profile.useWal) {
+    getBackgroundCheckpointer().add(db);
   }
+  return db;
+}
+
+void
+DbHelper::closeDatabase(sqlite3* db)
+{
+  getBackgroundCheckpointer().remove(db);
+
+  int res = sqlite3_close(db);
+  _LOG_DEBUG_COND(res != SQLITE_OK, "Cannot close database: " << sqlite3_errmsg(db));
+}
+
+void
+DbHelper::startBackgroundCheckpoints(boost::asio::io_service& ioService)
+{
+  getBackgroundCheckpointer().start(ioService, g_defaultProfile.checkpointInterval);
+}
+
+void
+DbHelper::stopBackgroundCheckpoints()
+{
+  getBackgroundCheckpointer().stop();
+}
 
-  res = sqlite3_create_function(m_db, "hash", 2, SQLITE_ANY, 0, 0, DbHelper::hash_xStep,
+DbHelper::DbHelper(const fs::path& path, const std::string& dbname)
+{
+  fs::create_directories(path);
+
+  m_db = openDatabase(path / dbname);
+
+  int res = sqlite3_create_function(m_db, "hash", 2, SQLITE_ANY, 0, 0, DbHelper::hash_xStep,
                                 DbHelper::hash_xFinal);
   if (res != SQLITE_OK) {
     BOOST_THROW_EXCEPTION(Error("Cannot create function ``hash''"));
@@ -75,12 +249,55 @@ DbHelper::DbHelper(const fs::path& path, const std::string& dbname)
 
 DbHelper::~DbHelper()
 {
-  int res = sqlite3_close(m_db);
+  for (auto& entry : m_statements) {
+    sqlite3_finalize(entry.second.stmt);
+  }
+  m_statements.clear();
+
+  closeDatabase(m_db);
+}
+
+DbHelper::Statement::Statement(DbHelper& helper, const std::string& sql)
+  : m_helper(helper)
+  , m_entry(nullptr)
+  , m_stmt(nullptr)
+{
+  std::lock_guard<std::mutex> lock(m_helper.m_statementsMutex);
+
+  auto entry = m_helper.m_statements.find(sql);
+  if (entry != m_helper.m_statements.end() && !entry->second.isInUse) {
+    m_entry = &entry->second;
+    m_entry->isInUse = true;
+    m_stmt = m_entry->stmt;
+    return;
+  }
+
+  int res = sqlite3_prepare_v2(m_helper.m_db, sql.c_str(), sql.size(), &m_stmt, 0);
   if (res != SQLITE_OK) {
-    // complain
+    _LOG_ERROR("Cannot prepare statement [" << sql << "]: " << sqlite3_errmsg(m_helper.m_db));
+    BOOST_THROW_EXCEPTION(Error(sqlite3_errmsg(m_helper.m_db)));
+  }
+
+  if (entry == m_helper.m_statements.end()) {
+    m_entry = &m_helper.m_statements.insert(std::make_pair(sql, CachedStatement{m_stmt, true}))
+                 .first->second;
   }
 }
 
+DbHelper::Statement::~Statement()
+{
+  if (m_entry == nullptr) {
+    sqlite3_finalize(m_stmt);
+    return;
+  }
+
+  sqlite3_reset(m_stmt);
+  sqlite3_clear_bindings(m_stmt);
+
+  std::lock_guard<std::mutex> lock(m_helper.m_statementsMutex);
+  m_entry->isInUse = false;
+}
+
 void
 DbHelper::hash_xStep(sqlite3_context* context, int argc, sqlite3_value** argv)
 {
@@ -24,13 +24,21 @@
 #include "core/chronoshare-common.hpp"
 
 #include <sqlite3.h>
+#include <boost/asio/io_service.hpp>
 #include <boost/filesystem.hpp>
+#include <ndn-cxx/util/time.hpp>
+
+#include <mutex>
+#include <unordered_map>
 
 namespace ndn {
 namespace chronoshare {
 
 class DbHelper
 {
+private:
+  struct CachedStatement;
+
 public:
   class Error : public boost::exception,
                 public std::runtime_error
@@ -43,10 +51,108 @@ public:
     }
   };
 
+  /**
+   * @brief Journaling, durability and caching settings of a database connection
+   */
+  struct Profile
+  {
+    /// Use write-ahead logging instead of the rollback journal
+    bool useWal;
+    /// Value of PRAGMA synchronous: 0 (OFF), 1 (NORMAL), or 2 (FULL)
+    int synchronous;
+    /// Value of PRAGMA mmap_size in bytes, zero disables memory-mapped I/O
+    sqlite3_int64 mmapSize;
+    /// Value of PRAGMA cache_size, negative values are in KiB and positive in pages
+    int cacheSize;
+    /// Period of background WAL checkpoints, zero leaves checkpointing to SQLite alone
+    time::seconds checkpointInterval;
+
+    /**
+     * @brief Rollback journal with synchronous=FULL: every commit is on disk when it returns
+     */
+    static Profile
+    durable();
+
+    /**
+     * @brief WAL with synchronous=NORMAL, 64 MiB of mmap, 8 MiB of page cache and checkpoints
+     *        every 30 seconds
+     *
+     * A power loss may roll back the last few commits, but never corrupts the database.
+     */
+    static Profile
+    fast();
+  };
+
+  /**
+   * @brief Prepared statement borrowed from the statement cache of DbHelper
+   *
+   * Every distinct SQL text is compiled only once per database connection.  When the handle goes
+   * out of scope, the statement is reset and its bindings are cleared, so the next user gets it in
+   * the same state as a freshly prepared one.
+   *
+   * If the same SQL text is requested while the cached statement is still in use (e.g., from
+   * within a visitor callback), a private statement is prepared and finalized instead.
+   */
+  class Statement : boost::noncopyable
+  {
+  public:
+    Statement(DbHelper& helper, const std::string& sql);
+
+    ~Statement();
+
+    operator sqlite3_stmt*() const
+    {
+      return m_stmt;
+    }
+
+  private:
+    DbHelper& m_helper;
+    CachedStatement* m_entry; ///< nullptr for a private (uncached) statement
+    sqlite3_stmt* m_stmt;
+  };
+
 public:
   DbHelper(const boost::filesystem::path& path, const std::string& dbname);
   virtual ~DbHelper();
 
+  /**
+   * @brief Set the profile applied to databases opened from now on
+   *
+   * Defaults to Profile::fast(), or to Profile::durable() when built with
+   * --without-sqlite-locking, as WAL needs shared memory that network file systems do not have.
+   */
+  static void
+  setDefaultProfile(const Profile& profile);
+
+  static const Profile&
+  getDefaultProfile();
+
+  /**
+   * @brief Open (create if necessary) database file @p path and apply the default profile
+   *
+   * The connection takes part in background checkpointing until it is closed with
+   * closeDatabase().  DbHelper-based databases are opened this way; the function is public for
+   * modules that keep a raw sqlite3 handle.
+   */
+  static sqlite3*
+  openDatabase(const boost::filesystem::path& path);
+
+  static void
+  closeDatabase(sqlite3* db);
+
+  /**
+   * @brief Start periodic passive checkpoints of all open WAL databases on @p ioService
+   *
+   * Calls are reference counted; the io_service of the first caller is used until the matching
+   * number of stopBackgroundCheckpoints() calls.  SQLite's own checkpoint on commit stays enabled
+   * as a backstop, but rarely kicks in once the log is checkpointed in the background.
+   */
+  static void
+  startBackgroundCheckpoints(boost::asio::io_service& ioService);
+
+  static void
+  stopBackgroundCheckpoints();
+
 private:
   static void
   hash_xStep(sqlite3_context* context, int argc, sqlite3_value** argv);
@@ -65,6 +171,16 @@ private:
 
 protected:
   sqlite3* m_db;
+
+private:
+  struct CachedStatement
+  {
+    sqlite3_stmt* stmt;
+    bool isInUse;
+  };
+
+  std::unordered_map<std::string, CachedStatement> m_statements;
+  std::mutex m_statementsMutex;
 };
 
 typedef shared_ptr<DbHelper> DbHelperPtr;
@@ -39,20 +39,33 @@ static const std::string BROADCAST_DOMAIN = "/ndn/broadcast";
 
 static const int CONTENT_FRESHNESS = 1800;                 // seconds
 const static double DEFAULT_SYNC_INTEREST_INTERVAL = 10.0; // seconds;
+static const int MAX_FILE_FETCH_RETRIES = 3;
+
+// file that a fetched file is written to before it is moved into the shared folder
+static fs::path
+getIncomingPath(const fs::path& rootDir, const Buffer& hash)
+{
+  return rootDir / ".chronoshare" / "incoming" / toHex(hash);
+}
 
 Dispatcher::Dispatcher(const std::string& localUserName, const std::string& sharedFolder,
                        const fs::path& rootDir, Face& face,
-                       bool enablePrefixDiscovery)
+                       bool enablePrefixDiscovery, size_t segmentSize,
+                       ObjectManager::Chunking chunking, uint32_t parallelFileFetches,
+                       uint32_t parallelFileFetchesPerDevice, bool keepFetchedObjects)
   : m_face(face)
   , m_core(NULL)
   , m_rootDir(rootDir)
   , m_ioService(face.getIoService())
-  , m_objectManager(face, rootDir, CHRONOSHARE_APP)
+  , m_objectManager(face, rootDir, CHRONOSHARE_APP, segmentSize, chunking)
   , m_localUserName(localUserName)
+  , m_keepFetchedObjects(keepFetchedObjects)
   , m_sharedFolder(sharedFolder)
   , m_server(NULL)
   , m_enablePrefixDiscovery(enablePrefixDiscovery)
 {
+  DbHelper::startBackgroundCheckpoints(m_ioService);
+
   m_syncLog = make_shared<SyncLog>(m_rootDir, localUserName);
   m_actionLog = make_shared<ActionLog>(std::ref(m_face), m_rootDir, m_syncLog, sharedFolder, CHRONOSHARE_APP,
     // bind(&Dispatcher::Did_ActionLog_ActionApply_AddOrModify, this, _1, _2, _3, _4, _5, _6, _7),
@@ -89,14 +102,27 @@ Dispatcher::Dispatcher(const std::string& localUserName, const std::string& shar
                                      FetchManager::FinishCallback(), actionTaskDb);
 
   FetchTaskDbPtr fileTaskDb = make_shared<FetchTaskDb>(m_rootDir, "file");
+  // before the fetch manager resumes the tasks and their segments arrive
+  RestoreChunkedFetches(*fileTaskDb);
   m_fileFetcher =
     make_shared<FetchManager>(std::ref(m_face), bind(&SyncLog::LookupLocator, &*m_syncLog, _1),
                                      Name(BROADCAST_DOMAIN), // no appname suffix now
-                                     3, bind(&Dispatcher::Did_FetchManager_FileSegmentFetch, this,
-                                             _1, _2, _3, _4),
+                                     parallelFileFetches,
+                                     bind(&Dispatcher::Did_FetchManager_FileSegmentFetch, this,
+                                          _1, _2, _3, _4),
                                      bind(&Dispatcher::Did_FetchManager_FileFetchComplete, this, _1,
                                           _2),
-                                     fileTaskDb);
+                                     fileTaskDb, CongestionWindow::ALGORITHM_AIMD,
+                                     parallelFileFetchesPerDevice);
+  // segments must be stored before the progress that includes them is saved
+  m_fileFetcher->SetWillSaveProgressCallback([this] {
+      for (auto& db : m_objectDbMap) {
+        db.second->commitPartial();
+      }
+      for (auto& assembler : m_fileAssemblers) {
+        assembler.second->sync();
+      }
+    });
 
   if (m_enablePrefixDiscovery) {
     _LOG_DEBUG("registering prefix discovery in Dispatcher");
@@ -130,6 +156,11 @@ Dispatcher::~Dispatcher()
     m_core = NULL;
   }
 
+  // files still being fetched are resumed from their saved progress after a restart
+  for (auto& db : m_objectDbMap) {
+    db.second->suspend();
+  }
+
   if (m_server != NULL) {
     delete m_server;
     m_server = NULL;
@@ -139,6 +170,8 @@ Dispatcher::~Dispatcher()
     delete m_stateServer;
     m_stateServer = NULL;
   }
+
+  DbHelper::stopBackgroundCheckpoints();
 }
 
 void
@@ -188,13 +221,59 @@ Dispatcher::Did_LocalPrefix_Updated(const Name& forwardingHint)
 void
 Dispatcher::Did_LocalFile_AddOrModify(const fs::path& relativeFilePath)
 {
-  m_ioService.post(bind(&Dispatcher::Did_LocalFile_AddOrModify_Execute, this, relativeFilePath));
+  boost::mutex::scoped_lock lock(m_pendingLocalFilesMutex);
+
+  // files reported before the queue is processed join the same batch
+  if (m_pendingLocalFiles.empty()) {
+    m_ioService.post(bind(&Dispatcher::Did_LocalFile_AddOrModify_Execute, this));
+  }
+  m_pendingLocalFiles.push_back(relativeFilePath);
 }
 
 void
-Dispatcher::Did_LocalFile_AddOrModify_Execute(fs::path relativeFilePath)
+Dispatcher::Did_LocalFile_AddOrModify_Execute()
+{
+  std::vector<fs::path> files;
+  {
+    boost::mutex::scoped_lock lock(m_pendingLocalFilesMutex);
+    files.swap(m_pendingLocalFiles);
+  }
+
+  _LOG_DEBUG(m_localUserName << " calls LocalFile_AddOrModify_Execute for " << files.size()
+                             << " files");
+
+  std::vector<ActionLog::LocalUpdate> updates;
+  std::set<fs::path> seen;
+  for (const fs::path& relativeFilePath : files) {
+    if (!seen.insert(relativeFilePath).second) {
+      continue;
+    }
+
+    try {
+      PrepareLocalFileUpdate(relativeFilePath, updates);
+    }
+    catch (fs::filesystem_error& error) {
+      _LOG_ERROR("File operations failed on [" << relativeFilePath << "](ignoring)");
+    }
+    catch (const ObjectManager::Error& error) {
+      _LOG_ERROR("Cannot publish [" << relativeFilePath << "]: " << error.what());
+    }
+  }
+
+  if (!updates.empty()) {
+    m_actionLog->AddLocalActionUpdates(updates);
+
+    // notify SyncCore to propagate the change
+    m_core->localStateChangedDelayed();
+  }
+
+  _LOG_DEBUG("LocalFile_AddOrModify_Execute Finished!");
+}
+
+void
+Dispatcher::PrepareLocalFileUpdate(const fs::path& relativeFilePath,
+                                   std::vector<ActionLog::LocalUpdate>& updates)
 {
-  _LOG_DEBUG(m_localUserName << " calls LocalFile_AddOrModify_Execute");
   fs::path absolutePath = m_rootDir / relativeFilePath;
   _LOG_DEBUG("relativeFilePath : " << relativeFilePath);
   _LOG_DEBUG("absolutePath : " << absolutePath);
@@ -207,49 +286,45 @@ Dispatcher::Did_LocalFile_AddOrModify_Execute(fs::path relativeFilePath)
 
   FileItemPtr currentFile = m_fileState->LookupFile(relativeFilePath.generic_string());
 
-  if (currentFile) {
-    fs::ifstream input(absolutePath);
-    if (*util::Sha256(input).computeDigest() ==
-        Buffer(currentFile->file_hash().c_str(), currentFile->file_hash().size())
-      // The following two are commented out to prevent front end from reporting intermediate files
-      // should enable it if there is other way to prevent this
-      // && last_write_time(absolutePath) == currentFile->mtime()
-      // && status(absolutePath).permissions() ==
-      // static_cast<fs::perms>(currentFile->mode())
-        ) {
-      _LOG_ERROR("Got notification about the same file [" << relativeFilePath << "]");
-      return;
-    }
-  }
-
   if (currentFile && !currentFile->is_complete()) {
     _LOG_ERROR("Got notification about incomplete file [" << relativeFilePath << "]");
     return;
   }
 
+  Buffer currentHash;
+  if (currentFile) {
+    currentHash = Buffer(currentFile->file_hash().c_str(), currentFile->file_hash().size());
+  }
+
+  // the file is hashed while it is segmented, nothing is published if the hash did not change
   int seg_num;
   ConstBufferPtr hash;
+  ObjectManager::ChunkList chunkList{nullptr, 0};
   _LOG_DEBUG("absolutePath: " << absolutePath << " m_localUserName: " << m_localUserName);
-  tie(hash, seg_num) = m_objectManager.localFileToObjects(absolutePath, m_localUserName);
+  tie(hash, seg_num) = m_objectManager.localFileToObjects(absolutePath, m_localUserName,
+                                                          currentHash, &chunkList);
+
+  if (seg_num == 0) {
+    // The following two are commented out to prevent front end from reporting intermediate files
+    // should enable it if there is other way to prevent this
+    // && last_write_time(absolutePath) == currentFile->mtime()
+    // && status(absolutePath).permissions() ==
+    // static_cast<fs::perms>(currentFile->mode())
+    _LOG_ERROR("Got notification about the same file [" << relativeFilePath << "]");
+    return;
+  }
 
-  try {
-    m_actionLog->AddLocalActionUpdate(relativeFilePath.generic_string(), *hash,
-                                      last_write_time(absolutePath),
+  updates.push_back(ActionLog::LocalUpdate{relativeFilePath.generic_string(), hash,
+                                           last_write_time(absolutePath),
 #if BOOST_VERSION >= 104900
-                                      status(absolutePath).permissions(),
+                                           status(absolutePath).permissions(),
 #else
-                                      0,
+                                           0,
 #endif
-                                      seg_num);
-
-    // notify SyncCore to propagate the change
-    m_core->localStateChangedDelayed();
-  }
-  catch (fs::filesystem_error& error) {
-    _LOG_ERROR("File operations failed on [" << relativeFilePath << "](ignoring)");
-  }
-
-  _LOG_DEBUG("LocalFile_AddOrModify_Execute Finished!");
+                                           seg_num, static_cast<int>(
+                                             m_objectManager.getSegmentSize()),
+                                           chunkList.hash,
+                                           static_cast<int>(chunkList.nSegments)});
 }
 
 void
@@ -356,18 +431,48 @@ Dispatcher::Did_FetchManager_ActionFetch(const Name& deviceName,
     fileNameBase.appendImplicitSha256Digest(hash);
 
     std::string hashStr = toHex(*hash);
-    if (ObjectDb::DoesExist(m_rootDir / ".chronoshare", deviceName, hashStr)) {
+    std::string layout = ObjectStore::makeLayout(action->seg_size(),
+                                                 action->has_chunk_list_hash());
+
+    std::vector<Name> sources = GetFileSources(deviceName, *action);
+    // the file may be stored already, published by this or another device in the same layout
+    if (ObjectDb::DoesExist(m_rootDir / ".chronoshare", deviceName, hashStr) ||
+        ObjectDb::AddAlias(m_rootDir / ".chronoshare", deviceName, hashStr, layout)) {
       _LOG_DEBUG("File already exists in the database. No need to refetch, just directly applying "
                  "the action");
       Did_FetchManager_FileFetchComplete(deviceName, fileNameBase);
     }
-    else {
-      if (m_objectDbMap.find(*hash) == m_objectDbMap.end()) {
-        _LOG_DEBUG("create ObjectDb for " << toHex(*hash));
-        m_objectDbMap[*hash] = make_shared<ObjectDb>(m_rootDir / ".chronoshare", hashStr);
+    else if (action->has_chunk_list_hash()) {
+      Buffer chunkListHash(action->chunk_list_hash().c_str(), action->chunk_list_hash().size());
+      std::string chunkListLayout = ObjectStore::makeLayout(action->seg_size(), false);
+      ObjectDb::AddAlias(m_rootDir / ".chronoshare", deviceName, toHex(chunkListHash),
+                         chunkListLayout);
+
+      ConstBufferPtr chunkList = m_objectManager.fetchChunkList(deviceName, chunkListHash);
+      if (chunkList) {
+        FetchMissingChunks(deviceName, *hash, layout, chunkList, sources);
+      }
+      else {
+        // the chunk list is fetched as a file, FetchMissingChunks continues once it is complete
+        if (m_objectDbMap.find(chunkListHash) == m_objectDbMap.end()) {
+          m_objectDbMap[chunkListHash] = make_shared<ObjectDb>(m_rootDir / ".chronoshare",
+                                                               toHex(chunkListHash),
+                                                               chunkListLayout);
+        }
+        m_pendingChunkLists[chunkListHash] = ChunkedFetch{*hash, layout, nullptr, 0, sources};
+
+        Name chunkListNameBase = Name("/");
+        chunkListNameBase.append(deviceName).append(CHRONOSHARE_APP).append("file");
+        chunkListNameBase.appendImplicitSha256Digest(chunkListHash.buf(), chunkListHash.size());
+
+        m_fileFetcher->Enqueue(deviceName, chunkListNameBase, 0,
+                               action->chunk_list_seg_num() - 1, FetchManager::PRIORITY_NORMAL);
       }
+    }
+    else {
+      StartFileFetch(*hash, *action);
 
-      m_fileFetcher->Enqueue(deviceName, fileNameBase, 0, action->seg_num() - 1,
+      m_fileFetcher->Enqueue(deviceName, fileNameBase, sources, 0, action->seg_num() - 1,
                              FetchManager::PRIORITY_NORMAL);
     }
   }
@@ -437,10 +542,63 @@ Dispatcher::Did_FetchManager_FileSegmentFetch_Execute(Name deviceName,
   // _LOG_DEBUG("Looking up objectdb for " << hash);
 
   std::map<Buffer, ObjectDbPtr>::iterator db = m_objectDbMap.find(hash);
+  std::map<Buffer, FileAssemblerPtr>::iterator assembler = m_fileAssemblers.find(hash);
+  if (db == m_objectDbMap.end() && assembler == m_fileAssemblers.end()) {
+    // fetch resumed after a restart, the layout is known from the action of the file
+    FileItemsPtr files = m_fileState->LookupFilesForHash(hash);
+    if (!files->empty()) {
+      const FileItem& file = files->front();
+      Name fileDeviceName(Block(reinterpret_cast<const uint8_t*>(file.device_name().c_str()),
+                                file.device_name().size()));
+      ActionItemPtr action = m_actionLog->LookupAction(fileDeviceName, file.seq_no());
+      // state of chunked files is restored by RestoreChunkedFetches, their ranges must not be
+      // committed as the complete file without it
+      if (action && !action->has_chunk_list_hash()) {
+        StartFileFetch(hash, *action);
+        db = m_objectDbMap.find(hash);
+        assembler = m_fileAssemblers.find(hash);
+      }
+    }
+  }
+
+  // segments of chunked files are not checked by an assembler, each one has to match its digest
+  // in the chunk list, as the segment is also read for other files with the same chunk
+  auto chunkedFetch = m_chunkedFetches.find(hash);
+  if (chunkedFetch != m_chunkedFetches.end() &&
+      !IsChunkValid(*chunkedFetch->second.chunkList, segment, *fileSegmentData)) {
+    ChunkedFetch& fetch = chunkedFetch->second;
+    if (++fetch.nSegmentRetries[segment] > MAX_FILE_FETCH_RETRIES) {
+      _LOG_ERROR("Segment " << segment << " of " << toHex(hash) << " does not match the chunk "
+                 "list, giving up");
+      return;
+    }
+
+    _LOG_DEBUG("Segment " << segment << " of " << toHex(hash) << " does not match the chunk list, "
+               "fetching it again");
+    fetch.nPendingRanges++;
+    m_fileFetcher->Enqueue(deviceName, fileSegmentBaseName, fetch.sources, segment, segment,
+                           FetchManager::PRIORITY_NORMAL);
+    return;
+  }
+
+  bool isSaved = false;
+  if (assembler != m_fileAssemblers.end()) {
+    try {
+      const Block& content = fileSegmentData->getContent();
+      assembler->second->addSegment(segment, content.value(), content.value_size());
+      isSaved = true;
+    }
+    catch (const FileAssembler::Error& error) {
+      _LOG_ERROR("Cannot write segment " << segment << " of " << toHex(hash) << ": "
+                 << error.what());
+      m_fileAssemblers.erase(assembler);
+    }
+  }
+
   if (db != m_objectDbMap.end()) {
     db->second->saveContentObject(deviceName, segment, *fileSegmentData);
   }
-  else {
+  else if (!isSaved) {
     _LOG_ERROR("no db available for this content object: " << fileSegmentBaseName << ", size: "
                                                            << fileSegmentData->getContent().size());
   }
@@ -449,6 +607,19 @@ Dispatcher::Did_FetchManager_FileSegmentFetch_Execute(Name deviceName,
   // objectDb.saveContentObject(deviceName, segment, *fileSegmentData);
 }
 
+bool
+Dispatcher::IsChunkValid(const Buffer& chunkList, uint32_t segment, const Data& data)
+{
+  size_t offset = static_cast<size_t>(segment) * ObjectStore::CHUNK_HASH_SIZE;
+  if (offset + ObjectStore::CHUNK_HASH_SIZE > chunkList.size()) {
+    return false;
+  }
+
+  const Block& content = data.getContent();
+  ConstBufferPtr digest = util::Sha256::computeDigest(content.value(), content.value_size());
+  return std::equal(digest->begin(), digest->end(), chunkList.begin() + offset);
+}
+
 void
 Dispatcher::Did_FetchManager_FileFetchComplete(const Name& deviceName,
                                                const Name& fileBaseName)
@@ -468,15 +639,49 @@ Dispatcher::Did_FetchManager_FileFetchComplete_Execute(Name deviceName, Name fil
 
   _LOG_DEBUG("Extracted hash: " << toHex(hash));
 
+  auto pendingChunkList = m_pendingChunkLists.find(hash);
+  if (pendingChunkList != m_pendingChunkLists.end()) {
+    ChunkedFetch fetch = pendingChunkList->second;
+    m_pendingChunkLists.erase(pendingChunkList);
+    m_objectDbMap.erase(hash); // to commit write
+
+    ConstBufferPtr chunkList = m_objectManager.fetchChunkList(deviceName, hash);
+    if (!chunkList) {
+      _LOG_ERROR("Fetched chunk list " << toHex(hash) << " cannot be read");
+      return;
+    }
+    FetchMissingChunks(deviceName, fetch.fileHash, fetch.layout, chunkList, fetch.sources);
+    return;
+  }
+
+  auto chunkedFetch = m_chunkedFetches.find(hash);
+  if (chunkedFetch != m_chunkedFetches.end()) {
+    if (--chunkedFetch->second.nPendingRanges > 0) {
+      return;
+    }
+    m_objectManager.addChunkList(deviceName, hash, chunkedFetch->second.layout,
+                                 *chunkedFetch->second.chunkList);
+    m_chunkedFetches.erase(chunkedFetch);
+  }
+
+  FileAssemblerPtr assembler;
+  auto fileAssembler = m_fileAssemblers.find(hash);
+  if (fileAssembler != m_fileAssemblers.end()) {
+    assembler = fileAssembler->second;
+    m_fileAssemblers.erase(fileAssembler);
+  }
+
   if (m_objectDbMap.find(hash) != m_objectDbMap.end()) {
     // remove the db handle
     m_objectDbMap.erase(hash); // to commit write
   }
-  else {
+  else if (assembler == nullptr) {
     _LOG_ERROR("no db available for this file: " << toHex(hash));
   }
 
   FileItemsPtr filesToAssemble = m_fileState->LookupFilesForHash(hash);
+  fs::path assembledPath; // file written by the assembler, copied to other files of the hash
+  bool isCorrupted = false; // assembled content did not match the hash
 
   for (FileItems::iterator file = filesToAssemble->begin(); file != filesToAssemble->end();
        file++) {
@@ -500,9 +705,37 @@ Dispatcher::Did_FetchManager_FileFetchComplete_Execute(Name deviceName, Name fil
       _LOG_ERROR("File operations failed on [" << filePath << "](ignoring)");
     }
 
-    if (ObjectDb::DoesExist(m_rootDir / ".chronoshare", deviceName,
+    if (assembler != nullptr || !assembledPath.empty() ||
+        ObjectDb::DoesExist(m_rootDir / ".chronoshare", deviceName,
                             toHex(hash))) {
-      bool ok = m_objectManager.objectsToLocalFile(deviceName, hash, filePath);
+      bool ok = false;
+      try {
+        if (assembler != nullptr) {
+          ok = assembler->commit(filePath);
+          assembler.reset();
+          if (ok) {
+            assembledPath = filePath;
+          }
+          else {
+            isCorrupted = true;
+          }
+        }
+        else if (!assembledPath.empty()) {
+          fs::path incomingPath = getIncomingPath(m_rootDir, hash);
+          fs::copy_file(assembledPath, incomingPath, fs::copy_option::overwrite_if_exists);
+          fs::rename(incomingPath, filePath);
+          ok = true;
+        }
+      }
+      catch (const fs::filesystem_error& error) {
+        _LOG_ERROR("Cannot write [" << filePath << "]: " << error.what());
+      }
+
+      // stored segments may be the same ones the assembler had; objectsToLocalFile checks the
+      // digest of the restored file and removes stored segments that do not match
+      if (!ok && ObjectDb::DoesExist(m_rootDir / ".chronoshare", deviceName, toHex(hash))) {
+        ok = m_objectManager.objectsToLocalFile(deviceName, hash, filePath, file->seg_num());
+      }
       if (ok) {
         last_write_time(filePath, file->mtime());
 #if BOOST_VERSION >= 104900
@@ -510,6 +743,16 @@ Dispatcher::Did_FetchManager_FileFetchComplete_Execute(Name deviceName, Name fil
 #endif
 
         m_fileState->SetFileComplete(file->filename());
+        m_nFileFetchRetries.erase(hash);
+      }
+      else if (isCorrupted ||
+               !ObjectDb::DoesExist(m_rootDir / ".chronoshare", deviceName, toHex(hash))) {
+        // segments of the corrupted fetch must be neither served nor kept over the new ones
+        m_objectManager.removeObjects(deviceName, hash);
+
+        // all files of the hash wait for the new fetch
+        RetryFileFetch(deviceName, fileBaseName, hash, *file);
+        break;
       }
       else {
         _LOG_ERROR("Notified about complete fetch, but file cannot be restored from the database: ["
@@ -521,6 +764,174 @@ Dispatcher::Did_FetchManager_FileFetchComplete_Execute(Name deviceName, Name fil
       // should abort for debugging
     }
   }
+
+  if (assembler != nullptr) {
+    // all files of the hash are in place already
+    boost::system::error_code ec;
+    fs::remove(getIncomingPath(m_rootDir, hash), ec);
+  }
+}
+
+void
+Dispatcher::StartFileFetch(const Buffer& hash, const ActionItem& action)
+{
+  if (!action.has_chunk_list_hash() && m_fileAssemblers.find(hash) == m_fileAssemblers.end()) {
+    try {
+      m_fileAssemblers[hash] = make_shared<FileAssembler>(getIncomingPath(m_rootDir, hash), hash,
+                                                          action.seg_size(), action.seg_num());
+    }
+    catch (const FileAssembler::Error& error) {
+      _LOG_ERROR("Cannot assemble " << toHex(hash) << " in place: " << error.what());
+    }
+  }
+
+  // segments of chunked files are read from the store when the file is assembled
+  bool isStored = m_keepFetchedObjects || m_fileAssemblers.find(hash) == m_fileAssemblers.end();
+  if (isStored && m_objectDbMap.find(hash) == m_objectDbMap.end()) {
+    _LOG_DEBUG("create ObjectDb for " << toHex(hash));
+    m_objectDbMap[hash] = make_shared<ObjectDb>(m_rootDir / ".chronoshare", toHex(hash),
+                                                ObjectStore::makeLayout(action.seg_size(),
+                                                                        action.has_chunk_list_hash()));
+  }
+}
+
+void
+Dispatcher::RetryFileFetch(const Name& deviceName, const Name& fileBaseName, const Buffer& hash,
+                           const FileItem& file)
+{
+  if (++m_nFileFetchRetries[hash] > MAX_FILE_FETCH_RETRIES) {
+    _LOG_ERROR("Fetched content of " << toHex(hash) << " does not match its hash, giving up");
+    m_nFileFetchRetries.erase(hash);
+    return;
+  }
+
+  Name fileDeviceName(Block(reinterpret_cast<const uint8_t*>(file.device_name().c_str()),
+                            file.device_name().size()));
+  ActionItemPtr action = m_actionLog->LookupAction(fileDeviceName, file.seq_no());
+  if (!action) {
+    _LOG_ERROR("Action of " << file.filename() << " is not found, cannot fetch it again");
+    return;
+  }
+
+  _LOG_DEBUG("Fetched content of " << toHex(hash) << " does not match its hash, fetching again");
+  if (action->has_chunk_list_hash()) {
+    // segments are fetched against the chunk list again, so that each of them is checked
+    Buffer chunkListHash(action->chunk_list_hash().c_str(), action->chunk_list_hash().size());
+    ConstBufferPtr chunkList = m_objectManager.fetchChunkList(deviceName, chunkListHash);
+    if (!chunkList) {
+      _LOG_ERROR("Chunk list of " << toHex(hash) << " cannot be read, cannot fetch it again");
+      return;
+    }
+    FetchMissingChunks(deviceName, hash, ObjectStore::makeLayout(action->seg_size(), true),
+                       chunkList, GetFileSources(deviceName, *action));
+    return;
+  }
+
+  StartFileFetch(hash, *action);
+  m_fileFetcher->Enqueue(deviceName, fileBaseName, GetFileSources(deviceName, *action), 0,
+                         action->seg_num() - 1, FetchManager::PRIORITY_NORMAL);
+}
+
+std::vector<Name>
+Dispatcher::GetFileSources(const Name& deviceName, const ActionItem& action)
+{
+  // devices that published the same file in the same layout can serve its segments as well
+  std::vector<Name> sources{deviceName};
+  for (const Name& source : m_actionLog->LookupFileSources(action)) {
+    if (source != deviceName && source != m_localUserName) {
+      sources.push_back(source);
+    }
+  }
+  return sources;
+}
+
+void
+Dispatcher::RestoreChunkedFetches(FetchTaskDb& taskDb)
+{
+  // saved tasks for each hash: ranges of a chunked file, or its chunk list
+  std::map<Buffer, size_t> nTasks;
+  taskDb.foreachTask([&nTasks] (const Name& deviceName, const Name& baseName, uint64_t minSeqNo,
+                                uint64_t maxSeqNo, int priority) {
+      nTasks[Buffer(baseName.get(-1).value(), baseName.get(-1).value_size())]++;
+    });
+  if (nTasks.empty()) {
+    return;
+  }
+
+  m_fileState->LookupIncompleteFiles([this, &nTasks] (const FileItem& file) {
+      Name deviceName(Block(reinterpret_cast<const uint8_t*>(file.device_name().c_str()),
+                            file.device_name().size()));
+      ActionItemPtr action = m_actionLog->LookupAction(deviceName, file.seq_no());
+      if (!action || !action->has_chunk_list_hash()) {
+        return;
+      }
+
+      Buffer fileHash(file.file_hash().c_str(), file.file_hash().size());
+      Buffer chunkListHash(action->chunk_list_hash().c_str(), action->chunk_list_hash().size());
+      std::string layout = ObjectStore::makeLayout(action->seg_size(), true);
+
+      auto ranges = nTasks.find(fileHash);
+      if (ranges != nTasks.end() && m_chunkedFetches.find(fileHash) == m_chunkedFetches.end()) {
+        ConstBufferPtr chunkList = m_objectManager.fetchChunkList(deviceName, chunkListHash);
+        if (!chunkList) {
+          _LOG_ERROR("Chunk list of " << toHex(fileHash) << " cannot be read, the file is not "
+                     "restored after its ranges are fetched");
+          return;
+        }
+
+        _LOG_DEBUG("Resuming " << ranges->second << " ranges of chunked " << toHex(fileHash));
+        m_objectDbMap[fileHash] = make_shared<ObjectDb>(m_rootDir / ".chronoshare",
+                                                        toHex(fileHash), layout);
+        m_chunkedFetches[fileHash] = ChunkedFetch{fileHash, layout, chunkList, ranges->second,
+                                                  GetFileSources(deviceName, *action)};
+      }
+      else if (nTasks.find(chunkListHash) != nTasks.end() &&
+               m_pendingChunkLists.find(chunkListHash) == m_pendingChunkLists.end()) {
+        _LOG_DEBUG("Resuming chunk list of " << toHex(fileHash));
+        m_objectDbMap[chunkListHash] = make_shared<ObjectDb>(m_rootDir / ".chronoshare",
+                                                             toHex(chunkListHash),
+                                                             ObjectStore::makeLayout(
+                                                               action->seg_size(), false));
+        m_pendingChunkLists[chunkListHash] = ChunkedFetch{fileHash, layout, nullptr, 0,
+                                                          GetFileSources(deviceName, *action)};
+      }
+    });
+}
+
+void
+Dispatcher::FetchMissingChunks(const Name& deviceName, const Buffer& fileHash,
+                               const std::string& layout, ConstBufferPtr chunkList,
+                               const std::vector<Name>& sources)
+{
+  Name fileNameBase = Name("/");
+  fileNameBase.append(deviceName).append(CHRONOSHARE_APP).append("file");
+  fileNameBase.appendImplicitSha256Digest(fileHash.buf(), fileHash.size());
+
+  std::vector<std::pair<size_t, size_t>> ranges = m_objectManager.findMissingChunks(*chunkList);
+
+  size_t nMissing = 0;
+  for (const auto& range : ranges) {
+    nMissing += range.second - range.first + 1;
+  }
+  _LOG_DEBUG("Fetching " << nMissing << " of " << chunkList->size() / ObjectStore::CHUNK_HASH_SIZE
+             << " segments of " << toHex(fileHash) << ", the rest is available locally");
+
+  if (ranges.empty()) {
+    m_objectManager.addChunkList(deviceName, fileHash, layout, *chunkList);
+    Did_FetchManager_FileFetchComplete(deviceName, fileNameBase);
+    return;
+  }
+
+  if (m_objectDbMap.find(fileHash) == m_objectDbMap.end()) {
+    m_objectDbMap[fileHash] = make_shared<ObjectDb>(m_rootDir / ".chronoshare", toHex(fileHash),
+                                                    layout);
+  }
+  m_chunkedFetches[fileHash] = ChunkedFetch{fileHash, layout, chunkList, ranges.size(), sources};
+
+  for (const auto& range : ranges) {
+    m_fileFetcher->Enqueue(deviceName, fileNameBase, sources, range.first, range.second,
+                           FetchManager::PRIORITY_NORMAL);
+  }
 }
 
 // moved to state-server
@@ -30,10 +30,14 @@
 #include "content-server.hpp"
 #include "state-server.hpp"
 #include "fetch-manager.hpp"
+#include "file-assembler.hpp"
 
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
+#include <boost/thread/mutex.hpp>
 #include <map>
+#include <set>
+#include <vector>
 
 namespace ndn {
 namespace chronoshare {
@@ -47,9 +51,23 @@ class Dispatcher {
 public:
   // sharedFolder is the name to be used in NDN name;
   // rootDir is the shared folder dir in local file system;
+  /**
+   * @param segmentSize size of segments of the files published by this device
+   * @param chunking    how files published by this device are segmented
+   * @param parallelFileFetches          limit of files fetched at a time
+   * @param parallelFileFetchesPerDevice limit of files fetched from one device at a time
+   * @param keepFetchedObjects           save segments of fetched files in the object store as
+   *                                     well, so that they are served to other devices; files
+   *                                     published in fixed-size segments are written directly
+   *                                     into the shared folder either way
+   */
   Dispatcher(const std::string& localUserName, const std::string& sharedFolder,
-             const boost::filesystem::path& rootDir, Face& face, 
-             bool enablePrefixDiscovery = true);
+             const boost::filesystem::path& rootDir, Face& face,
+             bool enablePrefixDiscovery = true,
+             size_t segmentSize = ObjectManager::MAX_SEGMENT_SIZE,
+             ObjectManager::Chunking chunking = ObjectManager::CHUNKING_FIXED_SIZE,
+             uint32_t parallelFileFetches = 8, uint32_t parallelFileFetchesPerDevice = 3,
+             bool keepFetchedObjects = true);
   ~Dispatcher();
 
   // ----- Callbacks, they only submit the job to executor and immediately return so that event
@@ -83,12 +101,22 @@ public:
   }
 
 private:
+  /**
+   * @brief Add actions for all files queued by Did_LocalFile_AddOrModify
+   *
+   * Bursts of notifications (e.g., a directory tree copied into the shared folder) are added to
+   * ActionLog as one batch and announced to SyncCore once.
+   */
+  void
+  Did_LocalFile_AddOrModify_Execute();
+
+  /**
+   * @brief Hash @p relativeFilepath into ObjectDb and append it to @p updates, unless the file is
+   *        gone or unchanged
+   */
   void
-  Did_LocalFile_AddOrModify_Execute(boost::filesystem::path relativeFilepath); // cannot be const &
-                                                                               // for Execute
-                                                                               // event!!! otherwise
-                                                                               // there will be
-                                                                               // segfault
+  PrepareLocalFileUpdate(const boost::filesystem::path& relativeFilepath,
+                         std::vector<ActionLog::LocalUpdate>& updates);
 
   void
   Did_LocalFile_Delete_Execute(boost::filesystem::path relativeFilepath); // cannot be const & for
@@ -161,6 +189,51 @@ private:
   void
   Did_LocalPrefix_Updated(const Name& prefix);
 
+  /**
+   * @brief Fetch segments of a file published with content-defined chunking, except the ones
+   *        with content that is stored locally
+   */
+  void
+  FetchMissingChunks(const Name& deviceName, const Buffer& fileHash, const std::string& layout,
+                     ConstBufferPtr chunkList, const std::vector<Name>& sources);
+
+  /**
+   * @brief Get devices that can serve segments of the file published by @p deviceName in
+   *        @p action
+   */
+  std::vector<Name>
+  GetFileSources(const Name& deviceName, const ActionItem& action);
+
+  /**
+   * @brief Rebuild state of chunked files whose ranges or chunk lists are fetched by saved
+   *        tasks of @p taskDb, so that they are assembled once all of them are fetched
+   */
+  void
+  RestoreChunkedFetches(FetchTaskDb& taskDb);
+
+  /**
+   * @brief Prepare to save segments of file @p hash published by @p action, in a FileAssembler
+   *        if the file is published in fixed-size segments, and in an ObjectDb if they are kept
+   */
+  void
+  StartFileFetch(const Buffer& hash, const ActionItem& action);
+
+  /**
+   * @brief Fetch file @p hash again after its fetched content did not match the digest, up to
+   *        MAX_FILE_FETCH_RETRIES times
+   *
+   * Segments of a chunked file are fetched against its chunk list again.
+   */
+  void
+  RetryFileFetch(const Name& deviceName, const Name& fileBaseName, const Buffer& hash,
+                 const FileItem& file);
+
+  /**
+   * @brief Check that content of @p segment of a chunked file matches its digest in @p chunkList
+   */
+  static bool
+  IsChunkValid(const Buffer& chunkList, uint32_t segment, const Data& data);
+
 private:
   void
   AssembleFile_Execute(const Name& deviceName, const Buffer& filehash,
@@ -197,6 +270,25 @@ private:
   // for every fetched segment of a file
 
   std::map<Buffer, ObjectDbPtr> m_objectDbMap;
+  // files being written directly into the shared folder
+  std::map<Buffer, FileAssemblerPtr> m_fileAssemblers;
+  bool m_keepFetchedObjects;
+  // file hash -> number of fetches retried because the assembled file did not match the hash
+  std::map<Buffer, int> m_nFileFetchRetries;
+
+  struct ChunkedFetch
+  {
+    Buffer fileHash;
+    std::string layout;
+    ConstBufferPtr chunkList;
+    size_t nPendingRanges;
+    std::vector<Name> sources; // devices to fetch the segments from
+    std::map<uint32_t, size_t> nSegmentRetries; // segments that did not match the chunk list
+  };
+  // chunk list hash -> fetch of the file waiting for the chunk list
+  std::map<Buffer, ChunkedFetch> m_pendingChunkLists;
+  // file hash -> fetch of segment ranges that are not available locally
+  std::map<Buffer, ChunkedFetch> m_chunkedFetches;
 
   std::string m_sharedFolder;
   ContentServer* m_server;
@@ -205,6 +297,10 @@ private:
 
   FetchManagerPtr m_actionFetcher;
   FetchManagerPtr m_fileFetcher;
+
+  // files reported by Did_LocalFile_AddOrModify and not yet processed
+  std::vector<boost::filesystem::path> m_pendingLocalFiles;
+  boost::mutex m_pendingLocalFilesMutex;
 };
 
 namespace Error {
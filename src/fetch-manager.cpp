@@ -23,11 +23,41 @@
 
 #include <ndn-cxx/face.hpp>
 
+#include <algorithm>
+
 namespace ndn {
 namespace chronoshare {
 
 INIT_LOGGER("FetchManager")
 
+const uint64_t FetchManager::MIN_SWARM_PART_SIZE = 32;
+const int FetchManager::PROGRESS_SAVE_INTERVAL = 10;
+
+// name of the file under /<device_name>/<app>/file/<hash> as served by another device
+static Name
+getSourceBaseName(const Name& deviceName, const Name& baseName, const Name& source)
+{
+  return Name(source).append(baseName.getSubName(deviceName.size()));
+}
+
+// sort ranges and merge the ones that overlap or adjoin
+static void
+mergeRanges(SegmentRanges& ranges)
+{
+  std::sort(ranges.begin(), ranges.end());
+
+  SegmentRanges merged;
+  for (const auto& range : ranges) {
+    if (!merged.empty() && range.first <= merged.back().second + 1) {
+      merged.back().second = std::max(merged.back().second, range.second);
+    }
+    else {
+      merged.push_back(range);
+    }
+  }
+  ranges.swap(merged);
+}
+
 // The disposer object function
 struct fetcher_disposer {
   void
@@ -42,16 +72,22 @@ FetchManager::FetchManager(Face& face, const Mapping& mapping,
                            uint32_t parallelFetches, // = 3
                            const SegmentCallback& defaultSegmentCallback,
                            const FinishCallback& defaultFinishCallback,
-                           const FetchTaskDbPtr& taskDb)
+                           const FetchTaskDbPtr& taskDb,
+                           CongestionWindow::Algorithm congestionControl,
+                           uint32_t parallelFetchesPerDevice)
   : m_face(face)
   , m_mapping(mapping)
   , m_maxParallelFetches(parallelFetches)
+  , m_maxParallelFetchesPerDevice(parallelFetchesPerDevice)
   , m_currentParallelFetches(0)
+  , m_nextQueueOrder(0)
   , m_scheduler(m_face.getIoService())
   , m_scheduledFetchesEvent(m_scheduler)
+  , m_saveProgressEvent(m_scheduler)
   , m_defaultSegmentCallback(defaultSegmentCallback)
   , m_defaultFinishCallback(defaultFinishCallback)
   , m_taskDb(taskDb)
+  , m_congestionControl(congestionControl)
   , m_broadcastHint(broadcastForwardingHint)
   , m_ioService(m_face.getIoService())
 {
@@ -61,10 +97,10 @@ FetchManager::FetchManager(Face& face, const Mapping& mapping,
 
   // resume un-finished fetches if there is any
   if (m_taskDb) {
-    m_taskDb->foreachTask([this] (const Name& deviceName, const Name& baseName, uint64_t minSeqNo,
-                              uint64_t maxSeqNo, int priority) {
-                            this->Enqueue(deviceName, baseName, minSeqNo, maxSeqNo, priority);
-                          });
+    m_taskDb->foreachTaskProgress(bind(&FetchManager::Resume, this, _1, _2, _3, _4, _5, _6));
+
+    m_saveProgressEvent = m_scheduler.scheduleEvent(time::seconds(PROGRESS_SAVE_INTERVAL),
+                                                    bind(&FetchManager::SaveProgress, this));
   }
 }
 
@@ -100,26 +136,20 @@ FetchManager::Enqueue(const Name& deviceName, const Name& baseName,
     m_taskDb->addTask(deviceName, baseName, minSeqNo, maxSeqNo, priority);
   }
 
-  boost::unique_lock<boost::mutex> lock(m_parellelFetchMutex);
-
   _LOG_TRACE("++++ Create fetcher: " << baseName);
   Fetcher* fetcher =
     new Fetcher(m_face, segmentCallback, finishCallback,
                 bind(&FetchManager::DidFetchComplete, this, _1, _2, _3),
                 bind(&FetchManager::DidNoDataTimeout, this, _1), deviceName, baseName,
-                minSeqNo, maxSeqNo, boost::posix_time::seconds(30), forwardingHint);
-
-  switch (priority) {
-  case PRIORITY_HIGH:
-    _LOG_TRACE("++++ Push front fetcher: " << fetcher->GetName());
-    m_fetchList.push_front(*fetcher);
-    break;
+                minSeqNo, maxSeqNo, boost::posix_time::seconds(30), forwardingHint,
+                m_congestionControl);
+  fetcher->SetPriority(priority);
 
-  case PRIORITY_NORMAL:
-  default:
+  {
+    boost::unique_lock<boost::mutex> lock(m_parellelFetchMutex);
     _LOG_TRACE("++++ Push back fetcher: " << fetcher->GetName());
     m_fetchList.push_back(*fetcher);
-    break;
+    Schedule(*fetcher);
   }
 
   _LOG_DEBUG("++++ Reschedule fetcher task");
@@ -128,40 +158,291 @@ FetchManager::Enqueue(const Name& deviceName, const Name& baseName,
 }
 
 void
-FetchManager::ScheduleFetches()
+FetchManager::Enqueue(const Name& deviceName, const Name& baseName,
+                      const std::vector<Name>& sources, uint64_t minSeqNo, uint64_t maxSeqNo,
+                      int priority /*PRIORITY_NORMAL*/)
 {
+  if (sources.size() < 2) {
+    Enqueue(deviceName, baseName, minSeqNo, maxSeqNo, priority);
+    return;
+  }
+
+  if (minSeqNo > maxSeqNo) {
+    return;
+  }
+
+  if (m_taskDb) {
+    m_taskDb->addTask(deviceName, baseName, minSeqNo, maxSeqNo, priority);
+  }
+
+  SwarmPtr swarm = MakeSwarm(deviceName, baseName, sources, minSeqNo, maxSeqNo, priority);
+
+  uint64_t nSegments = maxSeqNo - minSeqNo + 1;
+  uint64_t nParts = std::min<uint64_t>({sources.size(), m_maxParallelFetches,
+                                        (nSegments + MIN_SWARM_PART_SIZE - 1) / MIN_SWARM_PART_SIZE});
+  nParts = std::max<uint64_t>(nParts, 1);
+  _LOG_DEBUG("Fetching " << baseName << " from " << nParts << " of " << sources.size()
+                         << " sources");
+
   boost::unique_lock<boost::mutex> lock(m_parellelFetchMutex);
 
-  boost::posix_time::ptime currentTime =
-    boost::date_time::second_clock<boost::posix_time::ptime>::universal_time();
-  boost::posix_time::ptime nextSheduleCheck =
-    currentTime + boost::posix_time::seconds(300); // no reason to have anything, but just in case
+  for (uint64_t part = 0; part < nParts; part++) {
+    AddSwarmPart(swarm, sources[part], minSeqNo + nSegments * part / nParts,
+                 minSeqNo + nSegments * (part + 1) / nParts - 1);
+  }
 
-  for (FetchList::iterator item = m_fetchList.begin();
-       m_currentParallelFetches < m_maxParallelFetches && item != m_fetchList.end(); item++) {
-    if (item->IsActive()) {
-      _LOG_DEBUG("Item is active");
-      continue;
+  m_scheduledFetchesEvent = m_scheduler.scheduleEvent(time::seconds(0),
+                                                      bind(&FetchManager::ScheduleFetches, this));
+}
+
+void
+FetchManager::Resume(const Name& deviceName, const Name& baseName, uint64_t minSeqNo,
+                     uint64_t maxSeqNo, int priority, const SegmentRanges& received)
+{
+  SegmentRanges gaps;
+  uint64_t next = minSeqNo;
+  for (const auto& range : received) {
+    if (range.first > next) {
+      gaps.push_back(std::make_pair(next, std::min(range.first - 1, maxSeqNo)));
     }
+    next = std::max(next, range.second + 1);
+  }
+  if (next <= maxSeqNo) {
+    gaps.push_back(std::make_pair(next, maxSeqNo));
+  }
+  if (gaps.empty()) {
+    // all segments were fetched, but completion was not reported before the restart
+    gaps.push_back(std::make_pair(maxSeqNo, maxSeqNo));
+  }
 
-    if (item->IsTimedWait()) {
-      _LOG_DEBUG("Item is in timed-wait");
+  uint64_t nMissing = 0;
+  for (const auto& gap : gaps) {
+    nMissing += gap.second - gap.first + 1;
+  }
+  _LOG_DEBUG("Resuming " << baseName << ", " << nMissing << " of "
+                         << maxSeqNo - minSeqNo + 1 << " segments are missing");
+
+  SwarmPtr swarm = MakeSwarm(deviceName, baseName, {deviceName}, minSeqNo, maxSeqNo, priority);
+  swarm->completed = received;
+
+  boost::unique_lock<boost::mutex> lock(m_parellelFetchMutex);
+
+  // gaps separated by few fetched segments are fetched together, skipping the fetched ones
+  size_t first = 0;
+  for (size_t i = 1; i <= gaps.size(); i++) {
+    if (i < gaps.size() && gaps[i].first - gaps[i - 1].second <= ReceiveWindow::INITIAL_CAPACITY) {
       continue;
     }
 
-    if (currentTime < item->GetNextScheduledRetry()) {
-      if (item->GetNextScheduledRetry() < nextSheduleCheck)
-        nextSheduleCheck = item->GetNextScheduledRetry();
+    Fetcher* fetcher = AddSwarmPart(swarm, deviceName, gaps[first].first, gaps[i - 1].second);
+    for (size_t gap = first + 1; gap < i; gap++) {
+      for (uint64_t seqNo = gaps[gap - 1].second + 1; seqNo < gaps[gap].first; seqNo++) {
+        fetcher->MarkReceived(seqNo);
+      }
+    }
+    first = i;
+  }
 
-      _LOG_DEBUG("Item is delayed");
-      continue;
+  m_scheduledFetchesEvent = m_scheduler.scheduleEvent(time::seconds(0),
+                                                      bind(&FetchManager::ScheduleFetches, this));
+}
+
+FetchManager::SwarmPtr
+FetchManager::MakeSwarm(const Name& deviceName, const Name& baseName,
+                        const std::vector<Name>& sources, uint64_t minSeqNo, uint64_t maxSeqNo,
+                        int priority)
+{
+  SwarmPtr swarm = make_shared<Swarm>();
+  swarm->deviceName = deviceName;
+  swarm->baseName = baseName;
+  swarm->minSeqNo = minSeqNo;
+  swarm->maxSeqNo = maxSeqNo;
+  swarm->segmentCallback = m_defaultSegmentCallback;
+  swarm->finishCallback = m_defaultFinishCallback;
+  swarm->priority = priority;
+  swarm->sources = sources;
+  swarm->nParts = 0;
+  return swarm;
+}
+
+Fetcher*
+FetchManager::AddSwarmPart(const SwarmPtr& swarm, const Name& source, uint64_t minSeqNo,
+                           uint64_t maxSeqNo)
+{
+  Name baseName = getSourceBaseName(swarm->deviceName, swarm->baseName, source);
+
+  _LOG_TRACE("++++ Create fetcher: " << baseName << ", segments " << minSeqNo << "-" << maxSeqNo);
+  // segments are reported for the swarm, and it finishes once all of its parts are fetched
+  Fetcher* fetcher =
+    new Fetcher(m_face,
+                [swarm] (Name&, Name&, uint64_t seq, shared_ptr<Data> data) {
+                  if (swarm->segmentCallback != nullptr) {
+                    swarm->segmentCallback(swarm->deviceName, swarm->baseName, seq, data);
+                  }
+                },
+                Fetcher::FinishCallback(),
+                bind(&FetchManager::DidFetchComplete, this, _1, _2, _3),
+                bind(&FetchManager::DidNoDataTimeout, this, _1), source, baseName,
+                minSeqNo, maxSeqNo, boost::posix_time::seconds(30), m_mapping(source),
+                m_congestionControl);
+  fetcher->SetPriority(swarm->priority);
+
+  m_swarmParts[fetcher] = swarm;
+  swarm->nParts++;
+
+  m_fetchList.push_back(*fetcher);
+  Schedule(*fetcher);
+  return fetcher;
+}
+
+void
+FetchManager::RebalanceSwarm(const SwarmPtr& swarm, const Name& source)
+{
+  Fetcher* slowest = nullptr;
+  int64_t maxRemaining = 0;
+  for (const auto& part : m_swarmParts) {
+    if (part.second == swarm) {
+      int64_t remaining = part.first->GetRemainingSegments();
+      if (remaining > maxRemaining) {
+        slowest = part.first;
+        maxRemaining = remaining;
+      }
     }
+  }
 
-    _LOG_DEBUG("Start fetching of " << item->GetName());
+  int64_t minSeqNo, maxSeqNo;
+  if (slowest != nullptr && maxRemaining >= static_cast<int64_t>(2 * MIN_SWARM_PART_SIZE) &&
+      slowest->TruncateRange(maxRemaining / 2, minSeqNo, maxSeqNo)) {
+    _LOG_DEBUG("Moving segments " << minSeqNo << "-" << maxSeqNo << " of " << swarm->baseName
+                                  << " from " << slowest->GetDeviceName() << " to " << source);
+    AddSwarmPart(swarm, source, minSeqNo, maxSeqNo);
+  }
+}
 
-    m_currentParallelFetches++;
-    _LOG_TRACE("++++ RESTART PIPELINE: " << item->GetName());
-    item->RestartPipeline();
+bool
+FetchManager::SwitchSwarmSource(const SwarmPtr& swarm, Fetcher& fetcher)
+{
+  Name current = fetcher.GetDeviceName();
+  swarm->nFailures[current]++;
+
+  // the source that failed the least times, the ones after the current source go first
+  size_t position = std::find(swarm->sources.begin(), swarm->sources.end(), current) -
+                    swarm->sources.begin();
+  const Name* next = nullptr;
+  int minFailures = 0;
+  for (size_t i = 1; i < swarm->sources.size(); i++) {
+    const Name& candidate = swarm->sources[(position + i) % swarm->sources.size()];
+    int nFailures = swarm->nFailures[candidate];
+    if (next == nullptr || nFailures < minFailures) {
+      next = &candidate;
+      minFailures = nFailures;
+    }
+  }
+
+  if (next == nullptr || minFailures > 0) {
+    // every source failed, start over after the usual pause
+    swarm->nFailures.clear();
+    return false;
+  }
+
+  _LOG_DEBUG("Continuing " << swarm->baseName << " from " << *next << " instead of " << current);
+  fetcher.SetSource(*next, getSourceBaseName(swarm->deviceName, swarm->baseName, *next));
+  fetcher.SetForwardingHint(m_mapping(*next));
+  fetcher.SetRetryPause(0);
+  fetcher.SetNextScheduledRetry(boost::date_time::second_clock<boost::posix_time::ptime>::universal_time());
+  return true;
+}
+
+void
+FetchManager::Schedule(Fetcher& fetcher)
+{
+  boost::posix_time::ptime currentTime =
+    boost::date_time::second_clock<boost::posix_time::ptime>::universal_time();
+
+  if (currentTime < fetcher.GetNextScheduledRetry()) {
+    m_delayedFetchers.insert(std::make_pair(fetcher.GetNextScheduledRetry(), &fetcher));
+    return;
+  }
+
+  ReadyQueue& queue = m_readyFetchers[fetcher.GetPriority()];
+  std::set<QueueEntry>& fetchers = queue.fetchers[fetcher.GetDeviceName()];
+  if (fetchers.empty()) {
+    queue.devices.push_back(fetcher.GetDeviceName());
+  }
+  fetchers.insert(QueueEntry{fetcher.GetRemainingSegments(), m_nextQueueOrder++, &fetcher});
+}
+
+void
+FetchManager::ReleaseFetchSlot(const Fetcher& fetcher)
+{
+  m_currentParallelFetches--;
+
+  auto nFetches = m_nDeviceFetches.find(fetcher.GetDeviceName());
+  if (nFetches != m_nDeviceFetches.end() && --nFetches->second == 0) {
+    m_nDeviceFetches.erase(nFetches);
+  }
+}
+
+void
+FetchManager::ScheduleFetches()
+{
+  boost::unique_lock<boost::mutex> lock(m_parellelFetchMutex);
+
+  boost::posix_time::ptime currentTime =
+    boost::date_time::second_clock<boost::posix_time::ptime>::universal_time();
+  boost::posix_time::ptime nextSheduleCheck =
+    currentTime + boost::posix_time::seconds(300); // no reason to have anything, but just in case
+
+  while (!m_delayedFetchers.empty() && m_delayedFetchers.begin()->first <= currentTime) {
+    Fetcher* fetcher = m_delayedFetchers.begin()->second;
+    m_delayedFetchers.erase(m_delayedFetchers.begin());
+    Schedule(*fetcher);
+  }
+  if (!m_delayedFetchers.empty() && m_delayedFetchers.begin()->first < nextSheduleCheck) {
+    nextSheduleCheck = m_delayedFetchers.begin()->first;
+  }
+
+  auto level = m_readyFetchers.begin();
+  while (m_currentParallelFetches < m_maxParallelFetches && level != m_readyFetchers.end()) {
+    ReadyQueue& queue = level->second;
+
+    // devices at their limit keep their turn, there are at most m_maxParallelFetches of them
+    std::vector<Name> busyDevices;
+    while (m_currentParallelFetches < m_maxParallelFetches && !queue.devices.empty()) {
+      Name deviceName = queue.devices.front();
+      queue.devices.pop_front();
+
+      uint32_t& nDeviceFetches = m_nDeviceFetches[deviceName];
+      if (m_maxParallelFetchesPerDevice > 0 && nDeviceFetches >= m_maxParallelFetchesPerDevice) {
+        busyDevices.push_back(deviceName);
+        continue;
+      }
+
+      auto fetchers = queue.fetchers.find(deviceName);
+      Fetcher* fetcher = fetchers->second.begin()->fetcher;
+      fetchers->second.erase(fetchers->second.begin());
+      if (fetchers->second.empty()) {
+        queue.fetchers.erase(fetchers);
+      }
+      else {
+        queue.devices.push_back(deviceName);
+      }
+
+      _LOG_DEBUG("Start fetching of " << fetcher->GetName());
+
+      m_currentParallelFetches++;
+      nDeviceFetches++;
+      _LOG_TRACE("++++ RESTART PIPELINE: " << fetcher->GetName());
+      fetcher->RestartPipeline();
+    }
+    queue.devices.insert(queue.devices.begin(), busyDevices.begin(), busyDevices.end());
+
+    if (queue.devices.empty()) {
+      level = m_readyFetchers.erase(level);
+    }
+    else {
+      level++;
+    }
   }
 
   m_scheduledFetchesEvent = m_scheduler.scheduleEvent(time::seconds((nextSheduleCheck - currentTime).total_seconds()),
@@ -171,13 +452,30 @@ FetchManager::ScheduleFetches()
 void
 FetchManager::DidNoDataTimeout(Fetcher& fetcher)
 {
+  Fetcher::Stats stats = fetcher.GetStats();
   _LOG_DEBUG("No data timeout for " << fetcher.GetName()
-                                    << " with forwarding hint: " << fetcher.GetForwardingHint());
+                                    << " with forwarding hint: " << fetcher.GetForwardingHint()
+                                    << ", " << stats.nReceived << " segments received, "
+                                    << stats.nTimeouts << " timeouts");
 
+  bool isSourceSwitched = false;
   {
     boost::unique_lock<boost::mutex> lock(m_parellelFetchMutex);
-    m_currentParallelFetches--;
-    // no need to do anything with the m_fetchList
+    ReleaseFetchSlot(fetcher);
+
+    auto part = m_swarmParts.find(&fetcher);
+    if (part != m_swarmParts.end()) {
+      isSourceSwitched = SwitchSwarmSource(part->second, fetcher);
+    }
+    if (isSourceSwitched) {
+      Schedule(fetcher);
+    }
+  }
+
+  if (isSourceSwitched) {
+    m_scheduledFetchesEvent = m_scheduler.scheduleEvent(time::seconds(0),
+                                                        bind(&FetchManager::ScheduleFetches, this));
+    return;
   }
 
   if (fetcher.GetForwardingHint().size() == 0) {
@@ -216,6 +514,10 @@ FetchManager::DidNoDataTimeout(Fetcher& fetcher)
   fetcher.SetRetryPause(delay);
   fetcher.SetNextScheduledRetry(boost::date_time::second_clock<boost::posix_time::ptime>::universal_time()
                                 + boost::posix_time::seconds(delay));
+  {
+    boost::unique_lock<boost::mutex> lock(m_parellelFetchMutex);
+    Schedule(fetcher);
+  }
 
   m_scheduledFetchesEvent = m_scheduler.scheduleEvent(time::seconds(0),
                                                       bind(&FetchManager::ScheduleFetches, this));
@@ -225,15 +527,42 @@ void
 FetchManager::DidFetchComplete(Fetcher& fetcher, const Name& deviceName,
                                const Name& baseName)
 {
+  SwarmPtr finishedSwarm;
   {
     boost::unique_lock<boost::mutex> lock(m_parellelFetchMutex);
-    m_currentParallelFetches--;
+    ReleaseFetchSlot(fetcher);
 
-    if (m_taskDb) {
-      m_taskDb->deleteTask(deviceName, baseName);
+    auto part = m_swarmParts.find(&fetcher);
+    if (part == m_swarmParts.end()) {
+      if (m_taskDb) {
+        m_taskDb->deleteTask(deviceName, baseName, fetcher.GetMinSeqNo(), fetcher.GetMaxSeqNo());
+      }
+    }
+    else {
+      SwarmPtr swarm = part->second;
+      m_swarmParts.erase(part);
+      swarm->nParts--;
+      for (const auto& range : fetcher.GetReceivedRanges()) {
+        swarm->completed.push_back(range);
+      }
+      mergeRanges(swarm->completed);
+
+      RebalanceSwarm(swarm, deviceName);
+      if (swarm->nParts == 0) {
+        if (m_taskDb) {
+          m_taskDb->deleteTask(swarm->deviceName, swarm->baseName, swarm->minSeqNo,
+                               swarm->maxSeqNo);
+        }
+        finishedSwarm = swarm;
+      }
     }
   }
 
+  if (finishedSwarm != nullptr && finishedSwarm->finishCallback != nullptr) {
+    _LOG_TRACE("Fetch finished from all sources: " << finishedSwarm->baseName);
+    finishedSwarm->finishCallback(finishedSwarm->deviceName, finishedSwarm->baseName);
+  }
+
   // like TCP timed-wait
   m_scheduler.scheduleEvent(time::seconds(10),
                             bind(&FetchManager::TimedWait, this, ref(fetcher)));
@@ -241,6 +570,61 @@ FetchManager::DidFetchComplete(Fetcher& fetcher, const Name& deviceName,
                                                       bind(&FetchManager::ScheduleFetches, this));
 }
 
+void
+FetchManager::SetWillSaveProgressCallback(const function<void()>& callback)
+{
+  m_willSaveProgress = callback;
+}
+
+void
+FetchManager::SaveProgress()
+{
+  {
+    boost::unique_lock<boost::mutex> lock(m_parellelFetchMutex);
+
+    std::map<SwarmPtr, SegmentRanges> swarms;
+    for (Fetcher& fetcher : m_fetchList) {
+      auto part = m_swarmParts.find(&fetcher);
+      if (part != m_swarmParts.end()) {
+        SegmentRanges& received = swarms[part->second];
+        for (const auto& range : fetcher.GetReceivedRanges()) {
+          received.push_back(range);
+        }
+      }
+      else if (!fetcher.IsTimedWait()) {
+        m_taskDb->updateProgress(fetcher.GetDeviceName(), fetcher.GetName(),
+                                 fetcher.GetMinSeqNo(), fetcher.GetMaxSeqNo(),
+                                 fetcher.GetReceivedRanges());
+      }
+    }
+
+    for (auto& swarm : swarms) {
+      SegmentRanges& received = swarm.second;
+      received.insert(received.end(), swarm.first->completed.begin(),
+                      swarm.first->completed.end());
+      mergeRanges(received);
+      m_taskDb->updateProgress(swarm.first->deviceName, swarm.first->baseName,
+                               swarm.first->minSeqNo, swarm.first->maxSeqNo, received);
+    }
+  }
+
+  // segments received so far are passed to the segment callback, which may post their
+  // processing, so progress is written after the handlers posted before
+  m_ioService.post(bind(&FetchManager::FlushProgress, this));
+}
+
+void
+FetchManager::FlushProgress()
+{
+  if (m_willSaveProgress != nullptr) {
+    m_willSaveProgress();
+  }
+  m_taskDb->flushProgress();
+
+  m_saveProgressEvent = m_scheduler.scheduleEvent(time::seconds(PROGRESS_SAVE_INTERVAL),
+                                                  bind(&FetchManager::SaveProgress, this));
+}
+
 void
 FetchManager::TimedWait(Fetcher& fetcher)
 {
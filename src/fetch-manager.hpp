@@ -28,7 +28,12 @@
 #include <ndn-cxx/util/scheduler.hpp>
 #include <ndn-cxx/util/scheduler-scoped-event-id.hpp>
 
+#include <deque>
+#include <functional>
 #include <list>
+#include <map>
+#include <set>
+#include <vector>
 
 namespace ndn {
 namespace chronoshare {
@@ -42,11 +47,23 @@ public:
   typedef function<void(Name& deviceName, Name& baseName)> FinishCallback;
 
 public:
+  /**
+   * Fetches are started in the order of decreasing priority.  Devices with fetches of the same
+   * priority take turns, and fetches of the same device go from the smallest one.
+   *
+   * @param parallelFetches          limit of fetches running at a time
+   * @param congestionControl        algorithm that adjusts the number of Interests each fetch
+   *                                 keeps in flight
+   * @param parallelFetchesPerDevice limit of fetches from one device running at a time, 0 for no
+   *                                 limit other than @p parallelFetches
+   */
   FetchManager(Face& face, const Mapping& mapping,
                const Name& broadcastForwardingHint, uint32_t parallelFetches = 3,
                const SegmentCallback& defaultSegmentCallback = SegmentCallback(),
                const FinishCallback& defaultFinishCallback = FinishCallback(),
-               const FetchTaskDbPtr& taskDb = FetchTaskDbPtr());
+               const FetchTaskDbPtr& taskDb = FetchTaskDbPtr(),
+               CongestionWindow::Algorithm congestionControl = CongestionWindow::ALGORITHM_AIMD,
+               uint32_t parallelFetchesPerDevice = 0);
   virtual ~FetchManager();
 
   void
@@ -59,7 +76,113 @@ public:
   Enqueue(const Name& deviceName, const Name& baseName, uint64_t minSeqNo,
           uint64_t maxSeqNo, int priority = PRIORITY_NORMAL);
 
+  /**
+   * @brief Enqueue fetching of a file that any of @p sources can serve, using default callbacks
+   *
+   * The range is split between up to parallelFetches of the sources.  A source that finishes
+   * its part takes over half of what is left of the slowest one, and a part whose source stops
+   * responding is continued from another source.  Segments and completion of the whole range
+   * are reported for @p deviceName and @p baseName, whichever source they come from.
+   *
+   * @param baseName  /<device_name>/<app>/file/<hash>, with the name of each source substituted
+   *                  for the device name to fetch from that source
+   */
+  void
+  Enqueue(const Name& deviceName, const Name& baseName, const std::vector<Name>& sources,
+          uint64_t minSeqNo, uint64_t maxSeqNo, int priority = PRIORITY_NORMAL);
+
+  /**
+   * @brief Set callback to make segments delivered so far durable, it is called before
+   *        progress of the fetches is saved in the task database
+   */
+  void
+  SetWillSaveProgressCallback(const function<void()>& callback);
+
+  /**
+   * @brief Smallest part of a range that is given to a separate source
+   */
+  static const uint64_t MIN_SWARM_PART_SIZE;
+
+  /**
+   * @brief Interval, in seconds, at which progress of the fetches is saved in the task database
+   */
+  static const int PROGRESS_SAVE_INTERVAL;
+
 private:
+  /**
+   * @brief Fetch of one range from several sources, each part of it is fetched by one Fetcher
+   */
+  struct Swarm
+  {
+    Name deviceName;
+    Name baseName;
+    uint64_t minSeqNo;
+    uint64_t maxSeqNo;
+    SegmentCallback segmentCallback;
+    FinishCallback finishCallback;
+    int priority;
+
+    std::vector<Name> sources;
+    std::map<Name, int> nFailures;
+    size_t nParts;
+    SegmentRanges completed; // segments fetched by finished parts or before a restart
+  };
+  typedef shared_ptr<Swarm> SwarmPtr;
+
+  SwarmPtr
+  MakeSwarm(const Name& deviceName, const Name& baseName, const std::vector<Name>& sources,
+            uint64_t minSeqNo, uint64_t maxSeqNo, int priority);
+
+  /**
+   * @brief Create a fetcher for a part of @p swarm, m_parellelFetchMutex should be locked
+   */
+  Fetcher*
+  AddSwarmPart(const SwarmPtr& swarm, const Name& source, uint64_t minSeqNo, uint64_t maxSeqNo);
+
+  /**
+   * @brief Give half of the largest part left in @p swarm to @p source, which finished its part
+   */
+  void
+  RebalanceSwarm(const SwarmPtr& swarm, const Name& source);
+
+  /**
+   * @brief Continue the part fetched by @p fetcher from another source of @p swarm
+   * @return false if all sources failed, in which case the source is not changed
+   */
+  bool
+  SwitchSwarmSource(const SwarmPtr& swarm, Fetcher& fetcher);
+
+  /**
+   * @brief Continue a task from the task database, fetching only segments not in @p received
+   */
+  void
+  Resume(const Name& deviceName, const Name& baseName, uint64_t minSeqNo, uint64_t maxSeqNo,
+         int priority, const SegmentRanges& received);
+
+  /**
+   * @brief Record segments fetched by all tasks, they are written once preceding segments are
+   *        processed
+   */
+  void
+  SaveProgress();
+
+  void
+  FlushProgress();
+
+  /**
+   * @brief Queue @p fetcher to be started once its retry time comes, m_parellelFetchMutex should
+   *        be locked
+   */
+  void
+  Schedule(Fetcher& fetcher);
+
+  /**
+   * @brief Account for @p fetcher, which was started, being stopped, m_parellelFetchMutex should
+   *        be locked
+   */
+  void
+  ReleaseFetchSlot(const Fetcher& fetcher);
+
   // Fetch Events
   void
   DidDataSegmentFetched(Fetcher& fetcher, uint64_t seqno, const Name& basename,
@@ -82,7 +205,9 @@ private:
   Mapping m_mapping;
 
   uint32_t m_maxParallelFetches;
+  uint32_t m_maxParallelFetchesPerDevice;
   uint32_t m_currentParallelFetches;
+  std::map<Name, uint32_t> m_nDeviceFetches; // running fetches of each device
   boost::mutex m_parellelFetchMutex;
 
   // optimized list structure for fetch queue
@@ -91,12 +216,42 @@ private:
   typedef boost::intrusive::list<Fetcher, MemberOption> FetchList;
 
   FetchList m_fetchList;
+
+  struct QueueEntry
+  {
+    int64_t nSegments;
+    uint64_t order;
+    Fetcher* fetcher;
+
+    bool
+    operator<(const QueueEntry& other) const
+    {
+      return nSegments < other.nSegments || (nSegments == other.nSegments && order < other.order);
+    }
+  };
+
+  /**
+   * @brief Fetchers of one priority that can be started, devices are served in turns
+   */
+  struct ReadyQueue
+  {
+    std::deque<Name> devices;
+    std::map<Name, std::set<QueueEntry>> fetchers;
+  };
+
+  std::map<int, ReadyQueue, std::greater<int>> m_readyFetchers;
+  std::multimap<boost::posix_time::ptime, Fetcher*> m_delayedFetchers;
+  uint64_t m_nextQueueOrder;
   Scheduler m_scheduler;
   util::scheduler::ScopedEventId m_scheduledFetchesEvent;
+  util::scheduler::ScopedEventId m_saveProgressEvent;
+  function<void()> m_willSaveProgress;
 
   SegmentCallback m_defaultSegmentCallback;
   FinishCallback m_defaultFinishCallback;
   FetchTaskDbPtr m_taskDb;
+  CongestionWindow::Algorithm m_congestionControl;
+  std::map<Fetcher*, SwarmPtr> m_swarmParts;
 
   const Name m_broadcastHint;
   boost::asio::io_service& m_ioService;
@@ -20,10 +20,13 @@
 
 #include "fetch-task-db.hpp"
 #include "db-helper.hpp"
+#include "core/logging.hpp"
 
 namespace ndn {
 namespace chronoshare {
 
+INIT_LOGGER("FetchTaskDb")
+
 namespace fs = boost::filesystem;
 
 const std::string INIT_DATABASE = "\
@@ -34,47 +37,94 @@ CREATE TABLE IF NOT EXISTS                                      \n\
     minSeqNo    INTEGER,                                        \n\
     maxSeqNo    INTEGER,                                        \n\
     priority    INTEGER,                                        \n\
-    PRIMARY KEY(deviceName, baseName)                          \n\
+    progress    INTEGER, /* first segment not fetched yet */   \n\
+    received    BLOB,    /* ranges fetched after progress */   \n\
+    PRIMARY KEY(deviceName, baseName, minSeqNo, maxSeqNo)      \n\
   );                                                            \n\
 CREATE INDEX identifier ON Task(deviceName, baseName);         \n\
 ";
 
-FetchTaskDb::FetchTaskDb(const boost::filesystem::path& folder, const std::string& tag)
+// earlier databases kept one task per file, even if its ranges were fetched separately
+static const std::string OLD_TASK_KEY = "PRIMARY KEY(deviceName, baseName)";
+
+// ranges are encoded as pairs of varints: distance from the end of the previous range, and
+// number of segments in the range less one
+
+static void
+appendVarNumber(Buffer& buffer, uint64_t number)
 {
-  fs::path actualFolder = folder / ".chronoshare" / "fetch_tasks";
-  fs::create_directories(actualFolder);
+  while (number >= 0x80) {
+    buffer.push_back(static_cast<uint8_t>(number) | 0x80);
+    number >>= 7;
+  }
+  buffer.push_back(static_cast<uint8_t>(number));
+}
 
-  int res = sqlite3_open((actualFolder / tag).c_str(), &m_db);
-  if (res != SQLITE_OK) {
-    BOOST_THROW_EXCEPTION(Error("Cannot open database: " + (actualFolder / tag).string()));
+static bool
+readVarNumber(const uint8_t*& begin, const uint8_t* end, uint64_t& number)
+{
+  number = 0;
+  for (int shift = 0; begin != end && shift < 64; shift += 7) {
+    uint8_t byte = *begin++;
+    number |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
   }
+  return false;
+}
 
+FetchTaskDb::FetchTaskDb(const boost::filesystem::path& folder, const std::string& tag)
+  : DbHelper(folder / ".chronoshare" / "fetch_tasks", tag)
+{
   char* errmsg = 0;
-  res = sqlite3_exec(m_db, INIT_DATABASE.c_str(), NULL, NULL, &errmsg);
+  int res = sqlite3_exec(m_db, INIT_DATABASE.c_str(), NULL, NULL, &errmsg);
   if (res != SQLITE_OK && errmsg != 0) {
     // _LOG_TRACE("Init \"error\": " << errmsg);
     sqlite3_free(errmsg);
   }
   else {
   }
+
+  // databases created before progress was recorded, fails if the columns exist
+  sqlite3_exec(m_db, "ALTER TABLE Task ADD COLUMN progress INTEGER;", NULL, NULL, NULL);
+  sqlite3_exec(m_db, "ALTER TABLE Task ADD COLUMN received BLOB;", NULL, NULL, NULL);
+
+  bool hasOldTaskKey = false;
+  {
+    Statement stmt(*this, "SELECT sql FROM sqlite_master WHERE type = 'table' AND name = 'Task'");
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+      std::string sql(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)),
+                      sqlite3_column_bytes(stmt, 0));
+      hasOldTaskKey = sql.find(OLD_TASK_KEY) != std::string::npos;
+    }
+  }
+
+  if (hasOldTaskKey) {
+    sqlite3_exec(m_db, "BEGIN TRANSACTION;", 0, 0, 0);
+    sqlite3_exec(m_db, "DROP INDEX IF EXISTS identifier; "
+                       "ALTER TABLE Task RENAME TO OldTask;", 0, 0, 0);
+    sqlite3_exec(m_db, INIT_DATABASE.c_str(), 0, 0, 0);
+    sqlite3_exec(m_db, "INSERT INTO Task(deviceName, baseName, minSeqNo, maxSeqNo, priority, "
+                       "                 progress, received) "
+                       "   SELECT deviceName, baseName, minSeqNo, maxSeqNo, priority, progress, "
+                       "          received "
+                       "     FROM OldTask; "
+                       "DROP TABLE OldTask;", 0, 0, 0);
+    sqlite3_exec(m_db, "END TRANSACTION;", 0, 0, 0);
+  }
 }
 
 FetchTaskDb::~FetchTaskDb()
 {
-  int res = sqlite3_close(m_db);
-  if (res != SQLITE_OK) {
-    // _LOG_ERROR
-  }
 }
 
 void
 FetchTaskDb::addTask(const Name& deviceName, const Name& baseName, uint64_t minSeqNo,
                      uint64_t maxSeqNo, int priority)
 {
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(m_db, "INSERT OR IGNORE INTO Task(deviceName, baseName, minSeqNo, maxSeqNo, "
-                           "priority) VALUES(?, ?, ?, ?, ?)",
-                     -1, &stmt, 0);
+  Statement stmt(*this, "INSERT OR IGNORE INTO Task(deviceName, baseName, minSeqNo, maxSeqNo, "
+                        "priority) VALUES(?, ?, ?, ?, ?)");
 
   sqlite3_bind_blob(stmt, 1, deviceName.wireEncode().wire(), deviceName.wireEncode().size(),
                     SQLITE_STATIC);
@@ -87,43 +137,136 @@ FetchTaskDb::addTask(const Name& deviceName, const Name& baseName, uint64_t minS
 
   if (res == SQLITE_OK) {
   }
-  sqlite3_finalize(stmt);
 }
 
 void
-FetchTaskDb::deleteTask(const Name& deviceName, const Name& baseName)
+FetchTaskDb::deleteTask(const Name& deviceName, const Name& baseName, uint64_t minSeqNo,
+                        uint64_t maxSeqNo)
 {
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(m_db, "DELETE FROM Task WHERE deviceName = ? AND baseName = ?;", -1, &stmt, 0);
+  m_pendingProgress.erase(makeTaskKey(deviceName, baseName, minSeqNo, maxSeqNo));
+
+  Statement stmt(*this, "DELETE FROM Task "
+                        "   WHERE deviceName = ? AND baseName = ? AND minSeqNo = ? AND maxSeqNo = ?;");
 
   sqlite3_bind_blob(stmt, 1, deviceName.wireEncode().wire(), deviceName.wireEncode().size(),
                     SQLITE_STATIC);
   sqlite3_bind_blob(stmt, 2, baseName.wireEncode().wire(), baseName.wireEncode().size(),
                     SQLITE_STATIC);
+  sqlite3_bind_int64(stmt, 3, minSeqNo);
+  sqlite3_bind_int64(stmt, 4, maxSeqNo);
 
   int res = sqlite3_step(stmt);
   if (res == SQLITE_OK) {
   }
-  sqlite3_finalize(stmt);
 }
 
 void
 FetchTaskDb::foreachTask(const FetchTaskCallback& callback)
 {
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(m_db, "SELECT * FROM Task;", -1, &stmt, 0);
+  Statement stmt(*this, "SELECT * FROM Task;");
   while (sqlite3_step(stmt) == SQLITE_ROW) {
     Name deviceName(Block(sqlite3_column_blob(stmt, 0), sqlite3_column_bytes(stmt, 0)));
     Name baseName(Block(sqlite3_column_blob(stmt, 1), sqlite3_column_bytes(stmt, 1)));
 
-    std::cout << "deviceName: " << deviceName << " baseName: " << baseName << std::endl;
+    _LOG_TRACE("deviceName: " << deviceName << " baseName: " << baseName);
     uint64_t minSeqNo = sqlite3_column_int64(stmt, 2);
     uint64_t maxSeqNo = sqlite3_column_int64(stmt, 3);
     int priority = sqlite3_column_int(stmt, 4);
     callback(deviceName, baseName, minSeqNo, maxSeqNo, priority);
   }
+}
+
+void
+FetchTaskDb::updateProgress(const Name& deviceName, const Name& baseName, uint64_t minSeqNo,
+                            uint64_t maxSeqNo, const SegmentRanges& received)
+{
+  Progress progress{minSeqNo, Buffer()};
+
+  SegmentRanges::const_iterator range = received.begin();
+  if (range != received.end() && range->first <= minSeqNo) {
+    progress.firstMissing = range->second + 1;
+    range++;
+  }
+
+  uint64_t previous = progress.firstMissing;
+  for (; range != received.end(); range++) {
+    appendVarNumber(progress.received, range->first - previous);
+    appendVarNumber(progress.received, range->second - range->first);
+    previous = range->second + 1;
+  }
 
-  sqlite3_finalize(stmt);
+  m_pendingProgress[makeTaskKey(deviceName, baseName, minSeqNo, maxSeqNo)] = progress;
+}
+
+void
+FetchTaskDb::flushProgress()
+{
+  if (m_pendingProgress.empty()) {
+    return;
+  }
+
+  sqlite3_exec(m_db, "BEGIN TRANSACTION;", 0, 0, 0);
+  for (const auto& task : m_pendingProgress) {
+    const Progress& progress = task.second;
+
+    Statement stmt(*this, "UPDATE Task SET progress = ?, received = ? "
+                          "WHERE deviceName = ? AND baseName = ? AND minSeqNo = ? AND maxSeqNo = ?");
+    sqlite3_bind_int64(stmt, 1, progress.firstMissing);
+    sqlite3_bind_blob(stmt, 2, progress.received.buf(), progress.received.size(), SQLITE_STATIC);
+    sqlite3_bind_blob(stmt, 3, task.first.deviceName.buf(), task.first.deviceName.size(),
+                      SQLITE_STATIC);
+    sqlite3_bind_blob(stmt, 4, task.first.baseName.buf(), task.first.baseName.size(),
+                      SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 5, task.first.minSeqNo);
+    sqlite3_bind_int64(stmt, 6, task.first.maxSeqNo);
+    sqlite3_step(stmt);
+  }
+  sqlite3_exec(m_db, "END TRANSACTION;", 0, 0, 0);
+
+  m_pendingProgress.clear();
+}
+
+FetchTaskDb::TaskKey
+FetchTaskDb::makeTaskKey(const Name& deviceName, const Name& baseName, uint64_t minSeqNo,
+                         uint64_t maxSeqNo)
+{
+  return TaskKey{Buffer(deviceName.wireEncode().wire(), deviceName.wireEncode().size()),
+                 Buffer(baseName.wireEncode().wire(), baseName.wireEncode().size()),
+                 minSeqNo, maxSeqNo};
+}
+
+void
+FetchTaskDb::foreachTaskProgress(const FetchTaskProgressCallback& callback)
+{
+  Statement stmt(*this, "SELECT deviceName, baseName, minSeqNo, maxSeqNo, priority, progress, "
+                        "       received "
+                        "   FROM Task");
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    Name deviceName(Block(sqlite3_column_blob(stmt, 0), sqlite3_column_bytes(stmt, 0)));
+    Name baseName(Block(sqlite3_column_blob(stmt, 1), sqlite3_column_bytes(stmt, 1)));
+    uint64_t minSeqNo = sqlite3_column_int64(stmt, 2);
+    uint64_t maxSeqNo = sqlite3_column_int64(stmt, 3);
+    int priority = sqlite3_column_int(stmt, 4);
+
+    SegmentRanges received;
+    if (sqlite3_column_type(stmt, 5) != SQLITE_NULL) {
+      uint64_t firstMissing = sqlite3_column_int64(stmt, 5);
+      if (firstMissing > minSeqNo) {
+        received.push_back(std::make_pair(minSeqNo, firstMissing - 1));
+      }
+
+      const uint8_t* begin = reinterpret_cast<const uint8_t*>(sqlite3_column_blob(stmt, 6));
+      const uint8_t* end = begin + sqlite3_column_bytes(stmt, 6);
+      uint64_t previous = firstMissing;
+      uint64_t distance, length;
+      while (readVarNumber(begin, end, distance) && readVarNumber(begin, end, length)) {
+        received.push_back(std::make_pair(previous + distance, previous + distance + length));
+        previous += distance + length + 1;
+      }
+    }
+
+    callback(deviceName, baseName, minSeqNo, maxSeqNo, priority, received);
+  }
 }
 
 } // chronoshare
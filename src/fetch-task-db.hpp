@@ -23,6 +23,7 @@
 
 #include "core/chronoshare-common.hpp"
 #include "db-helper.hpp"
+#include "receive-window.hpp"
 
 #include <ndn-cxx/name.hpp>
 
@@ -30,10 +31,13 @@
 
 #include <boost/filesystem.hpp>
 
+#include <map>
+#include <tuple>
+
 namespace ndn {
 namespace chronoshare {
 
-class FetchTaskDb
+class FetchTaskDb : public DbHelper
 {
 public:
   class Error : public DbHelper::Error
@@ -47,25 +51,75 @@ public:
   };
 
   typedef function<void(const Name&, const Name&, uint64_t, uint64_t, int)> FetchTaskCallback;
+  typedef function<void(const Name& deviceName, const Name& baseName, uint64_t minSeqNo,
+                        uint64_t maxSeqNo, int priority,
+                        const SegmentRanges& received)> FetchTaskProgressCallback;
 
 public:
   FetchTaskDb(const boost::filesystem::path& folder, const std::string& tag);
-  ~FetchTaskDb();
+  virtual ~FetchTaskDb();
 
-  // task with same deviceName and baseName combination will be added only once
+  // task with same deviceName, baseName and range combination will be added only once
   // if task already exists, this call does nothing
   void
   addTask(const Name& deviceName, const Name& baseName, uint64_t minSeqNo,
           uint64_t maxSeqNo, int priority);
 
   void
-  deleteTask(const Name& deviceName, const Name& baseName);
+  deleteTask(const Name& deviceName, const Name& baseName, uint64_t minSeqNo,
+             uint64_t maxSeqNo);
 
   void
   foreachTask(const FetchTaskCallback& callback);
 
+  /**
+   * @brief Record progress of the task fetching @p minSeqNo to @p maxSeqNo, which is written
+   *        by the next flushProgress()
+   * @param received  ranges of segments fetched already, in increasing order
+   */
+  void
+  updateProgress(const Name& deviceName, const Name& baseName, uint64_t minSeqNo,
+                 uint64_t maxSeqNo, const SegmentRanges& received);
+
+  /**
+   * @brief Write progress recorded since the last flush in one transaction
+   */
+  void
+  flushProgress();
+
+  /**
+   * @brief Call @p callback for every task, with the ranges of segments it fetched already
+   */
+  void
+  foreachTaskProgress(const FetchTaskProgressCallback& callback);
+
 private:
-  sqlite3* m_db;
+  // ranges of the same file, e.g., missing chunks, are separate tasks
+  struct TaskKey
+  {
+    Buffer deviceName;
+    Buffer baseName;
+    uint64_t minSeqNo;
+    uint64_t maxSeqNo;
+
+    bool
+    operator<(const TaskKey& other) const
+    {
+      return std::tie(deviceName, baseName, minSeqNo, maxSeqNo) <
+             std::tie(other.deviceName, other.baseName, other.minSeqNo, other.maxSeqNo);
+    }
+  };
+
+  static TaskKey
+  makeTaskKey(const Name& deviceName, const Name& baseName, uint64_t minSeqNo, uint64_t maxSeqNo);
+
+  struct Progress
+  {
+    uint64_t firstMissing; // all segments before it are fetched
+    Buffer received;       // encoded ranges of fetched segments after firstMissing
+  };
+
+  std::map<TaskKey, Progress> m_pendingProgress; // progress not written yet
 };
 
 typedef shared_ptr<FetchTaskDb> FetchTaskDbPtr;
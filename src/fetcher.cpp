@@ -36,7 +36,8 @@ Fetcher::Fetcher(Face& face,
                  const Name& deviceName, const Name& name, int64_t minSeqNo,
                  int64_t maxSeqNo,
                  boost::posix_time::time_duration timeout /* = boost::posix_time::seconds(30)*/,
-                 const Name& forwardingHint /* = Name()*/)
+                 const Name& forwardingHint /* = Name()*/,
+                 CongestionWindow::Algorithm congestionControl /* = ALGORITHM_AIMD*/)
   : m_face(face)
 
   , m_segmentCallback(segmentCallback)
@@ -53,13 +54,19 @@ Fetcher::Fetcher(Face& face,
 
   , m_minSendSeqNo(minSeqNo - 1)
   , m_maxInOrderRecvSeqNo(minSeqNo - 1)
-  // , m_minSeqNo(minSeqNo)
+  , m_segments(minSeqNo)
+  , m_minSeqNo(minSeqNo)
   , m_maxSeqNo(maxSeqNo)
 
-  , m_pipeline(6) // initial "congestion window"
+  , m_window(congestionControl)
+  , m_recoveryPoint(minSeqNo - 1)
   , m_activePipeline(0)
+  , m_nReceived(0)
+  , m_nTimeouts(0)
+  , m_nRetransmissions(0)
   , m_retryPause(0)
   , m_nextScheduledRetry(boost::date_time::second_clock<boost::posix_time::ptime>::universal_time())
+  , m_priority(0)
 
   , m_ioService(m_face.getIoService())
 {
@@ -86,19 +93,80 @@ Fetcher::SetForwardingHint(const Name& forwardingHint)
   m_forwardingHint = forwardingHint;
 }
 
+void
+Fetcher::SetSource(const Name& deviceName, const Name& name)
+{
+  m_deviceName = deviceName;
+  m_name = name;
+}
+
+int64_t
+Fetcher::GetRemainingSegments()
+{
+  boost::unique_lock<boost::mutex> lock(m_seqNoMutex);
+  return m_maxSeqNo - m_maxInOrderRecvSeqNo;
+}
+
+bool
+Fetcher::TruncateRange(int64_t nSegments, int64_t& minSeqNo, int64_t& maxSeqNo)
+{
+  boost::unique_lock<boost::mutex> lock(m_seqNoMutex);
+  if (m_maxSeqNo - m_maxInOrderRecvSeqNo <= nSegments) {
+    return false;
+  }
+
+  // segments already requested past the new end are still delivered, duplicates are harmless
+  minSeqNo = m_maxInOrderRecvSeqNo + nSegments + 1;
+  maxSeqNo = m_maxSeqNo;
+  m_maxSeqNo = minSeqNo - 1;
+  return true;
+}
+
+void
+Fetcher::MarkReceived(int64_t seqNo)
+{
+  boost::unique_lock<boost::mutex> lock(m_seqNoMutex);
+  m_segments.markReceived(seqNo);
+  m_maxInOrderRecvSeqNo = m_segments.getFirstMissing() - 1;
+}
+
+SegmentRanges
+Fetcher::GetReceivedRanges()
+{
+  boost::unique_lock<boost::mutex> lock(m_seqNoMutex);
+
+  SegmentRanges ranges;
+  if (m_maxInOrderRecvSeqNo >= m_minSeqNo) {
+    ranges.push_back(std::make_pair(m_minSeqNo, m_maxInOrderRecvSeqNo));
+  }
+  for (const auto& range : m_segments.getReceivedRanges()) {
+    ranges.push_back(range);
+  }
+  return ranges;
+}
+
+Fetcher::Stats
+Fetcher::GetStats()
+{
+  boost::unique_lock<boost::mutex> lock(m_seqNoMutex);
+  return Stats{m_rtt.getSmoothedRtt(), m_rtt.getRttVariation(), m_rtt.getRto(),
+               m_window.getWindow(), m_nReceived, m_nTimeouts, m_nRetransmissions};
+}
+
 void
 Fetcher::FillPipeline()
 {
-  for (; m_minSendSeqNo < m_maxSeqNo && m_activePipeline < m_pipeline; m_minSendSeqNo++) {
+  for (; m_minSendSeqNo < m_maxSeqNo && m_activePipeline < m_window.getWindow();
+       m_minSendSeqNo++) {
     boost::unique_lock<boost::mutex> lock(m_seqNoMutex);
 
-    if (m_outOfOrderRecvSeqNo.find(m_minSendSeqNo + 1) != m_outOfOrderRecvSeqNo.end())
+    if (m_segments.isReceived(m_minSendSeqNo + 1))
       continue;
 
-    if (m_inActivePipeline.find(m_minSendSeqNo + 1) != m_inActivePipeline.end())
+    if (m_segments.isPending(m_minSendSeqNo + 1))
       continue;
 
-    m_inActivePipeline.insert(m_minSendSeqNo + 1);
+    m_segments.markPending(m_minSendSeqNo + 1, std::chrono::steady_clock::now());
 
     _LOG_DEBUG(" >>> i " << Name(m_forwardingHint).append(m_name)
                          << ", seq = " << (m_minSendSeqNo + 1));
@@ -110,7 +178,7 @@ Fetcher::FillPipeline()
         .append(m_name)
         .appendNumber(m_minSendSeqNo + 1)); // Alex: this lifetime should be changed to RTO
     _LOG_DEBUG("interest Name: " << interest);
-    interest.setInterestLifetime(time::seconds(1));
+    interest.setInterestLifetime(time::milliseconds(static_cast<int64_t>(m_rtt.getRto().count())));
     m_face.expressInterest(interest,
                            bind(&Fetcher::OnData, this, m_minSendSeqNo + 1, _1, _2),
                            bind(&Fetcher::OnTimeout, this, m_minSendSeqNo + 1, _1));
@@ -169,30 +237,36 @@ Fetcher::OnData_Execute(uint64_t seqno, const Interest& interest, Data& data)
   ////////////////////////////////////////////////////////////////////////////
   boost::unique_lock<boost::mutex> lock(m_seqNoMutex);
 
-  m_outOfOrderRecvSeqNo.insert(seqno);
-  m_inActivePipeline.erase(seqno);
-  _LOG_DEBUG("Total segments received: " << m_outOfOrderRecvSeqNo.size());
-  std::set<int64_t>::iterator inOrderSeqNo = m_outOfOrderRecvSeqNo.begin();
-  for (; inOrderSeqNo != m_outOfOrderRecvSeqNo.end(); inOrderSeqNo++) {
-    _LOG_TRACE("Checking " << *inOrderSeqNo << " and " << m_maxInOrderRecvSeqNo + 1);
-    if (*inOrderSeqNo == m_maxInOrderRecvSeqNo + 1) {
-      m_maxInOrderRecvSeqNo = *inOrderSeqNo;
-    }
-    else if (*inOrderSeqNo < m_maxInOrderRecvSeqNo + 1) // not possible anymore, but just in case
-    {
-      continue;
+  m_nReceived++;
+
+  ReceiveWindow::TimePoint sendTime;
+  bool isRetransmitted = false;
+  if (m_segments.clearPending(seqno, sendTime, isRetransmitted)) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    // Karn's algorithm: data for a retransmitted Interest may answer any of its copies
+    if (!isRetransmitted) {
+      m_rtt.addMeasurement(now - sendTime);
     }
-    else
-      break;
+    m_window.increase(now);
   }
-  m_outOfOrderRecvSeqNo.erase(m_outOfOrderRecvSeqNo.begin(), inOrderSeqNo);
+  m_segments.markReceived(seqno);
+  m_maxInOrderRecvSeqNo = m_segments.getFirstMissing() - 1;
+  _LOG_DEBUG("Total segments received out of order: " << m_segments.getNReceivedOutOfOrder());
   ////////////////////////////////////////////////////////////////////////////
 
   _LOG_TRACE("Max in order received: " << m_maxInOrderRecvSeqNo
                                        << ", max seqNo to request: " << m_maxSeqNo);
 
-  if (m_maxInOrderRecvSeqNo == m_maxSeqNo) {
-    _LOG_TRACE("Fetch finished: " << m_name);
+  if (m_timedwait) {
+    // data for the part of the range that was given away after the fetch finished
+    return;
+  }
+
+  if (m_maxInOrderRecvSeqNo >= m_maxSeqNo) {
+    _LOG_DEBUG("Fetch finished: " << m_name << ", " << m_nReceived << " segments, srtt "
+               << m_rtt.getSmoothedRtt().count() << "ms, rto " << m_rtt.getRto().count()
+               << "ms, " << m_window.getAlgorithm() << " window " << m_window.getWindow() << ", "
+               << m_nTimeouts << " timeouts");
     m_active = false;
     // invoke callback
     if (m_finishCallback != nullptr) {
@@ -237,7 +311,10 @@ Fetcher::OnTimeout_Execute(uint64_t seqno, const Interest& interest)
     bool done = false;
     {
       boost::unique_lock<boost::mutex> lock(m_seqNoMutex);
-      m_inActivePipeline.erase(seqno);
+      m_nTimeouts++;
+      ReceiveWindow::TimePoint sendTime;
+      bool isRetransmitted;
+      m_segments.clearPending(seqno, sendTime, isRetransmitted);
       m_activePipeline--;
 
       if (m_activePipeline == 0) {
@@ -249,7 +326,7 @@ Fetcher::OnTimeout_Execute(uint64_t seqno, const Interest& interest)
       {
         boost::unique_lock<boost::mutex> lock(m_seqNoMutex);
         _LOG_DEBUG("Telling that fetch failed");
-        _LOG_DEBUG("Active pipeline size should be zero: " << m_inActivePipeline.size());
+        _LOG_DEBUG("Active pipeline size should be zero: " << m_segments.getNPending());
       }
 
       m_active = false;
@@ -260,10 +337,30 @@ Fetcher::OnTimeout_Execute(uint64_t seqno, const Interest& interest)
     }
   }
   else {
+    Interest retransmission(interest);
+    {
+      boost::unique_lock<boost::mutex> lock(m_seqNoMutex);
+      m_nTimeouts++;
+      m_nRetransmissions++;
+      m_rtt.backoff();
+
+      // losses of segments sent before the window was reduced do not reduce it again
+      if (static_cast<int64_t>(seqno) > m_recoveryPoint) {
+        m_window.decrease();
+        m_recoveryPoint = m_minSendSeqNo;
+        _LOG_DEBUG("Loss of seq = " << seqno << ", " << m_window.getAlgorithm() << " window "
+                   << m_window.getWindow() << ", rto " << m_rtt.getRto().count() << "ms");
+      }
+
+      m_segments.markRetransmitted(seqno);
+      retransmission.setInterestLifetime(time::milliseconds(static_cast<int64_t>(m_rtt.getRto().count())));
+    }
+    retransmission.refreshNonce();
+
     _LOG_DEBUG("Asking to reexpress seqno: " << seqno);
-    m_face.expressInterest(interest,
-                           bind(&Fetcher::OnData, this, seqno, _1, _2), // TODO: correct?
-                           bind(&Fetcher::OnTimeout, this, seqno, _1)); // TODO: correct?
+    m_face.expressInterest(retransmission,
+                           bind(&Fetcher::OnData, this, seqno, _1, _2),
+                           bind(&Fetcher::OnTimeout, this, seqno, _1));
   }
 }
 
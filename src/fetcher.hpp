@@ -22,11 +22,11 @@
 #define CHRONOSHARE_SRC_FETCHER_HPP
 
 #include "core/chronoshare-common.hpp"
+#include "congestion-control.hpp"
+#include "receive-window.hpp"
 
 #include <ndn-cxx/face.hpp>
 
-#include <set>
-
 #include <boost/intrusive/list.hpp>
 #include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <boost/thread.hpp>
@@ -44,6 +44,17 @@ public:
   typedef function<void(Fetcher&, const Name& deviceName, const Name& baseName)> OnFetchCompleteCallback;
   typedef function<void(Fetcher&)> OnFetchFailedCallback;
 
+  struct Stats
+  {
+    Milliseconds srtt; ///< zero until the first measurement
+    Milliseconds rttVar;
+    Milliseconds rto;
+    double window;
+    uint64_t nReceived;
+    uint64_t nTimeouts;
+    uint64_t nRetransmissions;
+  };
+
   Fetcher(Face& face,
           const SegmentCallback& segmentCallback, // callback passed by caller of FetchManager
           const FinishCallback& finishCallback,   // callback passed by caller of FetchManager
@@ -53,7 +64,8 @@ public:
           boost::posix_time::time_duration timeout =
             boost::posix_time::seconds(30), // this time is not precise, but sets min bound
                                             // actual time depends on how fast Interests timeout
-          const Name& forwardingHint = Name());
+          const Name& forwardingHint = Name(),
+          CongestionWindow::Algorithm congestionControl = CongestionWindow::ALGORITHM_AIMD);
   virtual ~Fetcher();
 
   bool
@@ -71,6 +83,26 @@ public:
   void
   SetForwardingHint(const Name& forwardingHint);
 
+  /**
+   * @brief Fetch the rest of the range as @p name from @p deviceName, which has the same content
+   */
+  void
+  SetSource(const Name& deviceName, const Name& name);
+
+  /**
+   * @brief Number of segments in the range that are not received yet in order
+   */
+  int64_t
+  GetRemainingSegments();
+
+  /**
+   * @brief Keep only the first @p nSegments remaining segments of the range, leaving the rest
+   *        (from @p minSeqNo to @p maxSeqNo) to another fetcher
+   * @return false if no more than @p nSegments segments remain
+   */
+  bool
+  TruncateRange(int64_t nSegments, int64_t& minSeqNo /*out*/, int64_t& maxSeqNo /*out*/);
+
   const Name&
   GetForwardingHint() const
   {
@@ -113,6 +145,48 @@ public:
     m_nextScheduledRetry = nextScheduledRetry;
   }
 
+  int
+  GetPriority() const
+  {
+    return m_priority;
+  }
+
+  void
+  SetPriority(int priority)
+  {
+    m_priority = priority;
+  }
+
+  int64_t
+  GetMinSeqNo() const
+  {
+    return m_minSeqNo;
+  }
+
+  int64_t
+  GetMaxSeqNo() const
+  {
+    return m_maxSeqNo;
+  }
+
+  /**
+   * @brief Skip @p seqNo, which was fetched before, e.g., before a restart
+   */
+  void
+  MarkReceived(int64_t seqNo);
+
+  /**
+   * @brief Get ranges of segments received so far
+   */
+  SegmentRanges
+  GetReceivedRanges();
+
+  /**
+   * @brief Round-trip time estimate, congestion window, and counters of the fetch
+   */
+  Stats
+  GetStats();
+
 private:
   void
   FillPipeline();
@@ -152,19 +226,25 @@ private:
 
   int64_t m_minSendSeqNo;
   int64_t m_maxInOrderRecvSeqNo;
-  std::set<int64_t> m_outOfOrderRecvSeqNo;
-  std::set<int64_t> m_inActivePipeline;
+  ReceiveWindow m_segments; // received and requested segments after m_maxInOrderRecvSeqNo
 
-  // int64_t m_minSeqNo;
+  int64_t m_minSeqNo;
   int64_t m_maxSeqNo;
 
-  uint32_t m_pipeline;
+  RttEstimator m_rtt;
+  CongestionWindow m_window;
+  int64_t m_recoveryPoint; // window is not reduced again for losses of segments up to this one
   uint32_t m_activePipeline;
 
+  uint64_t m_nReceived;
+  uint64_t m_nTimeouts;
+  uint64_t m_nRetransmissions;
+
   boost::posix_time::ptime m_lastPositiveActivity;
 
   double m_retryPause; // pause to stop trying to fetch(for fetch-manager)
   boost::posix_time::ptime m_nextScheduledRetry;
+  int m_priority; // priority in the fetch queue (for fetch-manager)
 
   boost::mutex m_seqNoMutex;
 
@@ -0,0 +1,162 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+
+#include "file-assembler.hpp"
+#include "core/logging.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace ndn {
+namespace chronoshare {
+
+INIT_LOGGER("FileAssembler")
+
+namespace fs = boost::filesystem;
+
+FileAssembler::FileAssembler(const fs::path& tempFile, const Buffer& hash, size_t segmentSize,
+                             uint64_t nSegments)
+  : m_tempFile(tempFile)
+  , m_hash(hash)
+  , m_segmentSize(segmentSize)
+  , m_nSegments(nSegments)
+  , m_segments(0)
+  , m_nHashedSegments(0)
+  , m_isCommitted(false)
+{
+  fs::create_directories(m_tempFile.parent_path());
+
+  m_fd = ::open(m_tempFile.c_str(), O_RDWR | O_CREAT, 0644);
+  if (m_fd < 0) {
+    BOOST_THROW_EXCEPTION(Error("Cannot open [" + m_tempFile.string() + "]: " +
+                                std::strerror(errno)));
+  }
+
+#ifdef __linux__
+  // the size grows as segments are written, so the last one determines it
+  if (m_nSegments > 1) {
+    ::fallocate(m_fd, FALLOC_FL_KEEP_SIZE, 0, (m_nSegments - 1) * m_segmentSize);
+  }
+#endif
+}
+
+FileAssembler::~FileAssembler()
+{
+  if (m_fd >= 0) {
+    ::close(m_fd);
+  }
+}
+
+void
+FileAssembler::addSegment(uint64_t segment, const uint8_t* buf, size_t size)
+{
+  if (m_isCommitted || segment >= m_nSegments ||
+      m_segments.isReceived(static_cast<int64_t>(segment))) {
+    return;
+  }
+
+  uint64_t offset = segment * m_segmentSize;
+  size_t written = 0;
+  while (written < size) {
+    ssize_t res = ::pwrite(m_fd, buf + written, size - written, offset + written);
+    if (res < 0) {
+      BOOST_THROW_EXCEPTION(Error("Cannot write to [" + m_tempFile.string() + "]: " +
+                                  std::strerror(errno)));
+    }
+    written += res;
+  }
+
+  m_segments.markReceived(static_cast<int64_t>(segment));
+
+  // segments that joined the in-order prefix
+  for (; m_nHashedSegments < static_cast<uint64_t>(m_segments.getFirstMissing());
+       m_nHashedSegments++) {
+    if (m_nHashedSegments == segment) {
+      m_digest.update(buf, size);
+    }
+    else {
+      hashRange(m_nHashedSegments * m_segmentSize, m_segmentSize);
+    }
+  }
+}
+
+void
+FileAssembler::sync()
+{
+  ::fdatasync(m_fd);
+}
+
+bool
+FileAssembler::commit(const fs::path& file)
+{
+  // segments written by an earlier assembler of the temporary file
+  for (; m_nHashedSegments < m_nSegments; m_nHashedSegments++) {
+    hashRange(m_nHashedSegments * m_segmentSize, m_segmentSize);
+  }
+
+  m_isCommitted = true;
+  if (*m_digest.computeDigest() != m_hash) {
+    _LOG_ERROR("Digest of [" << m_tempFile << "] does not match, discarding it");
+    fs::remove(m_tempFile);
+    return false;
+  }
+
+  ::fsync(m_fd);
+
+  fs::create_directories(file.parent_path());
+  fs::rename(m_tempFile, file);
+
+  // make the rename durable as well
+  int dirFd = ::open(file.parent_path().c_str(), O_RDONLY);
+  if (dirFd >= 0) {
+    ::fsync(dirFd);
+    ::close(dirFd);
+  }
+
+  _LOG_DEBUG("Assembled [" << file << "]");
+  return true;
+}
+
+size_t
+FileAssembler::hashRange(uint64_t offset, size_t size)
+{
+  Buffer buffer(size);
+  size_t nRead = 0;
+  while (nRead < size) {
+    ssize_t res = ::pread(m_fd, buffer.buf() + nRead, size - nRead, offset + nRead);
+    if (res < 0) {
+      BOOST_THROW_EXCEPTION(Error("Cannot read from [" + m_tempFile.string() + "]: " +
+                                  std::strerror(errno)));
+    }
+    if (res == 0) {
+      break;
+    }
+    nRead += res;
+  }
+
+  m_digest.update(buffer.buf(), nRead);
+  return nRead;
+}
+
+} // chronoshare
+} // ndn
@@ -0,0 +1,121 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+
+#ifndef CHRONOSHARE_SRC_FILE_ASSEMBLER_HPP
+#define CHRONOSHARE_SRC_FILE_ASSEMBLER_HPP
+
+#include "core/chronoshare-common.hpp"
+#include "receive-window.hpp"
+
+#include <ndn-cxx/util/digest.hpp>
+
+#include <boost/filesystem.hpp>
+
+namespace ndn {
+namespace chronoshare {
+
+class FileAssembler;
+typedef shared_ptr<FileAssembler> FileAssemblerPtr;
+
+/**
+ * @brief Writes segments of a fetched file directly into the file
+ *
+ * Segments are written at their offsets into a temporary file, in whatever order they arrive.
+ * The SHA-256 digest of the file is updated as the in-order prefix grows, segments that arrived
+ * ahead of the prefix are read back from the page cache, so the digest is ready when the last
+ * segment is written.  Only files published in fixed-size segments can be assembled this way.
+ *
+ * The temporary file is kept if the assembler is destroyed before commit(), an assembler of the
+ * same temporary file continues it, e.g., when the fetch is resumed after a restart.
+ */
+class FileAssembler : noncopyable
+{
+public:
+  class Error : public boost::exception,
+                public std::runtime_error
+  {
+  public:
+    explicit
+    Error(const std::string& what)
+      : std::runtime_error(what)
+    {
+    }
+  };
+
+public:
+  /**
+   * @param tempFile     temporary file on the same file system as the files it is committed to
+   * @param hash         SHA-256 digest of the file
+   * @param segmentSize  size of all segments except the last one
+   * @param nSegments    number of segments of the file
+   */
+  FileAssembler(const boost::filesystem::path& tempFile, const Buffer& hash, size_t segmentSize,
+                uint64_t nSegments);
+
+  ~FileAssembler();
+
+  /**
+   * @brief Write content of @p segment, segments written before are ignored
+   */
+  void
+  addSegment(uint64_t segment, const uint8_t* buf, size_t size);
+
+  /**
+   * @brief Make segments written so far durable
+   */
+  void
+  sync();
+
+  /**
+   * @brief Verify the digest, make the file durable, and atomically rename it to @p file
+   *
+   * Should be called once all segments are written.  Segments written by an earlier assembler
+   * of the temporary file are hashed here, as they are not known to this one.
+   *
+   * @return false if the digest does not match, in which case the temporary file is removed
+   */
+  bool
+  commit(const boost::filesystem::path& file);
+
+private:
+  /**
+   * @brief Read up to @p size bytes at @p offset into m_digest
+   * @return number of bytes read, less than @p size at the end of the file
+   */
+  size_t
+  hashRange(uint64_t offset, size_t size);
+
+private:
+  boost::filesystem::path m_tempFile;
+  Buffer m_hash;
+  size_t m_segmentSize;
+  uint64_t m_nSegments;
+  int m_fd;
+
+  ReceiveWindow m_segments;
+  util::Sha256 m_digest;
+  uint64_t m_nHashedSegments; // segments fed to m_digest, all of them are written
+  bool m_isCommitted;
+};
+
+} // chronoshare
+} // ndn
+
+#endif // CHRONOSHARE_SRC_FILE_ASSEMBLER_HPP
@@ -42,12 +42,14 @@ CREATE TABLE FileState(                                                \n\
     file_chmod  INTEGER,                                                \n\
     file_seg_num INTEGER,                                               \n\
     is_complete INTEGER,                                               \n\
+    file_seg_size INTEGER, /* NULL if unknown(1024) */                  \n\
                                                                         \n\
     PRIMARY KEY(type, filename)                                        \n\
 );                                                                      \n\
                                                                         \n\
 CREATE INDEX FileState_device_name_seq_no ON FileState(device_name, seq_no); \n\
 CREATE INDEX FileState_type_file_hash ON FileState(type, file_hash);   \n\
+CREATE INDEX FileState_type_directory ON FileState(type, directory);   \n\
 ";
 
 FileState::FileState(const boost::filesystem::path& path)
@@ -55,6 +57,14 @@ FileState::FileState(const boost::filesystem::path& path)
 {
   sqlite3_exec(m_db, INIT_DATABASE.c_str(), NULL, NULL, NULL);
   _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, "DB INIT: " << sqlite3_errmsg(m_db));
+
+  // databases created before the index was added
+  sqlite3_exec(m_db, "CREATE INDEX IF NOT EXISTS FileState_type_directory "
+                     "ON FileState(type, directory);",
+               NULL, NULL, NULL);
+
+  // databases created before segment size was recorded, fails if the column exists
+  sqlite3_exec(m_db, "ALTER TABLE FileState ADD COLUMN file_seg_size INTEGER;", NULL, NULL, NULL);
 }
 
 FileState::~FileState()
@@ -64,22 +74,23 @@ FileState::~FileState()
 void
 FileState::UpdateFile(const std::string& filename, sqlite3_int64 version, const Buffer& hash,
                       const Buffer& device_name, sqlite3_int64 seq_no, time_t atime,
-                      time_t mtime, time_t ctime, int mode, int seg_num)
+                      time_t mtime, time_t ctime, int mode, int seg_num, int seg_size)
 {
   _LOG_DEBUG("UpdateFile Triggered...");
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(m_db, "UPDATE FileState "
-                           "SET "
-                           "device_name=?, seq_no=?, "
-                           "version=?,"
-                           "file_hash=?,"
-                           "file_atime=datetime(?, 'unixepoch'),"
-                           "file_mtime=datetime(?, 'unixepoch'),"
-                           "file_ctime=datetime(?, 'unixepoch'),"
-                           "file_chmod=?, "
-                           "file_seg_num=? "
-                           "WHERE type=0 AND filename=?",
-                     -1, &stmt, 0);
+  Statement stmt(*this, "UPDATE FileState "
+                        "SET "
+                        "device_name=?, seq_no=?, "
+                        "version=?,"
+                        "file_hash=?,"
+                        "file_atime=datetime(?, 'unixepoch'),"
+                        "file_mtime=datetime(?, 'unixepoch'),"
+                        "file_ctime=datetime(?, 'unixepoch'),"
+                        "file_chmod=?, "
+                        "file_seg_num=?, "
+                        "file_seg_size=?, "
+                        // new content is incomplete until it is fetched or published
+                        "is_complete=CASE WHEN file_hash=?4 THEN is_complete END "
+                        "WHERE type=0 AND filename=?");
 
   sqlite3_bind_blob(stmt, 1, device_name.buf(), device_name.size(), SQLITE_STATIC);
   sqlite3_bind_int64(stmt, 2, seq_no);
@@ -90,57 +101,52 @@ FileState::UpdateFile(const std::string& filename, sqlite3_int64 version, const
   sqlite3_bind_int64(stmt, 7, ctime);
   sqlite3_bind_int(stmt, 8, mode);
   sqlite3_bind_int(stmt, 9, seg_num);
-  sqlite3_bind_text(stmt, 10, filename.c_str(), -1, SQLITE_STATIC);
+  if (seg_size > 0) {
+    sqlite3_bind_int(stmt, 10, seg_size);
+  }
+  sqlite3_bind_text(stmt, 11, filename.c_str(), -1, SQLITE_STATIC);
 
   sqlite3_step(stmt);
 
   _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_ROW && sqlite3_errcode(m_db) != SQLITE_DONE,
                   "UpdataeFile: " << sqlite3_errmsg(m_db));
 
-  sqlite3_finalize(stmt);
-
   int affected_rows = sqlite3_changes(m_db);
   if (affected_rows == 0) // file didn't exist
   {
-    sqlite3_stmt* stmt;
-    sqlite3_prepare_v2(
-      m_db, "INSERT INTO FileState "
-            "(type,filename,version,device_name,seq_no,file_hash,file_atime,file_mtime,file_ctime,"
-            "file_chmod,file_seg_num) "
-            "VALUES(0, ?, ?, ?, ?, ?, "
-            "datetime(?, 'unixepoch'), datetime(?, 'unixepoch'), datetime(?, 'unixepoch'), ?, ?)",
-      -1, &stmt, 0);
-
-    _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, "UpdateFile:(inside1) "
-                                                          << sqlite3_errmsg(m_db));
-
-    sqlite3_bind_text(stmt, 1, filename.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_int64(stmt, 2, version);
-    sqlite3_bind_blob(stmt, 3, device_name.buf(), device_name.size(), SQLITE_STATIC);
-    sqlite3_bind_int64(stmt, 4, seq_no);
-    sqlite3_bind_blob(stmt, 5, hash.buf(), hash.size(), SQLITE_STATIC);
-    sqlite3_bind_int64(stmt, 6, atime);
-    sqlite3_bind_int64(stmt, 7, mtime);
-    sqlite3_bind_int64(stmt, 8, ctime);
-    sqlite3_bind_int(stmt, 9, mode);
-    sqlite3_bind_int(stmt, 10, seg_num);
-
-    sqlite3_step(stmt);
+    Statement insertStmt(*this,
+                         "INSERT INTO FileState "
+                         "(type,filename,version,device_name,seq_no,file_hash,file_atime,file_mtime,"
+                         "file_ctime,file_chmod,file_seg_num,file_seg_size) "
+                         "VALUES(0, ?, ?, ?, ?, ?, "
+                         "datetime(?, 'unixepoch'), datetime(?, 'unixepoch'), "
+                         "datetime(?, 'unixepoch'), ?, ?, ?)");
+
+    sqlite3_bind_text(insertStmt, 1, filename.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(insertStmt, 2, version);
+    sqlite3_bind_blob(insertStmt, 3, device_name.buf(), device_name.size(), SQLITE_STATIC);
+    sqlite3_bind_int64(insertStmt, 4, seq_no);
+    sqlite3_bind_blob(insertStmt, 5, hash.buf(), hash.size(), SQLITE_STATIC);
+    sqlite3_bind_int64(insertStmt, 6, atime);
+    sqlite3_bind_int64(insertStmt, 7, mtime);
+    sqlite3_bind_int64(insertStmt, 8, ctime);
+    sqlite3_bind_int(insertStmt, 9, mode);
+    sqlite3_bind_int(insertStmt, 10, seg_num);
+    if (seg_size > 0) {
+      sqlite3_bind_int(insertStmt, 11, seg_size);
+    }
+
+    sqlite3_step(insertStmt);
     _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE, "UpdateFile:(inside2) "
                                                             << sqlite3_errmsg(m_db));
-    sqlite3_finalize(stmt);
 
-    sqlite3_prepare_v2(m_db,
-                       "UPDATE FileState SET directory=directory_name(filename) WHERE filename=?",
-                       -1, &stmt, 0);
-    _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, "UpdateFile:(inside3) "
-                                                          << sqlite3_errmsg(m_db));
+    Statement dirStmt(*this,
+                      "UPDATE FileState SET directory=directory_name(filename) WHERE filename=?");
 
-    sqlite3_bind_text(stmt, 1, filename.c_str(), -1, SQLITE_STATIC);
-    sqlite3_step(stmt);
+    sqlite3_bind_text(dirStmt, 1, filename.c_str(), -1, SQLITE_STATIC);
+    sqlite3_step(dirStmt);
     _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE, "UpdateFile:(inside4) "
                                                             << sqlite3_errmsg(m_db));
-    sqlite3_finalize(stmt);
   }
 }
 
@@ -148,31 +154,38 @@ void
 FileState::DeleteFile(const std::string& filename)
 {
 
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(m_db, "DELETE FROM FileState WHERE type=0 AND filename=?", -1, &stmt, 0);
+  Statement stmt(*this, "DELETE FROM FileState WHERE type=0 AND filename=?");
   sqlite3_bind_text(stmt, 1, filename.c_str(), -1, SQLITE_STATIC);
 
   _LOG_DEBUG("Delete " << filename);
 
   sqlite3_step(stmt);
   _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE, "DeleteFile " << sqlite3_errmsg(m_db));
-  sqlite3_finalize(stmt);
 }
 
 void
 FileState::SetFileComplete(const std::string& filename)
 {
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(m_db, "UPDATE FileState SET is_complete=1 WHERE type = 0 AND filename = ?", -1,
-                     &stmt, 0);
-  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, "SetFileComplete:1 " << sqlite3_errmsg(m_db));
+  Statement stmt(*this, "UPDATE FileState SET is_complete=1 WHERE type = 0 AND filename = ?");
   sqlite3_bind_text(stmt, 1, filename.c_str(), -1, SQLITE_STATIC);
 
   sqlite3_step(stmt);
   _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE, "SetFileComplete:2 "
                                                           << sqlite3_errmsg(m_db));
+}
+
+void
+FileState::BeginUpdates()
+{
+  sqlite3_exec(m_db, "BEGIN TRANSACTION;", 0, 0, 0);
+  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, "BeginUpdates: " << sqlite3_errmsg(m_db));
+}
 
-  sqlite3_finalize(stmt);
+void
+FileState::CommitUpdates()
+{
+  sqlite3_exec(m_db, "END TRANSACTION;", 0, 0, 0);
+  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, "CommitUpdates: " << sqlite3_errmsg(m_db));
 }
 
 /**
@@ -181,13 +194,10 @@ FileState::SetFileComplete(const std::string& filename)
 FileItemPtr
 FileState::LookupFile(const std::string& filename)
 {
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(m_db, "SELECT filename,version,device_name,seq_no,file_hash,strftime('%s', "
-                           "file_mtime),file_chmod,file_seg_num,is_complete "
-                           "       FROM FileState "
-                           "       WHERE type = 0 AND filename = ?",
-                     -1, &stmt, 0);
-  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, "LookupFile before" << sqlite3_errmsg(m_db));
+  Statement stmt(*this, "SELECT filename,version,device_name,seq_no,file_hash,strftime('%s', "
+                        "file_mtime),file_chmod,file_seg_num,is_complete,file_seg_size "
+                        "       FROM FileState "
+                        "       WHERE type = 0 AND filename = ?");
   sqlite3_bind_text(stmt, 1, filename.c_str(), -1, SQLITE_STATIC);
 
   FileItemPtr retval;
@@ -203,10 +213,12 @@ FileState::LookupFile(const std::string& filename)
     retval->set_mode(sqlite3_column_int(stmt, 6));
     retval->set_seg_num(sqlite3_column_int64(stmt, 7));
     retval->set_is_complete(sqlite3_column_int(stmt, 8));
+    if (sqlite3_column_type(stmt, 9) != SQLITE_NULL) {
+      retval->set_seg_size(sqlite3_column_int(stmt, 9));
+    }
   }
   _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE, "LookupFile after "
                                                           << sqlite3_errmsg(m_db));
-  sqlite3_finalize(stmt);
 
   return retval;
 }
@@ -214,14 +226,10 @@ FileState::LookupFile(const std::string& filename)
 FileItemsPtr
 FileState::LookupFilesForHash(const Buffer& hash)
 {
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(m_db, "SELECT filename,version,device_name,seq_no,file_hash,strftime('%s', "
-                           "file_mtime),file_chmod,file_seg_num,is_complete "
-                           "   FROM FileState "
-                           "   WHERE type = 0 AND file_hash = ?",
-                     -1, &stmt, 0);
-  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK,
-                  "LookupFilesForHash before bind: " << sqlite3_errmsg(m_db));
+  Statement stmt(*this, "SELECT filename,version,device_name,seq_no,file_hash,strftime('%s', "
+                        "file_mtime),file_chmod,file_seg_num,is_complete,file_seg_size "
+                        "   FROM FileState "
+                        "   WHERE type = 0 AND file_hash = ?");
   sqlite3_bind_blob(stmt, 1, hash.buf(), hash.size(), SQLITE_STATIC);
   _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK,
                   "LookupFilesForHash after bind: " << sqlite3_errmsg(m_db));
@@ -239,14 +247,15 @@ FileState::LookupFilesForHash(const Buffer& hash)
     file.set_mode(sqlite3_column_int(stmt, 6));
     file.set_seg_num(sqlite3_column_int64(stmt, 7));
     file.set_is_complete(sqlite3_column_int(stmt, 8));
+    if (sqlite3_column_type(stmt, 9) != SQLITE_NULL) {
+      file.set_seg_size(sqlite3_column_int(stmt, 9));
+    }
 
     retval->push_back(file);
   }
   _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE,
                   "LookupFilesForHash finish: " << sqlite3_errmsg(m_db));
 
-  sqlite3_finalize(stmt);
-
   return retval;
 }
 
@@ -254,13 +263,11 @@ void
 FileState::LookupFilesInFolder(const function<void(const FileItem&)>& visitor,
                                const std::string& folder, int offset /*=0*/, int limit /*=-1*/)
 {
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(m_db, "SELECT filename,version,device_name,seq_no,file_hash,strftime('%s', "
-                           "file_mtime),file_chmod,file_seg_num,is_complete "
-                           "   FROM FileState "
-                           "   WHERE type = 0 AND directory = ?"
-                           "   LIMIT ? OFFSET ?",
-                     -1, &stmt, 0);
+  Statement stmt(*this, "SELECT filename,version,device_name,seq_no,file_hash,strftime('%s', "
+                        "file_mtime),file_chmod,file_seg_num,is_complete,file_seg_size "
+                        "   FROM FileState "
+                        "   WHERE type = 0 AND directory = ?"
+                        "   LIMIT ? OFFSET ?");
   if (folder.size() == 0)
     sqlite3_bind_null(stmt, 1);
   else
@@ -281,14 +288,15 @@ FileState::LookupFilesInFolder(const function<void(const FileItem&)>& visitor,
     file.set_mode(sqlite3_column_int(stmt, 6));
     file.set_seg_num(sqlite3_column_int64(stmt, 7));
     file.set_is_complete(sqlite3_column_int(stmt, 8));
+    if (sqlite3_column_type(stmt, 9) != SQLITE_NULL) {
+      file.set_seg_size(sqlite3_column_int(stmt, 9));
+    }
 
     visitor(file);
   }
 
   _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE, "LookupFilesInFolder "
                                                           << sqlite3_errmsg(m_db));
-
-  sqlite3_finalize(stmt);
 }
 
 FileItemsPtr
@@ -313,44 +321,89 @@ FileState::LookupFilesInFolderRecursively(const function<void(const FileItem&)>&
   if (limit >= 0)
     limit++;
 
-  sqlite3_stmt* stmt;
   if (folder != "") {
-    /// @todo Do something to improve efficiency of this query. Right now it is basically scanning
-    /// the whole database
-
-    sqlite3_prepare_v2(m_db, "SELECT filename,version,device_name,seq_no,file_hash,strftime('%s', "
-                             "file_mtime),file_chmod,file_seg_num,is_complete "
-                             "   FROM FileState "
-                             "   WHERE type = 0 AND is_dir_prefix(?, directory)=1 "
-                             "   ORDER BY filename "
-                             "   LIMIT ? OFFSET ?",
-                       -1, &stmt, 0); // there is a small ambiguity with is_prefix matching, but
-                                      // should be ok for now
-    _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, "LookupFilesInFolderRecursively before bind"
-                                                          << sqlite3_errmsg(m_db));
-
-    sqlite3_bind_text(stmt, 1, folder.c_str(), folder.size(), SQLITE_STATIC);
+    // files under the folder are exactly those with filename in ["folder/", "folder0"), as '0'
+    // follows '/'; the range is scanned using the primary key
+    std::string from = folder + "/";
+    std::string to = folder + "0";
+
+    Statement stmt(*this, "SELECT filename,version,device_name,seq_no,file_hash,strftime('%s', "
+                          "file_mtime),file_chmod,file_seg_num,is_complete,file_seg_size "
+                          "   FROM FileState "
+                          "   WHERE type = 0 AND filename >= ? AND filename < ? "
+                          "   ORDER BY filename "
+                          "   LIMIT ? OFFSET ?");
+
+    sqlite3_bind_text(stmt, 1, from.c_str(), from.size(), SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, to.c_str(), to.size(), SQLITE_STATIC);
     _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, "LookupFilesInFolderRecursively after bind"
                                                           << sqlite3_errmsg(m_db));
 
-    sqlite3_bind_int(stmt, 2, limit);
-    sqlite3_bind_int(stmt, 3, offset);
+    sqlite3_bind_int(stmt, 3, limit);
+    sqlite3_bind_int(stmt, 4, offset);
+
+    return VisitFiles(stmt, visitor, limit);
   }
   else {
-    sqlite3_prepare_v2(m_db, "SELECT filename,version,device_name,seq_no,file_hash,strftime('%s', "
-                             "file_mtime),file_chmod,file_seg_num,is_complete "
-                             "   FROM FileState "
-                             "   WHERE type = 0"
-                             "   ORDER BY filename "
-                             "   LIMIT ? OFFSET ?",
-                       -1, &stmt, 0);
+    Statement stmt(*this, "SELECT filename,version,device_name,seq_no,file_hash,strftime('%s', "
+                          "file_mtime),file_chmod,file_seg_num,is_complete,file_seg_size "
+                          "   FROM FileState "
+                          "   WHERE type = 0"
+                          "   ORDER BY filename "
+                          "   LIMIT ? OFFSET ?");
     sqlite3_bind_int(stmt, 1, limit);
     sqlite3_bind_int(stmt, 2, offset);
+
+    return VisitFiles(stmt, visitor, limit);
+  }
+}
+
+bool
+FileState::LookupFilesInFolderRecursively(const function<void(const FileItem&)>& visitor,
+                                          const std::string& folder,
+                                          const std::string& afterFilename, int limit)
+{
+  _LOG_DEBUG("LookupFilesInFolderRecursively: [" << folder << "] after [" << afterFilename << "]");
+
+  if (limit >= 0)
+    limit++;
+
+  if (folder != "") {
+    std::string from = std::max(folder + "/", afterFilename);
+    std::string to = folder + "0";
+
+    Statement stmt(*this, "SELECT filename,version,device_name,seq_no,file_hash,strftime('%s', "
+                          "file_mtime),file_chmod,file_seg_num,is_complete,file_seg_size "
+                          "   FROM FileState "
+                          "   WHERE type = 0 AND filename > ? AND filename < ? "
+                          "   ORDER BY filename "
+                          "   LIMIT ?");
+
+    sqlite3_bind_text(stmt, 1, from.c_str(), from.size(), SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, to.c_str(), to.size(), SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 3, limit);
+
+    return VisitFiles(stmt, visitor, limit);
   }
+  else {
+    Statement stmt(*this, "SELECT filename,version,device_name,seq_no,file_hash,strftime('%s', "
+                          "file_mtime),file_chmod,file_seg_num,is_complete,file_seg_size "
+                          "   FROM FileState "
+                          "   WHERE type = 0 AND filename > ? "
+                          "   ORDER BY filename "
+                          "   LIMIT ?");
+
+    sqlite3_bind_text(stmt, 1, afterFilename.c_str(), afterFilename.size(), SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, limit);
 
-  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, "LookupFilesInFolderRecursively before while"
-                                                        << sqlite3_errmsg(m_db));
+    return VisitFiles(stmt, visitor, limit);
+  }
+}
 
+bool
+FileState::VisitFiles(sqlite3_stmt* stmt, const function<void(const FileItem&)>& visitor,
+                      int limit)
+{
   while (sqlite3_step(stmt) == SQLITE_ROW) {
     if (limit == 1)
       break;
@@ -366,6 +419,9 @@ FileState::LookupFilesInFolderRecursively(const function<void(const FileItem&)>&
     file.set_mode(sqlite3_column_int(stmt, 6));
     file.set_seg_num(sqlite3_column_int64(stmt, 7));
     file.set_is_complete(sqlite3_column_int(stmt, 8));
+    if (sqlite3_column_type(stmt, 9) != SQLITE_NULL) {
+      file.set_seg_size(sqlite3_column_int(stmt, 9));
+    }
 
     visitor(file);
     limit--;
@@ -374,11 +430,19 @@ FileState::LookupFilesInFolderRecursively(const function<void(const FileItem&)>&
   _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE,
                   "LookupFilesInFolderRecursively finish: " << sqlite3_errmsg(m_db));
 
-  sqlite3_finalize(stmt);
-
   return (limit == 1);
 }
 
+void
+FileState::LookupIncompleteFiles(const function<void(const FileItem&)>& visitor)
+{
+  Statement stmt(*this, "SELECT filename,version,device_name,seq_no,file_hash,strftime('%s', "
+                        "file_mtime),file_chmod,file_seg_num,is_complete,file_seg_size "
+                        "   FROM FileState "
+                        "   WHERE type = 0 AND (is_complete IS NULL OR is_complete = 0)");
+  VisitFiles(stmt, visitor, -1);
+}
+
 FileItemsPtr
 FileState::LookupFilesInFolderRecursively(const std::string& folder, int offset /*=0*/,
                                           int limit /*=-1*/)
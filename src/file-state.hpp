@@ -43,11 +43,12 @@ public:
 
   /**
    * @brief Update or add a file
+   * @param seg_size size of the segments the file was published with, 0 if unknown
    */
   void
   UpdateFile(const std::string& filename, sqlite3_int64 version, const Buffer& hash,
              const Buffer& device_name, sqlite3_int64 seqno, time_t atime, time_t mtime,
-             time_t ctime, int mode, int seg_num);
+             time_t ctime, int mode, int seg_num, int seg_size);
 
   /**
    * @brief Delete file
@@ -64,6 +65,15 @@ public:
   void
   SetFileComplete(const std::string& filename);
 
+  /**
+   * @brief Group subsequent updates of FileState into one transaction, until CommitUpdates()
+   */
+  void
+  BeginUpdates();
+
+  void
+  CommitUpdates();
+
   /**
    * @brief Lookup file state using file name
    */
@@ -97,12 +107,35 @@ public:
   LookupFilesInFolderRecursively(const function<void(const FileItem&)>& visitor,
                                  const std::string& folder, int offset = 0, int limit = -1);
 
+  /**
+   * @brief Recursively lookup up to [limit] files in the specified folder whose names follow
+   *        [afterFilename] and call visitor(file) for each file
+   */
+  bool
+  LookupFilesInFolderRecursively(const function<void(const FileItem&)>& visitor,
+                                 const std::string& folder, const std::string& afterFilename,
+                                 int limit);
+
   /**
    * @brief Recursively lookup all files in the specified folder(wrapper around the overloaded
    * version)
    */
   FileItemsPtr
   LookupFilesInFolderRecursively(const std::string& folder, int offset = 0, int limit = -1);
+
+  /**
+   * @brief Lookup files that are not fetched yet and call visitor(file) for each file
+   */
+  void
+  LookupIncompleteFiles(const function<void(const FileItem&)>& visitor);
+
+private:
+  /**
+   * @brief Step through rows of a FileState SELECT and call visitor for up to (limit - 1) of them
+   * @return true if more rows are available
+   */
+  bool
+  VisitFiles(sqlite3_stmt* stmt, const function<void(const FileItem&)>& visitor, int limit);
 };
 
 typedef shared_ptr<FileState> FileStatePtr;
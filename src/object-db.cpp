@@ -22,8 +22,7 @@
 #include "db-helper.hpp"
 #include "core/logging.hpp"
 
-#include <iostream>
-#include <sys/stat.h>
+#include <ndn-cxx/util/string-helper.hpp>
 
 namespace ndn {
 namespace chronoshare {
@@ -32,119 +31,56 @@ INIT_LOGGER("Object.Db")
 
 namespace fs = boost::filesystem;
 
-const std::string INIT_DATABASE = "\
-CREATE TABLE                                                            \n \
-    File(                                                               \n\
-        device_name     BLOB NOT NULL,                                  \n\
-        segment         INTEGER,                                        \n\
-        content_object  BLOB,                                           \n\
-                                                                        \
-        PRIMARY KEY(device_name, segment)                              \n\
-    );                                                                  \n\
-CREATE INDEX device ON File(device_name);                               \n\
-";
-
-ObjectDb::ObjectDb(const fs::path& folder, const std::string& hash)
-  : m_lastUsed(std::time(NULL))
+ObjectDb::ObjectDb(const fs::path& folder, const std::string& hash, const std::string& layout)
+  : m_store(ObjectStore::open(folder))
+  , m_hash(*fromHex(hash))
+  , m_layout(layout)
+  , m_partialLayout(ObjectStore::makePartialLayout(layout))
+  , m_lastUsed(std::time(NULL))
 {
-  fs::path actualFolder = folder / "objects" / hash.substr(0, 2);
-  _LOG_DEBUG("actualFolder: " << actualFolder << " hash:" << hash);
-  fs::create_directories(actualFolder);
-
-  _LOG_DEBUG("Open " << (actualFolder / hash.substr(2, hash.size() - 2)));
-
-  int res = sqlite3_open((actualFolder / hash.substr(2, hash.size() - 2)).c_str(), &m_db);
-  if (res != SQLITE_OK) {
-    BOOST_THROW_EXCEPTION(Error(
-                            "Cannot open/create dabatabase: ["
-                            + (actualFolder / hash.substr(2, hash.size() - 2)).string() + "]"));
-  }
-
-  // Alex: determine if tables initialized. if not, initialize... not sure what is the best way to
-  // go...
-  // for now, just attempt to create everything
-
-  char* errmsg = 0;
-  res = sqlite3_exec(m_db, INIT_DATABASE.c_str(), NULL, NULL, &errmsg);
-  if (res != SQLITE_OK && errmsg != 0) {
-    // _LOG_TRACE("Init \"error\": " << errmsg);
-    sqlite3_free(errmsg);
-  }
-
-  // _LOG_DEBUG("open db");
-
-  willStartSave();
+  _LOG_DEBUG("Open " << hash << " in " << folder);
 }
 
 bool
 ObjectDb::DoesExist(const boost::filesystem::path& folder, const Name& deviceName,
                     const std::string& hash)
 {
-  fs::path actualFolder = folder / "objects" / hash.substr(0, 2);
-  bool retval = false;
-
-  sqlite3* db;
-  int res = sqlite3_open((actualFolder / hash.substr(2, hash.size() - 2)).c_str(), &db);
-  if (res == SQLITE_OK) {
-    sqlite3_stmt* stmt;
-    sqlite3_prepare_v2(
-      db, "SELECT count(*), count(nullif (content_object,0)) FROM File WHERE device_name=?", -1,
-      &stmt, 0);
-
-    sqlite3_bind_blob(stmt, 1, deviceName.wireEncode().wire(), deviceName.wireEncode().size(),
-                      SQLITE_TRANSIENT);
-
-    int res = sqlite3_step(stmt);
-    if (res == SQLITE_ROW) {
-      int countAll = sqlite3_column_int(stmt, 0);
-      int countNonNull = sqlite3_column_int(stmt, 1);
-
-      _LOG_TRACE("Total segments: " << countAll << ", non-empty segments: " << countNonNull);
-
-      if (countAll > 0 && countAll == countNonNull) {
-        retval = true;
-      }
-    }
-
-    sqlite3_finalize(stmt);
-  }
+  return ObjectStore::open(folder)->hasObject(*fromHex(hash), deviceName);
+}
 
-  sqlite3_close(db);
-  return retval;
+bool
+ObjectDb::AddAlias(const boost::filesystem::path& folder, const Name& deviceName,
+                   const std::string& hash, const std::string& layout)
+{
+  return ObjectStore::open(folder)->addAlias(*fromHex(hash), deviceName, layout);
 }
 
 ObjectDb::~ObjectDb()
 {
   didStopSave();
-
-  // _LOG_DEBUG("close db");
-  int res = sqlite3_close(m_db);
-  if (res != SQLITE_OK) {
-    // complain
-  }
 }
 
 void
 ObjectDb::saveContentObject(const Name& deviceName, sqlite3_int64 segment,
                             const Data& data)
 {
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(m_db, "INSERT INTO File "
-                           "(device_name, segment, content_object) "
-                           "VALUES(?, ?, ?)",
-                     -1, &stmt, 0);
-
   _LOG_DEBUG("Saving content object for [" << deviceName << ", seqno: " << segment
                                            << ", size: " << data.wireEncode().size() << "]");
 
-  sqlite3_bind_blob(stmt, 1, deviceName.wireEncode().wire(), deviceName.wireEncode().size(),
-                    SQLITE_STATIC);
-  sqlite3_bind_int64(stmt, 2, segment);
-  sqlite3_bind_blob(stmt, 3, data.wireEncode().wire(), data.wireEncode().size(), SQLITE_STATIC);
+  if (m_layout.empty()) {
+    BOOST_THROW_EXCEPTION(Error("Cannot save segments without knowing their layout"));
+  }
+
+  const Block& deviceBlock = deviceName.wireEncode();
+  Buffer device(deviceBlock.wire(), deviceBlock.size());
+  m_pendingAliases.insert(device);
 
-  sqlite3_step(stmt);
-  //_LOG_DEBUG("After saving object: " << sqlite3_errmsg(m_db));
-  sqlite3_finalize(stmt);
+  // the first saved copy of a segment wins, whichever device it is from
+  ObjectStore::Location location;
+  if (m_pending.count(segment) == 0 && !m_store->lookup(m_hash, m_layout, segment, location) &&
+      !m_store->lookup(m_hash, m_partialLayout, segment, location)) {
+    m_pending[segment] = ObjectStore::IndexEntry{device, segment, m_store->append(data)};
+  }
 
   // update last used time
   m_lastUsed = std::time(NULL);
@@ -153,33 +89,53 @@ ObjectDb::saveContentObject(const Name& deviceName, sqlite3_int64 segment,
 BufferPtr
 ObjectDb::fetchSegment(const Name& deviceName, sqlite3_int64 segment)
 {
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(m_db, "SELECT content_object FROM File WHERE device_name=? AND segment=?", -1,
-                     &stmt, 0);
-
-  sqlite3_bind_blob(stmt, 1, deviceName.wireEncode().wire(), deviceName.wireEncode().size(),
-                    SQLITE_TRANSIENT);
+  shared_ptr<Data> data = fetchSegmentData(deviceName, segment);
+  if (!data) {
+    return BufferPtr();
+  }
+  return make_shared<Buffer>(data->getContent().value(), data->getContent().value_size());
+}
 
-  sqlite3_bind_int64(stmt, 2, segment);
+shared_ptr<Data>
+ObjectDb::fetchSegmentData(const Name& deviceName, sqlite3_int64 segment)
+{
+  shared_ptr<Data> data;
+
+  ObjectStore::Location location;
+  bool isFound = false;
+  if (!m_pendingAliases.empty()) {
+    // the alias of the device is not committed yet
+    const Block& deviceBlock = deviceName.wireEncode();
+    if (m_pendingAliases.count(Buffer(deviceBlock.wire(), deviceBlock.size())) > 0) {
+      auto pending = m_pending.find(segment);
+      if (pending != m_pending.end()) {
+        location = pending->second.location;
+        isFound = true;
+      }
+      else {
+        isFound = m_store->lookup(m_hash, m_layout, segment, location) ||
+                  m_store->lookup(m_hash, m_partialLayout, segment, location);
+      }
+    }
+  }
 
-  BufferPtr ret;
-  shared_ptr<Data> data = make_shared<Data>();
+  if (!isFound) {
+    isFound = m_store->lookup(m_hash, deviceName, segment, location);
+  }
 
-  int res = sqlite3_step(stmt);
-  if (res == SQLITE_ROW) {
-    //      const unsigned char *buf = reinterpret_cast<const unsigned
-    //      char*>(sqlite3_column_blob(stmt, 0));
-    data->wireDecode(Block(sqlite3_column_blob(stmt, 0), sqlite3_column_bytes(stmt, 0)));
-    ret =
-      make_shared<Buffer>(data->getContent().value(), data->getContent().value_size());
+  if (!isFound) {
+    // segment was not fetched, as the same content is stored for another file
+    isFound = m_store->lookupChunk(m_hash, deviceName, segment, location);
   }
 
-  sqlite3_finalize(stmt);
+  if (isFound) {
+    data = m_store->read(location);
+  }
 
   // update last used time
   m_lastUsed = std::time(NULL);
 
-  return ret;
+  return data;
 }
 
 time_t
@@ -189,17 +145,46 @@ ObjectDb::secondsSinceLastUse()
 }
 
 void
-ObjectDb::willStartSave()
+ObjectDb::commitPartial()
 {
-  sqlite3_exec(m_db, "BEGIN TRANSACTION;", 0, 0, 0);
-  // _LOG_DEBUG("Open transaction: " << sqlite3_errmsg(m_db));
+  if (m_pending.empty()) {
+    return;
+  }
+
+  std::vector<ObjectStore::IndexEntry> entries;
+  entries.reserve(m_pending.size());
+  for (const auto& pending : m_pending) {
+    entries.push_back(pending.second);
+  }
+
+  m_store->commit(m_hash, m_partialLayout, {}, entries);
+  m_pending.clear();
+}
+
+void
+ObjectDb::suspend()
+{
+  commitPartial();
+  m_pendingAliases.clear();
 }
 
 void
 ObjectDb::didStopSave()
 {
-  sqlite3_exec(m_db, "END TRANSACTION;", 0, 0, 0);
-  // _LOG_DEBUG("Close transaction: " << sqlite3_errmsg(m_db));
+  if (m_pending.empty() && m_pendingAliases.empty()) {
+    return;
+  }
+
+  std::vector<ObjectStore::IndexEntry> entries;
+  entries.reserve(m_pending.size());
+  for (const auto& pending : m_pending) {
+    entries.push_back(pending.second);
+  }
+
+  m_store->commit(m_hash, m_layout,
+                  std::vector<Buffer>(m_pendingAliases.begin(), m_pendingAliases.end()), entries);
+  m_pending.clear();
+  m_pendingAliases.clear();
 }
 
 } // chronoshare
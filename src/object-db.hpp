@@ -23,10 +23,13 @@
 
 #include "core/chronoshare-common.hpp"
 #include "db-helper.hpp"
+#include "object-store.hpp"
 
 #include <sqlite3.h>
 
 #include <ctime>
+#include <map>
+#include <set>
 #include <vector>
 
 #include <ndn-cxx/name.hpp>
@@ -37,7 +40,20 @@
 namespace ndn {
 namespace chronoshare {
 
-class ObjectDb {
+/**
+ * @brief Segments of one file (identified by its hash) in the ObjectStore of a folder
+ *
+ * Segments are looked up by the name of a device publishing the file, and any device's copy in
+ * the same layout satisfies the lookup.  Segments are saved in the layout given to the
+ * constructor, the first saved copy of a segment wins.
+ *
+ * Segments saved through an ObjectDb become visible to other ObjectDb instances and to
+ * DoesExist() only when the ObjectDb is destroyed.  Segments of a file that is still being
+ * fetched can be committed earlier in the partial layout of the file, where the next ObjectDb
+ * of the file finds them.
+ */
+class ObjectDb
+{
 public:
   class Error : public DbHelper::Error
   {
@@ -50,9 +66,10 @@ public:
   };
 
 public:
-  // database will be create in <folder>/<first-pair-of-hash-bytes>/<rest-of-hash>
-  ObjectDb(const boost::filesystem::path& folder, const std::string& hash);
-  ~ObjectDb();
+  // segments are stored in the ObjectStore of <folder>, layout is needed only to save segments
+  ObjectDb(const boost::filesystem::path& folder, const std::string& hash,
+           const std::string& layout = std::string());
+  virtual ~ObjectDb();
 
   void
   saveContentObject(const Name& deviceName, sqlite3_int64 segment, const Data& data);
@@ -60,6 +77,28 @@ public:
   BufferPtr
   fetchSegment(const Name& deviceName, sqlite3_int64 segment);
 
+  /**
+   * @brief Get the stored signed packet of @p segment, decoded over its stored wire encoding
+   *
+   * The packet keeps the name and signature it was stored with, which may belong to another
+   * device if the segment was not fetched for @p deviceName.
+   */
+  shared_ptr<Data>
+  fetchSegmentData(const Name& deviceName, sqlite3_int64 segment);
+
+  /**
+   * @brief Commit segments saved so far in the partial layout, so that they survive a restart
+   */
+  void
+  commitPartial();
+
+  /**
+   * @brief Commit segments saved so far in the partial layout, and do not make the file
+   *        available when the ObjectDb is destroyed, as not all of its segments are saved
+   */
+  void
+  suspend();
+
   time_t
   secondsSinceLastUse();
 
@@ -67,15 +106,27 @@ public:
   DoesExist(const boost::filesystem::path& folder, const Name& deviceName,
             const std::string& hash);
 
-private:
-  void
-  willStartSave();
+  /**
+   * @brief Make the file stored in @p layout, e.g., fetched from another device, available
+   *        under @p deviceName
+   * @return false if the file is not stored in @p layout
+   */
+  static bool
+  AddAlias(const boost::filesystem::path& folder, const Name& deviceName,
+           const std::string& hash, const std::string& layout);
 
+private:
   void
   didStopSave();
 
 private:
-  sqlite3* m_db;
+  ObjectStorePtr m_store;
+  Buffer m_hash;
+  std::string m_layout;
+  std::string m_partialLayout;
+  // segments saved, but not yet committed to the store index, and devices that saved them
+  std::map<sqlite3_int64, ObjectStore::IndexEntry> m_pending;
+  std::set<Buffer> m_pendingAliases;
   time_t m_lastUsed;
 };
 
@@ -19,6 +19,7 @@
  */
 
 #include "object-manager.hpp"
+#include "chunker.hpp"
 #include "object-db.hpp"
 #include "core/logging.hpp"
 
@@ -37,15 +38,54 @@ INIT_LOGGER("Object.Manager")
 namespace fs = boost::filesystem;
 using util::Sha256;
 
-const int MAX_FILE_SEGMENT_SIZE = 1024;
+const size_t ObjectManager::DEFAULT_SEGMENT_SIZE = 1024;
+// leaves room for the name, including the 32-byte digest, and for an RSA signature
+const size_t ObjectManager::MAX_SEGMENT_SIZE = 8000;
+
+const size_t SIGNING_BATCH_SIZE = 256;
+
+// Segment names carry the digest of the whole file, so no segment can be signed before the file
+// is read to its end.  Files up to this size are kept in memory and read once.  Larger files are
+// spooled to the local .chronoshare folder while they are hashed, which costs one more write and
+// read of the file but bounds memory to this size plus one signing batch.  Reading the original
+// file twice instead would save the write, but could publish content that changed in between.
+const uint64_t MAX_IN_MEMORY_FILE_SIZE = 4 * 1024 * 1024;
+
+/**
+ * @brief Spool file of a file being published, removed when it goes out of scope
+ */
+class SpoolFile : noncopyable
+{
+public:
+  ~SpoolFile()
+  {
+    if (!path.empty()) {
+      boost::system::error_code ec;
+      fs::remove(path, ec);
+    }
+  }
+
+public:
+  fs::path path; // empty while the file is kept in memory
+};
 
 ObjectManager::ObjectManager(Face& face, const fs::path& folder,
-                             const std::string& appName)
+                             const std::string& appName, size_t segmentSize,
+                             Chunking chunking)
   : m_face(face)
   , m_folder(folder / ".chronoshare")
   , m_appName(appName)
+  , m_segmentSize(segmentSize)
+  , m_chunking(chunking)
+  , m_signingService(SigningService::getInstance())
 {
+  if (m_segmentSize == 0 || m_segmentSize > MAX_SEGMENT_SIZE) {
+    BOOST_THROW_EXCEPTION(Error("Segment size must be between 1 and " +
+                                std::to_string(MAX_SEGMENT_SIZE)));
+  }
+
   fs::create_directories(m_folder);
+  m_objectStore = ObjectStore::open(m_folder);
 }
 
 ObjectManager::~ObjectManager()
@@ -54,54 +94,196 @@ ObjectManager::~ObjectManager()
 
 // /<devicename>/<appname>/file/<hash>/<segment>
 std::tuple<ConstBufferPtr /*object-db name*/, size_t /* number of segments*/>
-ObjectManager::localFileToObjects(const fs::path& file, const Name& deviceName)
+ObjectManager::localFileToObjects(const fs::path& file, const Name& deviceName,
+                                  const Buffer& currentHash, ChunkList* chunkList)
 {
-  fs::ifstream input1(file, std::ios::in | std::ios::binary);
-  Sha256 fileHash(input1);
-  _LOG_DEBUG("fileHash content " << fileHash.toString());
-
   _LOG_DEBUG("file " << file);
-  ObjectDb fileDb(m_folder, fileHash.toString());
 
-  fs::ifstream iff(file, std::ios::in | std::ios::binary);
+  // The file is read only once.  Segment names include the digest of the whole file, so the
+  // content is kept in memory, or in a local spool file for large files, until it is known.
+  Sha256 fileHash;
+  Buffer content;
+  SpoolFile spoolFile;
+  fs::ofstream spool;
+  uint64_t fileSize = 0;
+
+  // with content-defined chunking, every chunk is published as one segment
+  bool isChunked = m_chunking == CHUNKING_CONTENT_DEFINED;
+  Chunker chunker(m_segmentSize);
+  Sha256 chunkHash;
+  size_t chunkSize = 0;
+  std::vector<uint32_t> chunkSizes;
+  Buffer chunkHashes;
+  auto finishChunk = [&] {
+    ConstBufferPtr digest = chunkHash.computeDigest();
+    chunkHashes.insert(chunkHashes.end(), digest->begin(), digest->end());
+    chunkSizes.push_back(chunkSize);
+    chunkHash.reset();
+    chunkSize = 0;
+  };
+
+  fs::ifstream input(file, std::ios::in | std::ios::binary);
+  std::vector<char> buf(m_segmentSize * SIGNING_BATCH_SIZE);
+  while (input.read(buf.data(), buf.size()) || input.gcount() > 0) {
+    size_t size = input.gcount();
+    fileHash.update(reinterpret_cast<const uint8_t*>(buf.data()), size);
+    fileSize += size;
+
+    for (size_t offset = 0; isChunked && offset < size;) {
+      const uint8_t* bytes = reinterpret_cast<const uint8_t*>(buf.data()) + offset;
+      size_t nConsumed = 0;
+      bool isBoundary = chunker.findBoundary(bytes, size - offset, nConsumed);
+      chunkHash.update(bytes, nConsumed);
+      chunkSize += nConsumed;
+      offset += nConsumed;
+      if (isBoundary) {
+        finishChunk();
+      }
+    }
+
+    if (spoolFile.path.empty() && fileSize > MAX_IN_MEMORY_FILE_SIZE) {
+      spoolFile.path = fs::unique_path(m_folder / "spool-%%%%-%%%%-%%%%-%%%%");
+      spool.open(spoolFile.path, std::ios::out | std::ios::binary);
+      spool.write(reinterpret_cast<const char*>(content.buf()), content.size());
+      content = Buffer();
+    }
+
+    if (spoolFile.path.empty()) {
+      content.insert(content.end(), buf.begin(), buf.begin() + size);
+    }
+    else if (!spool.write(buf.data(), size)) {
+      BOOST_THROW_EXCEPTION(Error("Cannot write spool file " + spoolFile.path.string()));
+    }
+  }
+  input.close();
+  spool.close();
+  if (!spoolFile.path.empty() && !spool) {
+    BOOST_THROW_EXCEPTION(Error("Cannot write spool file " + spoolFile.path.string()));
+  }
+
+  if (chunkSize > 0) {
+    finishChunk();
+  }
+
+  ConstBufferPtr digest = fileHash.computeDigest();
+  _LOG_DEBUG("fileHash content " << toHex(*digest));
+
+  if (*digest == currentHash) {
+    return std::make_tuple(digest, 0);
+  }
+
+  fs::ifstream spoolInput;
+  if (!spoolFile.path.empty()) {
+    spoolInput.open(spoolFile.path, std::ios::in | std::ios::binary);
+    if (!spoolInput) {
+      BOOST_THROW_EXCEPTION(Error("Cannot open spool file " + spoolFile.path.string()));
+    }
+  }
+
+  uint64_t offset = 0;
+  size_t segment = 0;
+  size_t nSegments = publishSegments(deviceName, digest, getLayout(),
+                                     [&] (const uint8_t*& segmentContent) {
+      if (offset >= fileSize) {
+        return size_t(0);
+      }
+
+      size_t size = isChunked ? chunkSizes[segment] :
+                                std::min<uint64_t>(m_segmentSize, fileSize - offset);
+      segmentContent = content.buf() + offset;
+      if (!spoolFile.path.empty()) {
+        // a short read would publish stale bytes of buf under the digest of the file
+        if (!spoolInput.read(buf.data(), size)) {
+          BOOST_THROW_EXCEPTION(Error("Cannot read spool file " + spoolFile.path.string()));
+        }
+        segmentContent = reinterpret_cast<const uint8_t*>(buf.data());
+      }
+
+      offset += size;
+      segment++;
+      return size;
+    });
+
+  spoolInput.close();
+
+  if (isChunked && chunkList != nullptr && !chunkSizes.empty()) {
+    // the chunk list is published as an object of its own, in fixed-size segments
+    chunkList->hash = Sha256::computeDigest(chunkHashes.buf(), chunkHashes.size());
+    size_t listOffset = 0;
+    chunkList->nSegments = publishSegments(deviceName, chunkList->hash,
+                                           ObjectStore::makeLayout(m_segmentSize, false),
+                                           [&] (const uint8_t*& segmentContent) {
+        size_t size = std::min(m_segmentSize, chunkHashes.size() - listOffset);
+        segmentContent = chunkHashes.buf() + listOffset;
+        listOffset += size;
+        return size;
+      });
+
+    m_objectStore->addChunks(*digest, deviceName, getLayout(), chunkHashes);
+    _LOG_DEBUG("Published " << chunkSizes.size() << " chunks, chunk list "
+               << toHex(*chunkList->hash));
+  }
+
+  return std::make_tuple(digest, nSegments);
+}
+
+size_t
+ObjectManager::publishSegments(const Name& deviceName, const ConstBufferPtr& hash,
+                               const std::string& layout,
+                               const function<size_t(const uint8_t*&)>& nextSegment)
+{
+  // identical content in the same layout, e.g., fetched from another device, is not stored
+  // again; ContentServer serves the stored copy under this device's name
+  if (m_objectStore->addAlias(*hash, deviceName, layout)) {
+    _LOG_DEBUG("Object " << toHex(*hash) << " is already stored, not publishing it again");
+    return m_objectStore->countSegments(*hash, layout);
+  }
+
+  ObjectDb fileDb(m_folder, toHex(*hash), layout);
+
   sqlite3_int64 segment = 0;
-  while (iff.good() && !iff.eof()) {
-    char buf[MAX_FILE_SEGMENT_SIZE];
-    iff.read(buf, MAX_FILE_SEGMENT_SIZE);
-    if (iff.gcount() == 0) {
-      // stupid streams...
-      break;
+
+  // segments are signed in batches, which keeps all signing threads busy without holding the
+  // whole file in memory
+  std::vector<shared_ptr<Data>> batch;
+  auto publishBatch = [&] {
+    m_signingService->sign(batch, SigningService::PRIORITY_BULK);
+    for (size_t i = 0; i < batch.size(); i++) {
+      m_face.put(*batch[i]);
+      fileDb.saveContentObject(deviceName, segment - batch.size() + i, *batch[i]);
     }
+    batch.clear();
+  };
 
+  const uint8_t* segmentContent = nullptr;
+  for (size_t size = nextSegment(segmentContent); size > 0; size = nextSegment(segmentContent)) {
     Name name = Name("/");
     name.append(deviceName)
       .append(m_appName)
       .append("file")
-      .appendImplicitSha256Digest(fileHash.computeDigest())
+      .appendImplicitSha256Digest(hash)
       .appendNumber(segment);
     _LOG_DEBUG("publish Data Name: " << name.toUri());
 
-    // cout << *fileHash << endl;
-    // cout << name << endl;
-    //_LOG_DEBUG("Read " << iff.gcount() << " from " << file << " for segment " << segment);
-
     shared_ptr<Data> data = make_shared<Data>();
     data->setName(name);
     data->setFreshnessPeriod(time::seconds(60));
-    data->setContent(reinterpret_cast<const uint8_t*>(&buf), iff.gcount());
-    m_keyChain.sign(*data);
-    m_face.put(*data);
-
-    fileDb.saveContentObject(deviceName, segment, *data);
+    data->setContent(segmentContent, size);
+    batch.push_back(data);
 
     segment++;
+    if (batch.size() == SIGNING_BATCH_SIZE) {
+      publishBatch();
+    }
   }
+  publishBatch();
+
   if (segment == 0) // handle empty files
   {
     Name name = Name("/");
     name.append(m_appName)
       .append("file")
-      .appendImplicitSha256Digest(fileHash.computeDigest())
+      .appendImplicitSha256Digest(hash)
       .append(deviceName)
       .appendNumber(0);
 
@@ -109,7 +291,7 @@ ObjectManager::localFileToObjects(const fs::path& file, const Name& deviceName)
     data->setName(name);
     data->setFreshnessPeriod(time::seconds(0));
     data->setContent(0, 0);
-    m_keyChain.sign(*data);
+    m_signingService->sign(*data, SigningService::PRIORITY_BULK);
     m_face.put(*data);
 
     fileDb.saveContentObject(deviceName, 0, *data);
@@ -117,12 +299,65 @@ ObjectManager::localFileToObjects(const fs::path& file, const Name& deviceName)
     segment++;
   }
 
-  return std::make_tuple(fileHash.computeDigest(), segment);
+  return segment;
+}
+
+ConstBufferPtr
+ObjectManager::fetchChunkList(const Name& deviceName, const Buffer& chunkListHash)
+{
+  if (!ObjectDb::DoesExist(m_folder, deviceName, toHex(chunkListHash))) {
+    return nullptr;
+  }
+
+  BufferPtr chunkList = make_shared<Buffer>();
+  ObjectStore::SegmentReader reader(*m_objectStore, chunkListHash, deviceName);
+  const uint8_t* content = nullptr;
+  size_t size = 0;
+  while (reader.next(content, size)) {
+    chunkList->insert(chunkList->end(), content, content + size);
+  }
+
+  if (chunkList->size() % ObjectStore::CHUNK_HASH_SIZE != 0 ||
+      *Sha256::computeDigest(chunkList->buf(), chunkList->size()) != chunkListHash) {
+    _LOG_ERROR("Chunk list " << toHex(chunkListHash) << " is incomplete or corrupt");
+    return nullptr;
+  }
+  return chunkList;
+}
+
+std::vector<std::pair<size_t, size_t>>
+ObjectManager::findMissingChunks(const Buffer& chunkList)
+{
+  std::vector<std::pair<size_t, size_t>> ranges;
+
+  size_t nChunks = chunkList.size() / ObjectStore::CHUNK_HASH_SIZE;
+  for (size_t chunk = 0; chunk < nChunks; chunk++) {
+    if (m_objectStore->hasChunk(chunkList.buf() + chunk * ObjectStore::CHUNK_HASH_SIZE)) {
+      continue;
+    }
+
+    if (!ranges.empty() && ranges.back().second + 1 == chunk) {
+      ranges.back().second = chunk;
+    }
+    else {
+      ranges.push_back(std::make_pair(chunk, chunk));
+    }
+  }
+
+  return ranges;
+}
+
+void
+ObjectManager::addChunkList(const Name& deviceName, const Buffer& fileHash,
+                            const std::string& layout, const Buffer& chunkList)
+{
+  m_objectStore->addChunks(fileHash, deviceName, layout, chunkList);
 }
 
 bool
 ObjectManager::objectsToLocalFile(/*in*/const Name& deviceName,
-                                  /*in*/const Buffer& fileHash, /*out*/const fs::path& file)
+                                  /*in*/const Buffer& fileHash, /*out*/const fs::path& file,
+                                  /*in*/size_t nSegments)
 {
   std::string hashStr = toHex(fileHash);
   if (!ObjectDb::DoesExist(m_folder, deviceName, hashStr)) {
@@ -136,18 +371,31 @@ ObjectManager::objectsToLocalFile(/*in*/const Name& deviceName,
   }
 
   fs::ofstream off(file, std::ios::out | std::ios::binary);
-  ObjectDb fileDb(m_folder, hashStr);
 
-  sqlite3_int64 segment = 0;
-  BufferPtr bytes = fileDb.fetchSegment(deviceName, 0);
-  while (bytes) {
+  ObjectStore::SegmentReader reader(*m_objectStore, fileHash, deviceName);
+  Sha256 digest;
+  const uint8_t* content = nullptr;
+  size_t size = 0;
+  while (reader.next(content, size)) {
+    digest.update(content, size);
+    off.write(reinterpret_cast<const char*>(content), size);
+  }
+  off.close();
 
-    if (bytes->buf()) {
-      off.write(reinterpret_cast<const char*>(bytes->buf()), bytes->size());
-    }
+  if (reader.getNSegments() != static_cast<sqlite3_int64>(nSegments) || !off) {
+    _LOG_ERROR("Only " << reader.getNSegments() << " of " << nSegments << " segments of "
+               << hashStr << " could be written to [" << file << "]");
+    boost::system::error_code ec;
+    fs::remove(file, ec);
+    return false;
+  }
 
-    segment++;
-    bytes = fileDb.fetchSegment(deviceName, segment);
+  if (*digest.computeDigest() != fileHash) {
+    _LOG_ERROR("Stored segments of " << hashStr << " do not match the hash, removing them");
+    boost::system::error_code ec;
+    fs::remove(file, ec);
+    removeObjects(deviceName, fileHash);
+    return false;
   }
 
   // permission and timestamp should be assigned somewhere else(ObjectManager has no idea about
@@ -156,5 +404,11 @@ ObjectManager::objectsToLocalFile(/*in*/const Name& deviceName,
   return true;
 }
 
+void
+ObjectManager::removeObjects(const Name& deviceName, const Buffer& hash)
+{
+  m_objectStore->remove(hash, deviceName);
+}
+
 } // chronoshare
 } // ndn
@@ -22,12 +22,15 @@
 #define CHRONOSHARE_SRC_OBJECT_MANAGER_HPP
 
 #include "core/chronoshare-common.hpp"
+#include "object-store.hpp"
+#include "signing-service.hpp"
 
 #include <boost/filesystem.hpp>
 
 #include <ndn-cxx/face.hpp>
 #include <ndn-cxx/util/digest.hpp>
-#include <ndn-cxx/security/key-chain.hpp>
+
+#include <vector>
 
 // everything related to managing object files
 
@@ -36,27 +39,139 @@ namespace chronoshare {
 
 class ObjectManager {
 public:
+  class Error : public boost::exception,
+                public std::runtime_error
+  {
+  public:
+    explicit
+    Error(const std::string& what)
+      : std::runtime_error(what)
+    {
+    }
+  };
+
+  /// segment size used by earlier versions, which did not record it
+  static const size_t DEFAULT_SEGMENT_SIZE;
+  /// largest segment size for which a signed Data packet fits into MAX_NDN_PACKET_SIZE
+  static const size_t MAX_SEGMENT_SIZE;
+
+  enum Chunking {
+    CHUNKING_FIXED_SIZE,      ///< all segments except the last one have the segment size
+    CHUNKING_CONTENT_DEFINED  ///< segments end at content-defined boundaries, see Chunker
+  };
+
+  /**
+   * @brief Chunk list of a file published with content-defined chunking
+   *
+   * The chunk list is an object of its own, the concatenated SHA-256 digests of the segments of
+   * the file, published in fixed-size segments.
+   */
+  struct ChunkList
+  {
+    ConstBufferPtr hash;
+    size_t nSegments;
+  };
+
+public:
+  /**
+   * @param segmentSize size of segments of the published files, up to MAX_SEGMENT_SIZE; the
+   *                    largest chunk size with content-defined chunking
+   */
   ObjectManager(Face& face, const boost::filesystem::path& folder,
-                const std::string& appName);
+                const std::string& appName, size_t segmentSize = DEFAULT_SEGMENT_SIZE,
+                Chunking chunking = CHUNKING_FIXED_SIZE);
   virtual ~ObjectManager();
 
+  size_t
+  getSegmentSize() const
+  {
+    return m_segmentSize;
+  }
+
+  /**
+   * @brief Get layout of the files published by this ObjectManager, see ObjectStore
+   */
+  std::string
+  getLayout() const
+  {
+    return ObjectStore::makeLayout(m_segmentSize, m_chunking == CHUNKING_CONTENT_DEFINED);
+  }
+
   /**
    * @brief Creates and saves local file in a local database file
    *
    * Format: /<appname>/file/<hash>/<devicename>/<segment>
+   *
+   * The file is read once, hashing and segmenting it in the same pass.  Nothing is published if
+   * the digest of the file equals @p currentHash, in which case the number of segments is 0.
+   *
+   * With content-defined chunking, the chunk list of a non-empty file is published as well and
+   * returned in @p chunkList.
    */
   std::tuple<ConstBufferPtr /*object-db name*/, size_t /* number of segments*/>
-  localFileToObjects(const boost::filesystem::path& file, const Name& deviceName);
+  localFileToObjects(const boost::filesystem::path& file, const Name& deviceName,
+                     const Buffer& currentHash = Buffer(), /*out*/ ChunkList* chunkList = nullptr);
 
+  /**
+   * @brief Write object @p hash, published by @p deviceName in @p nSegments segments, to @p file
+   * @return false, removing @p file, if not all of the segments are stored or the written
+   *         content does not match @p hash; in the latter case the stored object is removed
+   */
   bool
   objectsToLocalFile(/*in*/ const Name& deviceName, /*in*/ const Buffer& hash,
-                     /*out*/ const boost::filesystem::path& file);
+                     /*out*/ const boost::filesystem::path& file, /*in*/ size_t nSegments);
+
+  /**
+   * @brief Remove stored segments of object @p hash published by @p deviceName, so that they
+   *        are neither served nor used to restore the file
+   */
+  void
+  removeObjects(const Name& deviceName, const Buffer& hash);
+
+  /**
+   * @brief Read a chunk list object from the local store
+   * @return nullptr if not all of its segments are stored or it does not match @p chunkListHash
+   */
+  ConstBufferPtr
+  fetchChunkList(const Name& deviceName, const Buffer& chunkListHash);
+
+  /**
+   * @brief Find chunks of @p chunkList that are not stored locally as segments of any file
+   * @return ranges [first, last] of the missing segments
+   */
+  std::vector<std::pair<size_t, size_t>>
+  findMissingChunks(const Buffer& chunkList);
+
+  /**
+   * @brief Record @p chunkList of a fetched file, so that its segments that were not fetched
+   *        are read from other files
+   */
+  void
+  addChunkList(const Name& deviceName, const Buffer& fileHash, const std::string& layout,
+               const Buffer& chunkList);
+
+private:
+  /**
+   * @brief Sign, publish, and save segments of object @p hash in @p layout
+   *
+   * Nothing is published if the object is already stored in @p layout.
+   *
+   * @param nextSegment sets the pointer to the content of the next segment and returns its size,
+   *                    0 after the last segment
+   * @return number of segments, an empty object is published as one empty segment
+   */
+  size_t
+  publishSegments(const Name& deviceName, const ConstBufferPtr& hash, const std::string& layout,
+                  const function<size_t(const uint8_t*&)>& nextSegment);
 
 private:
   Face& m_face;
   boost::filesystem::path m_folder;
+  ObjectStorePtr m_objectStore; // keeps the store of m_folder open
   std::string m_appName;
-  KeyChain m_keyChain;
+  size_t m_segmentSize;
+  Chunking m_chunking;
+  SigningServicePtr m_signingService;
 };
 
 typedef shared_ptr<ObjectManager> ObjectManagerPtr;
@@ -0,0 +1,657 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+
+#include "object-store.hpp"
+#include "core/logging.hpp"
+
+#include <ndn-cxx/util/string-helper.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace ndn {
+namespace chronoshare {
+
+INIT_LOGGER("Object.Store")
+
+namespace fs = boost::filesystem;
+
+const sqlite3_int64 ObjectStore::MAX_PACK_SIZE = 256 * 1024 * 1024;
+const size_t ObjectStore::CHUNK_HASH_SIZE = 32;
+
+const std::string INIT_DATABASE = "\
+CREATE TABLE IF NOT EXISTS                                              \n\
+    Objects(                                                            \n\
+        file_hash       BLOB NOT NULL,                                  \n\
+        layout          TEXT NOT NULL,                                  \n\
+        segment         INTEGER NOT NULL,                               \n\
+        device_name     BLOB NOT NULL, /* signer of the stored packet */\n\
+        pack_id         INTEGER NOT NULL,                               \n\
+        pack_offset     INTEGER NOT NULL,                               \n\
+        length          INTEGER NOT NULL,                               \n\
+                                                                        \
+        PRIMARY KEY(file_hash, layout, segment)                        \n\
+    ) WITHOUT ROWID;                                                    \n\
+                                                                        \n\
+CREATE TABLE IF NOT EXISTS                                              \n\
+    Aliases(                                                            \n\
+        file_hash       BLOB NOT NULL,                                  \n\
+        device_name     BLOB NOT NULL,                                  \n\
+        layout          TEXT NOT NULL,                                  \n\
+                                                                        \
+        PRIMARY KEY(file_hash, device_name)                            \n\
+    ) WITHOUT ROWID;                                                    \n\
+                                                                        \n\
+CREATE TABLE IF NOT EXISTS                                              \n\
+    ObjectChunks(                                                       \n\
+        file_hash       BLOB NOT NULL,                                  \n\
+        layout          TEXT NOT NULL,                                  \n\
+        segment         INTEGER NOT NULL,                               \n\
+        chunk_hash      BLOB NOT NULL,                                  \n\
+                                                                        \
+        PRIMARY KEY(file_hash, layout, segment)                        \n\
+    ) WITHOUT ROWID;                                                    \n\
+CREATE INDEX IF NOT EXISTS ObjectChunksByHash ON ObjectChunks(chunk_hash); \n\
+";
+
+// per-hash databases were created by versions that always used 1024-byte segments
+const size_t LEGACY_SEGMENT_SIZE = 1024;
+
+const std::string PACK_PREFIX = "pack-";
+
+static std::mutex g_storesMutex;
+static std::map<fs::path, std::weak_ptr<ObjectStore>> g_stores;
+
+ObjectStorePtr
+ObjectStore::open(const fs::path& folder)
+{
+  fs::path key = fs::absolute(folder);
+
+  std::lock_guard<std::mutex> lock(g_storesMutex);
+  ObjectStorePtr store = g_stores[key].lock();
+  if (store == nullptr) {
+    store = make_shared<ObjectStore>(key);
+    g_stores[key] = store;
+  }
+  return store;
+}
+
+ObjectStore::ObjectStore(const fs::path& folder)
+  : DbHelper(folder / "objects", "index.db")
+  , m_objectsFolder(folder / "objects")
+  , m_currentPack(0)
+  , m_currentPackSize(0)
+  , m_hasUnsyncedData(false)
+{
+  sqlite3_exec(m_db, INIT_DATABASE.c_str(), NULL, NULL, NULL);
+  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, sqlite3_errmsg(m_db));
+
+  // continue appending to the last pack file, unless it is full
+  for (fs::directory_iterator entry(m_objectsFolder); entry != fs::directory_iterator(); ++entry) {
+    std::string name = entry->path().filename().string();
+    if (name.compare(0, PACK_PREFIX.size(), PACK_PREFIX) != 0) {
+      continue;
+    }
+
+    sqlite3_int64 pack = std::strtoll(name.c_str() + PACK_PREFIX.size(), nullptr, 10);
+    if (pack >= m_currentPack) {
+      m_currentPack = pack;
+      m_currentPackSize = fs::file_size(entry->path());
+    }
+  }
+
+  if (m_currentPackSize >= MAX_PACK_SIZE) {
+    m_currentPack++;
+    m_currentPackSize = 0;
+  }
+
+  migrateLegacyObjects();
+}
+
+std::string
+ObjectStore::makeLayout(size_t segmentSize, bool isChunked)
+{
+  return (isChunked ? "cdc-" : "fixed-") + std::to_string(segmentSize);
+}
+
+std::string
+ObjectStore::makePartialLayout(const std::string& layout)
+{
+  return "partial-" + layout;
+}
+
+ObjectStore::~ObjectStore()
+{
+  for (auto& packFd : m_packFds) {
+    ::close(packFd.second);
+  }
+}
+
+ObjectStore::Location
+ObjectStore::append(const Data& data)
+{
+  const Block& wire = data.wireEncode();
+  return appendBytes(wire.wire(), wire.size());
+}
+
+ObjectStore::Location
+ObjectStore::appendBytes(const uint8_t* buf, size_t size)
+{
+  std::lock_guard<std::mutex> lock(m_packMutex);
+
+  int fd = getPackFd(m_currentPack);
+  Location location{m_currentPack, m_currentPackSize, static_cast<sqlite3_int64>(size)};
+
+  size_t written = 0;
+  while (written < size) {
+    ssize_t res = ::pwrite(fd, buf + written, size - written, m_currentPackSize + written);
+    if (res < 0) {
+      BOOST_THROW_EXCEPTION(Error("Cannot write to pack " + std::to_string(m_currentPack) + ": " +
+                                  std::strerror(errno)));
+    }
+    written += res;
+  }
+
+  m_currentPackSize += size;
+  m_hasUnsyncedData = true;
+
+  if (m_currentPackSize >= MAX_PACK_SIZE) {
+    ::fdatasync(fd);
+    m_hasUnsyncedData = false;
+
+    m_currentPack++;
+    m_currentPackSize = 0;
+    _LOG_DEBUG("Starting new pack " << m_currentPack);
+  }
+
+  return location;
+}
+
+void
+ObjectStore::commit(const Buffer& fileHash, const std::string& layout,
+                    const std::vector<Buffer>& aliases, const std::vector<IndexEntry>& entries)
+{
+  std::lock_guard<std::mutex> lock(m_packMutex);
+
+  if (m_hasUnsyncedData) {
+    ::fdatasync(getPackFd(m_currentPack));
+    m_hasUnsyncedData = false;
+  }
+
+  sqlite3_exec(m_db, "BEGIN TRANSACTION;", 0, 0, 0);
+  for (const IndexEntry& entry : entries) {
+    Statement stmt(*this, "INSERT OR IGNORE INTO Objects "
+                          "(file_hash, layout, segment, device_name, pack_id, pack_offset, length) "
+                          "VALUES(?, ?, ?, ?, ?, ?, ?)");
+
+    sqlite3_bind_blob(stmt, 1, fileHash.buf(), fileHash.size(), SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, layout.c_str(), layout.size(), SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 3, entry.segment);
+    sqlite3_bind_blob(stmt, 4, entry.deviceName.buf(), entry.deviceName.size(), SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 5, entry.location.pack);
+    sqlite3_bind_int64(stmt, 6, entry.location.offset);
+    sqlite3_bind_int64(stmt, 7, entry.location.length);
+
+    int res = sqlite3_step(stmt);
+    _LOG_DEBUG_COND(res != SQLITE_DONE, "Cannot index segment: " << sqlite3_errmsg(m_db));
+  }
+
+  if (!aliases.empty()) {
+    // the object is complete
+    std::string partialLayout = makePartialLayout(layout);
+    {
+      Statement stmt(*this, "UPDATE OR IGNORE Objects SET layout=? WHERE file_hash=? AND layout=?");
+      sqlite3_bind_text(stmt, 1, layout.c_str(), layout.size(), SQLITE_STATIC);
+      sqlite3_bind_blob(stmt, 2, fileHash.buf(), fileHash.size(), SQLITE_STATIC);
+      sqlite3_bind_text(stmt, 3, partialLayout.c_str(), partialLayout.size(), SQLITE_STATIC);
+      sqlite3_step(stmt);
+    }
+    {
+      // segments that were also committed in the layout
+      Statement stmt(*this, "DELETE FROM Objects WHERE file_hash=? AND layout=?");
+      sqlite3_bind_blob(stmt, 1, fileHash.buf(), fileHash.size(), SQLITE_STATIC);
+      sqlite3_bind_text(stmt, 2, partialLayout.c_str(), partialLayout.size(), SQLITE_STATIC);
+      sqlite3_step(stmt);
+    }
+  }
+
+  for (const Buffer& deviceName : aliases) {
+    Statement stmt(*this, "INSERT OR REPLACE INTO Aliases (file_hash, device_name, layout) "
+                          "VALUES(?, ?, ?)");
+
+    sqlite3_bind_blob(stmt, 1, fileHash.buf(), fileHash.size(), SQLITE_STATIC);
+    sqlite3_bind_blob(stmt, 2, deviceName.buf(), deviceName.size(), SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, layout.c_str(), layout.size(), SQLITE_STATIC);
+
+    int res = sqlite3_step(stmt);
+    _LOG_DEBUG_COND(res != SQLITE_DONE, "Cannot add alias: " << sqlite3_errmsg(m_db));
+  }
+  sqlite3_exec(m_db, "END TRANSACTION;", 0, 0, 0);
+}
+
+bool
+ObjectStore::lookup(const Buffer& fileHash, const std::string& layout, sqlite3_int64 segment,
+                    Location& location)
+{
+  Statement stmt(*this, "SELECT pack_id, pack_offset, length FROM Objects "
+                        "WHERE file_hash=? AND layout=? AND segment=?");
+
+  sqlite3_bind_blob(stmt, 1, fileHash.buf(), fileHash.size(), SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 2, layout.c_str(), layout.size(), SQLITE_STATIC);
+  sqlite3_bind_int64(stmt, 3, segment);
+
+  if (sqlite3_step(stmt) != SQLITE_ROW) {
+    return false;
+  }
+
+  location.pack = sqlite3_column_int64(stmt, 0);
+  location.offset = sqlite3_column_int64(stmt, 1);
+  location.length = sqlite3_column_int64(stmt, 2);
+  return true;
+}
+
+bool
+ObjectStore::lookup(const Buffer& fileHash, const Name& deviceName, sqlite3_int64 segment,
+                    Location& location)
+{
+  Statement stmt(*this, "SELECT o.pack_id, o.pack_offset, o.length FROM Aliases a "
+                        "  JOIN Objects o ON o.file_hash=a.file_hash AND o.layout=a.layout "
+                        "WHERE a.file_hash=? AND a.device_name=? AND o.segment=?");
+
+  sqlite3_bind_blob(stmt, 1, fileHash.buf(), fileHash.size(), SQLITE_STATIC);
+  sqlite3_bind_blob(stmt, 2, deviceName.wireEncode().wire(), deviceName.wireEncode().size(),
+                    SQLITE_STATIC);
+  sqlite3_bind_int64(stmt, 3, segment);
+
+  if (sqlite3_step(stmt) != SQLITE_ROW) {
+    return false;
+  }
+
+  location.pack = sqlite3_column_int64(stmt, 0);
+  location.offset = sqlite3_column_int64(stmt, 1);
+  location.length = sqlite3_column_int64(stmt, 2);
+  return true;
+}
+
+shared_ptr<Data>
+ObjectStore::read(const Location& location)
+{
+  // the packet is decoded over the buffer it was read into, so it can be put as is
+  BufferPtr buffer = make_shared<Buffer>();
+  if (!readPacket(location, *buffer)) {
+    return nullptr;
+  }
+
+  shared_ptr<Data> data = make_shared<Data>();
+  data->wireDecode(Block(buffer));
+  return data;
+}
+
+bool
+ObjectStore::readPacket(const Location& location, Buffer& buffer)
+{
+  int fd = -1;
+  {
+    std::lock_guard<std::mutex> lock(m_packMutex);
+    fd = getPackFd(location.pack);
+  }
+
+  buffer.resize(location.length);
+  size_t nRead = 0;
+  while (nRead < buffer.size()) {
+    ssize_t res = ::pread(fd, buffer.buf() + nRead, buffer.size() - nRead, location.offset + nRead);
+    if (res <= 0) {
+      _LOG_ERROR("Cannot read " << location.length << " bytes at " << location.offset
+                 << " from pack " << location.pack);
+      return false;
+    }
+    nRead += res;
+  }
+  return true;
+}
+
+ObjectStore::SegmentReader::SegmentReader(ObjectStore& store, const Buffer& fileHash,
+                                          const Name& deviceName, sqlite3_int64 firstSegment)
+  : m_store(store)
+  , m_fileHash(fileHash)
+  , m_deviceName(deviceName)
+  , m_stmt(store, "SELECT o.segment, o.pack_id, o.pack_offset, o.length FROM Aliases a "
+                  "  JOIN Objects o ON o.file_hash=a.file_hash AND o.layout=a.layout "
+                  "WHERE a.file_hash=? AND a.device_name=? AND o.segment>=? ORDER BY o.segment")
+  , m_segment(firstSegment)
+{
+  sqlite3_bind_blob(m_stmt, 1, m_fileHash.buf(), m_fileHash.size(), SQLITE_STATIC);
+  sqlite3_bind_blob(m_stmt, 2, m_deviceName.wireEncode().wire(), m_deviceName.wireEncode().size(),
+                    SQLITE_STATIC);
+  sqlite3_bind_int64(m_stmt, 3, firstSegment);
+  m_hasRow = sqlite3_step(m_stmt) == SQLITE_ROW;
+}
+
+bool
+ObjectStore::SegmentReader::next(const uint8_t*& content, size_t& size)
+{
+  Location location;
+  if (m_hasRow && sqlite3_column_int64(m_stmt, 0) == m_segment) {
+    location.pack = sqlite3_column_int64(m_stmt, 1);
+    location.offset = sqlite3_column_int64(m_stmt, 2);
+    location.length = sqlite3_column_int64(m_stmt, 3);
+    m_hasRow = sqlite3_step(m_stmt) == SQLITE_ROW;
+  }
+  else if (!m_store.lookupChunk(m_fileHash, m_deviceName, m_segment, location)) {
+    return false;
+  }
+
+  m_block = Block();
+  if (m_packet == nullptr || !m_packet.unique()) {
+    m_packet = make_shared<Buffer>();
+  }
+  if (!m_store.readPacket(location, *m_packet)) {
+    return false;
+  }
+
+  try {
+    m_block = Block(m_packet);
+    m_block.parse();
+    const Block& contentBlock = m_block.get(tlv::Content);
+    content = contentBlock.value();
+    size = contentBlock.value_size();
+  }
+  catch (const tlv::Error& error) {
+    _LOG_ERROR("Segment " << m_segment << " of " << toHex(m_fileHash) << " is corrupt: "
+               << error.what());
+    return false;
+  }
+
+  m_segment++;
+  return true;
+}
+
+bool
+ObjectStore::hasObject(const Buffer& fileHash, const Name& deviceName)
+{
+  Statement stmt(*this, "SELECT 1 FROM Aliases a "
+                        "WHERE a.file_hash=? AND a.device_name=? AND "
+                        "  (EXISTS (SELECT 1 FROM Objects o "
+                        "           WHERE o.file_hash=a.file_hash AND o.layout=a.layout) OR "
+                        "   EXISTS (SELECT 1 FROM ObjectChunks c "
+                        "           WHERE c.file_hash=a.file_hash AND c.layout=a.layout))");
+
+  sqlite3_bind_blob(stmt, 1, fileHash.buf(), fileHash.size(), SQLITE_STATIC);
+  sqlite3_bind_blob(stmt, 2, deviceName.wireEncode().wire(), deviceName.wireEncode().size(),
+                    SQLITE_STATIC);
+
+  return sqlite3_step(stmt) == SQLITE_ROW;
+}
+
+bool
+ObjectStore::addAlias(const Buffer& fileHash, const Name& deviceName, const std::string& layout)
+{
+  Statement stmt(*this, "INSERT OR REPLACE INTO Aliases (file_hash, device_name, layout) "
+                        "SELECT ?1, ?2, ?3 WHERE EXISTS "
+                        "  (SELECT 1 FROM Objects WHERE file_hash=?1 AND layout=?3)");
+
+  sqlite3_bind_blob(stmt, 1, fileHash.buf(), fileHash.size(), SQLITE_STATIC);
+  sqlite3_bind_blob(stmt, 2, deviceName.wireEncode().wire(), deviceName.wireEncode().size(),
+                    SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 3, layout.c_str(), layout.size(), SQLITE_STATIC);
+
+  int res = sqlite3_step(stmt);
+  _LOG_DEBUG_COND(res != SQLITE_DONE, "Cannot add alias: " << sqlite3_errmsg(m_db));
+  return res == SQLITE_DONE && sqlite3_changes(m_db) > 0;
+}
+
+sqlite3_int64
+ObjectStore::countSegments(const Buffer& fileHash, const std::string& layout)
+{
+  // segments of chunked objects may be stored only as chunks of other objects
+  Statement stmt(*this, "SELECT MAX(segment) + 1 FROM "
+                        "  (SELECT segment FROM Objects WHERE file_hash=?1 AND layout=?2 "
+                        "   UNION ALL "
+                        "   SELECT segment FROM ObjectChunks WHERE file_hash=?1 AND layout=?2)");
+
+  sqlite3_bind_blob(stmt, 1, fileHash.buf(), fileHash.size(), SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 2, layout.c_str(), layout.size(), SQLITE_STATIC);
+
+  if (sqlite3_step(stmt) != SQLITE_ROW) {
+    return 0;
+  }
+  return sqlite3_column_int64(stmt, 0); // NULL (0) if there are no segments
+}
+
+void
+ObjectStore::addChunks(const Buffer& fileHash, const Name& deviceName, const std::string& layout,
+                       const Buffer& chunkList)
+{
+  const Block& deviceBlock = deviceName.wireEncode();
+  size_t nChunks = chunkList.size() / CHUNK_HASH_SIZE;
+
+  sqlite3_exec(m_db, "BEGIN TRANSACTION;", 0, 0, 0);
+  for (size_t chunk = 0; chunk < nChunks; chunk++) {
+    Statement stmt(*this, "INSERT OR IGNORE INTO ObjectChunks "
+                          "(file_hash, layout, segment, chunk_hash) "
+                          "VALUES(?, ?, ?, ?)");
+
+    sqlite3_bind_blob(stmt, 1, fileHash.buf(), fileHash.size(), SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, layout.c_str(), layout.size(), SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 3, chunk);
+    sqlite3_bind_blob(stmt, 4, chunkList.buf() + chunk * CHUNK_HASH_SIZE, CHUNK_HASH_SIZE,
+                      SQLITE_STATIC);
+
+    int res = sqlite3_step(stmt);
+    _LOG_DEBUG_COND(res != SQLITE_DONE, "Cannot index chunk: " << sqlite3_errmsg(m_db));
+  }
+
+  Statement stmt(*this, "INSERT OR REPLACE INTO Aliases (file_hash, device_name, layout) "
+                        "VALUES(?, ?, ?)");
+  sqlite3_bind_blob(stmt, 1, fileHash.buf(), fileHash.size(), SQLITE_STATIC);
+  sqlite3_bind_blob(stmt, 2, deviceBlock.wire(), deviceBlock.size(), SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 3, layout.c_str(), layout.size(), SQLITE_STATIC);
+  int res = sqlite3_step(stmt);
+  _LOG_DEBUG_COND(res != SQLITE_DONE, "Cannot add alias: " << sqlite3_errmsg(m_db));
+  sqlite3_exec(m_db, "END TRANSACTION;", 0, 0, 0);
+}
+
+void
+ObjectStore::remove(const Buffer& fileHash, const Name& deviceName)
+{
+  std::string layout;
+  {
+    Statement stmt(*this, "SELECT layout FROM Aliases WHERE file_hash=? AND device_name=?");
+    sqlite3_bind_blob(stmt, 1, fileHash.buf(), fileHash.size(), SQLITE_STATIC);
+    sqlite3_bind_blob(stmt, 2, deviceName.wireEncode().wire(), deviceName.wireEncode().size(),
+                      SQLITE_STATIC);
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+      return;
+    }
+    layout.assign(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)),
+                  sqlite3_column_bytes(stmt, 0));
+  }
+  std::string partialLayout = makePartialLayout(layout);
+
+  _LOG_DEBUG("Removing " << toHex(fileHash) << " in layout " << layout);
+
+  sqlite3_exec(m_db, "BEGIN TRANSACTION;", 0, 0, 0);
+  {
+    Statement stmt(*this, "DELETE FROM Objects WHERE file_hash=?1 AND (layout=?2 OR layout=?3)");
+    sqlite3_bind_blob(stmt, 1, fileHash.buf(), fileHash.size(), SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, layout.c_str(), layout.size(), SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, partialLayout.c_str(), partialLayout.size(), SQLITE_STATIC);
+    sqlite3_step(stmt);
+  }
+  {
+    Statement stmt(*this, "DELETE FROM ObjectChunks WHERE file_hash=? AND layout=?");
+    sqlite3_bind_blob(stmt, 1, fileHash.buf(), fileHash.size(), SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, layout.c_str(), layout.size(), SQLITE_STATIC);
+    sqlite3_step(stmt);
+  }
+  {
+    Statement stmt(*this, "DELETE FROM Aliases WHERE file_hash=? AND layout=?");
+    sqlite3_bind_blob(stmt, 1, fileHash.buf(), fileHash.size(), SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, layout.c_str(), layout.size(), SQLITE_STATIC);
+    sqlite3_step(stmt);
+  }
+  sqlite3_exec(m_db, "END TRANSACTION;", 0, 0, 0);
+}
+
+bool
+ObjectStore::hasChunk(const uint8_t* chunkHash)
+{
+  Statement stmt(*this, "SELECT 1 FROM ObjectChunks c "
+                        "  JOIN Objects o ON o.file_hash=c.file_hash AND "
+                        "                    o.layout=c.layout AND "
+                        "                    o.segment=c.segment "
+                        "WHERE c.chunk_hash=? LIMIT 1");
+
+  sqlite3_bind_blob(stmt, 1, chunkHash, CHUNK_HASH_SIZE, SQLITE_STATIC);
+
+  return sqlite3_step(stmt) == SQLITE_ROW;
+}
+
+bool
+ObjectStore::lookupChunk(const Buffer& fileHash, const Name& deviceName, sqlite3_int64 segment,
+                         Location& location)
+{
+  Statement stmt(*this, "SELECT o.pack_id, o.pack_offset, o.length FROM Aliases a "
+                        "  JOIN ObjectChunks c ON c.file_hash=a.file_hash AND c.layout=a.layout "
+                        "  JOIN ObjectChunks same ON same.chunk_hash=c.chunk_hash "
+                        "  JOIN Objects o ON o.file_hash=same.file_hash AND "
+                        "                    o.layout=same.layout AND "
+                        "                    o.segment=same.segment "
+                        "WHERE a.file_hash=? AND a.device_name=? AND c.segment=? LIMIT 1");
+
+  sqlite3_bind_blob(stmt, 1, fileHash.buf(), fileHash.size(), SQLITE_STATIC);
+  sqlite3_bind_blob(stmt, 2, deviceName.wireEncode().wire(), deviceName.wireEncode().size(),
+                    SQLITE_STATIC);
+  sqlite3_bind_int64(stmt, 3, segment);
+
+  if (sqlite3_step(stmt) != SQLITE_ROW) {
+    return false;
+  }
+
+  location.pack = sqlite3_column_int64(stmt, 0);
+  location.offset = sqlite3_column_int64(stmt, 1);
+  location.length = sqlite3_column_int64(stmt, 2);
+  return true;
+}
+
+int
+ObjectStore::getPackFd(sqlite3_int64 pack)
+{
+  auto packFd = m_packFds.find(pack);
+  if (packFd != m_packFds.end()) {
+    return packFd->second;
+  }
+
+  fs::path packPath = m_objectsFolder / (PACK_PREFIX + std::to_string(pack));
+  int fd = ::open(packPath.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    BOOST_THROW_EXCEPTION(Error("Cannot open pack file [" + packPath.string() + "]: " +
+                                std::strerror(errno)));
+  }
+
+  m_packFds[pack] = fd;
+  return fd;
+}
+
+void
+ObjectStore::migrateLegacyObjects()
+{
+  // legacy layout: <folder>/objects/<first-pair-of-hash-bytes>/<rest-of-hash>
+  for (fs::directory_iterator dir(m_objectsFolder); dir != fs::directory_iterator(); ++dir) {
+    std::string prefix = dir->path().filename().string();
+    if (!fs::is_directory(dir->path()) || prefix.size() != 2 ||
+        !std::isxdigit(prefix[0]) || !std::isxdigit(prefix[1])) {
+      continue;
+    }
+
+    for (fs::directory_iterator file(dir->path()); file != fs::directory_iterator(); ++file) {
+      std::string rest = file->path().filename().string();
+      if (!std::all_of(rest.begin(), rest.end(), [] (char c) { return std::isxdigit(c); })) {
+        continue; // -journal, -wal, and -shm files are removed together with the database
+      }
+
+      try {
+        migrateLegacyObject(file->path(), *fromHex(prefix + rest));
+      }
+      catch (const std::exception& e) {
+        _LOG_ERROR("Cannot migrate legacy object db [" << file->path() << "]: " << e.what());
+      }
+    }
+
+    boost::system::error_code ec;
+    if (fs::is_empty(dir->path(), ec)) {
+      fs::remove(dir->path(), ec);
+    }
+  }
+}
+
+void
+ObjectStore::migrateLegacyObject(const fs::path& legacyDb, const Buffer& fileHash)
+{
+  _LOG_DEBUG("Migrate legacy object db " << legacyDb);
+
+  sqlite3* db;
+  int res = sqlite3_open_v2(legacyDb.c_str(), &db, SQLITE_OPEN_READONLY, 0);
+  if (res != SQLITE_OK) {
+    sqlite3_close(db);
+    BOOST_THROW_EXCEPTION(Error("Cannot open database"));
+  }
+
+  sqlite3_stmt* stmt;
+  res = sqlite3_prepare_v2(db, "SELECT device_name, segment, content_object FROM File "
+                               "WHERE content_object IS NOT NULL", -1, &stmt, 0);
+  if (res != SQLITE_OK) {
+    std::string error = sqlite3_errmsg(db);
+    sqlite3_close(db);
+    BOOST_THROW_EXCEPTION(Error(error));
+  }
+
+  std::vector<IndexEntry> entries;
+  std::vector<Buffer> aliases;
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    IndexEntry entry;
+    entry.deviceName = Buffer(sqlite3_column_blob(stmt, 0), sqlite3_column_bytes(stmt, 0));
+    if (std::find(aliases.begin(), aliases.end(), entry.deviceName) == aliases.end()) {
+      aliases.push_back(entry.deviceName);
+    }
+    entry.segment = sqlite3_column_int64(stmt, 1);
+    entry.location = appendBytes(reinterpret_cast<const uint8_t*>(sqlite3_column_blob(stmt, 2)),
+                                 sqlite3_column_bytes(stmt, 2));
+    entries.push_back(std::move(entry));
+  }
+
+  sqlite3_finalize(stmt);
+  sqlite3_close(db);
+
+  commit(fileHash, makeLayout(LEGACY_SEGMENT_SIZE, false), aliases, entries);
+
+  for (const char* suffix : {"", "-journal", "-wal", "-shm"}) {
+    boost::system::error_code ec;
+    fs::remove(legacyDb.string() + suffix, ec);
+  }
+}
+
+} // chronoshare
+} // ndn
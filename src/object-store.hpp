@@ -0,0 +1,307 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+
+#ifndef CHRONOSHARE_SRC_OBJECT_STORE_HPP
+#define CHRONOSHARE_SRC_OBJECT_STORE_HPP
+
+#include "core/chronoshare-common.hpp"
+#include "db-helper.hpp"
+
+#include <ndn-cxx/data.hpp>
+#include <ndn-cxx/name.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace ndn {
+namespace chronoshare {
+
+class ObjectStore;
+typedef shared_ptr<ObjectStore> ObjectStorePtr;
+
+/**
+ * @brief Append-only store of file segments shared by all ObjectDb instances of a folder
+ *
+ * Segments (complete Data packets) are appended to pack files <folder>/objects/pack-<N>, a new
+ * pack is started once the current one grows beyond MAX_PACK_SIZE.  The index database
+ * <folder>/objects/index.db maps (file_hash, layout, segment) to (pack, offset, length).
+ *
+ * Objects are addressed by content: the layout is how the object is split into segments (see
+ * ObjectManager::getLayout), not who published it, so identical content published by several
+ * devices with the same settings is stored once.  Aliases map (file_hash, device_name), i.e.,
+ * the names /<device_name>/<appname>/file/<hash>/<segment>, to the layout that device publishes
+ * the object with; any device's copy of that layout satisfies lookups under the name.
+ *
+ * Pack data is flushed to disk before the index entries pointing to it are committed, so the
+ * index never references missing data.  Space of segments written without a committed index
+ * entry (e.g., after a crash) is not reclaimed.
+ *
+ * Files published with content-defined chunking also have their chunks indexed: ObjectChunks
+ * maps (file_hash, layout, segment) to the SHA-256 digest of the segment's content.  A segment
+ * that has not been fetched can be read from any stored segment with the same digest.
+ *
+ * Per-hash SQLite databases of earlier versions (<folder>/objects/xx/<rest-of-hash>) are imported
+ * into the store when it is opened for the first time.
+ */
+class ObjectStore : public DbHelper
+{
+public:
+  class Error : public DbHelper::Error
+  {
+  public:
+    explicit
+    Error(const std::string& what)
+      : DbHelper::Error(what)
+    {
+    }
+  };
+
+  struct Location
+  {
+    sqlite3_int64 pack;
+    sqlite3_int64 offset;
+    sqlite3_int64 length;
+  };
+
+  struct IndexEntry
+  {
+    Buffer deviceName; ///< device that signed the stored packet
+    sqlite3_int64 segment;
+    Location location;
+  };
+
+  static const sqlite3_int64 MAX_PACK_SIZE;
+  /// size of a chunk digest in chunk lists
+  static const size_t CHUNK_HASH_SIZE;
+
+  /**
+   * @brief Reads segments of an object in order, with one index query for all of them
+   *
+   * The content of each segment is located in the stored packet without decoding the Data
+   * packet and without copying it.  Segments that were not fetched, as the same content is
+   * stored for another file, are looked up one by one.
+   */
+  class SegmentReader : noncopyable
+  {
+  public:
+    /**
+     * @brief Read object @p fileHash in the layout @p deviceName publishes it with, starting
+     *        from @p firstSegment
+     */
+    SegmentReader(ObjectStore& store, const Buffer& fileHash, const Name& deviceName,
+                  sqlite3_int64 firstSegment = 0);
+
+    /**
+     * @brief Read the next segment
+     * @param[out] content  content of the segment, valid until the next call
+     * @return false after the last stored segment, or if the segment cannot be read
+     */
+    bool
+    next(const uint8_t*& content /*out*/, size_t& size /*out*/);
+
+    /**
+     * @brief Number of segments read so far, including the ones before the first segment
+     */
+    sqlite3_int64
+    getNSegments() const
+    {
+      return m_segment;
+    }
+
+    /**
+     * @brief Stored packet of the segment returned by the last next()
+     */
+    const Block&
+    getPacket() const
+    {
+      return m_block;
+    }
+
+  private:
+    ObjectStore& m_store;
+    Buffer m_fileHash;
+    Name m_deviceName;
+    Statement m_stmt;
+    bool m_hasRow; // m_stmt is on a row that is not read yet
+    sqlite3_int64 m_segment;
+
+    shared_ptr<Buffer> m_packet; // reused unless the previous content is still referenced
+    Block m_block;
+  };
+
+public:
+  /**
+   * @brief Get layout of objects split into @p segmentSize segments, or into chunks of up to
+   *        @p segmentSize bytes if @p isChunked
+   */
+  static std::string
+  makeLayout(size_t segmentSize, bool isChunked);
+
+  /**
+   * @brief Get layout under which segments of an incomplete object in @p layout are committed
+   *
+   * Such segments are not visible in @p layout, so the object is not considered stored, until
+   * the object is committed in @p layout.
+   */
+  static std::string
+  makePartialLayout(const std::string& layout);
+
+  /**
+   * @brief Get the store of @p folder, opening (and migrating) it if it is not open yet
+   *
+   * The store stays open as long as a returned pointer is alive.
+   */
+  static ObjectStorePtr
+  open(const boost::filesystem::path& folder);
+
+  ObjectStore(const boost::filesystem::path& folder);
+
+  virtual ~ObjectStore();
+
+  /**
+   * @brief Append @p data to the current pack file
+   *
+   * The segment becomes visible to lookups only after its location is passed to commit().
+   */
+  Location
+  append(const Data& data);
+
+  /**
+   * @brief Flush appended data to disk and add @p entries of object (@p fileHash, @p layout),
+   *        as well as @p aliases for it, in one transaction
+   *
+   * The object is complete once @p aliases are committed for it, so its segments committed
+   * earlier in the partial layout are moved to @p layout.
+   */
+  void
+  commit(const Buffer& fileHash, const std::string& layout, const std::vector<Buffer>& aliases,
+         const std::vector<IndexEntry>& entries);
+
+  bool
+  lookup(const Buffer& fileHash, const std::string& layout, sqlite3_int64 segment,
+         Location& location);
+
+  /**
+   * @brief Lookup a segment of @p fileHash in the layout @p deviceName publishes it with
+   */
+  bool
+  lookup(const Buffer& fileHash, const Name& deviceName, sqlite3_int64 segment,
+         Location& location);
+
+  /**
+   * @brief Read Data packet stored at @p location
+   * @return nullptr if the pack file cannot be read
+   */
+  shared_ptr<Data>
+  read(const Location& location);
+
+  /**
+   * @brief Check if there are committed segments or indexed chunks of @p fileHash in the layout
+   *        @p deviceName publishes it with
+   */
+  bool
+  hasObject(const Buffer& fileHash, const Name& deviceName);
+
+  /**
+   * @brief Make object (@p fileHash, @p layout) available under @p deviceName
+   * @return false, without adding the alias, if the object is not stored
+   */
+  bool
+  addAlias(const Buffer& fileHash, const Name& deviceName, const std::string& layout);
+
+  /**
+   * @brief Get number of segments of object (@p fileHash, @p layout), 0 if it is not stored
+   */
+  sqlite3_int64
+  countSegments(const Buffer& fileHash, const std::string& layout);
+
+  /**
+   * @brief Index chunks of object (@p fileHash, @p layout) and make it available under
+   *        @p deviceName, segment N of the object is the N-th digest in @p chunkList
+   */
+  void
+  addChunks(const Buffer& fileHash, const Name& deviceName, const std::string& layout,
+            const Buffer& chunkList);
+
+  /**
+   * @brief Remove segments, indexed chunks, and aliases of @p fileHash in the layout
+   *        @p deviceName publishes it with, e.g., if the stored content does not match the hash
+   *
+   * Pack space of the removed segments is not reclaimed.
+   */
+  void
+  remove(const Buffer& fileHash, const Name& deviceName);
+
+  /**
+   * @brief Check if a segment with content digest @p chunkHash is stored
+   */
+  bool
+  hasChunk(const uint8_t* chunkHash);
+
+  /**
+   * @brief Find a stored segment with the same content as the segment of @p fileHash
+   */
+  bool
+  lookupChunk(const Buffer& fileHash, const Name& deviceName, sqlite3_int64 segment,
+              Location& location);
+
+private:
+  /**
+   * @brief Read the packet stored at @p location into @p buffer
+   */
+  bool
+  readPacket(const Location& location, Buffer& buffer);
+
+  /**
+   * @brief Append raw bytes to the current pack file, starting a new one if it is full
+   */
+  Location
+  appendBytes(const uint8_t* buf, size_t size);
+
+  /**
+   * @brief Get (open if necessary) file descriptor of @p pack, must be called with m_packMutex
+   *        held
+   */
+  int
+  getPackFd(sqlite3_int64 pack);
+
+  void
+  migrateLegacyObjects();
+
+  void
+  migrateLegacyObject(const boost::filesystem::path& legacyDb, const Buffer& fileHash);
+
+private:
+  boost::filesystem::path m_objectsFolder;
+
+  std::mutex m_packMutex;
+  std::map<sqlite3_int64, int> m_packFds;
+  sqlite3_int64 m_currentPack;
+  sqlite3_int64 m_currentPackSize;
+  bool m_hasUnsyncedData;
+};
+
+} // chronoshare
+} // ndn
+
+#endif // CHRONOSHARE_SRC_OBJECT_STORE_HPP
@@ -0,0 +1,131 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+
+#include "packet-cache.hpp"
+
+namespace ndn {
+namespace chronoshare {
+
+const size_t PacketCache::DEFAULT_CAPACITY = 32 * 1024 * 1024;
+
+PacketCache::PacketCache(size_t capacity)
+  : m_capacity(capacity)
+  , m_nBytes(0)
+  , m_nHits(0)
+  , m_nMisses(0)
+  , m_nEvictions(0)
+{
+}
+
+shared_ptr<const Data>
+PacketCache::find(const Name& name)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  auto entry = m_index.find(name);
+  if (entry == m_index.end()) {
+    m_nMisses++;
+    return nullptr;
+  }
+
+  m_nHits++;
+  m_packets.splice(m_packets.begin(), m_packets, entry->second);
+  return *entry->second;
+}
+
+bool
+PacketCache::markPending(const Name& name, const OnInserted& onInserted)
+{
+  shared_ptr<const Data> cached;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto entry = m_index.find(name);
+    if (entry == m_index.end()) {
+      auto pending = m_pending.find(name);
+      if (pending == m_pending.end()) {
+        m_pending[name];
+        return true;
+      }
+      if (onInserted != nullptr) {
+        pending->second.push_back(onInserted);
+      }
+      return false;
+    }
+    cached = *entry->second;
+  }
+
+  if (onInserted != nullptr) {
+    onInserted(cached);
+  }
+  return false;
+}
+
+void
+PacketCache::insert(const shared_ptr<const Data>& data)
+{
+  std::vector<OnInserted> waiting;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const Name& name = data->getName();
+    auto pending = m_pending.find(name);
+    if (pending != m_pending.end()) {
+      waiting.swap(pending->second);
+      m_pending.erase(pending);
+    }
+
+    size_t size = data->wireEncode().size();
+    if (size <= m_capacity && m_index.count(name) == 0) {
+      while (m_nBytes + size > m_capacity) {
+        const shared_ptr<const Data>& last = m_packets.back();
+        m_nBytes -= last->wireEncode().size();
+        m_index.erase(last->getName());
+        m_packets.pop_back();
+        m_nEvictions++;
+      }
+
+      m_packets.push_front(data);
+      m_index[name] = m_packets.begin();
+      m_nBytes += size;
+    }
+  }
+
+  for (const auto& onInserted : waiting) {
+    onInserted(data);
+  }
+}
+
+void
+PacketCache::cancelPending(const Name& name)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_pending.erase(name);
+}
+
+PacketCache::Stats
+PacketCache::getStats() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return Stats{m_nHits, m_nMisses, m_nEvictions, m_packets.size(), m_nBytes};
+}
+
+} // chronoshare
+} // ndn
@@ -0,0 +1,131 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+
+#ifndef CHRONOSHARE_SRC_PACKET_CACHE_HPP
+#define CHRONOSHARE_SRC_PACKET_CACHE_HPP
+
+#include "core/chronoshare-common.hpp"
+
+#include <ndn-cxx/data.hpp>
+#include <ndn-cxx/name.hpp>
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace ndn {
+namespace chronoshare {
+
+class PacketCache;
+typedef shared_ptr<PacketCache> PacketCachePtr;
+
+/**
+ * @brief LRU cache of signed Data packets, limited by their total wire size
+ *
+ * Packets are keyed by their full name, so the same segment served under different forwarding
+ * hints is cached separately.  Names can be marked pending while their packets are being
+ * prepared, so that they are not prepared twice; requests for a pending packet wait until it is
+ * inserted.
+ */
+class PacketCache : noncopyable
+{
+public:
+  struct Stats
+  {
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nEvictions;
+    size_t nPackets;
+    size_t nBytes;
+
+    double
+    getHitRate() const
+    {
+      return nHits + nMisses > 0 ? static_cast<double>(nHits) / (nHits + nMisses) : 0.0;
+    }
+  };
+
+  typedef function<void(const shared_ptr<const Data>&)> OnInserted;
+
+  /// default limit of the total wire size of cached packets
+  static const size_t DEFAULT_CAPACITY;
+
+public:
+  explicit
+  PacketCache(size_t capacity = DEFAULT_CAPACITY);
+
+  /**
+   * @brief Find packet named @p name, making it the most recently used one
+   * @return nullptr if the packet is not cached
+   */
+  shared_ptr<const Data>
+  find(const Name& name);
+
+  /**
+   * @brief Mark that the packet named @p name is being prepared
+   *
+   * If the packet is cached, @p onInserted is called with it right away; if it is pending,
+   * @p onInserted is called once it is inserted.
+   *
+   * @param onInserted  may be empty if the caller does not need the packet
+   * @return true if the name is marked, i.e., the caller has to insert() the packet or
+   *         cancelPending(); false if the packet is cached or pending already
+   */
+  bool
+  markPending(const Name& name, const OnInserted& onInserted = OnInserted());
+
+  /**
+   * @brief Add signed @p data, evicting the least recently used packets to stay within the
+   *        capacity, clear its pending mark and pass it to the requests waiting for it
+   */
+  void
+  insert(const shared_ptr<const Data>& data);
+
+  /**
+   * @brief Clear the pending mark of @p name, whose packet could not be prepared, dropping the
+   *        requests waiting for it
+   */
+  void
+  cancelPending(const Name& name);
+
+  Stats
+  getStats() const;
+
+private:
+  typedef std::list<shared_ptr<const Data>> PacketList;
+
+  size_t m_capacity;
+
+  mutable std::mutex m_mutex;
+  PacketList m_packets; // most recently used first
+  std::map<Name, PacketList::iterator> m_index;
+  std::map<Name, std::vector<OnInserted>> m_pending; // pending name -> requests waiting for it
+
+  size_t m_nBytes;
+  uint64_t m_nHits;
+  uint64_t m_nMisses;
+  uint64_t m_nEvictions;
+};
+
+} // chronoshare
+} // ndn
+
+#endif // CHRONOSHARE_SRC_PACKET_CACHE_HPP
@@ -0,0 +1,169 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+
+#include "receive-window.hpp"
+
+namespace ndn {
+namespace chronoshare {
+
+const size_t ReceiveWindow::INITIAL_CAPACITY = 1024;
+
+ReceiveWindow::ReceiveWindow(int64_t first)
+  : m_first(first)
+  , m_capacity(INITIAL_CAPACITY)
+  , m_received(INITIAL_CAPACITY / 64)
+  , m_pending(INITIAL_CAPACITY / 64)
+  , m_retransmitted(INITIAL_CAPACITY / 64)
+  , m_sendTimes(INITIAL_CAPACITY)
+  , m_nReceivedOutOfOrder(0)
+  , m_nPending(0)
+{
+}
+
+void
+ReceiveWindow::markPending(int64_t seqNo, TimePoint sendTime)
+{
+  if (seqNo < m_first) {
+    return;
+  }
+  reserve(seqNo);
+
+  if (!testBit(m_pending, seqNo)) {
+    setBit(m_pending, seqNo);
+    m_nPending++;
+  }
+  clearBit(m_retransmitted, seqNo);
+  m_sendTimes[index(seqNo)] = sendTime;
+}
+
+void
+ReceiveWindow::markRetransmitted(int64_t seqNo)
+{
+  if (isPending(seqNo)) {
+    setBit(m_retransmitted, seqNo);
+  }
+}
+
+bool
+ReceiveWindow::clearPending(int64_t seqNo, TimePoint& sendTime, bool& isRetransmitted)
+{
+  if (!isPending(seqNo)) {
+    return false;
+  }
+
+  sendTime = m_sendTimes[index(seqNo)];
+  isRetransmitted = testBit(m_retransmitted, seqNo);
+  clearBit(m_pending, seqNo);
+  m_nPending--;
+  return true;
+}
+
+bool
+ReceiveWindow::markReceived(int64_t seqNo)
+{
+  if (isReceived(seqNo)) {
+    return false;
+  }
+  reserve(seqNo);
+
+  if (testBit(m_pending, seqNo)) {
+    clearBit(m_pending, seqNo);
+    m_nPending--;
+  }
+
+  if (seqNo != m_first) {
+    setBit(m_received, seqNo);
+    m_nReceivedOutOfOrder++;
+    return true;
+  }
+
+  // slots behind the first missing segment are reused for segments further ahead
+  m_first++;
+  while (m_nReceivedOutOfOrder > 0 && testBit(m_received, m_first)) {
+    clearBit(m_received, m_first);
+    m_nReceivedOutOfOrder--;
+    m_first++;
+  }
+  return true;
+}
+
+SegmentRanges
+ReceiveWindow::getReceivedRanges() const
+{
+  SegmentRanges ranges;
+  size_t nFound = 0;
+  for (int64_t seqNo = m_first; nFound < m_nReceivedOutOfOrder; seqNo++) {
+    if (index(seqNo) % 64 == 0 && m_received[index(seqNo) / 64] == 0) {
+      seqNo += 63;
+      continue;
+    }
+    if (!testBit(m_received, seqNo)) {
+      continue;
+    }
+
+    if (!ranges.empty() && ranges.back().second + 1 == static_cast<uint64_t>(seqNo)) {
+      ranges.back().second = seqNo;
+    }
+    else {
+      ranges.push_back(std::make_pair(seqNo, seqNo));
+    }
+    nFound++;
+  }
+  return ranges;
+}
+
+void
+ReceiveWindow::reserve(int64_t seqNo)
+{
+  size_t capacity = m_capacity;
+  while (seqNo - m_first >= static_cast<int64_t>(capacity)) {
+    capacity *= 2;
+  }
+  if (capacity == m_capacity) {
+    return;
+  }
+
+  ReceiveWindow grown(m_first);
+  grown.m_capacity = capacity;
+  grown.m_received.resize(capacity / 64);
+  grown.m_pending.resize(capacity / 64);
+  grown.m_retransmitted.resize(capacity / 64);
+  grown.m_sendTimes.resize(capacity);
+  grown.m_nReceivedOutOfOrder = m_nReceivedOutOfOrder;
+  grown.m_nPending = m_nPending;
+
+  for (int64_t i = m_first; i < m_first + static_cast<int64_t>(m_capacity); i++) {
+    if (testBit(m_received, i)) {
+      grown.setBit(grown.m_received, i);
+    }
+    if (testBit(m_pending, i)) {
+      grown.setBit(grown.m_pending, i);
+    }
+    if (testBit(m_retransmitted, i)) {
+      grown.setBit(grown.m_retransmitted, i);
+    }
+    grown.m_sendTimes[grown.index(i)] = m_sendTimes[index(i)];
+  }
+
+  *this = std::move(grown);
+}
+
+} // chronoshare
+} // ndn
@@ -0,0 +1,179 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+
+#ifndef CHRONOSHARE_SRC_RECEIVE_WINDOW_HPP
+#define CHRONOSHARE_SRC_RECEIVE_WINDOW_HPP
+
+#include "core/chronoshare-common.hpp"
+
+#include <chrono>
+#include <utility>
+#include <vector>
+
+namespace ndn {
+namespace chronoshare {
+
+/**
+ * @brief Ranges of segment numbers, from the first to the last segment of each range
+ */
+typedef std::vector<std::pair<uint64_t, uint64_t>> SegmentRanges;
+
+/**
+ * @brief Receive state of segments from the first segment that is not received yet
+ *
+ * Segments are tracked in bitmaps of a ring buffer indexed by segment number, so marking a
+ * segment and advancing past the segments received in order take constant time and do not
+ * allocate.  The buffer grows to cover the span between the first missing segment and the last
+ * one requested or received.
+ */
+class ReceiveWindow
+{
+public:
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+  static const size_t INITIAL_CAPACITY;
+
+public:
+  /**
+   * @param first  first segment to receive
+   */
+  explicit
+  ReceiveWindow(int64_t first);
+
+  /**
+   * @brief The first segment that is not received yet, all segments before it are received
+   */
+  int64_t
+  getFirstMissing() const
+  {
+    return m_first;
+  }
+
+  bool
+  isReceived(int64_t seqNo) const
+  {
+    return seqNo < m_first || (seqNo - m_first < static_cast<int64_t>(m_capacity) &&
+                               testBit(m_received, seqNo));
+  }
+
+  bool
+  isPending(int64_t seqNo) const
+  {
+    return seqNo >= m_first && seqNo - m_first < static_cast<int64_t>(m_capacity) &&
+           testBit(m_pending, seqNo);
+  }
+
+  /**
+   * @brief Mark that an Interest for @p seqNo is sent at @p sendTime
+   */
+  void
+  markPending(int64_t seqNo, TimePoint sendTime);
+
+  /**
+   * @brief Mark that the Interest for pending @p seqNo is retransmitted
+   */
+  void
+  markRetransmitted(int64_t seqNo);
+
+  /**
+   * @brief Stop tracking the Interest for @p seqNo
+   * @param[out] sendTime          when the Interest was sent
+   * @param[out] isRetransmitted  whether the Interest was retransmitted since
+   * @return false if @p seqNo is not pending
+   */
+  bool
+  clearPending(int64_t seqNo, TimePoint& sendTime /*out*/, bool& isRetransmitted /*out*/);
+
+  /**
+   * @brief Mark @p seqNo received, advancing past the segments that are received in order
+   * @return false if @p seqNo is received already
+   */
+  bool
+  markReceived(int64_t seqNo);
+
+  /**
+   * @brief Number of segments received after the first missing one
+   */
+  size_t
+  getNReceivedOutOfOrder() const
+  {
+    return m_nReceivedOutOfOrder;
+  }
+
+  size_t
+  getNPending() const
+  {
+    return m_nPending;
+  }
+
+  /**
+   * @brief Get ranges of segments received after the first missing one
+   */
+  SegmentRanges
+  getReceivedRanges() const;
+
+private:
+  size_t
+  index(int64_t seqNo) const
+  {
+    return static_cast<uint64_t>(seqNo) & (m_capacity - 1);
+  }
+
+  bool
+  testBit(const std::vector<uint64_t>& bits, int64_t seqNo) const
+  {
+    return (bits[index(seqNo) / 64] >> (index(seqNo) % 64)) & 1;
+  }
+
+  void
+  setBit(std::vector<uint64_t>& bits, int64_t seqNo)
+  {
+    bits[index(seqNo) / 64] |= uint64_t(1) << (index(seqNo) % 64);
+  }
+
+  void
+  clearBit(std::vector<uint64_t>& bits, int64_t seqNo)
+  {
+    bits[index(seqNo) / 64] &= ~(uint64_t(1) << (index(seqNo) % 64));
+  }
+
+  /**
+   * @brief Grow the buffer to cover @p seqNo, which should not precede the first missing segment
+   */
+  void
+  reserve(int64_t seqNo);
+
+private:
+  int64_t m_first;
+  size_t m_capacity; // in segments, a power of two
+
+  std::vector<uint64_t> m_received;
+  std::vector<uint64_t> m_pending;
+  std::vector<uint64_t> m_retransmitted;
+  std::vector<TimePoint> m_sendTimes;
+
+  size_t m_nReceivedOutOfOrder;
+  size_t m_nPending;
+};
+
+} // chronoshare
+} // ndn
+
+#endif // CHRONOSHARE_SRC_RECEIVE_WINDOW_HPP
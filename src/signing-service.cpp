@@ -0,0 +1,194 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+
+#include "signing-service.hpp"
+#include "core/logging.hpp"
+
+#include <ndn-cxx/security/key-chain.hpp>
+
+namespace ndn {
+namespace chronoshare {
+
+INIT_LOGGER("SigningService")
+
+const size_t SigningService::MAX_QUEUE_SIZE = 4096;
+
+static std::mutex g_instanceMutex;
+static std::weak_ptr<SigningService> g_instance;
+
+SigningServicePtr
+SigningService::getInstance()
+{
+  std::lock_guard<std::mutex> lock(g_instanceMutex);
+  SigningServicePtr service = g_instance.lock();
+  if (service == nullptr) {
+    service = make_shared<SigningService>();
+    g_instance = service;
+  }
+  return service;
+}
+
+SigningService::SigningService(size_t nThreads, size_t maxQueueSize)
+  : m_maxQueueSize(maxQueueSize)
+  , m_startTime(std::chrono::steady_clock::now())
+  , m_nextOrder(0)
+  , m_nBounded(0)
+  , m_isStopped(false)
+  , m_nSigned(0)
+  , m_maxQueueDepth(0)
+{
+  if (nThreads == 0) {
+    nThreads = std::max(std::thread::hardware_concurrency(), 1U);
+  }
+
+  _LOG_DEBUG("Starting " << nThreads << " signing threads");
+  for (size_t i = 0; i < nThreads; i++) {
+    m_workers.push_back(std::thread(&SigningService::run, this));
+  }
+}
+
+SigningService::~SigningService()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_isStopped = true;
+  }
+  m_hasRequests.notify_all();
+
+  // queued requests are still served
+  for (std::thread& worker : m_workers) {
+    worker.join();
+  }
+
+  Stats stats = getStats();
+  _LOG_DEBUG("Signed " << stats.nSigned << " packets, " << stats.signaturesPerSecond
+                       << " signatures/sec, max queue depth " << stats.maxQueueDepth);
+}
+
+void
+SigningService::sign(const shared_ptr<Data>& data, Priority priority,
+                     boost::asio::io_service& ioService, const OnSigned& onSigned)
+{
+  enqueue(priority, true, *data, [data, &ioService, onSigned] {
+      ioService.post(bind(onSigned, data));
+    });
+}
+
+void
+SigningService::signAndPut(Face& face, const shared_ptr<Data>& data, Priority priority)
+{
+  sign(data, priority, face.getIoService(), [&face] (const shared_ptr<Data>& signedData) {
+      face.put(*signedData);
+    });
+}
+
+void
+SigningService::sign(Data& data, Priority priority)
+{
+  sign(std::vector<shared_ptr<Data>>{shared_ptr<Data>(&data, [] (Data*) {})}, priority);
+}
+
+void
+SigningService::sign(const std::vector<shared_ptr<Data>>& data, Priority priority)
+{
+  std::mutex mutex;
+  std::condition_variable isDone;
+  size_t nPending = data.size();
+
+  for (const auto& packet : data) {
+    enqueue(priority, false, *packet, [&] {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--nPending == 0) {
+          isDone.notify_one();
+        }
+      });
+  }
+
+  std::unique_lock<std::mutex> lock(mutex);
+  isDone.wait(lock, [&nPending] { return nPending == 0; });
+}
+
+SigningService::Stats
+SigningService::getStats() const
+{
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_startTime;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return Stats{m_nSigned, elapsed.count() > 0 ? m_nSigned / elapsed.count() : 0.0,
+               m_queue.size(), m_maxQueueDepth};
+}
+
+void
+SigningService::enqueue(Priority priority, bool isBounded, Data& data,
+                        const function<void()>& onSigned)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (isBounded) {
+    m_hasSpace.wait(lock, [this] { return m_nBounded < m_maxQueueSize; });
+    m_nBounded++;
+  }
+
+  m_queue.push(Request{priority, m_nextOrder++, isBounded, &data, onSigned});
+  m_maxQueueDepth = std::max(m_maxQueueDepth, m_queue.size());
+  lock.unlock();
+
+  m_hasRequests.notify_one();
+}
+
+void
+SigningService::run()
+{
+  // KeyChain is not thread-safe, so every worker uses its own instance
+  KeyChain keyChain;
+
+  while (true) {
+    Request request;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_hasRequests.wait(lock, [this] { return !m_queue.empty() || m_isStopped; });
+      if (m_queue.empty()) {
+        return;
+      }
+
+      request = m_queue.top();
+      m_queue.pop();
+      if (request.isBounded) {
+        m_nBounded--;
+        m_hasSpace.notify_one();
+      }
+    }
+
+    try {
+      keyChain.sign(*request.data);
+    }
+    catch (const std::exception& e) {
+      _LOG_ERROR("Cannot sign " << request.data->getName() << ": " << e.what());
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_nSigned++;
+    }
+    request.onSigned();
+  }
+}
+
+} // chronoshare
+} // ndn
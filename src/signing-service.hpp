@@ -0,0 +1,173 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+
+#ifndef CHRONOSHARE_SRC_SIGNING_SERVICE_HPP
+#define CHRONOSHARE_SRC_SIGNING_SERVICE_HPP
+
+#include "core/chronoshare-common.hpp"
+
+#include <ndn-cxx/data.hpp>
+#include <ndn-cxx/face.hpp>
+
+#include <boost/asio/io_service.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace ndn {
+namespace chronoshare {
+
+class SigningService;
+typedef shared_ptr<SigningService> SigningServicePtr;
+
+/**
+ * @brief Signs Data packets on a pool of worker threads
+ *
+ * Requests are served in the order of their priority, and in the order of submission within
+ * the same priority.  Every worker thread uses its own KeyChain, as KeyChain is not
+ * thread-safe.
+ *
+ * Asynchronous requests wait for space once MAX_QUEUE_SIZE requests are queued, so bulk
+ * producers cannot run ahead of the workers.  Blocking requests are not limited, their callers
+ * wait for the result anyway.
+ */
+class SigningService : noncopyable
+{
+public:
+  enum Priority {
+    PRIORITY_SYNC,        ///< sync replies
+    PRIORITY_INTERACTIVE, ///< actions and replies to local commands
+    PRIORITY_SEGMENT,     ///< file segments requested by other devices
+    PRIORITY_BULK         ///< segments of newly published files
+  };
+
+  typedef function<void(const shared_ptr<Data>&)> OnSigned;
+
+  struct Stats
+  {
+    uint64_t nSigned;
+    double signaturesPerSecond; ///< since the service was started
+    size_t queueDepth;
+    size_t maxQueueDepth;
+  };
+
+  static const size_t MAX_QUEUE_SIZE;
+
+public:
+  /**
+   * @brief Get the service shared by all components, starting it if it is not running
+   *
+   * The service stays running as long as a returned pointer is alive.
+   */
+  static SigningServicePtr
+  getInstance();
+
+  /**
+   * @param nThreads      number of worker threads, 0 to use one per hardware thread
+   * @param maxQueueSize  number of queued asynchronous requests at which submission blocks
+   */
+  explicit
+  SigningService(size_t nThreads = 0, size_t maxQueueSize = MAX_QUEUE_SIZE);
+
+  ~SigningService();
+
+  /**
+   * @brief Sign @p data asynchronously, @p onSigned is posted to @p ioService afterwards
+   */
+  void
+  sign(const shared_ptr<Data>& data, Priority priority, boost::asio::io_service& ioService,
+       const OnSigned& onSigned);
+
+  /**
+   * @brief Sign @p data asynchronously and put it to @p face
+   */
+  void
+  signAndPut(Face& face, const shared_ptr<Data>& data, Priority priority);
+
+  /**
+   * @brief Sign @p data, blocking until it is signed
+   */
+  void
+  sign(Data& data, Priority priority);
+
+  /**
+   * @brief Sign all of @p data in parallel, blocking until all of them are signed
+   */
+  void
+  sign(const std::vector<shared_ptr<Data>>& data, Priority priority);
+
+  Stats
+  getStats() const;
+
+private:
+  struct Request
+  {
+    Priority priority;
+    uint64_t order;
+    bool isBounded;
+    Data* data;
+    function<void()> onSigned; // called on the worker thread
+  };
+
+  struct RequestCompare
+  {
+    bool
+    operator()(const Request& a, const Request& b) const
+    {
+      // std::priority_queue pops the largest element
+      return a.priority > b.priority || (a.priority == b.priority && a.order > b.order);
+    }
+  };
+
+  /**
+   * @brief Queue a request, waiting for space if it is asynchronous
+   */
+  void
+  enqueue(Priority priority, bool isBounded, Data& data, const function<void()>& onSigned);
+
+  void
+  run();
+
+private:
+  size_t m_maxQueueSize;
+  std::chrono::steady_clock::time_point m_startTime;
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_hasRequests;
+  std::condition_variable m_hasSpace;
+  std::priority_queue<Request, std::vector<Request>, RequestCompare> m_queue;
+  uint64_t m_nextOrder;
+  size_t m_nBounded; // queued asynchronous requests
+  bool m_isStopped;
+
+  uint64_t m_nSigned;
+  size_t m_maxQueueDepth;
+
+  std::vector<std::thread> m_workers;
+};
+
+} // chronoshare
+} // ndn
+
+#endif // CHRONOSHARE_SRC_SIGNING_SERVICE_HPP
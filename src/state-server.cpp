@@ -36,18 +36,70 @@ INIT_LOGGER("StateServer")
 
 namespace fs = boost::filesystem;
 
+// cursor components are distinguished from numeric <offset> components by this prefix
+static const std::string CURSOR_PREFIX = "after=";
+
+static bool
+isCursor(const name::Component& component)
+{
+  return component.value_size() > CURSOR_PREFIX.size() &&
+         std::equal(CURSOR_PREFIX.begin(), CURSOR_PREFIX.end(), component.value());
+}
+
+static std::string
+getCursorValue(const name::Component& component)
+{
+  return std::string(reinterpret_cast<const char*>(component.value()) + CURSOR_PREFIX.size(),
+                     component.value_size() - CURSOR_PREFIX.size());
+}
+
+// <timestamp>.<seq_no>.<hex of device name>
+static std::string
+encodeActionCursor(const ActionLog::ActionKey& key)
+{
+  const Block& deviceName = key.deviceName.wireEncode();
+  return CURSOR_PREFIX + boost::lexical_cast<std::string>(key.timestamp) + "." +
+         boost::lexical_cast<std::string>(key.seqNo) + "." +
+         toHex(deviceName.wire(), deviceName.size());
+}
+
+static bool
+decodeActionCursor(const std::string& cursor, ActionLog::ActionKey& key)
+{
+  size_t timestampEnd = cursor.find('.');
+  size_t seqNoEnd = cursor.find('.', timestampEnd + 1);
+  if (timestampEnd == std::string::npos || seqNoEnd == std::string::npos) {
+    return false;
+  }
+
+  try {
+    key.timestamp = boost::lexical_cast<time_t>(cursor.substr(0, timestampEnd));
+    key.seqNo = boost::lexical_cast<sqlite3_int64>(
+      cursor.substr(timestampEnd + 1, seqNoEnd - timestampEnd - 1));
+    shared_ptr<const Buffer> deviceName = fromHex(cursor.substr(seqNoEnd + 1));
+    key.deviceName = Name(Block(deviceName));
+  }
+  catch (const std::exception&) {
+    return false;
+  }
+  return true;
+}
+
 StateServer::StateServer(Face& face, ActionLogPtr actionLog,
                          const fs::path& rootDir, const Name& userName,
                          const std::string& sharedFolderName, const std::string& appName,
-                         ObjectManager& objectManager, time::milliseconds freshness)
+                         ObjectManager& objectManager, time::milliseconds freshness,
+                         int pageSize)
   : m_face(face)
   , m_actionLog(actionLog)
   , m_objectManager(objectManager)
   , m_rootDir(rootDir)
   , m_freshness(freshness)
+  , m_pageSize(pageSize)
   , m_userName(userName)
   , m_sharedFolderName(sharedFolderName)
   , m_appName(appName)
+  , m_signingService(SigningService::getInstance())
   , m_ioService(m_face.getIoService())
 {
   // may be later /localhop should be replaced with /%C1.M.S.localhost
@@ -143,7 +195,8 @@ StateServer::formatActionJson(json_spirit::Array& actions, const Name& name,
    *              "hash": "<FILE-HASH>",
    *              "timestamp": "<FILE-TIMESTAMP>",
    *              "chmod": "<FILE-MODE>",
-   *              "segNum": "<NUMBER-OF-SEGMENTS(~file size)>"
+   *              "segNum": "<NUMBER-OF-SEGMENTS>",
+   *              "segSize": "<SEGMENT-SIZE>"
    *          },
    *
    *          // if parent_device_name is set
@@ -181,6 +234,7 @@ StateServer::formatActionJson(json_spirit::Array& actions, const Name& name,
     update.push_back(Pair("chmod", chmod.str()));
 
     update.push_back(Pair("segNum", action.seg_num()));
+    update.push_back(Pair("segSize", static_cast<int>(action.seg_size())));
     json.push_back(Pair("update", update));
   }
 
@@ -231,7 +285,6 @@ StateServer::info_actions_fileOrFolder_Execute(const Name& interest, bool isFold
     _LOG_ERROR("empty interest name");
     return;
   }
-  uint64_t offset = interest.get(-1).toNumber();
 
   /// @todo !!! add security checking
 
@@ -251,30 +304,53 @@ StateServer::info_actions_fileOrFolder_Execute(const Name& interest, bool isFold
    * }
    */
 
-  _LOG_DEBUG("info_actions_fileOrFolder_Execute! offset: " << offset);
   using namespace json_spirit;
   Object json;
 
   Array actions;
+  ActionLog::ActionKey last{0, Name(), 0};
+  auto visitor = [&actions, &last] (const Name& name, sqlite3_int64 seq_no,
+                                    const ActionItem& action) {
+    StateServer::formatActionJson(actions, name, seq_no, action);
+    last = ActionLog::ActionKey{static_cast<time_t>(action.timestamp()), name, seq_no};
+  };
+
   bool more;
-  if (isFolder) {
-    more =
-      m_actionLog->LookupActionsInFolderRecursively(bind(StateServer::formatActionJson,
-                                                                boost::ref(actions), _1, _2, _3),
-                                                    fileOrFolderName, offset * 10, 10);
+  if (isCursor(interest.get(-1))) {
+    ActionLog::ActionKey after;
+    if (!decodeActionCursor(getCursorValue(interest.get(-1)), after)) {
+      _LOG_ERROR("Invalid cursor in " << interest);
+      return;
+    }
+    _LOG_DEBUG("info_actions_fileOrFolder_Execute! after: " << after.deviceName << "/"
+                                                           << after.seqNo);
+
+    if (isFolder) {
+      more = m_actionLog->LookupActionsInFolderRecursively(visitor, fileOrFolderName, after,
+                                                           m_pageSize);
+    }
+    else {
+      more = m_actionLog->LookupActionsForFile(visitor, fileOrFolderName, after, m_pageSize);
+    }
   }
   else {
-    more = m_actionLog->LookupActionsForFile(bind(StateServer::formatActionJson,
-                                                         boost::ref(actions), _1, _2, _3),
-                                             fileOrFolderName, offset * 10, 10);
+    uint64_t offset = interest.get(-1).toNumber();
+    _LOG_DEBUG("info_actions_fileOrFolder_Execute! offset: " << offset);
+
+    if (isFolder) {
+      more = m_actionLog->LookupActionsInFolderRecursively(visitor, fileOrFolderName,
+                                                           offset * m_pageSize, m_pageSize);
+    }
+    else {
+      more = m_actionLog->LookupActionsForFile(visitor, fileOrFolderName, offset * m_pageSize,
+                                               m_pageSize);
+    }
   }
 
   json.push_back(Pair("actions", actions));
 
   if (more) {
-    json.push_back(Pair("more", boost::lexical_cast<std::string>(offset + 1)));
-    // Name more = Name(interest.getPartialName(0, interest.size() - 1))(offset + 1);
-    // json.push_back(Pair("more", boost::lexical_cast<std::string>(more)));
+    json.push_back(Pair("more", encodeActionCursor(last)));
   }
 
   std::ostringstream os;
@@ -284,8 +360,7 @@ StateServer::info_actions_fileOrFolder_Execute(const Name& interest, bool isFold
   data->setName(interest);
   data->setFreshnessPeriod(m_freshness);
   data->setContent(reinterpret_cast<const uint8_t*>(os.str().c_str()), os.str().size());
-  m_keyChain.sign(*data);
-  m_face.put(*data);
+  m_signingService->signAndPut(m_face, data, SigningService::PRIORITY_INTERACTIVE);
 }
 
 void
@@ -304,7 +379,8 @@ StateServer::formatFilestateJson(json_spirit::Array& files, const FileItem& file
    *          "hash": "<FILE-HASH>",
    *          "timestamp": "<FILE-TIMESTAMP>",
    *          "chmod": "<FILE-MODE>",
-   *          "segNum": "<NUMBER-OF-SEGMENTS(~file size)>"
+   *          "segNum": "<NUMBER-OF-SEGMENTS>",
+   *          "segSize": "<SEGMENT-SIZE>"
    *      }, ...,
    *      ]
    *
@@ -337,6 +413,7 @@ StateServer::formatFilestateJson(json_spirit::Array& files, const FileItem& file
   json.push_back(Pair("chmod", chmod.str()));
 
   json.push_back(Pair("segNum", file.seg_num()));
+  json.push_back(Pair("segSize", static_cast<int>(file.seg_size())));
 
   files.push_back(json);
 }
@@ -369,7 +446,6 @@ StateServer::info_files_folder_Execute(const Name& interest)
     _LOG_ERROR("empty interest name");
     return;
   }
-  uint64_t offset = interest.get(-1).toNumber();
 
   // /// @todo !!! add security checking
 
@@ -394,17 +470,41 @@ StateServer::info_files_folder_Execute(const Name& interest)
   Object json;
 
   Array files;
-  bool more = m_actionLog->GetFileState()
-                ->LookupFilesInFolderRecursively(bind(StateServer::formatFilestateJson,
-                                                             boost::ref(files), _1),
-                                                 folder, offset * 10, 10);
+  std::string last;
+  auto visitor = [&files, &last] (const FileItem& file) {
+    StateServer::formatFilestateJson(files, file);
+    last = file.filename();
+  };
+
+  bool more;
+  if (isCursor(interest.get(-1))) {
+    // <hex of the last returned filename>
+    std::string after;
+    try {
+      shared_ptr<const Buffer> filename = fromHex(getCursorValue(interest.get(-1)));
+      after.assign(reinterpret_cast<const char*>(filename->buf()), filename->size());
+    }
+    catch (const std::exception&) {
+      _LOG_ERROR("Invalid cursor in " << interest);
+      return;
+    }
+
+    more = m_actionLog->GetFileState()->LookupFilesInFolderRecursively(visitor, folder, after,
+                                                                       m_pageSize);
+  }
+  else {
+    uint64_t offset = interest.get(-1).toNumber();
+    more = m_actionLog->GetFileState()->LookupFilesInFolderRecursively(visitor, folder,
+                                                                       offset * m_pageSize,
+                                                                       m_pageSize);
+  }
 
   json.push_back(Pair("files", files));
 
   if (more) {
-    json.push_back(Pair("more", boost::lexical_cast<std::string>(offset + 1)));
-    // Name more = Name(interest.getPartialName(0, interest.size() - 1))(offset + 1);
-    // json.push_back(Pair("more", boost::lexical_cast<std::string>(more)));
+    json.push_back(Pair("more", CURSOR_PREFIX + toHex(reinterpret_cast<const uint8_t*>(
+                                                          last.data()),
+                                                        last.size())));
   }
 
   std::ostringstream os;
@@ -414,8 +514,7 @@ StateServer::info_files_folder_Execute(const Name& interest)
   data->setName(interest);
   data->setFreshnessPeriod(m_freshness);
   data->setContent(reinterpret_cast<const uint8_t*>(os.str().c_str()), os.str().size());
-  m_keyChain.sign(*data);
-  m_face.put(*data);
+  m_signingService->signAndPut(m_face, data, SigningService::PRIORITY_INTERACTIVE);
 }
 
 void
@@ -470,8 +569,7 @@ StateServer::cmd_restore_file_Execute(const Name& interest)
     data->setFreshnessPeriod(m_freshness);
     std::string msg = "FAIL: Requested file is not found";
     data->setContent(reinterpret_cast<const uint8_t*>(msg.c_str()), msg.size());
-    m_keyChain.sign(*data);
-    m_face.put(*data);
+    m_signingService->signAndPut(m_face, data, SigningService::PRIORITY_INTERACTIVE);
     return;
   }
 
@@ -499,8 +597,7 @@ StateServer::cmd_restore_file_Execute(const Name& interest)
         data->setFreshnessPeriod(m_freshness);
         std::string msg = "OK: File already exists";
         data->setContent(reinterpret_cast<const uint8_t*>(msg.c_str()), msg.size());
-        m_keyChain.sign(*data);
-        m_face.put(*data);
+        m_signingService->signAndPut(m_face, data, SigningService::PRIORITY_INTERACTIVE);
         _LOG_DEBUG("Asking to assemble a file, but file already exists on a filesystem");
         return;
       }
@@ -512,14 +609,13 @@ StateServer::cmd_restore_file_Execute(const Name& interest)
     data->setFreshnessPeriod(m_freshness);
     std::string msg = "FAIL: File operation failed";
     data->setContent(reinterpret_cast<const uint8_t*>(msg.c_str()), msg.size());
-    m_keyChain.sign(*data);
-    m_face.put(*data);
+    m_signingService->signAndPut(m_face, data, SigningService::PRIORITY_INTERACTIVE);
     _LOG_ERROR("File operations failed on [" << filePath << "](ignoring)");
   }
 
   _LOG_TRACE("Restoring file [" << filePath << "]"
                                 << " deviceName " << deviceName);
-  if (m_objectManager.objectsToLocalFile(deviceName, hash, filePath)) {
+  if (m_objectManager.objectsToLocalFile(deviceName, hash, filePath, file->seg_num())) {
     last_write_time(filePath, file->mtime());
 #if BOOST_VERSION >= 104900
     permissions(filePath, static_cast<fs::perms>(file->mode()));
@@ -529,8 +625,7 @@ StateServer::cmd_restore_file_Execute(const Name& interest)
     data->setFreshnessPeriod(m_freshness);
     std::string msg = "OK";
     data->setContent(reinterpret_cast<const uint8_t*>(msg.c_str()), msg.size());
-    m_keyChain.sign(*data);
-    m_face.put(*data);
+    m_signingService->signAndPut(m_face, data, SigningService::PRIORITY_INTERACTIVE);
     _LOG_DEBUG("Restoring file successfully!");
   }
   else {
@@ -539,8 +634,7 @@ StateServer::cmd_restore_file_Execute(const Name& interest)
     data->setFreshnessPeriod(m_freshness);
     std::string msg = "FAIL: Unknown error while restoring file";
     data->setContent(reinterpret_cast<const uint8_t*>(msg.c_str()), msg.size());
-    m_keyChain.sign(*data);
-    m_face.put(*data);
+    m_signingService->signAndPut(m_face, data, SigningService::PRIORITY_INTERACTIVE);
   }
 }
 
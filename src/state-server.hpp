@@ -62,18 +62,17 @@ namespace chronoshare {
  *
  *   Get list of actions for a folder(for all files under this folder)
  *
- *   <PREFIX_INFO>/"actions"/"folder"/<offset>  (all actions)
+ *   <PREFIX_INFO>/"actions"/"folder"/<offset|cursor>  (all actions)
  *   or
- *   <PREFIX_INFO>/"actions"/"folder"/<one-component-relative-file-name>/<offset>
+ *   <PREFIX_INFO>/"actions"/"folder"/<one-component-relative-file-name>/<offset|cursor>
  *
  *   Actions are ordered in decreasing order(latest will go first).
  *
- *   Each data packet contains up to 100 actions.
+ *   Each data packet contains up to pageSize actions(10 by default).
  *
- *   TEMPORARILY LIMIT IS REDUCED TO 10 !(for debug purposes)
- *  (may be even not temporarily...)
- *
- *   If more items are available, application data will specify URL for the next packet
+ *   If more items are available, application data will specify the cursor component of the
+ *   next packet.  The cursor encodes the last returned action, so the next page is looked up
+ *   directly instead of skipping <offset> pages.
  *
  *   Format of returned data(JSON):
  *   {
@@ -93,7 +92,8 @@ namespace chronoshare {
  *              "hash": "<FILE-HASH>",
  *              "timestamp": "<FILE-TIMESTAMP>",
  *              "chmod": "<FILE-MODE>",
- *              "segNum": "<NUMBER-OF-SEGMENTS(~file size)>"
+ *              "segNum": "<NUMBER-OF-SEGMENTS>",
+ *              "segSize": "<SEGMENT-SIZE>"
  *          },
  *
  *          // if parent_device_name is set
@@ -104,21 +104,18 @@ namespace chronoshare {
  *      },
  *
  *      // only if there are more actions available
- *      "more": "next segment number"
+ *      "more": "<cursor of the next packet>"
  *   }
  *
  *
  * - file
  *
- *   <PREFIX_INFO>/"files"/"folder"/<offset>  (full filestate)
+ *   <PREFIX_INFO>/"files"/"folder"/<offset|cursor>  (full filestate)
  *   or
- *   <PREFIX_INFO>/"files"/"folder"/<one-component-relative-folder-name>/<offset>
- *
- *   Each Data packets contains a list of up to 100 files.
- *   If more items are available, application data will specify URL for the next packet
+ *   <PREFIX_INFO>/"files"/"folder"/<one-component-relative-folder-name>/<offset|cursor>
  *
- *   TEMPORARILY LIMIT IS REDUCED TO 10 !(for debug purposes)
- *  (may be even not temporarily...)
+ *   Each Data packets contains a list of up to pageSize files(10 by default).
+ *   If more items are available, application data will specify the cursor of the next packet
  *
  *   Format of returned data(JSON):
  *   {
@@ -133,12 +130,13 @@ namespace chronoshare {
  *          "hash": "<FILE-HASH>",
  *          "timestamp": "<FILE-TIMESTAMP>",
  *          "chmod": "<FILE-MODE>",
- *          "segNum": "<NUMBER-OF-SEGMENTS(~file size)>"
+ *          "segNum": "<NUMBER-OF-SEGMENTS>",
+ *          "segSize": "<SEGMENT-SIZE>"
  *      }, ...,
  *      ]
  *
  *      // only if there are more actions available
- *      "more": "next segment number"
+ *      "more": "<cursor of the next packet>"
  *   }
  *
  * Commands available:
@@ -161,7 +159,8 @@ public:
   StateServer(Face& face, ActionLogPtr actionLog,
               const boost::filesystem::path& rootDir, const Name& userName,
               const std::string& sharedFolderName, const std::string& appName,
-              ObjectManager& objectManager, time::milliseconds freshness = time::seconds(60));
+              ObjectManager& objectManager, time::milliseconds freshness = time::seconds(60),
+              int pageSize = 10);
   ~StateServer();
 
 private:
@@ -215,11 +214,12 @@ private:
 
   boost::filesystem::path m_rootDir;
   time::milliseconds m_freshness;
+  int m_pageSize;
 
   Name m_userName;
   std::string m_sharedFolderName;
   std::string m_appName;
-  KeyChain m_keyChain;
+  SigningServicePtr m_signingService;
 
   boost::asio::io_service& m_ioService;
 };
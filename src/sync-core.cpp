@@ -49,6 +49,7 @@ SyncCore::SyncCore(Face& face, SyncLogPtr syncLog, const Name& userName,
   , m_syncPrefix(syncPrefix)
   , m_recoverWaitGenerator(new RandomIntervalGenerator(WAIT, RANDOM_PERCENT, RandomIntervalGenerator::UP))
   , m_syncInterestInterval(syncInterestInterval)
+  , m_signingService(SigningService::getInstance())
 {
   m_rootDigest = m_log->RememberStateInStateLog();
 
@@ -118,8 +119,7 @@ SyncCore::localStateChanged()
   data->setName(syncName);
   data->setFreshnessPeriod(time::seconds(FRESHNESS));
   data->setContent(reinterpret_cast<const uint8_t*>(syncData->buf()), syncData->size());
-  m_keyChain.sign(*data);
-  m_face.put(*data);
+  m_signingService->signAndPut(m_face, data, SigningService::PRIORITY_SYNC);
 
   _LOG_TRACE(msg);
 
@@ -232,8 +232,7 @@ SyncCore::handleSyncInterest(const Name& name)
     data->setName(name);
     data->setFreshnessPeriod(time::seconds(FRESHNESS));
     data->setContent(reinterpret_cast<const uint8_t*>(syncData->buf()), syncData->size());
-    m_keyChain.sign(*data);
-    m_face.put(*data);
+    m_signingService->signAndPut(m_face, data, SigningService::PRIORITY_SYNC);
 
     _LOG_TRACE(m_log->GetLocalName()
                << " publishes: " << toHex(*digest)
@@ -278,8 +277,7 @@ SyncCore::handleRecoverInterest(const Name& name)
     data->setName(name);
     data->setFreshnessPeriod(time::seconds(FRESHNESS));
     data->setContent(reinterpret_cast<const uint8_t*>(syncData->buf()), syncData->size());
-    m_keyChain.sign(*data);
-    m_face.put(*data);
+    m_signingService->signAndPut(m_face, data, SigningService::PRIORITY_SYNC);
 
     _LOG_TRACE("[" << m_log->GetLocalName() << "] publishes "
                    << toHex(*digest)
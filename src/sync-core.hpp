@@ -23,10 +23,10 @@
 
 #include "core/chronoshare-common.hpp"
 #include "sync-log.hpp"
+#include "signing-service.hpp"
 #include "core/random-interval-generator.hpp"
 
 #include <ndn-cxx/face.hpp>
-#include <ndn-cxx/security/key-chain.hpp>
 #include <ndn-cxx/util/scheduler.hpp>
 #include <ndn-cxx/util/scheduler-scoped-event-id.hpp>
 
@@ -216,7 +216,7 @@ private:
   IntervalGeneratorPtr m_recoverWaitGenerator;
 
   long m_syncInterestInterval;
-  KeyChain m_keyChain;
+  SigningServicePtr m_signingService;
   const RegisteredPrefixId* m_registeredPrefixId;
 };
 
@@ -21,14 +21,12 @@
 #include "sync-log.hpp"
 #include "core/logging.hpp"
 
-#include <ndn-cxx/util/sqlite3-statement.hpp>
+#include <ndn-cxx/util/digest.hpp>
 #include <ndn-cxx/util/string-helper.hpp>
 
 namespace ndn {
 namespace chronoshare {
 
-using util::Sqlite3Statement;
-
 INIT_LOGGER("Sync.Log")
 
 const std::string INIT_DATABASE = "\
@@ -61,7 +59,8 @@ CREATE INDEX SyncNodes_device_name ON SyncNodes(device_name);         \n\
 CREATE TABLE SyncLog(                                                  \n\
         state_id    INTEGER PRIMARY KEY AUTOINCREMENT,                 \n\
         state_hash  BLOB NOT NULL UNIQUE,                              \n\
-        last_update TIMESTAMP NOT NULL                                 \n\
+        last_update TIMESTAMP NOT NULL,                                \n\
+        is_checkpoint INTEGER NOT NULL DEFAULT 1                       \n\
     );                                                                 \n\
                                                                        \n\
 CREATE TABLE                                                            \n\
@@ -90,46 +89,154 @@ CREATE TRIGGER SyncLogGuard_trigger                                     \n\
     END;                                                                \n\
 ";
 
-SyncLog::SyncLog(const boost::filesystem::path& path, const Name& localName)
+SyncLog::SyncLog(const boost::filesystem::path& path, const Name& localName,
+                 size_t checkpointInterval, size_t maxStates, size_t stateCacheSize)
   : DbHelper(path / ".chronoshare", "sync-log.db")
   , m_localName(localName)
+  , m_checkpointInterval(std::max<size_t>(checkpointInterval, 1))
+  , m_maxStates(maxStates)
+  // SyncNodes may have changed after the last remembered state, so start with a full state
+  , m_nDeltasSinceCheckpoint(m_checkpointInterval)
+  , m_stateCacheSize(stateCacheSize)
+  , m_nStateCacheHits(0)
+  , m_nStateCacheMisses(0)
+  , m_localSeqNo(0)
+  , m_savedLocalSeqNo(0)
 {
   sqlite3_exec(m_db, INIT_DATABASE.c_str(), NULL, NULL, NULL);
   _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, "DB Constructer: " << sqlite3_errmsg(m_db));
 
+  // logs created before delta encoding contain only full states; fails if the column exists
+  sqlite3_exec(m_db, "ALTER TABLE SyncLog ADD COLUMN is_checkpoint INTEGER NOT NULL DEFAULT 1;",
+               NULL, NULL, NULL);
+
+  {
+    Statement stmt(*this, "SELECT device_name, device_id, seq_no, last_known_locator FROM SyncNodes");
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+      auto device = m_seqNos.insert(std::make_pair(
+        Buffer(sqlite3_column_blob(stmt, 0), sqlite3_column_bytes(stmt, 0)),
+        DeviceState{sqlite3_column_int64(stmt, 1), sqlite3_column_int64(stmt, 2),
+                    Buffer(sqlite3_column_blob(stmt, 3), sqlite3_column_bytes(stmt, 3))}));
+      m_devicesById[device.first->second.deviceId] = device.first;
+    }
+  }
+
+  {
+    Statement stmt(*this, "SELECT state_hash FROM SyncLog ORDER BY state_id DESC LIMIT 1");
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+      m_lastStateHash = make_shared<Buffer>(sqlite3_column_blob(stmt, 0),
+                                            sqlite3_column_bytes(stmt, 0));
+    }
+  }
+
   UpdateDeviceSeqNo(localName, 0);
 
-  Sqlite3Statement * stmt = new Sqlite3Statement(m_db, "SELECT device_id, seq_no FROM SyncNodes WHERE device_name=?");
-  stmt->bind(1, m_localName.wireEncode(), SQLITE_STATIC);
+  Statement stmt(*this, "SELECT device_id, seq_no FROM SyncNodes WHERE device_name=?");
+  sqlite3_bind_blob(stmt, 1, m_localName.wireEncode().wire(), m_localName.wireEncode().size(),
+                    SQLITE_STATIC);
 
-  if (sqlite3_step(*stmt) == SQLITE_ROW) {
-    m_localDeviceId = stmt->getInt(0);
+  if (sqlite3_step(stmt) == SQLITE_ROW) {
+    m_localDeviceId = sqlite3_column_int64(stmt, 0);
+    m_savedLocalSeqNo = sqlite3_column_int64(stmt, 1);
   }
   else {
     BOOST_THROW_EXCEPTION(Error("Impossible thing in SyncLog::SyncLog"));
   }
 
-  sqlite3_finalize(*stmt);
+  // seq_no handed out after the last saved state are recovered by ActionLog, which owns them
+  m_localSeqNo = m_savedLocalSeqNo;
 }
 
-sqlite3_int64
-SyncLog::GetNextLocalSeqNo()
+SyncLog::~SyncLog()
+{
+  // save seq_no handed out after the last remembered state
+  try {
+    WriteLock lock(m_stateUpdateMutex);
+
+    sqlite3_int64 localSeqNo = m_localSeqNo;
+    if (localSeqNo > m_savedLocalSeqNo) {
+      Statement stmt(*this, "UPDATE SyncNodes SET seq_no=MAX(seq_no,?) WHERE device_id=?;");
+      sqlite3_bind_int64(stmt, 1, localSeqNo);
+      sqlite3_bind_int64(stmt, 2, m_localDeviceId);
+      sqlite3_step(stmt);
+      _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE, sqlite3_errmsg(m_db));
+    }
+  }
+  catch (const Error& error) {
+    _LOG_ERROR("Cannot save local seq_no: " << error.what());
+  }
+}
+
+void
+SyncLog::updateCachedSeqNo(const Buffer& deviceName, sqlite3_int64 seqNo)
 {
-  Sqlite3Statement stmt_seq(m_db, "SELECT seq_no FROM SyncNodes WHERE device_id = ?");
-  stmt_seq.bind(1, m_localDeviceId);
+  WriteLock lock(m_seqNosMutex);
+
+  auto device = m_seqNos.find(deviceName);
+  if (device == m_seqNos.end()) {
+    Statement stmt(*this, "SELECT device_id FROM SyncNodes WHERE device_name=?");
+    sqlite3_bind_blob(stmt, 1, deviceName.buf(), deviceName.size(), SQLITE_STATIC);
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+      BOOST_THROW_EXCEPTION(Error("Device is missing in SyncNodes"));
+    }
 
-  if (sqlite3_step(stmt_seq) != SQLITE_ROW) {
-    BOOST_THROW_EXCEPTION(Error("Impossible thing in SyncLog::GetNextLocalSeqNo"));
+    device = m_seqNos.insert(std::make_pair(deviceName,
+                                            DeviceState{sqlite3_column_int64(stmt, 0), seqNo,
+                                                        Buffer()}))
+               .first;
+    m_devicesById[device->second.deviceId] = device;
+  }
+  else if (device->second.seqNo < seqNo) {
+    device->second.seqNo = seqNo;
+  }
+  else {
+    return;
+  }
+
+  m_rootDigest.reset();
+  m_changedSeqNos[device->second.deviceId] = device->second.seqNo;
+}
+
+ConstBufferPtr
+SyncLog::getRootDigest()
+{
+  if (m_rootDigest != nullptr) {
+    return m_rootDigest;
   }
 
-  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE,
-                  "DB GetNextLocalSeqNo: " << sqlite3_errmsg(m_db));
+  if (m_seqNos.empty()) {
+    // same as hash_xFinal for an empty set
+    m_rootDigest = make_shared<Buffer>(1);
+    return m_rootDigest;
+  }
 
-  sqlite3_int64 seq_no = stmt_seq.getInt(0) + 1;
+  util::Sha256 digest;
+  for (const auto& device : m_seqNos) {
+    sqlite3_int64 seqNo = device.second.seqNo;
+    digest.update(device.first.buf(), device.first.size());
+    digest.update(reinterpret_cast<const uint8_t*>(&seqNo), sizeof(sqlite3_int64));
+  }
+
+  m_rootDigest = digest.computeDigest();
+  return m_rootDigest;
+}
+
+sqlite3_int64
+SyncLog::GetNextLocalSeqNo()
+{
+  return GetNextLocalSeqNos(1);
+}
+
+sqlite3_int64
+SyncLog::GetNextLocalSeqNos(sqlite3_int64 count)
+{
+  sqlite3_int64 last_seq_no = m_localSeqNo.fetch_add(count) + count;
 
-  UpdateDeviceSeqNo(m_localDeviceId, seq_no);
+  // SyncNodes is updated when the state is remembered
+  updateCachedSeqNo(Buffer(m_localName.wireEncode().wire(), m_localName.wireEncode().size()),
+                    last_seq_no);
 
-  return seq_no;
+  return last_seq_no - count + 1;
 }
 
 ConstBufferPtr
@@ -137,78 +244,259 @@ SyncLog::RememberStateInStateLog()
 {
   WriteLock lock(m_stateUpdateMutex);
 
+  ConstBufferPtr retval;
+  std::map<sqlite3_int64, sqlite3_int64> changedSeqNos;
+  shared_ptr<SeqVector> seqNos = make_shared<SeqVector>();
+  sqlite3_int64 localSeqNo = 0;
+  {
+    WriteLock seqNosLock(m_seqNosMutex);
+    retval = getRootDigest();
+    changedSeqNos.swap(m_changedSeqNos);
+    localSeqNo = m_devicesById[m_localDeviceId]->second.seqNo;
+
+    seqNos->reserve(m_devicesById.size());
+    for (const auto& device : m_devicesById) {
+      seqNos->push_back(std::make_pair(device.first, device.second->second.seqNo));
+    }
+  }
+
+  // seq numbers only grow, so the same digest means nothing has changed
+  if (m_lastStateHash != nullptr && *m_lastStateHash == *retval) {
+    return retval;
+  }
+
+  bool isCheckpoint = m_nDeltasSinceCheckpoint + 1 >= m_checkpointInterval;
+
   int res = sqlite3_exec(m_db, "BEGIN TRANSACTION;", 0, 0, 0);
 
-  res += sqlite3_exec(m_db, "\
-INSERT INTO SyncLog                                                \
-   (state_hash, last_update)                                      \
-    SELECT                                                         \
-       hash(device_name, seq_no), datetime('now', 'localtime')                  \
-    FROM(SELECT * FROM SyncNodes                                  \
-              ORDER BY device_name);                               \
-",
-                      0, 0, 0);
+  {
+    Statement stmt(*this, "INSERT INTO SyncLog(state_hash, last_update, is_checkpoint) "
+                          "VALUES(?, datetime('now', 'localtime'), ?)");
+    sqlite3_bind_blob(stmt, 1, retval->buf(), retval->size(), SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, isCheckpoint ? 1 : 0);
+
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+      res = sqlite3_errcode(m_db);
+    }
+  }
 
   _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK, "DbError: " << sqlite3_errmsg(m_db));
 
   if (res != SQLITE_OK) {
     sqlite3_exec(m_db, "ROLLBACK TRANSACTION;", 0, 0, 0);
+    m_nDeltasSinceCheckpoint = m_checkpointInterval; // changes are lost, next state must be full
     BOOST_THROW_EXCEPTION(Error(sqlite3_errmsg(m_db)));
   }
 
   sqlite3_int64 rowId = sqlite3_last_insert_rowid(m_db);
 
-  sqlite3_stmt* insertStmt;
-  res += sqlite3_prepare(m_db, "\
+  if (localSeqNo > m_savedLocalSeqNo) {
+    Statement stmt(*this, "UPDATE SyncNodes SET seq_no=MAX(seq_no,?) WHERE device_id=?;");
+    res += sqlite3_bind_int64(stmt, 1, localSeqNo);
+    res += sqlite3_bind_int64(stmt, 2, m_localDeviceId);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+      res += sqlite3_errcode(m_db);
+    }
+  }
+
+  if (isCheckpoint) {
+    Statement stmt(*this, "\
 INSERT INTO SyncStateNodes                              \
      (state_id, device_id, seq_no)                     \
       SELECT ?, device_id, seq_no                       \
             FROM SyncNodes;                             \
-",
-                         -1, &insertStmt, 0);
+");
 
-  res += sqlite3_bind_int64(insertStmt, 1, rowId);
-  sqlite3_step(insertStmt);
+    res += sqlite3_bind_int64(stmt, 1, rowId);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+      res += sqlite3_errcode(m_db);
+    }
+  }
+  else {
+    for (const auto& device : changedSeqNos) {
+      Statement stmt(*this, "INSERT INTO SyncStateNodes(state_id, device_id, seq_no) "
+                            "VALUES(?, ?, ?)");
+
+      res += sqlite3_bind_int64(stmt, 1, rowId);
+      res += sqlite3_bind_int64(stmt, 2, device.first);
+      res += sqlite3_bind_int64(stmt, 3, device.second);
+      if (sqlite3_step(stmt) != SQLITE_DONE) {
+        res += sqlite3_errcode(m_db);
+      }
+    }
+  }
 
-  _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_DONE, "DbError: " << sqlite3_errmsg(m_db));
+  _LOG_DEBUG_COND(res != SQLITE_OK, "DbError: " << sqlite3_errmsg(m_db));
   if (res != SQLITE_OK) {
     sqlite3_exec(m_db, "ROLLBACK TRANSACTION;", 0, 0, 0);
+    m_nDeltasSinceCheckpoint = m_checkpointInterval;
     BOOST_THROW_EXCEPTION(Error(sqlite3_errmsg(m_db)));
   }
-  sqlite3_finalize(insertStmt);
-
-  sqlite3_stmt* getHashStmt;
-  res += sqlite3_prepare(m_db, "\
-SELECT state_hash FROM SyncLog WHERE state_id = ?\
-",
-                         -1, &getHashStmt, 0);
-  res += sqlite3_bind_int64(getHashStmt, 1, rowId);
 
-  BufferPtr retval;
-  int stepRes = sqlite3_step(getHashStmt);
-  if (stepRes == SQLITE_ROW) {
-    retval = make_shared<Buffer>(static_cast<const uint8_t*>(
-                                             sqlite3_column_blob(getHashStmt, 0)),
-                                           sqlite3_column_bytes(getHashStmt, 0));
+  if (isCheckpoint) {
+    removeExpiredStates();
   }
-  else {
-    sqlite3_exec(m_db, "ROLLBACK TRANSACTION;", 0, 0, 0);
 
-    _LOG_ERROR("DbError: " << sqlite3_errmsg(m_db));
-    BOOST_THROW_EXCEPTION(Error("Not a valid hash in rememberStateInStateLog"));
-  }
-  sqlite3_finalize(getHashStmt);
   res += sqlite3_exec(m_db, "COMMIT;", 0, 0, 0);
 
   if (res != SQLITE_OK) {
     sqlite3_exec(m_db, "ROLLBACK TRANSACTION;", 0, 0, 0);
+    m_nDeltasSinceCheckpoint = m_checkpointInterval;
     BOOST_THROW_EXCEPTION(Error("Some error with rememberStateInStateLog"));
   }
 
-  _LOG_DEBUG("rememberinStateLog rootDigest: " << toHex(*retval));
+  m_nDeltasSinceCheckpoint = isCheckpoint ? 0 : m_nDeltasSinceCheckpoint + 1;
+  m_lastStateHash = retval;
+  m_savedLocalSeqNo = std::max(m_savedLocalSeqNo, localSeqNo);
+  cacheState(*retval, rowId, seqNos);
+
+  _LOG_DEBUG("rememberinStateLog rootDigest: " << toHex(*retval)
+             << (isCheckpoint ? " (checkpoint)" : ""));
   return retval;
 }
 
+void
+SyncLog::removeExpiredStates()
+{
+  if (m_maxStates == 0) {
+    return;
+  }
+
+  // the oldest state to keep needs the nearest checkpoint at or before it
+  sqlite3_int64 firstKeptState = 0;
+  {
+    Statement stmt(*this, "SELECT MAX(state_id) FROM SyncLog WHERE is_checkpoint=1 AND state_id <= "
+                          "(SELECT state_id FROM SyncLog ORDER BY state_id DESC LIMIT 1 OFFSET ?)");
+    sqlite3_bind_int64(stmt, 1, m_maxStates - 1);
+
+    if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+      firstKeptState = sqlite3_column_int64(stmt, 0);
+    }
+  }
+
+  if (firstKeptState == 0) {
+    return;
+  }
+
+  {
+    Statement stmt(*this, "DELETE FROM SyncStateNodes WHERE state_id < ?");
+    sqlite3_bind_int64(stmt, 1, firstKeptState);
+    sqlite3_step(stmt);
+  }
+  {
+    Statement stmt(*this, "DELETE FROM SyncLog WHERE state_id < ?");
+    sqlite3_bind_int64(stmt, 1, firstKeptState);
+    sqlite3_step(stmt);
+
+    _LOG_DEBUG_COND(sqlite3_changes(m_db) > 0,
+                    "Removed " << sqlite3_changes(m_db) << " states before " << firstKeptState);
+  }
+
+  WriteLock lock(m_stateCacheMutex);
+  for (auto state = m_stateCache.begin(); state != m_stateCache.end();) {
+    if (state->stateId < firstKeptState) {
+      m_stateCacheIndex.erase(state->stateHash);
+      state = m_stateCache.erase(state);
+    }
+    else {
+      ++state;
+    }
+  }
+}
+
+SyncLog::SeqVectorPtr
+SyncLog::lookupState(const Buffer& stateHash)
+{
+  SeqVectorPtr cached;
+  sqlite3_int64 stateId = findCachedState(stateHash, cached);
+  if (stateId > 0) {
+    return cached;
+  }
+
+  shared_ptr<SeqVector> seqNos = make_shared<SeqVector>();
+
+  {
+    Statement stmt(*this, "SELECT state_id FROM SyncLog WHERE state_hash = ?");
+    sqlite3_bind_blob(stmt, 1, stateHash.buf(), stateHash.size(), SQLITE_STATIC);
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+      return seqNos;
+    }
+    stateId = sqlite3_column_int64(stmt, 0);
+  }
+
+  Statement stmt(*this, "\
+SELECT device_id, MAX(seq_no)                                           \
+    FROM SyncStateNodes                                                 \
+    WHERE state_id BETWEEN(SELECT MAX(state_id)                        \
+                               FROM SyncLog                             \
+                               WHERE is_checkpoint=1 AND state_id<=?1) \
+                       AND ?1                                           \
+    GROUP BY device_id                                                  \
+    ORDER BY device_id                                                  \
+");
+  sqlite3_bind_int64(stmt, 1, stateId);
+
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    seqNos->push_back(std::make_pair(sqlite3_column_int64(stmt, 0), sqlite3_column_int64(stmt, 1)));
+  }
+
+  cacheState(stateHash, stateId, seqNos);
+  return seqNos;
+}
+
+sqlite3_int64
+SyncLog::findCachedState(const Buffer& stateHash, SeqVectorPtr& seqNos)
+{
+  WriteLock lock(m_stateCacheMutex);
+
+  auto entry = m_stateCacheIndex.find(stateHash);
+  if (entry == m_stateCacheIndex.end()) {
+    m_nStateCacheMisses++;
+    return 0;
+  }
+
+  m_nStateCacheHits++;
+  m_stateCache.splice(m_stateCache.begin(), m_stateCache, entry->second);
+  seqNos = entry->second->seqNos;
+  return entry->second->stateId;
+}
+
+void
+SyncLog::cacheState(const Buffer& stateHash, sqlite3_int64 stateId, SeqVectorPtr seqNos)
+{
+  if (m_stateCacheSize == 0) {
+    return;
+  }
+
+  WriteLock lock(m_stateCacheMutex);
+
+  auto entry = m_stateCacheIndex.find(stateHash);
+  if (entry != m_stateCacheIndex.end()) {
+    m_stateCache.erase(entry->second);
+    m_stateCacheIndex.erase(entry);
+  }
+
+  m_stateCache.push_front(CachedState{stateHash, stateId, seqNos});
+  m_stateCacheIndex[stateHash] = m_stateCache.begin();
+
+  if (m_stateCache.size() > m_stateCacheSize) {
+    m_stateCacheIndex.erase(m_stateCache.back().stateHash);
+    m_stateCache.pop_back();
+  }
+}
+
+uint64_t
+SyncLog::GetStateCacheHits() const
+{
+  return m_nStateCacheHits;
+}
+
+uint64_t
+SyncLog::GetStateCacheMisses() const
+{
+  return m_nStateCacheMisses;
+}
+
 sqlite3_int64
 SyncLog::LookupSyncLog(const std::string& stateHash)
 {
@@ -218,15 +506,15 @@ SyncLog::LookupSyncLog(const std::string& stateHash)
 sqlite3_int64
 SyncLog::LookupSyncLog(const Buffer& stateHash)
 {
-  sqlite3_stmt* stmt;
-  int res =
-    sqlite3_prepare(m_db, "SELECT state_id FROM SyncLog WHERE state_hash = ?", -1, &stmt, 0);
-
-  if (res != SQLITE_OK) {
-    BOOST_THROW_EXCEPTION(Error("Cannot prepare statement"));
+  SeqVectorPtr cached;
+  sqlite3_int64 cachedStateId = findCachedState(stateHash, cached);
+  if (cachedStateId > 0) {
+    return cachedStateId;
   }
 
-  res = sqlite3_bind_blob(stmt, 1, stateHash.buf(), stateHash.size(), SQLITE_STATIC);
+  Statement stmt(*this, "SELECT state_id FROM SyncLog WHERE state_hash = ?");
+
+  int res = sqlite3_bind_blob(stmt, 1, stateHash.buf(), stateHash.size(), SQLITE_STATIC);
   if (res != SQLITE_OK) {
     BOOST_THROW_EXCEPTION(Error("Cannot bind"));
   }
@@ -237,21 +525,17 @@ SyncLog::LookupSyncLog(const Buffer& stateHash)
     row = sqlite3_column_int64(stmt, 0);
   }
 
-  sqlite3_finalize(stmt);
-
   return row;
 }
 
 void
 SyncLog::UpdateDeviceSeqNo(const Name& name, sqlite3_int64 seqNo)
 {
-  sqlite3_stmt* stmt;
   _LOG_DEBUG("UpdateDeviceSeqNo Name: " << name << " seq_no: " << seqNo);
   // update is performed using trigger
-  int res =
-    sqlite3_prepare(m_db, "INSERT INTO SyncNodes(device_name, seq_no) VALUES(?,?);", -1, &stmt, 0);
+  Statement stmt(*this, "INSERT INTO SyncNodes(device_name, seq_no) VALUES(?,?);");
 
-  res +=
+  int res =
     sqlite3_bind_blob(stmt, 1, name.wireEncode().wire(), name.wireEncode().size(), SQLITE_STATIC);
   res += sqlite3_bind_int64(stmt, 2, seqNo);
   sqlite3_step(stmt);
@@ -259,7 +543,8 @@ SyncLog::UpdateDeviceSeqNo(const Name& name, sqlite3_int64 seqNo)
   if (res != SQLITE_OK) {
     BOOST_THROW_EXCEPTION(Error("Some error with UpdateDeviceSeqNo(name)"));
   }
-  sqlite3_finalize(stmt);
+
+  updateCachedSeqNo(Buffer(name.wireEncode().wire(), name.wireEncode().size()), seqNo);
 }
 
 void
@@ -271,13 +556,11 @@ SyncLog::UpdateLocalSeqNo(sqlite3_int64 seqNo)
 void
 SyncLog::UpdateDeviceSeqNo(sqlite3_int64 deviceId, sqlite3_int64 seqNo)
 {
-  sqlite3_stmt* stmt;
   // update is performed using trigger
   _LOG_DEBUG("UpdateLocalSeqNo my_Name: " << m_localName << " seq_no: " << seqNo);
-  int res = sqlite3_prepare(m_db, "UPDATE SyncNodes SET seq_no=MAX(seq_no,?) WHERE device_id=?;",
-                            -1, &stmt, 0);
+  Statement stmt(*this, "UPDATE SyncNodes SET seq_no=MAX(seq_no,?) WHERE device_id=?;");
 
-  res += sqlite3_bind_int64(stmt, 1, seqNo);
+  int res = sqlite3_bind_int64(stmt, 1, seqNo);
   res += sqlite3_bind_int64(stmt, 2, deviceId);
   sqlite3_step(stmt);
 
@@ -285,18 +568,31 @@ SyncLog::UpdateDeviceSeqNo(sqlite3_int64 deviceId, sqlite3_int64 seqNo)
     BOOST_THROW_EXCEPTION(Error("Some error with UpdateDeviceSeqNo(id)"));
   }
 
+  if (deviceId == m_localDeviceId) {
+    sqlite3_int64 localSeqNo = m_localSeqNo;
+    while (localSeqNo < seqNo && !m_localSeqNo.compare_exchange_weak(localSeqNo, seqNo)) {
+    }
+
+    updateCachedSeqNo(Buffer(m_localName.wireEncode().wire(), m_localName.wireEncode().size()),
+                      seqNo);
+  }
+  else {
+    Statement nameStmt(*this, "SELECT device_name FROM SyncNodes WHERE device_id=?");
+    sqlite3_bind_int64(nameStmt, 1, deviceId);
+    if (sqlite3_step(nameStmt) == SQLITE_ROW) {
+      updateCachedSeqNo(Buffer(sqlite3_column_blob(nameStmt, 0), sqlite3_column_bytes(nameStmt, 0)),
+                        seqNo);
+    }
+  }
+
   _LOG_DEBUG_COND(sqlite3_errcode(m_db) != SQLITE_OK,
                   "DB UpdateDeviceSeqNo: " << sqlite3_errmsg(m_db));
-
-  sqlite3_finalize(stmt);
 }
 
 Name
 SyncLog::LookupLocator(const Name& deviceName)
 {
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(m_db, "SELECT last_known_locator FROM SyncNodes WHERE device_name=?;", -1,
-                     &stmt, 0);
+  Statement stmt(*this, "SELECT last_known_locator FROM SyncNodes WHERE device_name=?;");
   sqlite3_bind_blob(stmt, 1, deviceName.wireEncode().wire(), deviceName.wireEncode().size(),
                     SQLITE_STATIC);
   int res = sqlite3_step(stmt);
@@ -312,8 +608,6 @@ SyncLog::LookupLocator(const Name& deviceName)
     BOOST_THROW_EXCEPTION(Error("Error in LookupLocator()"));
   }
 
-  sqlite3_finalize(stmt);
-
   return locator;
 }
 
@@ -326,10 +620,8 @@ SyncLog::LookupLocalLocator()
 void
 SyncLog::UpdateLocator(const Name& deviceName, const Name& locator)
 {
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(m_db, "UPDATE SyncNodes SET last_known_locator=?,last_update=datetime('now', "
-                           "'localtime') WHERE device_name=?;",
-                     -1, &stmt, 0);
+  Statement stmt(*this, "UPDATE SyncNodes SET last_known_locator=?,last_update=datetime('now', "
+                        "'localtime') WHERE device_name=?;");
 
   sqlite3_bind_blob(stmt, 1, locator.wireEncode().wire(), locator.wireEncode().size(),
                     SQLITE_STATIC);
@@ -342,7 +634,11 @@ SyncLog::UpdateLocator(const Name& deviceName, const Name& locator)
     BOOST_THROW_EXCEPTION(Error("Error in UpdateLoactor()"));
   }
 
-  sqlite3_finalize(stmt);
+  WriteLock lock(m_seqNosMutex);
+  auto device = m_seqNos.find(Buffer(deviceName.wireEncode().wire(), deviceName.wireEncode().size()));
+  if (device != m_seqNos.end()) {
+    device->second.locator = Buffer(locator.wireEncode().wire(), locator.wireEncode().size());
+  }
 }
 
 void
@@ -362,107 +658,72 @@ SyncStateMsgPtr
 SyncLog::FindStateDifferences(const Buffer& oldHash, const Buffer& newHash,
                               bool includeOldSeq)
 {
-  sqlite3_stmt* stmt;
-
-  int res = sqlite3_prepare_v2(m_db, "\
-SELECT sn.device_name, sn.last_known_locator, s_old.seq_no, s_new.seq_no\
-    FROM(SELECT *                                                      \
-            FROM SyncStateNodes                                         \
-            WHERE state_id=(SELECT state_id                             \
-                                FROM SyncLog                            \
-                                WHERE state_hash=:old_hash)) s_old      \
-    LEFT JOIN(SELECT *                                                 \
-                FROM SyncStateNodes                                     \
-                WHERE state_id=(SELECT state_id                         \
-                                    FROM SyncLog                        \
-                                    WHERE state_hash=:new_hash)) s_new  \
-                                                                        \
-        ON s_old.device_id = s_new.device_id                            \
-    JOIN SyncNodes sn ON sn.device_id = s_old.device_id                 \
-                                                                        \
-    WHERE s_new.seq_no IS NULL OR                                       \
-          s_old.seq_no != s_new.seq_no                                  \
-                                                                        \
-UNION ALL                                                               \
-                                                                        \
-SELECT sn.device_name, sn.last_known_locator, s_old.seq_no, s_new.seq_no\
-    FROM(SELECT *                                                      \
-            FROM SyncStateNodes                                         \
-            WHERE state_id=(SELECT state_id                             \
-                                FROM SyncLog                            \
-                                WHERE state_hash=:new_hash )) s_new     \
-    LEFT JOIN(SELECT *                                                 \
-                FROM SyncStateNodes                                     \
-                WHERE state_id=(SELECT state_id                         \
-                                    FROM SyncLog                        \
-                                    WHERE state_hash=:old_hash)) s_old  \
-                                                                        \
-        ON s_old.device_id = s_new.device_id                            \
-    JOIN SyncNodes sn ON sn.device_id = s_new.device_id                 \
-                                                                        \
-    WHERE s_old.seq_no IS NULL                                          \
-",
-                               -1, &stmt, 0);
-
-  if (res != SQLITE_OK) {
-    BOOST_THROW_EXCEPTION(Error("Some error with FindStateDifferences"));
-  }
-
-  res += sqlite3_bind_blob(stmt, 1, oldHash.buf(), oldHash.size(), SQLITE_STATIC);
-  res += sqlite3_bind_blob(stmt, 2, newHash.buf(), newHash.size(), SQLITE_STATIC);
+  SeqVectorPtr oldSeqNos = lookupState(oldHash);
+  SeqVectorPtr newSeqNos = lookupState(newHash);
 
   SyncStateMsgPtr msg = make_shared<SyncStateMsg>();
 
-  // sqlite3_trace(m_db, xTrace, NULL);
+  WriteLock lock(m_seqNosMutex);
+
+  // oldSeqNo < 0 means the device is not in the old state, newSeqNo < 0 that it is not in the new
+  auto addState = [this, msg, includeOldSeq] (sqlite3_int64 deviceId, sqlite3_int64 oldSeqNo,
+                                              sqlite3_int64 newSeqNo) {
+    auto device = m_devicesById.find(deviceId);
+    if (device == m_devicesById.end()) {
+      return;
+    }
 
-  while (sqlite3_step(stmt) == SQLITE_ROW) {
     SyncState* state = msg->add_state();
 
     // set name
-    state->set_name(reinterpret_cast<const char*>(sqlite3_column_blob(stmt, 0)),
-                    sqlite3_column_bytes(stmt, 0));
-    //      state->set_name(Name(Block(reinterpret_cast<const char*>(sqlite3_column_blob(stmt,
-    //      0)), sqlite3_column_bytes(stmt, 0))).toUri());
-
-    // locator is optional, so must check if it is null
-    if (sqlite3_column_type(stmt, 1) == SQLITE_BLOB) {
-      state->set_locator(reinterpret_cast<const char*>(sqlite3_column_blob(stmt, 1)),
-                         sqlite3_column_bytes(stmt, 1));
-      //        state->set_locator(Name(Block(reinterpret_cast<const
-      //        char*>(sqlite3_column_blob(stmt, 1)), sqlite3_column_bytes(stmt, 1))).toUri());
+    const Buffer& name = device->second->first;
+    state->set_name(reinterpret_cast<const char*>(name.buf()), name.size());
+
+    // locator is optional
+    const Buffer& locator = device->second->second.locator;
+    if (!locator.empty()) {
+      state->set_locator(reinterpret_cast<const char*>(locator.buf()), locator.size());
     }
 
     // set old seq
     if (includeOldSeq) {
-      if (sqlite3_column_type(stmt, 2) == SQLITE_NULL) {
-        // old seq is zero; we always have an initial action of zero seq
-        // other's do not need to fetch this action
-        state->set_old_seq(0);
-      }
-      else {
-        sqlite3_int64 oldSeqNo = sqlite3_column_int64(stmt, 2);
-        state->set_old_seq(oldSeqNo);
-      }
+      // old seq is zero if missing; we always have an initial action of zero seq
+      // other's do not need to fetch this action
+      state->set_old_seq(oldSeqNo < 0 ? 0 : oldSeqNo);
     }
 
     // set new seq
-    if (sqlite3_column_type(stmt, 3) == SQLITE_NULL) {
+    if (newSeqNo < 0) {
       state->set_type(SyncState::DELETE);
     }
     else {
-      sqlite3_int64 newSeqNo = sqlite3_column_int64(stmt, 3);
       state->set_type(SyncState::UPDATE);
       state->set_seq(newSeqNo);
     }
+  };
+
+  auto byDeviceId = [] (const SeqVector::value_type& device, sqlite3_int64 deviceId) {
+    return device.first < deviceId;
+  };
 
-    // std::cout << sqlite3_column_text(stmt, 0) <<
-    //   ": from "  << sqlite3_column_int64(stmt, 1) <<
-    //   " to "     << sqlite3_column_int64(stmt, 2) <<
-    //   std::endl;
+  for (const auto& device : *oldSeqNos) {
+    auto newDevice = std::lower_bound(newSeqNos->begin(), newSeqNos->end(), device.first,
+                                      byDeviceId);
+    if (newDevice == newSeqNos->end() || newDevice->first != device.first) {
+      addState(device.first, device.second, -1);
+    }
+    else if (newDevice->second != device.second) {
+      addState(device.first, device.second, newDevice->second);
+    }
   }
-  sqlite3_finalize(stmt);
 
-  // sqlite3_trace(m_db, NULL, NULL);
+  for (const auto& device : *newSeqNos) {
+    auto oldDevice = std::lower_bound(oldSeqNos->begin(), oldSeqNos->end(), device.first,
+                                      byDeviceId);
+    if (oldDevice == oldSeqNos->end() || oldDevice->first != device.first) {
+      addState(device.first, -1, device.second);
+    }
+  }
 
   return msg;
 }
@@ -470,24 +731,20 @@ SELECT sn.device_name, sn.last_known_locator, s_old.seq_no, s_new.seq_no\
 sqlite3_int64
 SyncLog::SeqNo(const Name& name)
 {
-  sqlite3_stmt* stmt;
-  sqlite3_int64 seq = -1;
-  sqlite3_prepare_v2(m_db, "SELECT seq_no FROM SyncNodes WHERE device_name=?;", -1, &stmt, 0);
-
-  sqlite3_bind_blob(stmt, 1, name.wireEncode().wire(), name.wireEncode().size(), SQLITE_STATIC);
+  // local seq_no in SyncNodes may lag behind, the in-memory state is always up to date
+  WriteLock lock(m_seqNosMutex);
 
-  if (sqlite3_step(stmt) == SQLITE_ROW) {
-    seq = sqlite3_column_int64(stmt, 0);
+  auto device = m_seqNos.find(Buffer(name.wireEncode().wire(), name.wireEncode().size()));
+  if (device == m_seqNos.end()) {
+    return -1;
   }
-
-  return seq;
+  return device->second.seqNo;
 }
 
 sqlite3_int64
 SyncLog::LogSize()
 {
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(m_db, "SELECT count(*) FROM SyncLog", -1, &stmt, 0);
+  Statement stmt(*this, "SELECT count(*) FROM SyncLog");
 
   sqlite3_int64 retval = -1;
   if (sqlite3_step(stmt) == SQLITE_ROW) {
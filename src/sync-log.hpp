@@ -27,7 +27,10 @@
 
 #include <ndn-cxx/name.hpp>
 
+#include <atomic>
+#include <list>
 #include <map>
+#include <vector>
 
 // @todo Replace with std::thread
 #include <boost/thread.hpp>
@@ -41,7 +44,18 @@ typedef shared_ptr<SyncStateMsg> SyncStateMsgPtr;
 class SyncLog : public DbHelper
 {
 public:
-  SyncLog(const boost::filesystem::path& path, const Name& localName);
+  /**
+   * @param checkpointInterval  every checkpointInterval-th remembered state is stored in full,
+   *                            states in between store only the devices that changed
+   * @param maxStates           number of the most recent states kept in the log (0 keeps all);
+   *                            older states are removed, so peers advertising them are handled by
+   *                            the RECOVER path of SyncCore
+   * @param stateCacheSize      number of recently used states whose seq vectors are kept in memory
+   */
+  SyncLog(const boost::filesystem::path& path, const Name& localName,
+          size_t checkpointInterval = 64, size_t maxStates = 4096, size_t stateCacheSize = 32);
+
+  virtual ~SyncLog();
 
   /**
    * @brief Get local username
@@ -49,9 +63,24 @@ public:
   const Name&
   GetLocalName() const;
 
+  /**
+   * @brief Allocate the next local seq_no
+   *
+   * Seq numbers are handed out from an in-memory counter, SyncNodes is updated with the local
+   * seq_no when the next state is remembered.  After an unclean shutdown the counter resumes at
+   * the last saved seq_no; ActionLog advances it past the last local action with
+   * UpdateLocalSeqNo(), so no published seq_no is handed out twice and none is skipped.
+   */
   sqlite3_int64
   GetNextLocalSeqNo(); // side effect: local seq_no will be increased
 
+  /**
+   * @brief Allocate @p count consecutive local seq_no
+   * @return the first allocated seq_no
+   */
+  sqlite3_int64
+  GetNextLocalSeqNos(sqlite3_int64 count);
+
   // done
   void
   UpdateDeviceSeqNo(const Name& name, sqlite3_int64 seqNo);
@@ -102,10 +131,65 @@ public:
   sqlite3_int64
   LogSize();
 
+  /**
+   * @brief Number of state digest lookups answered from the recent-state cache
+   */
+  uint64_t
+  GetStateCacheHits() const;
+
+  /**
+   * @brief Number of state digest lookups that had to go to the database
+   */
+  uint64_t
+  GetStateCacheMisses() const;
+
 protected:
   void
   UpdateDeviceSeqNo(sqlite3_int64 deviceId, sqlite3_int64 seqNo);
 
+private:
+  /**
+   * @brief Set seq_no of @p deviceName in the in-memory copy of SyncNodes to max(old, @p seqNo)
+   */
+  void
+  updateCachedSeqNo(const Buffer& deviceName, sqlite3_int64 seqNo);
+
+  /**
+   * @brief Get the root digest of the in-memory copy of SyncNodes, m_seqNosMutex must be held
+   *
+   * The digest is byte-identical to what the ``hash'' aggregate returns for SyncNodes ordered by
+   * device_name.  It is recomputed only after a seq_no has changed.
+   */
+  ConstBufferPtr
+  getRootDigest();
+
+  // (device_id, seq_no) pairs ordered by device_id
+  typedef std::vector<std::pair<sqlite3_int64, sqlite3_int64>> SeqVector;
+  typedef shared_ptr<const SeqVector> SeqVectorPtr;
+
+  /**
+   * @brief Get (device_id, seq_no) vector of the state with @p stateHash
+   *
+   * Recently used states are answered from the state cache.  Otherwise, as seq numbers never
+   * decrease, the vector is the per-device maximum over the nearest full checkpoint and the
+   * deltas after it.  An unknown hash yields an empty vector.
+   */
+  SeqVectorPtr
+  lookupState(const Buffer& stateHash);
+
+  /**
+   * @brief Find @p stateHash in the state cache and make it the most recently used entry
+   * @return state_id of the state, or 0 if it is not cached
+   */
+  sqlite3_int64
+  findCachedState(const Buffer& stateHash, SeqVectorPtr& seqNos);
+
+  void
+  cacheState(const Buffer& stateHash, sqlite3_int64 stateId, SeqVectorPtr seqNos);
+
+  void
+  removeExpiredStates();
+
 protected:
   Name m_localName;
 
@@ -115,6 +199,44 @@ protected:
   typedef boost::unique_lock<Mutex> WriteLock;
 
   Mutex m_stateUpdateMutex;
+
+private:
+  struct DeviceState
+  {
+    sqlite3_int64 deviceId;
+    sqlite3_int64 seqNo;
+    Buffer locator; // empty if unknown
+  };
+
+  // SyncNodes by device_name; std::map order of the name wires matches ORDER BY on blobs
+  std::map<Buffer, DeviceState> m_seqNos;
+  std::map<sqlite3_int64, std::map<Buffer, DeviceState>::iterator> m_devicesById;
+  ConstBufferPtr m_rootDigest; // nullptr after m_seqNos has changed
+  // device_id -> seq_no changed since the last remembered state
+  std::map<sqlite3_int64, sqlite3_int64> m_changedSeqNos;
+  Mutex m_seqNosMutex;
+
+  size_t m_checkpointInterval;
+  size_t m_maxStates;
+  size_t m_nDeltasSinceCheckpoint;
+  ConstBufferPtr m_lastStateHash;
+
+  struct CachedState
+  {
+    Buffer stateHash;
+    sqlite3_int64 stateId;
+    SeqVectorPtr seqNos;
+  };
+
+  std::list<CachedState> m_stateCache; // most recently used first
+  std::map<Buffer, std::list<CachedState>::iterator> m_stateCacheIndex;
+  size_t m_stateCacheSize;
+  Mutex m_stateCacheMutex;
+  std::atomic<uint64_t> m_nStateCacheHits;
+  std::atomic<uint64_t> m_nStateCacheMisses;
+
+  std::atomic<sqlite3_int64> m_localSeqNo;
+  sqlite3_int64 m_savedLocalSeqNo; // local seq_no in SyncNodes, guarded by m_stateUpdateMutex
 };
 
 typedef shared_ptr<SyncLog> SyncLogPtr;
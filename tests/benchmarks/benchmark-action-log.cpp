@@ -0,0 +1,409 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+#include "logging.hpp"
+#include "action-log.hpp"
+#include "sync-log.hpp"
+#include "test-common.hpp"
+
+#include <ndn-cxx/security/key-chain.hpp>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <map>
+
+INIT_LOGGER("Benchmark.ActionLog")
+
+namespace fs = boost::filesystem;
+
+namespace ndn {
+namespace chronoshare {
+
+// Benchmarks are built into unit-benchmarks, separately from unit-tests, as they run for a long
+// time; a single one is selected with --run_test=BenchmarkActionLog/<name>
+BOOST_AUTO_TEST_SUITE(BenchmarkActionLog)
+
+class ActionLogWithRawDb : public ActionLog
+{
+public:
+  using ActionLog::ActionLog;
+
+  sqlite3*
+  getDb()
+  {
+    return m_db;
+  }
+};
+
+static const std::string INSERT_BENCHMARK_ACTION =
+  "INSERT INTO ActionLog "
+  "(device_name, seq_no, action, filename, version, action_timestamp, "
+  "file_hash, file_mtime, file_chmod, file_seg_num, action_name, action_content_object) "
+  "VALUES(?, ?, 0, ?, 0, datetime(?, 'unixepoch'), ?, datetime(?, 'unixepoch'), ?, ?, ?, ?)";
+
+static void
+bindBenchmarkAction(sqlite3_stmt* stmt, const Block& deviceName, sqlite3_int64 seqNo,
+                    const std::string& filename, const Buffer& hash, const Buffer& content)
+{
+  sqlite3_bind_blob(stmt, 1, deviceName.wire(), deviceName.size(), SQLITE_STATIC);
+  sqlite3_bind_int64(stmt, 2, seqNo);
+  sqlite3_bind_text(stmt, 3, filename.c_str(), filename.size(), SQLITE_STATIC);
+  sqlite3_bind_int64(stmt, 4, std::time(NULL));
+  sqlite3_bind_blob(stmt, 5, hash.buf(), hash.size(), SQLITE_STATIC);
+  sqlite3_bind_int64(stmt, 6, std::time(NULL));
+  sqlite3_bind_int(stmt, 7, 0644);
+  sqlite3_bind_int(stmt, 8, 1);
+  sqlite3_bind_blob(stmt, 9, content.buf(), 16, SQLITE_STATIC);
+  sqlite3_bind_blob(stmt, 10, content.buf(), content.size(), SQLITE_STATIC);
+}
+
+BOOST_AUTO_TEST_CASE(InsertBenchmark)
+{
+  const int N_INSERTS = 5000;
+
+  Name localName("/lijing");
+
+  fs::path tmpdir = fs::unique_path("./Loli_Benchmark");
+  if (exists(tmpdir)) {
+    remove_all(tmpdir);
+  }
+  shared_ptr<Face> face = make_shared<Face>();
+
+  SyncLogPtr syncLog = make_shared<SyncLog>(tmpdir, localName);
+  shared_ptr<ActionLogWithRawDb> actionLog =
+    std::make_shared<ActionLogWithRawDb>(*face, tmpdir, syncLog, "top-secret", "test-chronoshare",
+                                         ActionLog::OnFileAddedOrChangedCallback(),
+                                         ActionLog::OnFileRemovedCallback());
+
+  Block deviceName = Name("/yukai").wireEncode();
+  Buffer hash = digestFromString("2ff304769cdb0125ac039e6fe7575f8576dceffc62618a431715aaf6eea2bf1c");
+  Buffer content(512);
+
+  // before: statement is compiled and finalized for every insert
+  sqlite3_exec(actionLog->getDb(), "BEGIN TRANSACTION;", 0, 0, 0);
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < N_INSERTS; i++) {
+    sqlite3_stmt* stmt;
+    sqlite3_prepare_v2(actionLog->getDb(), INSERT_BENCHMARK_ACTION.c_str(), -1, &stmt, 0);
+    bindBenchmarkAction(stmt, deviceName, i + 1, "file-" + std::to_string(i), hash, content);
+    sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+  }
+  std::chrono::duration<double> uncached = std::chrono::steady_clock::now() - start;
+  sqlite3_exec(actionLog->getDb(), "END TRANSACTION;", 0, 0, 0);
+
+  // after: statement is taken from the DbHelper statement cache
+  sqlite3_exec(actionLog->getDb(), "BEGIN TRANSACTION;", 0, 0, 0);
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < N_INSERTS; i++) {
+    DbHelper::Statement stmt(*actionLog, INSERT_BENCHMARK_ACTION);
+    bindBenchmarkAction(stmt, deviceName, N_INSERTS + i + 1, "file-" + std::to_string(i), hash,
+                        content);
+    sqlite3_step(stmt);
+  }
+  std::chrono::duration<double> cached = std::chrono::steady_clock::now() - start;
+  sqlite3_exec(actionLog->getDb(), "END TRANSACTION;", 0, 0, 0);
+
+  BOOST_CHECK_EQUAL(actionLog->LogSize(), 2 * N_INSERTS);
+
+  // full local path(includes signing of every action)
+  const int N_LOCAL = 200;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < N_LOCAL; i++) {
+    actionLog->AddLocalActionUpdate("local-" + std::to_string(i), hash, std::time(NULL), 0644, 1);
+  }
+  std::chrono::duration<double> local = std::chrono::steady_clock::now() - start;
+
+  BOOST_CHECK_EQUAL(actionLog->LogSize(), 2 * N_INSERTS + N_LOCAL);
+
+  // the same number of files added as one batch
+  std::vector<ActionLog::LocalUpdate> updates;
+  for (int i = 0; i < N_LOCAL; i++) {
+    updates.push_back(ActionLog::LocalUpdate{"batch-" + std::to_string(i),
+                                             make_shared<Buffer>(hash), std::time(NULL), 0644, 1});
+  }
+  start = std::chrono::steady_clock::now();
+  actionLog->AddLocalActionUpdates(updates);
+  std::chrono::duration<double> batch = std::chrono::steady_clock::now() - start;
+
+  BOOST_CHECK_EQUAL(actionLog->LogSize(), 2 * N_INSERTS + 2 * N_LOCAL);
+
+  std::cout << "ActionLog inserts/sec, prepare per insert: " << N_INSERTS / uncached.count()
+            << std::endl;
+  std::cout << "ActionLog inserts/sec, cached statement:   " << N_INSERTS / cached.count()
+            << std::endl;
+  std::cout << "ActionLog AddLocalActionUpdate/sec:        " << N_LOCAL / local.count()
+            << std::endl;
+  std::cout << "ActionLog AddLocalActionUpdates, files/sec: " << N_LOCAL / batch.count()
+            << std::endl;
+
+  remove_all(tmpdir);
+  face->shutdown();
+}
+
+static double
+measureAutocommitInserts(const DbHelper::Profile& profile, const std::string& expectedJournalMode,
+                         int nInserts)
+{
+  DbHelper::Profile oldProfile = DbHelper::getDefaultProfile();
+  DbHelper::setDefaultProfile(profile);
+
+  Name localName("/lijing");
+
+  fs::path tmpdir = fs::unique_path("./Loli_Benchmark");
+  if (exists(tmpdir)) {
+    remove_all(tmpdir);
+  }
+  shared_ptr<Face> face = make_shared<Face>();
+
+  SyncLogPtr syncLog = make_shared<SyncLog>(tmpdir, localName);
+  shared_ptr<ActionLogWithRawDb> actionLog =
+    std::make_shared<ActionLogWithRawDb>(*face, tmpdir, syncLog, "top-secret", "test-chronoshare",
+                                         ActionLog::OnFileAddedOrChangedCallback(),
+                                         ActionLog::OnFileRemovedCallback());
+
+  {
+    DbHelper::Statement stmt(*actionLog, "PRAGMA journal_mode;");
+    BOOST_REQUIRE_EQUAL(sqlite3_step(stmt), SQLITE_ROW);
+    BOOST_CHECK_EQUAL(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)),
+                      expectedJournalMode);
+  }
+
+  Block deviceName = Name("/yukai").wireEncode();
+  Buffer hash = digestFromString("2ff304769cdb0125ac039e6fe7575f8576dceffc62618a431715aaf6eea2bf1c");
+  Buffer content(512);
+
+  // every insert is its own transaction, as for actions arriving one by one
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < nInserts; i++) {
+    DbHelper::Statement stmt(*actionLog, INSERT_BENCHMARK_ACTION);
+    bindBenchmarkAction(stmt, deviceName, i + 1, "file-" + std::to_string(i), hash, content);
+    sqlite3_step(stmt);
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  BOOST_CHECK_EQUAL(actionLog->LogSize(), nInserts);
+
+  actionLog.reset();
+  syncLog.reset();
+  remove_all(tmpdir);
+  face->shutdown();
+
+  DbHelper::setDefaultProfile(oldProfile);
+  return nInserts / elapsed.count();
+}
+
+BOOST_AUTO_TEST_CASE(ProfileWriteBenchmark)
+{
+  const int N_INSERTS = 500;
+
+  double durable = measureAutocommitInserts(DbHelper::Profile::durable(), "delete", N_INSERTS);
+  double fast = measureAutocommitInserts(DbHelper::Profile::fast(), "wal", N_INSERTS);
+
+  std::cout << "ActionLog autocommit inserts/sec, durable profile(rollback journal, FULL): "
+            << durable << std::endl;
+  std::cout << "ActionLog autocommit inserts/sec, fast profile(WAL, NORMAL):              "
+            << fast << std::endl;
+}
+
+BOOST_AUTO_TEST_CASE(FolderLookupBenchmark)
+{
+  const int N_ACTIONS = 1000000;
+  const int N_FOLDERS = 1000;
+  const int N_LOOKUPS = 20;
+
+  Name localName("/lijing");
+
+  fs::path tmpdir = fs::unique_path("./Loli_Benchmark");
+  if (exists(tmpdir)) {
+    remove_all(tmpdir);
+  }
+  shared_ptr<Face> face = make_shared<Face>();
+
+  SyncLogPtr syncLog = make_shared<SyncLog>(tmpdir, localName);
+  shared_ptr<ActionLogWithRawDb> actionLog =
+    std::make_shared<ActionLogWithRawDb>(*face, tmpdir, syncLog, "top-secret", "test-chronoshare",
+                                         ActionLog::OnFileAddedOrChangedCallback(),
+                                         ActionLog::OnFileRemovedCallback());
+
+  Block deviceName = Name("/yukai").wireEncode();
+  Buffer hash = digestFromString("2ff304769cdb0125ac039e6fe7575f8576dceffc62618a431715aaf6eea2bf1c");
+  Buffer content(512);
+
+  actionLog->GetFileState()->BeginUpdates();
+  sqlite3_exec(actionLog->getDb(), "BEGIN TRANSACTION;", 0, 0, 0);
+  for (int i = 0; i < N_ACTIONS; i++) {
+    DbHelper::Statement stmt(*actionLog, INSERT_BENCHMARK_ACTION);
+    bindBenchmarkAction(stmt, deviceName, i + 1,
+                        "folder-" + std::to_string(i % N_FOLDERS) + "/sub/file-" + std::to_string(i),
+                        hash, content);
+    sqlite3_step(stmt);
+  }
+  sqlite3_exec(actionLog->getDb(), "UPDATE ActionLog SET directory=directory_name(filename);",
+               0, 0, 0);
+  sqlite3_exec(actionLog->getDb(), "END TRANSACTION;", 0, 0, 0);
+  actionLog->GetFileState()->CommitUpdates();
+
+  BOOST_CHECK_EQUAL(actionLog->LogSize(), N_ACTIONS);
+
+  int nVisited = 0;
+  auto visitor = [&nVisited] (const Name&, sqlite3_int64, const ActionItem&) { nVisited++; };
+
+  // before: is_dir_prefix() is evaluated for every row of the log
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < N_LOOKUPS; i++) {
+    std::string folder = "folder-" + std::to_string(i * 37 % N_FOLDERS);
+    DbHelper::Statement stmt(*actionLog, "SELECT seq_no FROM ActionLog "
+                                         "   WHERE is_dir_prefix(?, directory)=1 "
+                                         "   ORDER BY action_timestamp DESC LIMIT 101");
+    sqlite3_bind_text(stmt, 1, folder.c_str(), folder.size(), SQLITE_STATIC);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+    }
+  }
+  std::chrono::duration<double> scan = std::chrono::steady_clock::now() - start;
+
+  // after: range scan over filename index
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < N_LOOKUPS; i++) {
+    actionLog->LookupActionsInFolderRecursively(visitor,
+                                                "folder-" + std::to_string(i * 37 % N_FOLDERS),
+                                                0, 100);
+  }
+  std::chrono::duration<double> range = std::chrono::steady_clock::now() - start;
+  BOOST_CHECK_EQUAL(nVisited, N_LOOKUPS * 100);
+
+  int nFiles = 0;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < N_LOOKUPS; i++) {
+    actionLog->GetFileState()
+      ->LookupFilesInFolderRecursively([&nFiles] (const FileItem&) { nFiles++; },
+                                       "folder-" + std::to_string(i * 37 % N_FOLDERS), 0, 100);
+  }
+  std::chrono::duration<double> files = std::chrono::steady_clock::now() - start;
+  BOOST_CHECK_EQUAL(nFiles, N_LOOKUPS * 100);
+
+  std::cout << "Folder history lookups/sec, is_dir_prefix scan: " << N_LOOKUPS / scan.count()
+            << std::endl;
+  std::cout << "Folder history lookups/sec, range scan:         " << N_LOOKUPS / range.count()
+            << std::endl;
+  std::cout << "Folder file listings/sec, range scan:           " << N_LOOKUPS / files.count()
+            << std::endl;
+
+  remove_all(tmpdir);
+  face->shutdown();
+}
+
+static shared_ptr<Data>
+makeRemoteUpdateAction(const Name& deviceName, sqlite3_int64 seqNo, const std::string& filename,
+                       sqlite3_int64 version, KeyChain& keyChain)
+{
+  ActionItem item;
+  item.set_action(ActionItem::UPDATE);
+  item.set_filename(filename);
+  item.set_version(version);
+  item.set_timestamp(std::time(NULL));
+  item.set_file_hash(std::string(32, 'h'));
+  item.set_mtime(std::time(NULL));
+  item.set_mode(0644);
+  item.set_seg_num(1);
+
+  std::string msg;
+  item.SerializeToString(&msg);
+
+  shared_ptr<Data> data = make_shared<Data>();
+  data->setName(Name(deviceName).append("test-chronoshare").append("action").append("top-secret")
+                  .appendNumber(seqNo));
+  data->setContent(reinterpret_cast<const uint8_t*>(msg.c_str()), msg.size());
+  keyChain.sign(*data);
+  return data;
+}
+
+static double
+measureRemoteActions(const std::vector<shared_ptr<Data>>& actions, bool useInsertTrigger,
+                     std::map<std::string, std::string>& winners)
+{
+  fs::path tmpdir = fs::unique_path("./Loli_Benchmark");
+  if (exists(tmpdir)) {
+    remove_all(tmpdir);
+  }
+  shared_ptr<Face> face = make_shared<Face>();
+
+  SyncLogPtr syncLog = make_shared<SyncLog>(tmpdir, Name("/lijing"));
+  ActionLogPtr actionLog =
+    std::make_shared<ActionLog>(*face, tmpdir, syncLog, "top-secret", "test-chronoshare",
+                                ActionLog::OnFileAddedOrChangedCallback(),
+                                ActionLog::OnFileRemovedCallback(), useInsertTrigger);
+
+  auto start = std::chrono::steady_clock::now();
+  for (const auto& action : actions) {
+    actionLog->AddRemoteAction(action);
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  // duplicates are ignored
+  BOOST_CHECK_EQUAL(actionLog->LogSize(), actions.size() - 1);
+
+  actionLog->GetFileState()->LookupFilesInFolderRecursively([&winners] (const FileItem& file) {
+      winners[file.filename()] = file.device_name() + "/" + std::to_string(file.version());
+    }, "");
+
+  actionLog.reset();
+  syncLog.reset();
+  remove_all(tmpdir);
+  face->shutdown();
+
+  return actions.size() / elapsed.count();
+}
+
+BOOST_AUTO_TEST_CASE(RemoteActionBenchmark)
+{
+  const int N_FILES = 1000;
+
+  KeyChain keyChain;
+  std::vector<shared_ptr<Data>> actions;
+  for (int i = 0; i < N_FILES; i++) {
+    std::string filename = "folder-" + std::to_string(i % 10) + "/file-" + std::to_string(i);
+    // concurrent updates of the same version, the larger device name wins
+    actions.push_back(makeRemoteUpdateAction("/yukai", i + 1, filename, 1, keyChain));
+    actions.push_back(makeRemoteUpdateAction("/alex", i + 1, filename, 1, keyChain));
+    if (i % 4 == 0) {
+      actions.push_back(makeRemoteUpdateAction("/alex", N_FILES + i + 1, filename, 2, keyChain));
+    }
+  }
+  actions.push_back(actions.front());
+
+  std::map<std::string, std::string> triggerWinners;
+  std::map<std::string, std::string> nativeWinners;
+  double trigger = measureRemoteActions(actions, true, triggerWinners);
+  double native = measureRemoteActions(actions, false, nativeWinners);
+
+  BOOST_CHECK_EQUAL(nativeWinners.size(), N_FILES);
+  BOOST_CHECK(triggerWinners == nativeWinners);
+
+  std::cout << "ActionLog AddRemoteAction/sec, insert trigger:      " << trigger << std::endl;
+  std::cout << "ActionLog AddRemoteAction/sec, in-memory resolution: " << native << std::endl;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // chronoshare
+} // ndn
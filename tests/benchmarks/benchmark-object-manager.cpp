@@ -0,0 +1,275 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+
+#include "logging.hpp"
+#include "object-manager.hpp"
+#include "object-db.hpp"
+
+#include <ndn-cxx/util/string-helper.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <iterator>
+#include <random>
+
+INIT_LOGGER("Benchmark.ObjectManager")
+
+namespace fs = boost::filesystem;
+
+namespace ndn {
+namespace chronoshare {
+
+BOOST_AUTO_TEST_SUITE(BenchmarkObjectManager)
+
+BOOST_AUTO_TEST_CASE(SegmentSizeBenchmark)
+{
+  const size_t FILE_SIZE = 4 * 1024 * 1024;
+
+  fs::path tmpdir = fs::unique_path(fs::temp_directory_path() / "%%%%-%%%%-%%%%-%%%%");
+  fs::create_directories(tmpdir);
+  Name deviceName("/device");
+
+  std::string content(FILE_SIZE, '\0');
+  for (size_t i = 0; i < content.size(); i++) {
+    content[i] = static_cast<char>(i * 7 + i / 1024);
+  }
+  {
+    fs::ofstream file(tmpdir / "file", std::ios::out | std::ios::binary);
+    file.write(content.data(), content.size());
+  }
+
+  shared_ptr<Face> face = make_shared<Face>();
+
+  for (size_t segmentSize : {ObjectManager::DEFAULT_SEGMENT_SIZE, size_t(4096),
+                             ObjectManager::MAX_SEGMENT_SIZE}) {
+    fs::path folder = tmpdir / std::to_string(segmentSize);
+    ObjectManager manager(*face, folder, "test-chronoshare", segmentSize);
+
+    auto start = std::chrono::steady_clock::now();
+    auto hash_segments = manager.localFileToObjects(tmpdir / "file", deviceName);
+    std::chrono::duration<double> publish = std::chrono::steady_clock::now() - start;
+
+    BOOST_CHECK_EQUAL(std::get<1>(hash_segments), (FILE_SIZE + segmentSize - 1) / segmentSize);
+
+    start = std::chrono::steady_clock::now();
+    bool ok = manager.objectsToLocalFile(deviceName, *std::get<0>(hash_segments),
+                                         folder / "restored", std::get<1>(hash_segments));
+    std::chrono::duration<double> restore = std::chrono::steady_clock::now() - start;
+    BOOST_CHECK_EQUAL(ok, true);
+
+    fs::ifstream restored(folder / "restored", std::ios::in | std::ios::binary);
+    std::string restoredContent((std::istreambuf_iterator<char>(restored)),
+                                std::istreambuf_iterator<char>());
+    BOOST_CHECK(restoredContent == content);
+
+    std::cout << "Segment size " << segmentSize << ": "
+              << std::get<1>(hash_segments) << " segments, publish "
+              << FILE_SIZE / publish.count() / 1024 / 1024 << " MB/s, restore "
+              << FILE_SIZE / restore.count() / 1024 / 1024 << " MB/s" << std::endl;
+  }
+
+  face->shutdown();
+  remove_all(tmpdir);
+}
+
+BOOST_AUTO_TEST_CASE(SegmentReaderBenchmark)
+{
+  const size_t FILE_SIZE = 16 * 1024 * 1024;
+
+  fs::path tmpdir = fs::unique_path(fs::temp_directory_path() / "%%%%-%%%%-%%%%-%%%%");
+  fs::create_directories(tmpdir);
+  Name deviceName("/device");
+
+  {
+    std::string content(FILE_SIZE, '\0');
+    for (size_t i = 0; i < content.size(); i++) {
+      content[i] = static_cast<char>(i * 7 + i / 1024);
+    }
+    fs::ofstream file(tmpdir / "file", std::ios::out | std::ios::binary);
+    file.write(content.data(), content.size());
+  }
+
+  shared_ptr<Face> face = make_shared<Face>();
+  ObjectManager manager(*face, tmpdir, "test-chronoshare");
+  auto hash_segments = manager.localFileToObjects(tmpdir / "file", deviceName);
+  const Buffer& hash = *std::get<0>(hash_segments);
+
+  // before: a lookup, a Data decode and a copy of the content per segment
+  auto start = std::chrono::steady_clock::now();
+  size_t nBytes = 0;
+  {
+    ObjectDb db(tmpdir / ".chronoshare", toHex(hash));
+    sqlite3_int64 segment = 0;
+    for (BufferPtr bytes = db.fetchSegment(deviceName, segment); bytes != nullptr;
+         bytes = db.fetchSegment(deviceName, ++segment)) {
+      nBytes += bytes->size();
+    }
+  }
+  std::chrono::duration<double> perSegment = std::chrono::steady_clock::now() - start;
+  BOOST_CHECK_EQUAL(nBytes, FILE_SIZE);
+
+  // after: one query for all segments, content is located in the stored packet
+  start = std::chrono::steady_clock::now();
+  nBytes = 0;
+  {
+    ObjectStore::SegmentReader reader(*ObjectStore::open(tmpdir / ".chronoshare"), hash,
+                                      deviceName);
+    const uint8_t* content = nullptr;
+    size_t size = 0;
+    while (reader.next(content, size)) {
+      nBytes += size;
+    }
+    BOOST_CHECK_EQUAL(reader.getNSegments(), std::get<1>(hash_segments));
+  }
+  std::chrono::duration<double> streaming = std::chrono::steady_clock::now() - start;
+  BOOST_CHECK_EQUAL(nBytes, FILE_SIZE);
+
+  std::cout << "Segments/sec, ObjectDb::fetchSegment:        "
+            << std::get<1>(hash_segments) / perSegment.count() << std::endl;
+  std::cout << "Segments/sec, ObjectStore::SegmentReader:    "
+            << std::get<1>(hash_segments) / streaming.count() << std::endl;
+
+  face->shutdown();
+  remove_all(tmpdir);
+}
+
+// copy segments [first, last] of object @p hash from the store of one folder to another, as
+// fetching them would, and return the number of transferred bytes
+static size_t
+transferSegments(const fs::path& from, const fs::path& to, const Name& deviceName,
+                 const Buffer& hash, const std::string& layout, size_t first, size_t last)
+{
+  ObjectStorePtr store = ObjectStore::open(from / ".chronoshare");
+  ObjectDb db(to / ".chronoshare", toHex(hash), layout);
+
+  size_t nBytes = 0;
+  for (size_t segment = first; segment <= last; segment++) {
+    ObjectStore::Location location;
+    BOOST_REQUIRE(store->lookup(hash, deviceName, segment, location));
+    shared_ptr<Data> data = store->read(location);
+    db.saveContentObject(deviceName, segment, *data);
+    nBytes += data->wireEncode().size();
+  }
+  return nBytes;
+}
+
+BOOST_AUTO_TEST_CASE(ContentDefinedChunkingBenchmark)
+{
+  const size_t FILE_SIZE = 8 * 1024 * 1024;
+
+  fs::path tmpdir = fs::unique_path(fs::temp_directory_path() / "%%%%-%%%%-%%%%-%%%%");
+  fs::create_directories(tmpdir);
+  Name deviceName("/device");
+
+  std::mt19937 random(1);
+  std::string original(FILE_SIZE, '\0');
+  for (char& byte : original) {
+    byte = static_cast<char>(random());
+  }
+  std::string inserted = original;
+  inserted.insert(FILE_SIZE / 2, "bytes inserted in the middle of the file");
+  std::string overwritten = original;
+  overwritten.replace(FILE_SIZE / 3, 4096, std::string(4096, 'x'));
+
+  shared_ptr<Face> face = make_shared<Face>();
+
+  for (ObjectManager::Chunking chunking : {ObjectManager::CHUNKING_FIXED_SIZE,
+                                           ObjectManager::CHUNKING_CONTENT_DEFINED}) {
+    fs::path publisherFolder = tmpdir / std::to_string(chunking) / "publisher";
+    fs::path receiverFolder = tmpdir / std::to_string(chunking) / "receiver";
+    ObjectManager publisher(*face, publisherFolder, "test-chronoshare",
+                            ObjectManager::MAX_SEGMENT_SIZE, chunking);
+    ObjectManager receiver(*face, receiverFolder, "test-chronoshare",
+                           ObjectManager::MAX_SEGMENT_SIZE, chunking);
+
+    // publish a version of the file and fetch it the way Dispatcher does
+    auto fetchVersion = [&] (const std::string& content) {
+      {
+        fs::ofstream file(publisherFolder / "file", std::ios::out | std::ios::binary);
+        file.write(content.data(), content.size());
+      }
+
+      ObjectManager::ChunkList chunkList{nullptr, 0};
+      auto hash_segments = publisher.localFileToObjects(publisherFolder / "file", deviceName,
+                                                        Buffer(), &chunkList);
+      const Buffer& hash = *std::get<0>(hash_segments);
+
+      size_t nBytes = 0;
+      if (chunkList.hash) {
+        nBytes += transferSegments(publisherFolder, receiverFolder, deviceName, *chunkList.hash,
+                                   ObjectStore::makeLayout(ObjectManager::MAX_SEGMENT_SIZE,
+                                                           false),
+                                   0, chunkList.nSegments - 1);
+        ConstBufferPtr list = receiver.fetchChunkList(deviceName, *chunkList.hash);
+        BOOST_REQUIRE(list != nullptr);
+
+        for (const auto& range : receiver.findMissingChunks(*list)) {
+          nBytes += transferSegments(publisherFolder, receiverFolder, deviceName, hash,
+                                     receiver.getLayout(), range.first, range.second);
+        }
+        receiver.addChunkList(deviceName, hash, receiver.getLayout(), *list);
+      }
+      else {
+        nBytes += transferSegments(publisherFolder, receiverFolder, deviceName, hash,
+                                   receiver.getLayout(), 0, std::get<1>(hash_segments) - 1);
+      }
+
+      BOOST_CHECK(receiver.objectsToLocalFile(deviceName, hash, receiverFolder / "file",
+                                              std::get<1>(hash_segments)));
+      fs::ifstream restored(receiverFolder / "file", std::ios::in | std::ios::binary);
+      std::string restoredContent((std::istreambuf_iterator<char>(restored)),
+                                  std::istreambuf_iterator<char>());
+      BOOST_CHECK(restoredContent == content);
+
+      return nBytes;
+    };
+
+    size_t initialBytes = fetchVersion(original);
+    size_t insertedBytes = fetchVersion(inserted);
+    size_t overwrittenBytes = fetchVersion(overwritten);
+
+    if (chunking == ObjectManager::CHUNKING_CONTENT_DEFINED) {
+      BOOST_CHECK_LT(insertedBytes, FILE_SIZE / 10);
+      BOOST_CHECK_LT(overwrittenBytes, FILE_SIZE / 10);
+    }
+    else {
+      BOOST_CHECK_GT(insertedBytes, FILE_SIZE);
+      BOOST_CHECK_GT(overwrittenBytes, FILE_SIZE);
+    }
+
+    std::cout << (chunking == ObjectManager::CHUNKING_CONTENT_DEFINED ? "Content-defined" :
+                                                                         "Fixed-size")
+              << " chunking, bytes transferred: initial " << initialBytes
+              << ", after insert in the middle " << insertedBytes
+              << ", after overwrite in the middle " << overwrittenBytes << std::endl;
+  }
+
+  face->shutdown();
+  remove_all(tmpdir);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // chronoshare
+} // ndn
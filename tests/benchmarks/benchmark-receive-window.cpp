@@ -0,0 +1,89 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+
+#include "receive-window.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <set>
+
+namespace ndn {
+namespace chronoshare {
+
+BOOST_AUTO_TEST_SUITE(BenchmarkReceiveWindow)
+
+BOOST_AUTO_TEST_CASE(ReorderingBenchmark)
+{
+  const int64_t N_SEGMENTS = 4000000;
+  const int64_t REORDERING = 512;
+
+  // segments arrive shuffled within blocks, as with a large window and multiple paths
+  std::vector<int64_t> stream(N_SEGMENTS);
+  for (int64_t i = 0; i < N_SEGMENTS; i++) {
+    stream[i] = i;
+  }
+  std::mt19937 random(0);
+  for (int64_t i = 0; i < N_SEGMENTS; i += REORDERING) {
+    std::shuffle(stream.begin() + i, stream.begin() + std::min(i + REORDERING, N_SEGMENTS), random);
+  }
+
+  // before: ordered sets, scanned from the beginning on every segment
+  auto start = std::chrono::steady_clock::now();
+  int64_t maxInOrder = -1;
+  std::set<int64_t> outOfOrder;
+  std::set<int64_t> inActivePipeline;
+  for (int64_t seqNo : stream) {
+    inActivePipeline.insert(seqNo);
+    inActivePipeline.erase(seqNo);
+    outOfOrder.insert(seqNo);
+    std::set<int64_t>::iterator inOrder = outOfOrder.begin();
+    for (; inOrder != outOfOrder.end() && *inOrder == maxInOrder + 1; inOrder++) {
+      maxInOrder = *inOrder;
+    }
+    outOfOrder.erase(outOfOrder.begin(), inOrder);
+  }
+  std::chrono::duration<double> sets = std::chrono::steady_clock::now() - start;
+  BOOST_CHECK_EQUAL(maxInOrder, N_SEGMENTS - 1);
+
+  // after
+  start = std::chrono::steady_clock::now();
+  ReceiveWindow window(0);
+  ReceiveWindow::TimePoint sendTime;
+  bool isRetransmitted;
+  for (int64_t seqNo : stream) {
+    window.markPending(seqNo, start);
+    window.clearPending(seqNo, sendTime, isRetransmitted);
+    window.markReceived(seqNo);
+  }
+  std::chrono::duration<double> bitmap = std::chrono::steady_clock::now() - start;
+  BOOST_CHECK_EQUAL(window.getFirstMissing(), N_SEGMENTS);
+
+  std::cout << "Segments/sec, std::set:       " << N_SEGMENTS / sets.count() << std::endl;
+  std::cout << "Segments/sec, ReceiveWindow:  " << N_SEGMENTS / bitmap.count() << std::endl;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // chronoshare
+} // ndn
@@ -0,0 +1,93 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+
+#include "logging.hpp"
+#include "signing-service.hpp"
+
+#include <ndn-cxx/security/key-chain.hpp>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <iostream>
+
+INIT_LOGGER("Benchmark.SigningService")
+
+namespace ndn {
+namespace chronoshare {
+
+BOOST_AUTO_TEST_SUITE(BenchmarkSigningService)
+
+static std::vector<shared_ptr<Data>>
+makePackets(const Name& prefix, size_t nPackets)
+{
+  std::vector<shared_ptr<Data>> packets;
+  for (size_t i = 0; i < nPackets; i++) {
+    shared_ptr<Data> data = make_shared<Data>(Name(prefix).appendNumber(i));
+    data->setContent(reinterpret_cast<const uint8_t*>("segment"), 7);
+    packets.push_back(data);
+  }
+  return packets;
+}
+
+BOOST_AUTO_TEST_CASE(SigningBenchmark)
+{
+  const size_t N_PACKETS = 2000;
+
+  // before: one KeyChain signing on the calling thread
+  std::vector<shared_ptr<Data>> packets = makePackets("/single", N_PACKETS);
+  KeyChain keyChain;
+  auto start = std::chrono::steady_clock::now();
+  for (const auto& data : packets) {
+    keyChain.sign(*data);
+  }
+  std::chrono::duration<double> single = std::chrono::steady_clock::now() - start;
+
+  // after: worker pool, fed asynchronously as ObjectManager and ContentServer do
+  boost::asio::io_service io;
+  boost::asio::io_service::work work(io);
+  SigningService service;
+  size_t nSigned = 0;
+
+  packets = makePackets("/pool", N_PACKETS);
+  start = std::chrono::steady_clock::now();
+  for (const auto& data : packets) {
+    service.sign(data, SigningService::PRIORITY_BULK, io,
+                 [&nSigned] (const shared_ptr<Data>&) { nSigned++; });
+  }
+  while (nSigned < N_PACKETS) {
+    io.run_one();
+  }
+  std::chrono::duration<double> pool = std::chrono::steady_clock::now() - start;
+
+  SigningService::Stats stats = service.getStats();
+  BOOST_CHECK_EQUAL(stats.nSigned, N_PACKETS);
+
+  std::cout << "Signatures/sec, KeyChain on calling thread: " << N_PACKETS / single.count()
+            << std::endl;
+  std::cout << "Signatures/sec, SigningService:             " << N_PACKETS / pool.count()
+            << ", max queue depth " << stats.maxQueueDepth << std::endl;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // chronoshare
+} // ndn
@@ -25,10 +25,13 @@
 #include "sync-log.hpp"
 #include "test-common.hpp"
 
+#include <ndn-cxx/security/key-chain.hpp>
+
 #include <unistd.h>
 #include <iostream>
 #include <boost/filesystem.hpp>
 #include <boost/make_shared.hpp>
+#include <set>
 #include <thread>
  
 INIT_LOGGER("ActionLogTes")
@@ -273,6 +276,533 @@ BOOST_AUTO_TEST_CASE(DeleteAction)
   }
 }
 
+class ActionLogWithRawDb : public ActionLog
+{
+public:
+  using ActionLog::ActionLog;
+
+  sqlite3*
+  getDb()
+  {
+    return m_db;
+  }
+};
+
+static const std::string INSERT_BENCHMARK_ACTION =
+  "INSERT INTO ActionLog "
+  "(device_name, seq_no, action, filename, version, action_timestamp, "
+  "file_hash, file_mtime, file_chmod, file_seg_num, action_name, action_content_object) "
+  "VALUES(?, ?, 0, ?, 0, datetime(?, 'unixepoch'), ?, datetime(?, 'unixepoch'), ?, ?, ?, ?)";
+
+static void
+bindBenchmarkAction(sqlite3_stmt* stmt, const Block& deviceName, sqlite3_int64 seqNo,
+                    const std::string& filename, const Buffer& hash, const Buffer& content)
+{
+  sqlite3_bind_blob(stmt, 1, deviceName.wire(), deviceName.size(), SQLITE_STATIC);
+  sqlite3_bind_int64(stmt, 2, seqNo);
+  sqlite3_bind_text(stmt, 3, filename.c_str(), filename.size(), SQLITE_STATIC);
+  sqlite3_bind_int64(stmt, 4, std::time(NULL));
+  sqlite3_bind_blob(stmt, 5, hash.buf(), hash.size(), SQLITE_STATIC);
+  sqlite3_bind_int64(stmt, 6, std::time(NULL));
+  sqlite3_bind_int(stmt, 7, 0644);
+  sqlite3_bind_int(stmt, 8, 1);
+  sqlite3_bind_blob(stmt, 9, content.buf(), 16, SQLITE_STATIC);
+  sqlite3_bind_blob(stmt, 10, content.buf(), content.size(), SQLITE_STATIC);
+}
+
+// timed version in tests/benchmarks/benchmark-action-log.cpp
+BOOST_AUTO_TEST_CASE(CachedStatementInserts)
+{
+  const int N_INSERTS = 100;
+
+  Name localName("/lijing");
+
+  fs::path tmpdir = fs::unique_path("./Loli_Test");
+  if (exists(tmpdir)) {
+    remove_all(tmpdir);
+  }
+  shared_ptr<Face> face = make_shared<Face>();
+
+  SyncLogPtr syncLog = make_shared<SyncLog>(tmpdir, localName);
+  shared_ptr<ActionLogWithRawDb> actionLog =
+    std::make_shared<ActionLogWithRawDb>(*face, tmpdir, syncLog, "top-secret", "test-chronoshare",
+                                         ActionLog::OnFileAddedOrChangedCallback(),
+                                         ActionLog::OnFileRemovedCallback());
+
+  Block deviceName = Name("/yukai").wireEncode();
+  Buffer hash = digestFromString("2ff304769cdb0125ac039e6fe7575f8576dceffc62618a431715aaf6eea2bf1c");
+  Buffer content(512);
+
+  // statement is compiled and finalized for every insert
+  sqlite3_exec(actionLog->getDb(), "BEGIN TRANSACTION;", 0, 0, 0);
+  for (int i = 0; i < N_INSERTS; i++) {
+    sqlite3_stmt* stmt;
+    sqlite3_prepare_v2(actionLog->getDb(), INSERT_BENCHMARK_ACTION.c_str(), -1, &stmt, 0);
+    bindBenchmarkAction(stmt, deviceName, i + 1, "file-" + std::to_string(i), hash, content);
+    sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+  }
+  sqlite3_exec(actionLog->getDb(), "END TRANSACTION;", 0, 0, 0);
+
+  // statement is taken from the DbHelper statement cache, reset and rebound for every insert
+  sqlite3_exec(actionLog->getDb(), "BEGIN TRANSACTION;", 0, 0, 0);
+  for (int i = 0; i < N_INSERTS; i++) {
+    DbHelper::Statement stmt(*actionLog, INSERT_BENCHMARK_ACTION);
+    bindBenchmarkAction(stmt, deviceName, N_INSERTS + i + 1, "file-" + std::to_string(i), hash,
+                        content);
+    sqlite3_step(stmt);
+  }
+  sqlite3_exec(actionLog->getDb(), "END TRANSACTION;", 0, 0, 0);
+
+  BOOST_CHECK_EQUAL(actionLog->LogSize(), 2 * N_INSERTS);
+
+  // local path, one by one and as one batch
+  const int N_LOCAL = 20;
+  for (int i = 0; i < N_LOCAL; i++) {
+    actionLog->AddLocalActionUpdate("local-" + std::to_string(i), hash, std::time(NULL), 0644, 1);
+  }
+
+  BOOST_CHECK_EQUAL(actionLog->LogSize(), 2 * N_INSERTS + N_LOCAL);
+
+  std::vector<ActionLog::LocalUpdate> updates;
+  for (int i = 0; i < N_LOCAL; i++) {
+    updates.push_back(ActionLog::LocalUpdate{"batch-" + std::to_string(i),
+                                             make_shared<Buffer>(hash), std::time(NULL), 0644, 1});
+  }
+  actionLog->AddLocalActionUpdates(updates);
+
+  BOOST_CHECK_EQUAL(actionLog->LogSize(), 2 * N_INSERTS + 2 * N_LOCAL);
+
+  remove_all(tmpdir);
+  face->shutdown();
+}
+
+// timed in a large log in tests/benchmarks/benchmark-action-log.cpp
+BOOST_AUTO_TEST_CASE(FolderLookup)
+{
+  Name localName("/lijing");
+
+  fs::path tmpdir = fs::unique_path("./Loli_Test");
+  if (exists(tmpdir)) {
+    remove_all(tmpdir);
+  }
+  shared_ptr<Face> face = make_shared<Face>();
+
+  SyncLogPtr syncLog = make_shared<SyncLog>(tmpdir, localName);
+  ActionLogPtr actionLog =
+    std::make_shared<ActionLog>(*face, tmpdir, syncLog, "top-secret", "test-chronoshare",
+                                ActionLog::OnFileAddedOrChangedCallback(),
+                                ActionLog::OnFileRemovedCallback());
+
+  ConstBufferPtr hash = make_shared<Buffer>(
+    digestFromString("2ff304769cdb0125ac039e6fe7575f8576dceffc62618a431715aaf6eea2bf1c"));
+  std::vector<ActionLog::LocalUpdate> updates;
+  // "dir-other" sorts before and "dir0" right after "dir/", neither is inside "dir"
+  for (const char* filename : {"a.txt", "dir/b.txt", "dir/sub/c.txt", "dir-other/d.txt",
+                               "dir0/e.txt", "dirx.txt"}) {
+    updates.push_back(ActionLog::LocalUpdate{filename, hash, std::time(NULL), 0644, 1});
+  }
+  actionLog->AddLocalActionUpdates(updates);
+
+  std::set<std::string> actions;
+  actionLog->LookupActionsInFolderRecursively([&actions] (const Name&, sqlite3_int64,
+                                                          const ActionItem& action) {
+                                                actions.insert(action.filename());
+                                              },
+                                              "dir");
+  BOOST_CHECK(actions == (std::set<std::string>{"dir/b.txt", "dir/sub/c.txt"}));
+
+  std::set<std::string> files;
+  auto fileVisitor = [&files] (const FileItem& file) { files.insert(file.filename()); };
+  actionLog->GetFileState()->LookupFilesInFolderRecursively(fileVisitor, "dir");
+  BOOST_CHECK(files == (std::set<std::string>{"dir/b.txt", "dir/sub/c.txt"}));
+
+  files.clear();
+  actionLog->GetFileState()->LookupFilesInFolderRecursively(fileVisitor, "dir/sub");
+  BOOST_CHECK(files == (std::set<std::string>{"dir/sub/c.txt"}));
+
+  remove_all(tmpdir);
+  face->shutdown();
+}
+
+BOOST_AUTO_TEST_CASE(BatchUpdateAction)
+{
+  Name localName("/lijing");
+
+  fs::path tmpdir = fs::unique_path("./Loli_Test");
+  if (exists(tmpdir)) {
+    remove_all(tmpdir);
+  }
+  shared_ptr<Face> face = make_shared<Face>();
+
+  SyncLogPtr syncLog = make_shared<SyncLog>(tmpdir, localName);
+  ActionLogPtr actionLog =
+    std::make_shared<ActionLog>(*face, tmpdir, syncLog, "top-secret", "test-chronoshare",
+                                ActionLog::OnFileAddedOrChangedCallback(),
+                                ActionLog::OnFileRemovedCallback());
+
+  actionLog->AddLocalActionUpdate("a.txt",
+                                  digestFromString(
+                                    "2ff304769cdb0125ac039e6fe7575f8576dceffc62618a431715aaf6eea2bf1c"),
+                                  std::time(NULL), 0644, 1);
+
+  ConstBufferPtr hash = make_shared<Buffer>(
+    digestFromString("2ff304769cdb0125ac039e6fe7575f8576dceffc62618a431715aaf6eea2bf1c"));
+  std::vector<ActionLog::LocalUpdate> updates;
+  updates.push_back(ActionLog::LocalUpdate{"a.txt", hash, std::time(NULL), 0644, 1});
+  updates.push_back(ActionLog::LocalUpdate{"dir/b.txt", hash, std::time(NULL), 0644, 2});
+  updates.push_back(ActionLog::LocalUpdate{"a.txt", hash, std::time(NULL), 0644, 3});
+
+  std::vector<ActionItemPtr> items = actionLog->AddLocalActionUpdates(updates);
+  BOOST_REQUIRE_EQUAL(items.size(), 3);
+  BOOST_CHECK_EQUAL(syncLog->SeqNo(localName), 4);
+  BOOST_CHECK_EQUAL(actionLog->LogSize(), 4);
+
+  // consecutive seq_no, versions and parents follow the order in the batch
+  ActionItemPtr action = actionLog->LookupAction(localName, 2);
+  BOOST_REQUIRE(action);
+  BOOST_CHECK_EQUAL(action->filename(), "a.txt");
+  BOOST_CHECK_EQUAL(action->version(), 1);
+  BOOST_CHECK_EQUAL(action->parent_seq_no(), 1);
+
+  action = actionLog->LookupAction(localName, 3);
+  BOOST_REQUIRE(action);
+  BOOST_CHECK_EQUAL(action->filename(), "dir/b.txt");
+  BOOST_CHECK_EQUAL(action->version(), 0);
+  BOOST_CHECK_EQUAL(action->has_parent_seq_no(), false);
+
+  action = actionLog->LookupAction(localName, 4);
+  BOOST_REQUIRE(action);
+  BOOST_CHECK_EQUAL(action->version(), 2);
+  BOOST_CHECK_EQUAL(action->parent_seq_no(), 2);
+
+  FileItemPtr file = actionLog->GetFileState()->LookupFile("a.txt");
+  BOOST_REQUIRE(file);
+  BOOST_CHECK_EQUAL(file->version(), 2);
+  BOOST_CHECK_EQUAL(file->seg_num(), 3);
+  BOOST_CHECK_EQUAL(file->is_complete(), true);
+
+  file = actionLog->GetFileState()->LookupFile("dir/b.txt");
+  BOOST_REQUIRE(file);
+  BOOST_CHECK_EQUAL(file->is_complete(), true);
+
+  remove_all(tmpdir);
+  face->shutdown();
+}
+
+BOOST_AUTO_TEST_CASE(KeysetPagination)
+{
+  const int N_FILES = 95;
+  const int PAGE_SIZE = 10;
+
+  Name localName("/lijing");
+
+  fs::path tmpdir = fs::unique_path("./Loli_Test");
+  if (exists(tmpdir)) {
+    remove_all(tmpdir);
+  }
+  shared_ptr<Face> face = make_shared<Face>();
+
+  SyncLogPtr syncLog = make_shared<SyncLog>(tmpdir, localName);
+  ActionLogPtr actionLog =
+    std::make_shared<ActionLog>(*face, tmpdir, syncLog, "top-secret", "test-chronoshare",
+                                ActionLog::OnFileAddedOrChangedCallback(),
+                                ActionLog::OnFileRemovedCallback());
+
+  ConstBufferPtr hash = make_shared<Buffer>(
+    digestFromString("2ff304769cdb0125ac039e6fe7575f8576dceffc62618a431715aaf6eea2bf1c"));
+  std::vector<ActionLog::LocalUpdate> updates;
+  for (int i = 0; i < N_FILES; i++) {
+    updates.push_back(ActionLog::LocalUpdate{"dir/file-" + std::to_string(i), hash,
+                                             std::time(NULL), 0644, 1});
+  }
+  // actions of one batch share the timestamp, so the order is defined by (device, seq_no)
+  actionLog->AddLocalActionUpdates(updates);
+
+  std::vector<sqlite3_int64> byOffset;
+  for (int page = 0; ; page++) {
+    bool more = actionLog->LookupActionsInFolderRecursively(
+      [&byOffset] (const Name&, sqlite3_int64 seqNo, const ActionItem&) {
+        byOffset.push_back(seqNo);
+      },
+      "dir", page * PAGE_SIZE, PAGE_SIZE);
+    if (!more)
+      break;
+  }
+
+  std::vector<sqlite3_int64> byCursor;
+  ActionLog::ActionKey last{0, Name(), 0};
+  bool more = actionLog->LookupActionsInFolderRecursively(
+    [&] (const Name& name, sqlite3_int64 seqNo, const ActionItem& action) {
+      byCursor.push_back(seqNo);
+      last = ActionLog::ActionKey{static_cast<time_t>(action.timestamp()), name, seqNo};
+    },
+    "dir", 0, PAGE_SIZE);
+  while (more) {
+    ActionLog::ActionKey after = last;
+    more = actionLog->LookupActionsInFolderRecursively(
+      [&] (const Name& name, sqlite3_int64 seqNo, const ActionItem& action) {
+        byCursor.push_back(seqNo);
+        last = ActionLog::ActionKey{static_cast<time_t>(action.timestamp()), name, seqNo};
+      },
+      "dir", after, PAGE_SIZE);
+  }
+
+  BOOST_CHECK_EQUAL(byCursor.size(), N_FILES);
+  BOOST_CHECK_EQUAL_COLLECTIONS(byCursor.begin(), byCursor.end(), byOffset.begin(), byOffset.end());
+
+  std::vector<std::string> files;
+  std::string lastFile;
+  do {
+    more = actionLog->GetFileState()->LookupFilesInFolderRecursively(
+      [&] (const FileItem& file) {
+        files.push_back(file.filename());
+        lastFile = file.filename();
+      },
+      "dir", lastFile, PAGE_SIZE);
+  } while (more);
+
+  BOOST_CHECK_EQUAL(files.size(), N_FILES);
+  BOOST_CHECK(std::is_sorted(files.begin(), files.end()));
+
+  remove_all(tmpdir);
+  face->shutdown();
+}
+
+static shared_ptr<Data>
+makeRemoteAction(const Name& deviceName, sqlite3_int64 seqNo, const ActionItem& item,
+                 KeyChain& keyChain)
+{
+  std::string msg;
+  item.SerializeToString(&msg);
+
+  shared_ptr<Data> data = make_shared<Data>();
+  data->setName(Name(deviceName).append("test-chronoshare").append("action").append("top-secret")
+                  .appendNumber(seqNo));
+  data->setContent(reinterpret_cast<const uint8_t*>(msg.c_str()), msg.size());
+  keyChain.sign(*data);
+  return data;
+}
+
+static ActionItem
+makeUpdateItem(const std::string& filename, sqlite3_int64 version)
+{
+  ActionItem item;
+  item.set_action(ActionItem::UPDATE);
+  item.set_filename(filename);
+  item.set_version(version);
+  item.set_timestamp(std::time(NULL));
+  item.set_file_hash(std::string(32, 'h'));
+  item.set_mtime(std::time(NULL));
+  item.set_mode(0644);
+  item.set_seg_num(1);
+  return item;
+}
+
+static shared_ptr<Data>
+makeRemoteUpdateAction(const Name& deviceName, sqlite3_int64 seqNo, const std::string& filename,
+                       sqlite3_int64 version, KeyChain& keyChain)
+{
+  return makeRemoteAction(deviceName, seqNo, makeUpdateItem(filename, version), keyChain);
+}
+
+static void
+applyRemoteActions(const std::vector<shared_ptr<Data>>& actions, bool useInsertTrigger,
+                   std::map<std::string, std::string>& winners)
+{
+  fs::path tmpdir = fs::unique_path("./Loli_Test");
+  if (exists(tmpdir)) {
+    remove_all(tmpdir);
+  }
+  shared_ptr<Face> face = make_shared<Face>();
+
+  SyncLogPtr syncLog = make_shared<SyncLog>(tmpdir, Name("/lijing"));
+  ActionLogPtr actionLog =
+    std::make_shared<ActionLog>(*face, tmpdir, syncLog, "top-secret", "test-chronoshare",
+                                ActionLog::OnFileAddedOrChangedCallback(),
+                                ActionLog::OnFileRemovedCallback(), useInsertTrigger);
+
+  for (const auto& action : actions) {
+    actionLog->AddRemoteAction(action);
+  }
+
+  // duplicates are ignored
+  BOOST_CHECK_EQUAL(actionLog->LogSize(), actions.size() - 1);
+
+  actionLog->GetFileState()->LookupFilesInFolderRecursively([&winners] (const FileItem& file) {
+      winners[file.filename()] = file.device_name() + "/" + std::to_string(file.version());
+    }, "");
+
+  actionLog.reset();
+  syncLog.reset();
+  remove_all(tmpdir);
+  face->shutdown();
+}
+
+// timed version in tests/benchmarks/benchmark-action-log.cpp
+BOOST_AUTO_TEST_CASE(RemoteActionConflicts)
+{
+  const int N_FILES = 100;
+
+  KeyChain keyChain;
+  std::vector<shared_ptr<Data>> actions;
+  for (int i = 0; i < N_FILES; i++) {
+    std::string filename = "folder-" + std::to_string(i % 10) + "/file-" + std::to_string(i);
+    // concurrent updates of the same version, the larger device name wins
+    actions.push_back(makeRemoteUpdateAction("/yukai", i + 1, filename, 1, keyChain));
+    actions.push_back(makeRemoteUpdateAction("/alex", i + 1, filename, 1, keyChain));
+    if (i % 4 == 0) {
+      actions.push_back(makeRemoteUpdateAction("/alex", N_FILES + i + 1, filename, 2, keyChain));
+    }
+  }
+  actions.push_back(actions.front());
+
+  std::map<std::string, std::string> triggerWinners;
+  std::map<std::string, std::string> nativeWinners;
+  applyRemoteActions(actions, true, triggerWinners);
+  applyRemoteActions(actions, false, nativeWinners);
+
+  BOOST_CHECK_EQUAL(nativeWinners.size(), N_FILES);
+  BOOST_CHECK(triggerWinners == nativeWinners);
+}
+
+BOOST_AUTO_TEST_CASE(LocalSeqNoAfterUncleanShutdown)
+{
+  fs::path tmpdir = fs::unique_path("./Loli_Test");
+  if (exists(tmpdir)) {
+    remove_all(tmpdir);
+  }
+  shared_ptr<Face> face = make_shared<Face>();
+  Buffer hash = digestFromString("2ff304769cdb0125ac039e6fe7575f8576dceffc62618a431715aaf6eea2bf1c");
+
+  {
+    SyncLogPtr syncLog = make_shared<SyncLog>(tmpdir, Name("/lijing"));
+    ActionLog actionLog(*face, tmpdir, syncLog, "top-secret", "test-chronoshare",
+                        ActionLog::OnFileAddedOrChangedCallback(),
+                        ActionLog::OnFileRemovedCallback());
+    for (int i = 0; i < 3; i++) {
+      actionLog.AddLocalActionUpdate("file-" + std::to_string(i), hash, std::time(NULL), 0644, 1);
+    }
+  }
+
+  // the last actions were not saved in SyncNodes
+  {
+    sqlite3* raw = nullptr;
+    BOOST_REQUIRE_EQUAL(sqlite3_open((tmpdir / ".chronoshare" / "sync-log.db").c_str(), &raw),
+                        SQLITE_OK);
+    sqlite3_exec(raw, "UPDATE SyncNodes SET seq_no=1", NULL, NULL, NULL);
+    sqlite3_close(raw);
+  }
+
+  SyncLogPtr syncLog = make_shared<SyncLog>(tmpdir, Name("/lijing"));
+  ActionLog actionLog(*face, tmpdir, syncLog, "top-secret", "test-chronoshare",
+                      ActionLog::OnFileAddedOrChangedCallback(),
+                      ActionLog::OnFileRemovedCallback());
+  BOOST_CHECK_EQUAL(syncLog->SeqNo(Name("/lijing")), 3);
+  BOOST_CHECK_EQUAL(syncLog->GetNextLocalSeqNo(), 4);
+
+  remove_all(tmpdir);
+  face->shutdown();
+}
+
+BOOST_AUTO_TEST_CASE(FileSources)
+{
+  fs::path tmpdir = fs::unique_path("./Loli_Test");
+  if (exists(tmpdir)) {
+    remove_all(tmpdir);
+  }
+  shared_ptr<Face> face = make_shared<Face>();
+
+  SyncLogPtr syncLog = make_shared<SyncLog>(tmpdir, Name("/lijing"));
+  ActionLogPtr actionLog =
+    std::make_shared<ActionLog>(*face, tmpdir, syncLog, "top-secret", "test-chronoshare",
+                                ActionLog::OnFileAddedOrChangedCallback(),
+                                ActionLog::OnFileRemovedCallback());
+
+  KeyChain keyChain;
+  ActionItem fixed = makeUpdateItem("a.txt", 1);
+  ActionItem chunked = makeUpdateItem("b.txt", 1);
+  chunked.set_chunk_list_hash(std::string(32, 'c'));
+  chunked.set_chunk_list_seg_num(1);
+  ActionItem larger = makeUpdateItem("c.txt", 1);
+  larger.set_seg_size(4096);
+
+  // all of them publish the same content, in different segments
+  actionLog->AddRemoteAction(makeRemoteAction("/alex", 1, fixed, keyChain));
+  actionLog->AddRemoteAction(makeRemoteAction("/alex", 2, makeUpdateItem("d.txt", 1), keyChain));
+  actionLog->AddRemoteAction(makeRemoteAction("/yukai", 1, chunked, keyChain));
+  actionLog->AddRemoteAction(makeRemoteAction("/zhenkai", 1, larger, keyChain));
+  actionLog->AddRemoteAction(makeRemoteAction("/zhenkai", 2, fixed, keyChain));
+
+  BOOST_CHECK(actionLog->LookupFileSources(fixed) ==
+              (std::vector<Name>{"/alex", "/zhenkai"}));
+  BOOST_CHECK(actionLog->LookupFileSources(chunked) == std::vector<Name>{"/yukai"});
+  BOOST_CHECK(actionLog->LookupFileSources(larger) == std::vector<Name>{"/zhenkai"});
+
+  actionLog.reset();
+  syncLog.reset();
+  remove_all(tmpdir);
+  face->shutdown();
+}
+
+static void
+checkAutocommitInserts(const DbHelper::Profile& profile, const std::string& expectedJournalMode,
+                       int nInserts)
+{
+  DbHelper::Profile oldProfile = DbHelper::getDefaultProfile();
+  DbHelper::setDefaultProfile(profile);
+
+  Name localName("/lijing");
+
+  fs::path tmpdir = fs::unique_path("./Loli_Test");
+  if (exists(tmpdir)) {
+    remove_all(tmpdir);
+  }
+  shared_ptr<Face> face = make_shared<Face>();
+
+  SyncLogPtr syncLog = make_shared<SyncLog>(tmpdir, localName);
+  shared_ptr<ActionLogWithRawDb> actionLog =
+    std::make_shared<ActionLogWithRawDb>(*face, tmpdir, syncLog, "top-secret", "test-chronoshare",
+                                         ActionLog::OnFileAddedOrChangedCallback(),
+                                         ActionLog::OnFileRemovedCallback());
+
+  {
+    DbHelper::Statement stmt(*actionLog, "PRAGMA journal_mode;");
+    BOOST_REQUIRE_EQUAL(sqlite3_step(stmt), SQLITE_ROW);
+    BOOST_CHECK_EQUAL(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)),
+                      expectedJournalMode);
+  }
+
+  Block deviceName = Name("/yukai").wireEncode();
+  Buffer hash = digestFromString("2ff304769cdb0125ac039e6fe7575f8576dceffc62618a431715aaf6eea2bf1c");
+  Buffer content(512);
+
+  // every insert is its own transaction, as for actions arriving one by one
+  for (int i = 0; i < nInserts; i++) {
+    DbHelper::Statement stmt(*actionLog, INSERT_BENCHMARK_ACTION);
+    bindBenchmarkAction(stmt, deviceName, i + 1, "file-" + std::to_string(i), hash, content);
+    sqlite3_step(stmt);
+  }
+
+  BOOST_CHECK_EQUAL(actionLog->LogSize(), nInserts);
+
+  actionLog.reset();
+  syncLog.reset();
+  remove_all(tmpdir);
+  face->shutdown();
+
+  DbHelper::setDefaultProfile(oldProfile);
+}
+
+// timed version in tests/benchmarks/benchmark-action-log.cpp
+BOOST_AUTO_TEST_CASE(Profiles)
+{
+  const int N_INSERTS = 20;
+
+  checkAutocommitInserts(DbHelper::Profile::durable(), "delete", N_INSERTS);
+  checkAutocommitInserts(DbHelper::Profile::fast(), "wal", N_INSERTS);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 } // chronoshare
 } // ndn
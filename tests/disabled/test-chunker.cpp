@@ -0,0 +1,112 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+
+#include "chunker.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace ndn {
+namespace chronoshare {
+
+BOOST_AUTO_TEST_SUITE(TestChunker)
+
+static std::vector<std::string>
+split(const std::string& content, size_t maxSize, size_t readSize)
+{
+  Chunker chunker(maxSize);
+  std::vector<std::string> chunks(1);
+  for (size_t offset = 0; offset < content.size();) {
+    size_t size = std::min(readSize, content.size() - offset);
+    size_t nConsumed = 0;
+    bool isBoundary = chunker.findBoundary(reinterpret_cast<const uint8_t*>(content.data()) + offset,
+                                           size, nConsumed);
+    chunks.back().append(content, offset, nConsumed);
+    offset += nConsumed;
+    if (isBoundary) {
+      chunks.push_back("");
+    }
+  }
+  if (chunks.back().empty()) {
+    chunks.pop_back();
+  }
+  return chunks;
+}
+
+BOOST_AUTO_TEST_CASE(Sizes)
+{
+  Chunker chunker(8000);
+  BOOST_CHECK_EQUAL(chunker.getAvgSize(), 2048);
+  BOOST_CHECK_EQUAL(chunker.getMinSize(), 1024);
+  BOOST_CHECK_EQUAL(chunker.getMaxSize(), 8000);
+
+  std::mt19937 random(1);
+  std::string content(1024 * 1024, '\0');
+  for (char& byte : content) {
+    byte = static_cast<char>(random());
+  }
+
+  std::vector<std::string> chunks = split(content, 8000, 65536);
+  for (size_t i = 0; i + 1 < chunks.size(); i++) {
+    BOOST_CHECK_GE(chunks[i].size(), chunker.getMinSize());
+    BOOST_CHECK_LE(chunks[i].size(), chunker.getMaxSize());
+  }
+
+  // boundaries do not depend on how the content is read
+  BOOST_CHECK(split(content, 8000, 1000) == chunks);
+
+  // content without any variation is cut at the maximum size
+  std::vector<std::string> zeroChunks = split(std::string(100000, '\0'), 8000, 65536);
+  BOOST_CHECK_EQUAL(zeroChunks.size(), 13);
+  BOOST_CHECK_EQUAL(zeroChunks[0].size(), 8000);
+}
+
+BOOST_AUTO_TEST_CASE(EditInTheMiddle)
+{
+  std::mt19937 random(2);
+  std::string content(1024 * 1024, '\0');
+  for (char& byte : content) {
+    byte = static_cast<char>(random());
+  }
+  std::vector<std::string> chunks = split(content, 8000, 65536);
+  std::set<std::string> oldChunks(chunks.begin(), chunks.end());
+
+  std::string inserted = content;
+  inserted.insert(content.size() / 2, "a few inserted bytes");
+  std::string removed = content;
+  removed.erase(content.size() / 2, 100);
+
+  for (const std::string& edited : {inserted, removed}) {
+    size_t nNewChunks = 0;
+    for (const std::string& chunk : split(edited, 8000, 65536)) {
+      nNewChunks += oldChunks.count(chunk) == 0;
+    }
+    BOOST_CHECK_LE(nNewChunks, 3);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // chronoshare
+} // ndn
@@ -0,0 +1,132 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+
+#include "congestion-control.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <cmath>
+
+namespace ndn {
+namespace chronoshare {
+
+BOOST_AUTO_TEST_SUITE(TestCongestionControl)
+
+BOOST_AUTO_TEST_CASE(Rtt)
+{
+  RttEstimator rtt;
+  BOOST_CHECK(!rtt.hasSamples());
+  BOOST_CHECK_EQUAL(rtt.getRto().count(), RttEstimator::INITIAL_RTO.count());
+
+  rtt.addMeasurement(Milliseconds(100));
+  BOOST_CHECK_CLOSE(rtt.getSmoothedRtt().count(), 100, 0.01);
+  BOOST_CHECK_CLOSE(rtt.getRttVariation().count(), 50, 0.01);
+  BOOST_CHECK_CLOSE(rtt.getRto().count(), 300, 0.01);
+
+  for (int i = 0; i < 100; i++) {
+    rtt.addMeasurement(Milliseconds(20));
+  }
+  BOOST_CHECK_CLOSE(rtt.getSmoothedRtt().count(), 20, 1);
+  BOOST_CHECK_EQUAL(rtt.getRto().count(), RttEstimator::MIN_RTO.count());
+
+  rtt.backoff();
+  BOOST_CHECK_EQUAL(rtt.getRto().count(), 2 * RttEstimator::MIN_RTO.count());
+  for (int i = 0; i < 10; i++) {
+    rtt.backoff();
+  }
+  BOOST_CHECK_EQUAL(rtt.getRto().count(), RttEstimator::MAX_RTO.count());
+}
+
+BOOST_AUTO_TEST_CASE(Fixed)
+{
+  CongestionWindow window(CongestionWindow::ALGORITHM_FIXED);
+  window.increase();
+  window.decrease();
+  BOOST_CHECK_EQUAL(window.getWindow(), CongestionWindow::INITIAL_WINDOW);
+}
+
+BOOST_AUTO_TEST_CASE(Aimd)
+{
+  CongestionWindow window(CongestionWindow::ALGORITHM_AIMD);
+
+  // slow start
+  for (int i = 0; i < 10; i++) {
+    window.increase();
+  }
+  BOOST_CHECK_EQUAL(window.getWindow(), CongestionWindow::INITIAL_WINDOW + 10);
+
+  window.decrease();
+  BOOST_CHECK_EQUAL(window.getWindow(), 8);
+  BOOST_CHECK_EQUAL(window.getThreshold(), 8);
+
+  // one segment per window
+  for (int i = 0; i < 8; i++) {
+    window.increase();
+  }
+  BOOST_CHECK_CLOSE(window.getWindow(), 9, 5);
+
+  for (int i = 0; i < 10; i++) {
+    window.decrease();
+  }
+  BOOST_CHECK_EQUAL(window.getWindow(), CongestionWindow::MIN_WINDOW);
+}
+
+BOOST_AUTO_TEST_CASE(Cubic)
+{
+  CongestionWindow window(CongestionWindow::ALGORITHM_CUBIC);
+  for (int i = 0; i < 94; i++) {
+    window.increase();
+  }
+  BOOST_CHECK_EQUAL(window.getWindow(), 100);
+
+  CongestionWindow::TimePoint loss = std::chrono::steady_clock::now();
+  window.decrease(loss);
+  BOOST_CHECK_CLOSE(window.getWindow(), 70, 0.01);
+
+  // concave growth back to the window of the loss, which is reached after
+  // K = cbrt(100 * 0.3 / 0.4) seconds
+  double k = std::cbrt(100 * 0.3 / 0.4);
+  auto at = [loss] (double seconds) {
+    return loss + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(seconds));
+  };
+
+  for (int i = 0; i < 1000 && window.getWindow() < 99; i++) {
+    window.increase(at(k * 0.99));
+  }
+  BOOST_CHECK_GT(window.getWindow(), 99);
+
+  // stays close to it around K
+  for (int i = 0; i < 100; i++) {
+    window.increase(at(k));
+  }
+  BOOST_CHECK_LT(window.getWindow(), 101);
+
+  // and grows faster afterwards
+  for (int i = 0; i < 1000; i++) {
+    window.increase(at(k + 5));
+  }
+  BOOST_CHECK_GT(window.getWindow(), 140);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // chronoshare
+} // ndn
@@ -24,6 +24,9 @@
 #include "logging.hpp"
 #include <ndn-cxx/security/key-chain.hpp>
 
+#include <algorithm>
+#include <set>
+
 INIT_LOGGER("Test.FetchManager")
 
 using namespace std;
@@ -42,10 +45,13 @@ struct FetcherTestData {
 
   bool m_done;
   bool m_failed;
+  int m_nFinished;
+  std::vector<Name> m_finishedNames;
 
   FetcherTestData()
     : m_done(false)
     , m_failed(false)
+    , m_nFinished(0)
   {
   }
 
@@ -112,6 +118,8 @@ struct FetcherTestData {
   void
   finish(const ndn::Name& deviceName, const ndn::Name& baseName)
   {
+    m_nFinished++;
+    m_finishedNames.push_back(baseName);
   }
 
   void
@@ -269,6 +277,95 @@ BOOST_AUTO_TEST_CASE(TestFetcher)
   face->shutdown();
 }
 
+BOOST_AUTO_TEST_CASE(SwarmFetch)
+{
+  shared_ptr<Face> face = make_shared<Face>();
+  ndn::KeyChain keyChain;
+
+  FetcherTestData ftData;
+
+  Name deviceName("/device-a");
+  Name baseName = Name(deviceName).append("chronoshare").append("file").append("hash");
+  std::vector<Name> sources{deviceName, Name("/device-b"), Name("/device-c")};
+
+  // /device-c is offline, its part has to be fetched from the others
+  for (int i = 0; i < 200; i++) {
+    for (const Name& source : {Name("/device-a"), Name("/device-b")}) {
+      ndn::shared_ptr<Data> data = ndn::make_shared<Data>();
+      data->setName(Name(source).append("chronoshare").append("file").append("hash")
+                      .appendNumber(i));
+      data->setFreshnessPeriod(time::seconds(60));
+      data->setContent(reinterpret_cast<const unsigned char*>(&i), sizeof(int));
+      keyChain.sign(*data);
+      face->put(*data);
+    }
+  }
+
+  FetchManager fetchManager(*face, [] (const Name&) { return Name(); }, Name("/broadcast"), 3,
+                            bind(&FetcherTestData::onData, &ftData, _1, _2, _3, _4),
+                            bind(&FetcherTestData::finish, &ftData, _1, _2));
+  fetchManager.Enqueue(deviceName, baseName, sources, 0, 199);
+
+  face->processEvents(time::seconds(40));
+
+  BOOST_CHECK_EQUAL(ftData.m_nFinished, 1);
+  BOOST_CHECK_EQUAL(ftData.recvData.size(), 200);
+  BOOST_CHECK_EQUAL(ftData.recvContent.size(), 200);
+
+  // segments are reported for the device of the action, whichever device served them
+  BOOST_REQUIRE_EQUAL(ftData.differentNames.size(), 1);
+  BOOST_CHECK_EQUAL(*ftData.differentNames.begin(), baseName);
+}
+
+BOOST_AUTO_TEST_CASE(DeviceFairness)
+{
+  shared_ptr<Face> face = make_shared<Face>();
+  ndn::KeyChain keyChain;
+
+  FetcherTestData ftData;
+
+  auto fileName = [] (const Name& deviceName, int file) {
+    return Name(deviceName).append("chronoshare").append("file").appendNumber(file);
+  };
+
+  // /device-a has a backlog of 20 files, /device-b has one file queued after it
+  for (const Name& deviceName : {Name("/device-a"), Name("/device-b")}) {
+    for (int file = 0; file < 20; file++) {
+      for (int i = 0; i < 10; i++) {
+        ndn::shared_ptr<Data> data = ndn::make_shared<Data>();
+        data->setName(Name(fileName(deviceName, file)).appendNumber(i));
+        data->setFreshnessPeriod(time::seconds(60));
+        data->setContent(reinterpret_cast<const unsigned char*>(&i), sizeof(int));
+        keyChain.sign(*data);
+        face->put(*data);
+      }
+    }
+  }
+
+  FetchManager fetchManager(*face, [] (const Name&) { return Name(); }, Name("/broadcast"), 2,
+                            bind(&FetcherTestData::onData, &ftData, _1, _2, _3, _4),
+                            bind(&FetcherTestData::finish, &ftData, _1, _2), FetchTaskDbPtr(),
+                            CongestionWindow::ALGORITHM_AIMD, 1);
+  for (int file = 0; file < 19; file++) {
+    fetchManager.Enqueue(Name("/device-a"), fileName(Name("/device-a"), file), 0, 9);
+  }
+  fetchManager.Enqueue(Name("/device-b"), fileName(Name("/device-b"), 0), 0, 9);
+  // high priority goes first, even if the device has a backlog
+  fetchManager.Enqueue(Name("/device-a"), fileName(Name("/device-a"), 19), 0, 9,
+                       FetchManager::PRIORITY_HIGH);
+
+  face->processEvents(time::seconds(40));
+
+  BOOST_REQUIRE_EQUAL(ftData.m_nFinished, 21);
+
+  // both fit into the two fetch slots, /device-b does not wait for the backlog of /device-a
+  for (const Name& name : {fileName(Name("/device-a"), 19), fileName(Name("/device-b"), 0)}) {
+    size_t position = std::find(ftData.m_finishedNames.begin(), ftData.m_finishedNames.end(),
+                                name) - ftData.m_finishedNames.begin();
+    BOOST_CHECK_LT(position, 2);
+  }
+}
+
 // BOOST_AUTO_TEST_CASE(ndnWrapperSelector)
 // {
 
@@ -141,7 +141,7 @@ BOOST_AUTO_TEST_CASE(FetchTaskDbTest)
     Name b = baseNamePrefix;
     d.appendNumber(i);
     b.appendNumber(i);
-    db->deleteTask(d, b);
+    db->deleteTask(d, b, i, 11);
   }
 
   // add back 3 to 7, 3 and 4 should not be added twice
@@ -179,6 +179,92 @@ BOOST_AUTO_TEST_CASE(FetchTaskDbTest)
   }
 }
 
+BOOST_AUTO_TEST_CASE(Progress)
+{
+  fs::path folder("TaskDbTest");
+  if (exists(folder)) {
+    fs::remove_all(folder);
+  }
+
+  fs::create_directories(folder / ".chronoshare");
+
+  Name deviceName("/device");
+  Name baseName("/device/base");
+  Name otherBaseName("/device/other");
+
+  SegmentRanges received{{0, 99}, {150, 150}, {200, 5000}, {9000, 9999}};
+  {
+    FetchTaskDb db(folder, "test");
+    db.addTask(deviceName, baseName, 0, 9999, 1);
+    db.addTask(deviceName, otherBaseName, 0, 99, 1);
+
+    db.updateProgress(deviceName, baseName, 0, 9999, SegmentRanges{{0, 10}});
+    db.updateProgress(deviceName, baseName, 0, 9999, received); // replaces the pending one
+    // the task was re-added with another range since the progress was taken
+    db.updateProgress(deviceName, otherBaseName, 0, 50, SegmentRanges{{0, 50}});
+    db.flushProgress();
+  }
+
+  FetchTaskDb db(folder, "test");
+  std::map<Name, SegmentRanges> progress;
+  db.foreachTaskProgress([&progress] (const Name& deviceName, const Name& baseName,
+                                      uint64_t minSeqNo, uint64_t maxSeqNo, int priority,
+                                      const SegmentRanges& received) {
+                           progress[baseName] = received;
+                         });
+
+  BOOST_REQUIRE_EQUAL(progress.size(), 2);
+  BOOST_REQUIRE_EQUAL(progress[baseName].size(), received.size());
+  for (size_t i = 0; i < received.size(); i++) {
+    BOOST_CHECK_EQUAL(progress[baseName][i].first, received[i].first);
+    BOOST_CHECK_EQUAL(progress[baseName][i].second, received[i].second);
+  }
+  BOOST_CHECK(progress[otherBaseName].empty());
+}
+
+BOOST_AUTO_TEST_CASE(SeparateRanges)
+{
+  fs::path folder("TaskDbTest");
+  if (exists(folder)) {
+    fs::remove_all(folder);
+  }
+
+  fs::create_directories(folder / ".chronoshare");
+
+  Name deviceName("/device");
+  Name baseName("/device/base");
+
+  // missing chunks of one file are fetched as separate ranges
+  {
+    FetchTaskDb db(folder, "test");
+    db.addTask(deviceName, baseName, 0, 9, 1);
+    db.addTask(deviceName, baseName, 20, 29, 1);
+    db.addTask(deviceName, baseName, 40, 49, 1);
+
+    db.updateProgress(deviceName, baseName, 20, 29, SegmentRanges{{20, 24}});
+    db.updateProgress(deviceName, baseName, 40, 49, SegmentRanges{{42, 43}});
+    db.flushProgress();
+
+    db.deleteTask(deviceName, baseName, 0, 9);
+  }
+
+  FetchTaskDb db(folder, "test");
+  std::map<uint64_t, SegmentRanges> progress;
+  db.foreachTaskProgress([&progress] (const Name& deviceName, const Name& baseName,
+                                      uint64_t minSeqNo, uint64_t maxSeqNo, int priority,
+                                      const SegmentRanges& received) {
+                           progress[minSeqNo] = received;
+                         });
+
+  BOOST_REQUIRE_EQUAL(progress.size(), 2);
+  BOOST_REQUIRE_EQUAL(progress[20].size(), 1);
+  BOOST_CHECK_EQUAL(progress[20][0].first, 20);
+  BOOST_CHECK_EQUAL(progress[20][0].second, 24);
+  BOOST_REQUIRE_EQUAL(progress[40].size(), 1);
+  BOOST_CHECK_EQUAL(progress[40][0].first, 42);
+  BOOST_CHECK_EQUAL(progress[40][0].second, 43);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 } // chronoshare
@@ -0,0 +1,139 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+
+#include "file-assembler.hpp"
+
+#include <ndn-cxx/util/digest.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+
+namespace fs = boost::filesystem;
+
+namespace ndn {
+namespace chronoshare {
+
+BOOST_AUTO_TEST_SUITE(TestFileAssembler)
+
+static const size_t SEGMENT_SIZE = 1000;
+
+struct FileAssemblerFixture
+{
+  FileAssemblerFixture()
+    : folder(fs::path("FileAssemblerTest"))
+    , tempFile(folder / "incoming" / "file")
+    , content(10 * SEGMENT_SIZE + 123)
+  {
+    fs::remove_all(folder);
+
+    std::mt19937 random(1);
+    std::generate(content.begin(), content.end(), [&random] { return random() & 0xFF; });
+    hash = *util::Sha256::computeDigest(content.buf(), content.size());
+  }
+
+  ~FileAssemblerFixture()
+  {
+    fs::remove_all(folder);
+  }
+
+  void
+  addSegment(FileAssembler& assembler, uint64_t segment)
+  {
+    size_t offset = segment * SEGMENT_SIZE;
+    assembler.addSegment(segment, content.buf() + offset,
+                         std::min(SEGMENT_SIZE, content.size() - offset));
+  }
+
+  Buffer
+  readFile(const fs::path& file)
+  {
+    fs::ifstream input(file, std::ios::in | std::ios::binary);
+    return Buffer(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+  }
+
+  fs::path folder;
+  fs::path tempFile;
+  Buffer content;
+  Buffer hash;
+};
+
+BOOST_FIXTURE_TEST_CASE(OutOfOrder, FileAssemblerFixture)
+{
+  FileAssembler assembler(tempFile, hash, SEGMENT_SIZE, 11);
+  for (uint64_t segment : {10, 3, 1, 0, 2, 2, 5, 4, 9, 8, 7, 6}) {
+    addSegment(assembler, segment);
+  }
+
+  BOOST_REQUIRE(assembler.commit(folder / "dir" / "file"));
+  BOOST_CHECK(!fs::exists(tempFile));
+
+  Buffer file = readFile(folder / "dir" / "file");
+  BOOST_CHECK_EQUAL_COLLECTIONS(file.begin(), file.end(), content.begin(), content.end());
+}
+
+BOOST_FIXTURE_TEST_CASE(Resume, FileAssemblerFixture)
+{
+  {
+    FileAssembler assembler(tempFile, hash, SEGMENT_SIZE, 11);
+    for (uint64_t segment = 0; segment < 11; segment += 2) {
+      addSegment(assembler, segment);
+    }
+    assembler.sync();
+  }
+
+  // segments written before are not known to the new assembler
+  FileAssembler assembler(tempFile, hash, SEGMENT_SIZE, 11);
+  for (uint64_t segment = 1; segment < 11; segment += 2) {
+    addSegment(assembler, segment);
+  }
+
+  BOOST_REQUIRE(assembler.commit(folder / "file"));
+  Buffer file = readFile(folder / "file");
+  BOOST_CHECK_EQUAL_COLLECTIONS(file.begin(), file.end(), content.begin(), content.end());
+}
+
+BOOST_FIXTURE_TEST_CASE(DigestMismatch, FileAssemblerFixture)
+{
+  fs::create_directories(folder);
+  fs::ofstream(folder / "file") << "existing";
+
+  FileAssembler assembler(tempFile, hash, SEGMENT_SIZE, 11);
+  content[5] ^= 1;
+  for (uint64_t segment = 0; segment < 11; segment++) {
+    addSegment(assembler, segment);
+  }
+
+  BOOST_CHECK(!assembler.commit(folder / "file"));
+  BOOST_CHECK(!fs::exists(tempFile));
+
+  // the existing file is left in place
+  Buffer file = readFile(folder / "file");
+  BOOST_CHECK_EQUAL(std::string(file.begin(), file.end()), "existing");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // chronoshare
+} // ndn
@@ -20,6 +20,10 @@
 
 #include "logging.hpp"
 #include "object-manager.hpp"
+#include "object-db.hpp"
+
+#include <ndn-cxx/security/key-chain.hpp>
+#include <ndn-cxx/util/string-helper.hpp>
 
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -29,6 +33,7 @@
 #include <boost/make_shared.hpp>
 #include <iostream>
 #include <iterator>
+#include <random>
 #include <thread>
 
 INIT_LOGGER("Test.ObjectManager")
@@ -59,7 +64,8 @@ BOOST_AUTO_TEST_CASE(ObjectManagerTest)
 
   BOOST_CHECK_EQUAL(std::get<1>(hash_segments), 3);
 
-  bool ok = manager.objectsToLocalFile(deviceName, *std::get<0>(hash_segments), tmpdir / "test.cc");
+  bool ok = manager.objectsToLocalFile(deviceName, *std::get<0>(hash_segments), tmpdir / "test.cc",
+                                       std::get<1>(hash_segments));
   BOOST_CHECK_EQUAL(ok, true);
 
   {
@@ -79,6 +85,419 @@ BOOST_AUTO_TEST_CASE(ObjectManagerTest)
   }
 }
 
+BOOST_AUTO_TEST_CASE(LegacyObjectDbMigration)
+{
+  fs::path tmpdir = fs::unique_path(fs::temp_directory_path() / "%%%%-%%%%-%%%%-%%%%");
+  Name deviceName("/device");
+  std::string hashStr = "ABCDEF0123456789ABCDEF0123456789ABCDEF0123456789ABCDEF0123456789";
+  std::string contents[] = {"first segment ", "second segment"};
+
+  // per-hash database, as created by earlier versions
+  fs::path legacyDb = tmpdir / ".chronoshare" / "objects" / hashStr.substr(0, 2) / hashStr.substr(2);
+  fs::create_directories(legacyDb.parent_path());
+
+  sqlite3* db;
+  BOOST_REQUIRE_EQUAL(sqlite3_open(legacyDb.c_str(), &db), SQLITE_OK);
+  sqlite3_exec(db, "CREATE TABLE File(device_name BLOB NOT NULL, segment INTEGER, "
+                   "content_object BLOB, PRIMARY KEY(device_name, segment));", 0, 0, 0);
+  KeyChain keyChain;
+  Block lastPacket;
+  for (int segment = 0; segment < 2; segment++) {
+    Data data(Name(deviceName).append("test-chronoshare").append("file").appendNumber(segment));
+    data.setContent(reinterpret_cast<const uint8_t*>(contents[segment].c_str()),
+                    contents[segment].size());
+    keyChain.sign(data);
+    lastPacket = data.wireEncode();
+
+    sqlite3_stmt* stmt;
+    sqlite3_prepare_v2(db, "INSERT INTO File VALUES(?, ?, ?)", -1, &stmt, 0);
+    sqlite3_bind_blob(stmt, 1, deviceName.wireEncode().wire(), deviceName.wireEncode().size(),
+                      SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, segment);
+    sqlite3_bind_blob(stmt, 3, data.wireEncode().wire(), data.wireEncode().size(), SQLITE_STATIC);
+    BOOST_CHECK_EQUAL(sqlite3_step(stmt), SQLITE_DONE);
+    sqlite3_finalize(stmt);
+  }
+  sqlite3_close(db);
+
+  shared_ptr<Face> face = make_shared<Face>();
+  {
+    ObjectManager manager(*face, tmpdir, "test-chronoshare");
+    BOOST_CHECK(!exists(legacyDb));
+    BOOST_CHECK(ObjectDb::DoesExist(tmpdir / ".chronoshare", deviceName, hashStr));
+
+    bool ok = manager.objectsToLocalFile(deviceName, *fromHex(hashStr), tmpdir / "restored", 2);
+    BOOST_CHECK_EQUAL(ok, true);
+
+    // stored packets are served as they were signed
+    ObjectDb objectDb(tmpdir / ".chronoshare", hashStr);
+    shared_ptr<Data> stored = objectDb.fetchSegmentData(deviceName, 1);
+    BOOST_REQUIRE(stored != nullptr);
+    BOOST_CHECK_EQUAL_COLLECTIONS(stored->wireEncode().begin(), stored->wireEncode().end(),
+                                  lastPacket.begin(), lastPacket.end());
+  }
+
+  fs::ifstream restored(tmpdir / "restored");
+  std::string restoredContent((std::istreambuf_iterator<char>(restored)),
+                              std::istreambuf_iterator<char>());
+  BOOST_CHECK_EQUAL(restoredContent, contents[0] + contents[1]);
+
+  face->shutdown();
+  remove_all(tmpdir);
+}
+
+// timed with a larger file in tests/benchmarks/benchmark-object-manager.cpp
+BOOST_AUTO_TEST_CASE(SegmentSize)
+{
+  // not a multiple of any of the segment sizes, the last segment is shorter
+  const size_t FILE_SIZE = 256 * 1024 + 1000;
+
+  fs::path tmpdir = fs::unique_path(fs::temp_directory_path() / "%%%%-%%%%-%%%%-%%%%");
+  fs::create_directories(tmpdir);
+  Name deviceName("/device");
+
+  std::string content(FILE_SIZE, '\0');
+  for (size_t i = 0; i < content.size(); i++) {
+    content[i] = static_cast<char>(i * 7 + i / 1024);
+  }
+  {
+    fs::ofstream file(tmpdir / "file", std::ios::out | std::ios::binary);
+    file.write(content.data(), content.size());
+  }
+
+  shared_ptr<Face> face = make_shared<Face>();
+
+  BOOST_CHECK_THROW(ObjectManager(*face, tmpdir / "too-large", "test-chronoshare",
+                                  ObjectManager::MAX_SEGMENT_SIZE + 1),
+                    ObjectManager::Error);
+
+  for (size_t segmentSize : {ObjectManager::DEFAULT_SEGMENT_SIZE, size_t(4096),
+                             ObjectManager::MAX_SEGMENT_SIZE}) {
+    fs::path folder = tmpdir / std::to_string(segmentSize);
+    ObjectManager manager(*face, folder, "test-chronoshare", segmentSize);
+
+    auto hash_segments = manager.localFileToObjects(tmpdir / "file", deviceName);
+
+    BOOST_CHECK_EQUAL(std::get<1>(hash_segments), (FILE_SIZE + segmentSize - 1) / segmentSize);
+
+    bool ok = manager.objectsToLocalFile(deviceName, *std::get<0>(hash_segments),
+                                         folder / "restored", std::get<1>(hash_segments));
+    BOOST_CHECK_EQUAL(ok, true);
+
+    fs::ifstream restored(folder / "restored", std::ios::in | std::ios::binary);
+    std::string restoredContent((std::istreambuf_iterator<char>(restored)),
+                                std::istreambuf_iterator<char>());
+    BOOST_CHECK(restoredContent == content);
+  }
+
+  face->shutdown();
+  remove_all(tmpdir);
+}
+
+// timed with a larger file in tests/benchmarks/benchmark-object-manager.cpp
+BOOST_AUTO_TEST_CASE(SegmentReader)
+{
+  const size_t FILE_SIZE = 64 * 1024 + 100;
+
+  fs::path tmpdir = fs::unique_path(fs::temp_directory_path() / "%%%%-%%%%-%%%%-%%%%");
+  fs::create_directories(tmpdir);
+  Name deviceName("/device");
+
+  std::string content(FILE_SIZE, '\0');
+  for (size_t i = 0; i < content.size(); i++) {
+    content[i] = static_cast<char>(i * 7 + i / 1024);
+  }
+  {
+    fs::ofstream file(tmpdir / "file", std::ios::out | std::ios::binary);
+    file.write(content.data(), content.size());
+  }
+
+  shared_ptr<Face> face = make_shared<Face>();
+  ObjectManager manager(*face, tmpdir, "test-chronoshare");
+  auto hash_segments = manager.localFileToObjects(tmpdir / "file", deviceName);
+  const Buffer& hash = *std::get<0>(hash_segments);
+
+  // segment by segment lookups
+  std::string perSegment;
+  {
+    ObjectDb db(tmpdir / ".chronoshare", toHex(hash));
+    sqlite3_int64 segment = 0;
+    for (BufferPtr bytes = db.fetchSegment(deviceName, segment); bytes != nullptr;
+         bytes = db.fetchSegment(deviceName, ++segment)) {
+      perSegment.append(reinterpret_cast<const char*>(bytes->buf()), bytes->size());
+    }
+  }
+  BOOST_CHECK(perSegment == content);
+
+  // one query for all segments, content is located in the stored packet
+  std::string streamed;
+  {
+    ObjectStore::SegmentReader reader(*ObjectStore::open(tmpdir / ".chronoshare"), hash,
+                                      deviceName);
+    const uint8_t* bytes = nullptr;
+    size_t size = 0;
+    while (reader.next(bytes, size)) {
+      streamed.append(reinterpret_cast<const char*>(bytes), size);
+    }
+    BOOST_CHECK_EQUAL(reader.getNSegments(), std::get<1>(hash_segments));
+  }
+  BOOST_CHECK(streamed == content);
+
+  // reading can start in the middle of the object
+  {
+    ObjectStore::SegmentReader reader(*ObjectStore::open(tmpdir / ".chronoshare"), hash,
+                                      deviceName, 10);
+    const uint8_t* bytes = nullptr;
+    size_t size = 0;
+    BOOST_REQUIRE(reader.next(bytes, size));
+    BOOST_CHECK(std::string(reinterpret_cast<const char*>(bytes), size) ==
+                content.substr(10 * ObjectManager::DEFAULT_SEGMENT_SIZE, size));
+  }
+
+  face->shutdown();
+  remove_all(tmpdir);
+}
+
+// copy segments [first, last] of object @p hash from the store of one folder to another, as
+// fetching them would, and return the number of transferred bytes
+static size_t
+transferSegments(const fs::path& from, const fs::path& to, const Name& deviceName,
+                 const Buffer& hash, const std::string& layout, size_t first, size_t last)
+{
+  ObjectStorePtr store = ObjectStore::open(from / ".chronoshare");
+  ObjectDb db(to / ".chronoshare", toHex(hash), layout);
+
+  size_t nBytes = 0;
+  for (size_t segment = first; segment <= last; segment++) {
+    ObjectStore::Location location;
+    BOOST_REQUIRE(store->lookup(hash, deviceName, segment, location));
+    shared_ptr<Data> data = store->read(location);
+    db.saveContentObject(deviceName, segment, *data);
+    nBytes += data->wireEncode().size();
+  }
+  return nBytes;
+}
+
+// bytes transferred for a larger file in tests/benchmarks/benchmark-object-manager.cpp
+BOOST_AUTO_TEST_CASE(ContentDefinedChunking)
+{
+  // chunks are at most MAX_SEGMENT_SIZE, so an edit changes a small share of them
+  const size_t FILE_SIZE = 512 * 1024;
+
+  fs::path tmpdir = fs::unique_path(fs::temp_directory_path() / "%%%%-%%%%-%%%%-%%%%");
+  fs::create_directories(tmpdir);
+  Name deviceName("/device");
+
+  std::mt19937 random(1);
+  std::string original(FILE_SIZE, '\0');
+  for (char& byte : original) {
+    byte = static_cast<char>(random());
+  }
+  std::string inserted = original;
+  inserted.insert(FILE_SIZE / 2, "bytes inserted in the middle of the file");
+  std::string overwritten = original;
+  overwritten.replace(FILE_SIZE / 3, 4096, std::string(4096, 'x'));
+
+  shared_ptr<Face> face = make_shared<Face>();
+
+  for (ObjectManager::Chunking chunking : {ObjectManager::CHUNKING_FIXED_SIZE,
+                                           ObjectManager::CHUNKING_CONTENT_DEFINED}) {
+    fs::path publisherFolder = tmpdir / std::to_string(chunking) / "publisher";
+    fs::path receiverFolder = tmpdir / std::to_string(chunking) / "receiver";
+    ObjectManager publisher(*face, publisherFolder, "test-chronoshare",
+                            ObjectManager::MAX_SEGMENT_SIZE, chunking);
+    ObjectManager receiver(*face, receiverFolder, "test-chronoshare",
+                           ObjectManager::MAX_SEGMENT_SIZE, chunking);
+
+    // publish a version of the file and fetch it the way Dispatcher does
+    auto fetchVersion = [&] (const std::string& content) {
+      {
+        fs::ofstream file(publisherFolder / "file", std::ios::out | std::ios::binary);
+        file.write(content.data(), content.size());
+      }
+
+      ObjectManager::ChunkList chunkList{nullptr, 0};
+      auto hash_segments = publisher.localFileToObjects(publisherFolder / "file", deviceName,
+                                                        Buffer(), &chunkList);
+      const Buffer& hash = *std::get<0>(hash_segments);
+
+      size_t nBytes = 0;
+      if (chunkList.hash) {
+        nBytes += transferSegments(publisherFolder, receiverFolder, deviceName, *chunkList.hash,
+                                   ObjectStore::makeLayout(ObjectManager::MAX_SEGMENT_SIZE,
+                                                           false),
+                                   0, chunkList.nSegments - 1);
+        ConstBufferPtr list = receiver.fetchChunkList(deviceName, *chunkList.hash);
+        BOOST_REQUIRE(list != nullptr);
+
+        for (const auto& range : receiver.findMissingChunks(*list)) {
+          nBytes += transferSegments(publisherFolder, receiverFolder, deviceName, hash,
+                                     receiver.getLayout(), range.first, range.second);
+        }
+        receiver.addChunkList(deviceName, hash, receiver.getLayout(), *list);
+      }
+      else {
+        nBytes += transferSegments(publisherFolder, receiverFolder, deviceName, hash,
+                                   receiver.getLayout(), 0, std::get<1>(hash_segments) - 1);
+      }
+
+      BOOST_CHECK(receiver.objectsToLocalFile(deviceName, hash, receiverFolder / "file",
+                                              std::get<1>(hash_segments)));
+      fs::ifstream restored(receiverFolder / "file", std::ios::in | std::ios::binary);
+      std::string restoredContent((std::istreambuf_iterator<char>(restored)),
+                                  std::istreambuf_iterator<char>());
+      BOOST_CHECK(restoredContent == content);
+
+      return nBytes;
+    };
+
+    fetchVersion(original);
+    size_t insertedBytes = fetchVersion(inserted);
+    size_t overwrittenBytes = fetchVersion(overwritten);
+
+    if (chunking == ObjectManager::CHUNKING_CONTENT_DEFINED) {
+      BOOST_CHECK_LT(insertedBytes, FILE_SIZE / 10);
+      BOOST_CHECK_LT(overwrittenBytes, FILE_SIZE / 10);
+    }
+    else {
+      BOOST_CHECK_GT(insertedBytes, FILE_SIZE);
+      BOOST_CHECK_GT(overwrittenBytes, FILE_SIZE);
+    }
+  }
+
+  face->shutdown();
+  remove_all(tmpdir);
+}
+
+BOOST_AUTO_TEST_CASE(UnchangedFile)
+{
+  fs::path tmpdir = fs::unique_path(fs::temp_directory_path() / "%%%%-%%%%-%%%%-%%%%");
+  fs::create_directories(tmpdir);
+  Name deviceName("/device");
+
+  {
+    fs::ofstream file(tmpdir / "file", std::ios::out | std::ios::binary);
+    file << std::string(10000, 'a');
+  }
+
+  shared_ptr<Face> face = make_shared<Face>();
+  ObjectManager manager(*face, tmpdir, "test-chronoshare");
+
+  auto hash_segments = manager.localFileToObjects(tmpdir / "file", deviceName);
+  BOOST_CHECK_EQUAL(std::get<1>(hash_segments), 10);
+
+  // same content: hashed, but nothing is published
+  auto unchanged = manager.localFileToObjects(tmpdir / "file", deviceName,
+                                              *std::get<0>(hash_segments));
+  BOOST_CHECK(*std::get<0>(unchanged) == *std::get<0>(hash_segments));
+  BOOST_CHECK_EQUAL(std::get<1>(unchanged), 0);
+
+  {
+    fs::ofstream file(tmpdir / "file", std::ios::out | std::ios::binary | std::ios::app);
+    file << "b";
+  }
+  auto changed = manager.localFileToObjects(tmpdir / "file", deviceName,
+                                            *std::get<0>(hash_segments));
+  BOOST_CHECK(*std::get<0>(changed) != *std::get<0>(hash_segments));
+  BOOST_CHECK_EQUAL(std::get<1>(changed), 10);
+
+  face->shutdown();
+  remove_all(tmpdir);
+}
+
+BOOST_AUTO_TEST_CASE(DeviceIndependentObjects)
+{
+  fs::path tmpdir = fs::unique_path(fs::temp_directory_path() / "%%%%-%%%%-%%%%-%%%%");
+  fs::create_directories(tmpdir);
+  Name deviceA("/deviceA");
+  Name deviceB("/deviceB");
+  Name deviceC("/deviceC");
+  fs::path objectsFolder = tmpdir / ".chronoshare";
+
+  {
+    fs::ofstream file(tmpdir / "file", std::ios::out | std::ios::binary);
+    file << std::string(10000, 'a');
+  }
+
+  shared_ptr<Face> face = make_shared<Face>();
+  ObjectManager manager(*face, tmpdir, "test-chronoshare");
+
+  auto hash_segments = manager.localFileToObjects(tmpdir / "file", deviceA);
+  std::string hashStr = toHex(*std::get<0>(hash_segments));
+  uintmax_t storeSize = fs::file_size(objectsFolder / "objects" / "pack-0");
+
+  // the same content published by another device is not stored again
+  auto hash_segmentsB = manager.localFileToObjects(tmpdir / "file", deviceB);
+  BOOST_CHECK_EQUAL(std::get<1>(hash_segmentsB), std::get<1>(hash_segments));
+  BOOST_CHECK_EQUAL(fs::file_size(objectsFolder / "objects" / "pack-0"), storeSize);
+  BOOST_CHECK(ObjectDb::DoesExist(objectsFolder, deviceB, hashStr));
+
+  BOOST_CHECK(manager.objectsToLocalFile(deviceB, *std::get<0>(hash_segments),
+                                         tmpdir / "restored", std::get<1>(hash_segments)));
+  BOOST_CHECK_EQUAL(fs::file_size(tmpdir / "restored"), 10000);
+
+  // a file is not restored truncated if some of its segments are missing
+  BOOST_CHECK(!manager.objectsToLocalFile(deviceB, *std::get<0>(hash_segments),
+                                          tmpdir / "truncated", std::get<1>(hash_segments) + 1));
+  BOOST_CHECK(!fs::exists(tmpdir / "truncated"));
+
+  // a device announcing the file in another layout still needs to be fetched
+  BOOST_CHECK(!ObjectDb::DoesExist(objectsFolder, deviceC, hashStr));
+  BOOST_CHECK(!ObjectDb::AddAlias(objectsFolder, deviceC, hashStr,
+                                  ObjectStore::makeLayout(4096, false)));
+  BOOST_CHECK(!ObjectDb::DoesExist(objectsFolder, deviceC, hashStr));
+  BOOST_CHECK(ObjectDb::AddAlias(objectsFolder, deviceC, hashStr, manager.getLayout()));
+  BOOST_CHECK(ObjectDb::DoesExist(objectsFolder, deviceC, hashStr));
+
+  ObjectDb db(objectsFolder, hashStr);
+  BOOST_CHECK(db.fetchSegment(deviceC, 9) != nullptr);
+  BOOST_CHECK(db.fetchSegment(deviceC, 10) == nullptr);
+
+  face->shutdown();
+  remove_all(tmpdir);
+}
+
+BOOST_AUTO_TEST_CASE(CorruptedStoredObject)
+{
+  fs::path tmpdir = fs::unique_path(fs::temp_directory_path() / "%%%%-%%%%-%%%%-%%%%");
+  fs::create_directories(tmpdir);
+  Name deviceName("/device");
+  fs::path objectsFolder = tmpdir / ".chronoshare";
+
+  shared_ptr<Face> face = make_shared<Face>();
+  ObjectManager manager(*face, tmpdir, "test-chronoshare");
+
+  // segments of a fetched file are kept in the store, but their content is not the announced one
+  std::string content = "announced content";
+  std::string hashStr = toHex(*util::Sha256::computeDigest(
+                                reinterpret_cast<const uint8_t*>(content.c_str()),
+                                content.size()));
+  std::string tampered[] = {"tampered ", "content"};
+  KeyChain keyChain;
+  {
+    ObjectDb db(objectsFolder, hashStr, manager.getLayout());
+    for (int segment = 0; segment < 2; segment++) {
+      Data data(Name(deviceName).append("test-chronoshare").append("file").appendNumber(segment));
+      data.setContent(reinterpret_cast<const uint8_t*>(tampered[segment].c_str()),
+                      tampered[segment].size());
+      keyChain.sign(data);
+      db.saveContentObject(deviceName, segment, data);
+    }
+  }
+  BOOST_REQUIRE(ObjectDb::DoesExist(objectsFolder, deviceName, hashStr));
+
+  // the file is not restored, and the segments are neither served nor used again
+  BOOST_CHECK(!manager.objectsToLocalFile(deviceName, *fromHex(hashStr), tmpdir / "restored", 2));
+  BOOST_CHECK(!fs::exists(tmpdir / "restored"));
+  BOOST_CHECK(!ObjectDb::DoesExist(objectsFolder, deviceName, hashStr));
+
+  ObjectDb db(objectsFolder, hashStr);
+  BOOST_CHECK(db.fetchSegment(deviceName, 0) == nullptr);
+
+  face->shutdown();
+  remove_all(tmpdir);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 } // chronoshare
@@ -0,0 +1,137 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+
+#include "packet-cache.hpp"
+
+#include <ndn-cxx/security/key-chain.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+namespace ndn {
+namespace chronoshare {
+
+BOOST_AUTO_TEST_SUITE(TestPacketCache)
+
+struct PacketCacheFixture
+{
+  shared_ptr<Data>
+  makeData(const Name& name)
+  {
+    shared_ptr<Data> data = make_shared<Data>(name);
+    std::vector<uint8_t> content(1000, 0xAB);
+    data->setContent(content.data(), content.size());
+    keyChain.sign(*data);
+    return data;
+  }
+
+  KeyChain keyChain;
+};
+
+BOOST_FIXTURE_TEST_CASE(EvictLeastRecentlyUsed, PacketCacheFixture)
+{
+  shared_ptr<Data> first = makeData("/device/app/file/hash/%00");
+  size_t packetSize = first->wireEncode().size();
+
+  PacketCache cache(3 * packetSize);
+  cache.insert(first);
+  cache.insert(makeData("/device/app/file/hash/%01"));
+  cache.insert(makeData("/device/app/file/hash/%02"));
+
+  // touch the first packet, so that the second one is the least recently used
+  BOOST_CHECK(cache.find("/device/app/file/hash/%00") == first);
+  cache.insert(makeData("/device/app/file/hash/%03"));
+
+  BOOST_CHECK(cache.find("/device/app/file/hash/%00") != nullptr);
+  BOOST_CHECK(cache.find("/device/app/file/hash/%01") == nullptr);
+  BOOST_CHECK(cache.find("/device/app/file/hash/%02") != nullptr);
+  BOOST_CHECK(cache.find("/device/app/file/hash/%03") != nullptr);
+
+  PacketCache::Stats stats = cache.getStats();
+  BOOST_CHECK_EQUAL(stats.nPackets, 3);
+  BOOST_CHECK_EQUAL(stats.nBytes, 3 * packetSize);
+  BOOST_CHECK_EQUAL(stats.nEvictions, 1);
+  BOOST_CHECK_EQUAL(stats.nHits, 4);
+  BOOST_CHECK_EQUAL(stats.nMisses, 1);
+  BOOST_CHECK_CLOSE(stats.getHitRate(), 0.8, 0.001);
+}
+
+BOOST_FIXTURE_TEST_CASE(ForwardingHintVariants, PacketCacheFixture)
+{
+  PacketCache cache;
+  cache.insert(makeData("/device/app/file/hash/%00"));
+
+  BOOST_CHECK(cache.find("/hint/device/app/file/hash/%00") == nullptr);
+  cache.insert(makeData("/hint/device/app/file/hash/%00"));
+
+  BOOST_CHECK(cache.find("/device/app/file/hash/%00") != nullptr);
+  BOOST_CHECK(cache.find("/hint/device/app/file/hash/%00") != nullptr);
+  BOOST_CHECK_EQUAL(cache.getStats().nPackets, 2);
+}
+
+BOOST_FIXTURE_TEST_CASE(Pending, PacketCacheFixture)
+{
+  PacketCache cache;
+  Name name("/device/app/file/hash/%00");
+
+  BOOST_CHECK(cache.markPending(name));
+  BOOST_CHECK(!cache.markPending(name));
+
+  cache.insert(makeData(name));
+  BOOST_CHECK(!cache.markPending(name));
+
+  Name other("/device/app/file/hash/%01");
+  BOOST_CHECK(cache.markPending(other));
+  cache.cancelPending(other);
+  BOOST_CHECK(cache.markPending(other));
+}
+
+BOOST_FIXTURE_TEST_CASE(WaitForPending, PacketCacheFixture)
+{
+  PacketCache cache;
+  Name name("/device/app/file/hash/%00");
+  int nPut = 0;
+  auto onInserted = [&nPut] (const shared_ptr<const Data>&) { nPut++; };
+
+  // the first request prepares the packet, duplicates wait for it
+  BOOST_CHECK(cache.markPending(name, onInserted));
+  BOOST_CHECK(!cache.markPending(name, onInserted));
+  BOOST_CHECK(!cache.markPending(name, onInserted));
+  BOOST_CHECK_EQUAL(nPut, 0);
+
+  cache.insert(makeData(name));
+  BOOST_CHECK_EQUAL(nPut, 2);
+
+  BOOST_CHECK(!cache.markPending(name, onInserted));
+  BOOST_CHECK_EQUAL(nPut, 3);
+
+  // waiting requests are dropped if the packet cannot be prepared
+  Name other("/device/app/file/hash/%01");
+  BOOST_CHECK(cache.markPending(other));
+  BOOST_CHECK(!cache.markPending(other, onInserted));
+  cache.cancelPending(other);
+  BOOST_CHECK(cache.markPending(other));
+  cache.insert(makeData(other));
+  BOOST_CHECK_EQUAL(nPut, 3);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // chronoshare
+} // ndn
@@ -0,0 +1,152 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+
+#include "receive-window.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <random>
+
+namespace ndn {
+namespace chronoshare {
+
+BOOST_AUTO_TEST_SUITE(TestReceiveWindow)
+
+BOOST_AUTO_TEST_CASE(Reordering)
+{
+  ReceiveWindow window(10);
+  BOOST_CHECK_EQUAL(window.getFirstMissing(), 10);
+  BOOST_CHECK(window.isReceived(9));
+  BOOST_CHECK(!window.isReceived(10));
+
+  BOOST_CHECK(window.markReceived(12));
+  BOOST_CHECK(window.markReceived(11));
+  BOOST_CHECK(!window.markReceived(11));
+  BOOST_CHECK_EQUAL(window.getFirstMissing(), 10);
+  BOOST_CHECK_EQUAL(window.getNReceivedOutOfOrder(), 2);
+
+  BOOST_CHECK(window.markReceived(10));
+  BOOST_CHECK_EQUAL(window.getFirstMissing(), 13);
+  BOOST_CHECK_EQUAL(window.getNReceivedOutOfOrder(), 0);
+  BOOST_CHECK(!window.markReceived(10));
+
+  // slots are reused after the window advances
+  for (int64_t i = 13; i < 13 + 10 * static_cast<int64_t>(ReceiveWindow::INITIAL_CAPACITY); i++) {
+    BOOST_REQUIRE(!window.isReceived(i));
+    window.markReceived(i);
+  }
+  BOOST_CHECK_EQUAL(window.getFirstMissing(), 13 + 10 * ReceiveWindow::INITIAL_CAPACITY);
+}
+
+BOOST_AUTO_TEST_CASE(Pending)
+{
+  ReceiveWindow window(0);
+  ReceiveWindow::TimePoint now = std::chrono::steady_clock::now();
+
+  window.markPending(0, now);
+  window.markPending(1, now + std::chrono::seconds(1));
+  window.markRetransmitted(1);
+  BOOST_CHECK_EQUAL(window.getNPending(), 2);
+  BOOST_CHECK(window.isPending(1));
+
+  ReceiveWindow::TimePoint sendTime;
+  bool isRetransmitted = true;
+  BOOST_CHECK(window.clearPending(0, sendTime, isRetransmitted));
+  BOOST_CHECK(sendTime == now);
+  BOOST_CHECK(!isRetransmitted);
+  BOOST_CHECK(!window.clearPending(0, sendTime, isRetransmitted));
+
+  BOOST_CHECK(window.clearPending(1, sendTime, isRetransmitted));
+  BOOST_CHECK(sendTime == now + std::chrono::seconds(1));
+  BOOST_CHECK(isRetransmitted);
+  BOOST_CHECK_EQUAL(window.getNPending(), 0);
+
+  // receiving a segment stops tracking its Interest as well
+  window.markPending(2, now);
+  window.markReceived(2);
+  BOOST_CHECK(!window.isPending(2));
+  BOOST_CHECK_EQUAL(window.getNPending(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(Grow)
+{
+  ReceiveWindow window(0);
+  ReceiveWindow::TimePoint now = std::chrono::steady_clock::now();
+
+  // the first segment is stuck while far more than the initial capacity arrives after it
+  int64_t last = 5 * ReceiveWindow::INITIAL_CAPACITY;
+  window.markPending(0, now);
+  window.markPending(last, now + std::chrono::seconds(5));
+  for (int64_t i = 1; i < last; i += 2) {
+    window.markReceived(i);
+  }
+  BOOST_CHECK_EQUAL(window.getFirstMissing(), 0);
+  BOOST_CHECK(window.isPending(0));
+  BOOST_CHECK(window.isPending(last));
+  BOOST_CHECK(window.isReceived(last - 1));
+  BOOST_CHECK(!window.isReceived(last - 2));
+
+  ReceiveWindow::TimePoint sendTime;
+  bool isRetransmitted;
+  BOOST_CHECK(window.clearPending(last, sendTime, isRetransmitted));
+  BOOST_CHECK(sendTime == now + std::chrono::seconds(5));
+
+  for (int64_t i = 0; i < last; i += 2) {
+    window.markReceived(i);
+  }
+  BOOST_CHECK_EQUAL(window.getFirstMissing(), last);
+  BOOST_CHECK_EQUAL(window.getNReceivedOutOfOrder(), 0);
+}
+
+// timed against std::set in tests/benchmarks/benchmark-receive-window.cpp
+BOOST_AUTO_TEST_CASE(ReorderedStream)
+{
+  const int64_t N_SEGMENTS = 20000;
+  const int64_t REORDERING = 512;
+
+  // segments arrive shuffled within blocks, as with a large window and multiple paths
+  std::vector<int64_t> stream(N_SEGMENTS);
+  for (int64_t i = 0; i < N_SEGMENTS; i++) {
+    stream[i] = i;
+  }
+  std::mt19937 random(0);
+  for (int64_t i = 0; i < N_SEGMENTS; i += REORDERING) {
+    std::shuffle(stream.begin() + i, stream.begin() + std::min(i + REORDERING, N_SEGMENTS), random);
+  }
+
+  ReceiveWindow::TimePoint now = std::chrono::steady_clock::now();
+  ReceiveWindow window(0);
+  ReceiveWindow::TimePoint sendTime;
+  bool isRetransmitted;
+  for (int64_t seqNo : stream) {
+    window.markPending(seqNo, now);
+    BOOST_REQUIRE(window.clearPending(seqNo, sendTime, isRetransmitted));
+    window.markReceived(seqNo);
+    BOOST_REQUIRE_LT(window.getNReceivedOutOfOrder(), REORDERING);
+  }
+  BOOST_CHECK_EQUAL(window.getFirstMissing(), N_SEGMENTS);
+  BOOST_CHECK_EQUAL(window.getNReceivedOutOfOrder(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // chronoshare
+} // ndn
@@ -0,0 +1,118 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/**
+ * Copyright (c) 2013-2015 Regents of the University of California.
+ *
+ * This file is part of ChronoShare, a decentralized file sharing application over NDN.
+ *
+ * ChronoShare is free software: you can redistribute it and/or modify it under the terms
+ * of the GNU General Public License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * ChronoShare is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received copies of the GNU General Public License along with
+ * ChronoShare, e.g., in COPYING.md file.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * See AUTHORS.md for complete list of ChronoShare authors and contributors.
+ */
+
+#include "logging.hpp"
+#include "signing-service.hpp"
+
+#include <boost/asio/io_service.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+
+INIT_LOGGER("Test.SigningService")
+
+namespace ndn {
+namespace chronoshare {
+
+BOOST_AUTO_TEST_SUITE(TestSigningService)
+
+static std::vector<shared_ptr<Data>>
+makePackets(const Name& prefix, size_t nPackets)
+{
+  std::vector<shared_ptr<Data>> packets;
+  for (size_t i = 0; i < nPackets; i++) {
+    shared_ptr<Data> data = make_shared<Data>(Name(prefix).appendNumber(i));
+    data->setContent(reinterpret_cast<const uint8_t*>("segment"), 7);
+    packets.push_back(data);
+  }
+  return packets;
+}
+
+BOOST_AUTO_TEST_CASE(Priorities)
+{
+  INIT_LOGGERS();
+
+  boost::asio::io_service io;
+  boost::asio::io_service::work work(io); // completions are posted from the workers
+  SigningService service(1);
+
+  std::vector<Name> signedNames;
+  auto onSigned = [&signedNames] (const shared_ptr<Data>& data) {
+    signedNames.push_back(data->getName());
+  };
+
+  // the only worker is busy with the first bulk packet while the rest is queued
+  for (const auto& data : makePackets("/bulk", 100)) {
+    service.sign(data, SigningService::PRIORITY_BULK, io, onSigned);
+  }
+  service.sign(makePackets("/sync", 1)[0], SigningService::PRIORITY_SYNC, io, onSigned);
+
+  while (signedNames.size() < 101) {
+    io.run_one();
+  }
+
+  size_t syncPosition = std::find(signedNames.begin(), signedNames.end(),
+                                  Name("/sync").appendNumber(0)) - signedNames.begin();
+  BOOST_CHECK_LT(syncPosition, 10);
+
+  // bulk packets are signed in the order of submission
+  for (size_t i = 1; i < signedNames.size(); i++) {
+    if (signedNames[i - 1].getPrefix(1) == signedNames[i].getPrefix(1)) {
+      BOOST_CHECK_LT(signedNames[i - 1], signedNames[i]);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(BoundedQueue)
+{
+  boost::asio::io_service io;
+  boost::asio::io_service::work work(io);
+  SigningService service(2, 8);
+
+  size_t nSigned = 0;
+  for (const auto& data : makePackets("/bulk", 100)) {
+    service.sign(data, SigningService::PRIORITY_BULK, io,
+                 [&nSigned] (const shared_ptr<Data>& data) {
+                   BOOST_CHECK_NO_THROW(data->wireEncode()); // throws if not signed
+                   nSigned++;
+                 });
+  }
+
+  // blocking requests do not wait for space
+  std::vector<shared_ptr<Data>> packets = makePackets("/sync", 10);
+  service.sign(packets, SigningService::PRIORITY_SYNC);
+  for (const auto& data : packets) {
+    BOOST_CHECK_NO_THROW(data->wireEncode()); // throws if not signed
+  }
+
+  while (nSigned < 100) {
+    io.run_one();
+  }
+
+  SigningService::Stats stats = service.getStats();
+  BOOST_CHECK_EQUAL(stats.nSigned, 110);
+  BOOST_CHECK_EQUAL(stats.queueDepth, 0);
+  BOOST_CHECK_LE(stats.maxQueueDepth, 8 + 10);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // chronoshare
+} // ndn
@@ -127,6 +127,168 @@ BOOST_AUTO_TEST_CASE(BasicDatabaseTest)
   BOOST_CHECK_EQUAL(msg->state(1).seq(), 1);
 }
 
+BOOST_AUTO_TEST_CASE(DeltaHistory)
+{
+  fs::path tmpdir = fs::unique_path("./Loli_Test");
+  if (exists(tmpdir)) {
+    remove_all(tmpdir);
+  }
+
+  const size_t CHECKPOINT_INTERVAL = 4;
+  const size_t MAX_STATES = 10;
+
+  std::vector<ndn::ConstBufferPtr> hashes;
+  {
+    SyncLog db(tmpdir, Name("/lijing"), CHECKPOINT_INTERVAL, MAX_STATES);
+    hashes.push_back(db.RememberStateInStateLog());
+
+    for (int i = 1; i <= 30; i++) {
+      db.UpdateDeviceSeqNo(Name("/lijing"), i);
+      if (i % 3 == 0) {
+        db.UpdateDeviceSeqNo(Name("/shuai"), i / 3);
+      }
+      hashes.push_back(db.RememberStateInStateLog());
+
+      BOOST_CHECK_LE(db.LogSize(), MAX_STATES + 2 * CHECKPOINT_INTERVAL);
+    }
+
+    // state 27 is within the retention window and is not a checkpoint
+    SyncStateMsgPtr msg = db.FindStateDifferences(*hashes[27], *hashes[30], true);
+    BOOST_REQUIRE_EQUAL(msg->state_size(), 2);
+    BOOST_CHECK_EQUAL(msg->state(0).old_seq(), 27);
+    BOOST_CHECK_EQUAL(msg->state(0).seq(), 30);
+    BOOST_CHECK_EQUAL(msg->state(1).old_seq(), 9);
+    BOOST_CHECK_EQUAL(msg->state(1).seq(), 10);
+
+    msg = db.FindStateDifferences(*hashes[29], *hashes[28]);
+    BOOST_REQUIRE_EQUAL(msg->state_size(), 1);
+    BOOST_CHECK_EQUAL(msg->state(0).seq(), 28);
+
+    // full state is reconstructed for peers in RECOVER
+    msg = db.FindStateDifferences(Buffer(1), *hashes[30]);
+    BOOST_REQUIRE_EQUAL(msg->state_size(), 2);
+    BOOST_CHECK_EQUAL(msg->state(0).seq(), 30);
+    BOOST_CHECK_EQUAL(msg->state(1).seq(), 10);
+
+    // states older than the window are forgotten
+    BOOST_CHECK_EQUAL(db.LookupSyncLog(*hashes[1]), 0);
+    BOOST_CHECK_GT(db.LookupSyncLog(*hashes[30]), 0);
+  }
+
+  // history stays consistent after restart
+  {
+    SyncLog db(tmpdir, Name("/lijing"), CHECKPOINT_INTERVAL, MAX_STATES);
+    BOOST_CHECK_EQUAL(digestToString(*db.RememberStateInStateLog()), digestToString(*hashes[30]));
+
+    db.UpdateDeviceSeqNo(Name("/shuai"), 11);
+    ndn::ConstBufferPtr hash = db.RememberStateInStateLog();
+
+    SyncStateMsgPtr msg = db.FindStateDifferences(*hashes[29], *hash);
+    BOOST_REQUIRE_EQUAL(msg->state_size(), 2);
+    BOOST_CHECK_EQUAL(msg->state(0).seq(), 30);
+    BOOST_CHECK_EQUAL(msg->state(1).seq(), 11);
+  }
+
+  remove_all(tmpdir);
+}
+
+BOOST_AUTO_TEST_CASE(StateCache)
+{
+  fs::path tmpdir = fs::unique_path("./Loli_Test");
+  if (exists(tmpdir)) {
+    remove_all(tmpdir);
+  }
+
+  const size_t STATE_CACHE_SIZE = 4;
+
+  std::vector<ndn::ConstBufferPtr> hashes;
+  {
+    SyncLog db(tmpdir, Name("/lijing"), 64, 4096, STATE_CACHE_SIZE);
+    hashes.push_back(db.RememberStateInStateLog());
+
+    for (int i = 1; i <= 10; i++) {
+      db.UpdateDeviceSeqNo(Name("/lijing"), i);
+      db.UpdateDeviceSeqNo(Name("/shuai"), i * 2);
+      hashes.push_back(db.RememberStateInStateLog());
+    }
+
+    // recent states are answered from memory
+    SyncStateMsgPtr msg = db.FindStateDifferences(*hashes[8], *hashes[10], true);
+    BOOST_REQUIRE_EQUAL(msg->state_size(), 2);
+    BOOST_CHECK_EQUAL(msg->state(0).old_seq(), 8);
+    BOOST_CHECK_EQUAL(msg->state(0).seq(), 10);
+    BOOST_CHECK_EQUAL(msg->state(1).old_seq(), 16);
+    BOOST_CHECK_EQUAL(msg->state(1).seq(), 20);
+    BOOST_CHECK_EQUAL(db.GetStateCacheHits(), 2);
+    BOOST_CHECK_EQUAL(db.GetStateCacheMisses(), 0);
+
+    // older states are reconstructed from the log and then cached
+    msg = db.FindStateDifferences(*hashes[2], *hashes[10]);
+    BOOST_REQUIRE_EQUAL(msg->state_size(), 2);
+    BOOST_CHECK_EQUAL(msg->state(0).seq(), 10);
+    BOOST_CHECK_EQUAL(msg->state(1).seq(), 20);
+    BOOST_CHECK_EQUAL(db.GetStateCacheHits(), 3);
+    BOOST_CHECK_EQUAL(db.GetStateCacheMisses(), 1);
+
+    BOOST_CHECK_GT(db.LookupSyncLog(*hashes[2]), 0);
+    BOOST_CHECK_EQUAL(db.GetStateCacheHits(), 4);
+  }
+
+  // after restart the cache is cold
+  {
+    SyncLog db(tmpdir, Name("/lijing"), 64, 4096, STATE_CACHE_SIZE);
+    SyncStateMsgPtr msg = db.FindStateDifferences(*hashes[9], *hashes[10]);
+    BOOST_REQUIRE_EQUAL(msg->state_size(), 2);
+    BOOST_CHECK_EQUAL(msg->state(0).seq(), 10);
+    BOOST_CHECK_EQUAL(msg->state(1).seq(), 20);
+    BOOST_CHECK_EQUAL(db.GetStateCacheHits(), 0);
+    BOOST_CHECK_EQUAL(db.GetStateCacheMisses(), 2);
+  }
+
+  remove_all(tmpdir);
+}
+
+BOOST_AUTO_TEST_CASE(LocalSeqNoResume)
+{
+  fs::path tmpdir = fs::unique_path("./Loli_Test");
+  if (exists(tmpdir)) {
+    remove_all(tmpdir);
+  }
+
+  {
+    SyncLog db(tmpdir, Name("/lijing"));
+    for (int i = 1; i <= 5; i++) {
+      BOOST_CHECK_EQUAL(db.GetNextLocalSeqNo(), i);
+    }
+    BOOST_CHECK_EQUAL(db.SeqNo(Name("/lijing")), 5);
+  }
+
+  // clean shutdown saves the handed out seq_no
+  {
+    SyncLog db(tmpdir, Name("/lijing"));
+    BOOST_CHECK_EQUAL(db.SeqNo(Name("/lijing")), 5);
+    BOOST_CHECK_EQUAL(db.GetNextLocalSeqNo(), 6);
+  }
+
+  // state left after an unclean shutdown: SyncNodes lags behind the handed out seq_no
+  {
+    sqlite3* raw = nullptr;
+    BOOST_REQUIRE_EQUAL(sqlite3_open((tmpdir / ".chronoshare" / "sync-log.db").c_str(), &raw),
+                        SQLITE_OK);
+    sqlite3_exec(raw, "UPDATE SyncNodes SET seq_no=3", NULL, NULL, NULL);
+    sqlite3_close(raw);
+  }
+
+  // the counter continues after the last seq_no that was used, without a gap
+  {
+    SyncLog db(tmpdir, Name("/lijing"));
+    db.UpdateLocalSeqNo(6);
+    BOOST_CHECK_EQUAL(db.GetNextLocalSeqNo(), 7);
+  }
+
+  remove_all(tmpdir);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 } // chronoshare